@@ -1,6 +1,6 @@
 import os
 import argparse
-from internals import process_file, print_bytecode, write_bytecode
+from internals import process_file, print_bytecode, write_bytecode, flat_bytes, image_bytes
 
 parser = argparse.ArgumentParser(
     description="Assemble the specified file into bytecide"
@@ -8,6 +8,10 @@ parser = argparse.ArgumentParser(
 parser.add_argument("input_file", type=str, help="file to assemble")
 parser.add_argument("-o", "--out", type=str, help="output file")
 parser.add_argument("-a", "--data-align", type=int, default=1, help="data alignment (default 4)")
+parser.add_argument("-s", "--stack-size", type=int, default=0, help="stack size the program needs (default: up to the VM)")
+parser.add_argument(
+    "-r", "--raw", action="store_true", help="write plain program bytes instead of an image"
+)
 parser.add_argument(
     "-p", "--print", action="store_true", help="print bytecode to stdout"
 )
@@ -19,7 +23,13 @@ if args.out:
 else:
     output_path = os.path.splitext(args.input_file)[0] + ".bin"
 
-bytecode = process_file(args.input_file, args.data_align)
+program = process_file(args.input_file, args.data_align)
+if args.raw:
+    if program.entry:
+        raise ValueError("Plain program bytes always start at address 0")
+    bytecode = flat_bytes(program)
+else:
+    bytecode = image_bytes(program, args.stack_size)
 write_bytecode(bytecode, output_path)
 
 if args.print:
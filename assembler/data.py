@@ -126,3 +126,6 @@ class Opcodes(AutoNumber):
     READF = ()   # read a float from stdin to the specified register
     READC = ()   # read a single character's code from stdin to the specified register
     READS = ()   # read a line to the specified memory address, to a maximum length
+    # far jumps:
+    LJMP = ()  # jump to a 32-bit address = () e.g.: ljmp 0x0A 0x00 0x01 0x00
+    LCALL = () # set register RA to the next instruction and jump to a 32-bit address = () e.g.: lcall 0x10 0x00 0x01 0x00
@@ -1,15 +1,48 @@
+import os
 import re
+import struct
+import zlib
 from data import REGISTERS, Opcodes
 
-re_data = re.compile(r"^\$(?P<name>[\w]+)\s+(?P<type>byte|word|dword)(?P<arr>\[\d*\])?\s+(?P<val>.*)$")
+re_data = re.compile(r"^\$(?P<name>[\w]+)\s+(?P<type>byte|word|dword)(?P<arr>\[\d*\])?(?:\s+(?P<val>.*))?$")
 type_sizes = {"byte": 1, "word": 2, "dword": 4}
 
-# includes actual labels AND data
+# image files: magic, version, header size, entry point, stack size, the sizes
+# of the code, read-only data and zeroed data sections, and a CRC-32 of the file
+IMAGE_MAGIC = b"RISV"
+IMAGE_VERSION = 1
+IMAGE_HEADER = struct.Struct("<4sHHIIIIII")
+# the page size images are aligned to for mapping them from the file
+IMAGE_PAGE_SIZE = 4096
+SECTIONS = ("code", "rodata", "bss")
+
+# includes actual labels AND data, as (section, offset in the section)
 labels = {}
 label_instances = {}
 
+
+class Program:
+    def __init__(self):
+        self.code = bytearray()
+        self.rodata = bytearray()
+        self.bss_size = 0
+        self.entry = None
+
+    # where each section starts in memory, the data ones aligned to 4 bytes
+    def bases(self):
+        rodata = len(self.code)
+        if self.rodata or self.bss_size:
+            rodata = (rodata + 3) // 4 * 4
+        bss = rodata + len(self.rodata)
+        if self.bss_size:
+            bss = (bss + 3) // 4 * 4
+        return {"code": 0, "rodata": rodata, "bss": bss}
+
+
 def process_file(path, align_data=4):
-    bytecode = bytearray()
+    program = Program()
+    section = "code"
+    entry = None
     f = open(path, "r", encoding="utf-8")
 
     line = f.readline()
@@ -22,38 +55,74 @@ def process_file(path, align_data=4):
         if len(line) == 0 or line.startswith(";"):  # comment or empty
             pass
         elif line.startswith("$"):  # data
-            handle_data(bytecode, line, align_data)
+            handle_data(program, section, line, align_data)
         elif line.startswith(".") and line.endswith(":") and len(line) > 2:  # labels
             label = line[1:-1]
             if label in labels:
                 raise ValueError("Label {} is already defined".format(label))
-            labels[label] = len(bytecode)
-        else:  # regular opcode
+            labels[label] = (section, section_size(program, section))
+        else:
             line = line.partition(";")[0].rstrip() # ignore comments
-            process_instruction(bytecode, line)
+            directive, _, arg = line.partition(" ")
+            if directive == "section":
+                section = arg.strip()
+                if section not in SECTIONS:
+                    raise ValueError("Unknown section '{}'".format(section))
+            elif directive == "entry":
+                entry = arg.strip()
+                if not entry.startswith("."):
+                    raise ValueError("The entry point must be a label")
+            elif section != "code":
+                raise ValueError("Instructions must be in the code section")
+            else:  # regular opcode
+                process_instruction(program.code, line)
 
         line = f.readline()
 
     f.close()
-    replace_label_instances(bytecode)
+    replace_label_instances(program)
+    if entry is not None:
+        program.entry = label_address(program, entry[1:])
 
-    return bytecode
+    return program
 
 
-def handle_data(bytecode, line, align):
+def section_size(program, section):
+    if section == "code":
+        return len(program.code)
+    elif section == "rodata":
+        return len(program.rodata)
+    return program.bss_size
+
+
+def handle_data(program, section, line, align):
     match = re_data.match(line)
     if not match:
         raise ValueError("Invalid data specification")
 
-    # first, align our bytecode
-    while len(bytecode) % align != 0:
-        bytecode.append(Opcodes.HALT)
-
     name, dtype, array, val = match.groups()
 
     if name in labels:
         raise ValueError("{} is already defined as a label".format(name))
-    labels[name] = len(bytecode)
+
+    # zeroed data only takes up space, e.g.: $buffer byte[64]
+    if section == "bss":
+        if val is not None:
+            raise ValueError("Data in the bss section can't have a value")
+        program.bss_size = (program.bss_size + align - 1) // align * align
+        labels[name] = (section, program.bss_size)
+        count = int(array[1:-1]) if array and array != "[]" else 1
+        program.bss_size += count * type_sizes[dtype]
+        return
+    if val is None:
+        raise ValueError("Data outside the bss section needs a value")
+
+    bytecode = program.code if section == "code" else program.rodata
+    # first, align our bytecode
+    while len(bytecode) % align != 0:
+        bytecode.append(Opcodes.HALT if section == "code" else 0)
+
+    labels[name] = (section, len(bytecode))
 
     if not array or array == "[1]":
         if val.startswith('"'):
@@ -84,22 +153,64 @@ def handle_data(bytecode, line, align):
             bytecode.append(0)
 
 
+# everything as laid out in memory, for programs loaded as plain bytes
+def flat_bytes(program):
+    bases = program.bases()
+    out = bytearray(program.code)
+    out.extend([Opcodes.HALT] * (bases["rodata"] - len(out)))
+    out.extend(program.rodata)
+    out.extend(bytes(bases["bss"] - len(out) + program.bss_size))
+    return out
+
+
+def image_bytes(program, stack_size=0, page_size=IMAGE_PAGE_SIZE):
+    bases = program.bases()
+    code = bytearray(program.code)
+    code.extend([Opcodes.HALT] * (bases["rodata"] - len(code)))
+    rodata = bytearray(program.rodata)
+    rodata.extend(bytes(bases["bss"] - bases["rodata"] - len(rodata)))
+    entry = program.entry or 0
+    # images of a page or more start a page into the file, so the VM can map
+    # them instead of copying them
+    header_size = IMAGE_HEADER.size
+    if len(code) + len(rodata) >= page_size > header_size:
+        header_size = page_size
+    padding = bytes(header_size - IMAGE_HEADER.size)
+
+    def header(checksum):
+        return IMAGE_HEADER.pack(IMAGE_MAGIC, IMAGE_VERSION, header_size, entry, stack_size,
+                                 len(code), len(rodata), program.bss_size, checksum) + padding
+
+    checksum = zlib.crc32(header(0) + code + rodata)
+    return header(checksum) + code + rodata
+
+
 def print_bytecode(bytecode):
     print(", ".join("0x{:02X}".format(b) for b in bytecode))
 
 
+# written next to path and renamed over it, so programs mapped from the old
+# file keep running what they loaded
 def write_bytecode(bytecode, path):
-    f = open(path, "wb")
-    f.write(bytecode)
-    f.close()
-
-
-def str_to_int(s, bytecode, bytes_ahead=0, accept_labels=True):
+    temp = os.path.join(os.path.dirname(os.path.abspath(path)), ".{}.{}.tmp".format(os.path.basename(path), os.getpid()))
+    try:
+        with open(temp, "wb") as f:
+            f.write(bytecode)
+        os.replace(temp, path)
+    except BaseException:
+        if os.path.exists(temp):
+            os.remove(temp)
+        raise
+
+
+# near jumps only hold the low 16 bits of a target in the same 64 KiB page
+def str_to_int(s, bytecode, bytes_ahead=0, accept_labels=True, nbytes=2, near=False):
     if len(s) == 3 and s.startswith("'") and s.endswith("'"):
         return ord(s[1])
     elif accept_labels and (s.startswith(".") or s.startswith("$")):
         label = s[1:]
-        location = len(bytecode) + bytes_ahead
+        page = len(bytecode) >> 16 if near else None
+        location = (len(bytecode) + bytes_ahead, nbytes, page)
         if label in label_instances:
             label_instances[label].append(location)
         else:
@@ -125,15 +236,28 @@ def register_from_name(s):
     return REGISTERS[s]
 
 
-def replace_label_instances(bytecode):
-    for l, instances in label_instances.items():
-        if l not in labels:
-            raise ValueError("Invalid label {}".format(l))
+def label_address(program, label):
+    if label not in labels:
+        raise ValueError("Invalid label {}".format(label))
+    section, offset = labels[label]
+    return program.bases()[section] + offset
+
 
-        label_val = int_to_bytes(labels[l], 2)
-        for instance in instances:
-            bytecode[instance] = label_val[0]
-            bytecode[instance + 1] = label_val[1]
+# only instructions refer to labels, so they're all in the code section
+def replace_label_instances(program):
+    bytecode = program.code
+    for l, instances in label_instances.items():
+        for location, nbytes, page in instances:
+            value = label_address(program, l)
+            if page is not None:
+                if value >> 16 != page:
+                    raise ValueError(
+                        "Label {} is in another 64 KiB page, use ljmp/lcall to reach it".format(l)
+                    )
+                value &= 0xFFFF
+            if value >= 1 << (8 * nbytes):
+                raise ValueError("Label {} doesn't fit in {} bytes".format(l, nbytes))
+            bytecode[location:location + nbytes] = int_to_bytes(value, nbytes)
 
 
 def singleop(bytecode, params, opcode):
@@ -154,12 +278,12 @@ def unop(bytecode, params, opcode):
     bytecode.append(reg)
 
 
-def unop_c(bytecode, params, opcode, nbytes):
+def unop_c(bytecode, params, opcode, nbytes, near=False):
     if len(params) != 1:
         raise ValueError(
             "Operation '{}' expects 1 argument, got {}".format(opcode, len(params))
         )
-    val = str_to_int(params[0], bytecode, 1)
+    val = str_to_int(params[0], bytecode, 1, nbytes=nbytes, near=near)
     bytecode.append(opcode)
     bytecode.extend(int_to_bytes(val, nbytes))
 
@@ -176,13 +300,13 @@ def binop(bytecode, params, opcode):
     bytecode.append(reg2)
 
 
-def binop_rc(bytecode, params, opcode, nbytes):
+def binop_rc(bytecode, params, opcode, nbytes, near=False):
     if len(params) != 2:
         raise ValueError(
             "Operation '{}' expects 2 arguments, got {}".format(opcode, len(params))
         )
     reg = register_from_name(params[0])
-    val = str_to_int(params[1], bytecode, 2)
+    val = str_to_int(params[1], bytecode, 2, nbytes=nbytes, near=near)
     bytecode.append(opcode)
     bytecode.append(reg)
     bytecode.extend(int_to_bytes(val, nbytes))
@@ -193,7 +317,7 @@ def binop_cr(bytecode, params, opcode, nbytes):
         raise ValueError(
             "Operation '{}' expects 2 arguments, got {}".format(opcode, len(params))
         )
-    val = str_to_int(params[0], bytecode, 1)
+    val = str_to_int(params[0], bytecode, 1, nbytes=nbytes)
     reg = register_from_name(params[1])
     bytecode.append(opcode)
     bytecode.extend(int_to_bytes(val, nbytes))
@@ -205,8 +329,8 @@ def binop_cc(bytecode, params, opcode, nbytes1, nbytes2):
         raise ValueError(
             "Operation '{}' expects 2 arguments, got {}".format(opcode, len(params))
         )
-    val1 = str_to_int(params[0], bytecode, 1)
-    val2 = str_to_int(params[1], bytecode, 1 + nbytes1)
+    val1 = str_to_int(params[0], bytecode, 1, nbytes=nbytes1)
+    val2 = str_to_int(params[1], bytecode, 1 + nbytes1, nbytes=nbytes2)
     bytecode.append(opcode)
     bytecode.extend(int_to_bytes(val1, nbytes1))
     bytecode.extend(int_to_bytes(val2, nbytes2))
@@ -231,23 +355,23 @@ def ternop_ccc(bytecode, params, opcode, nbytes1, nbytes2, nbytes3):
         raise ValueError(
             "Operation '{}' expects 3 arguments, got {}".format(opcode, len(params))
         )
-    val1 = str_to_int(params[0], bytecode, 1)
-    val2 = str_to_int(params[1], bytecode, 1 + nbytes1)
-    val3 = str_to_int(params[2], bytecode, 1 + nbytes1 + nbytes2)
+    val1 = str_to_int(params[0], bytecode, 1, nbytes=nbytes1)
+    val2 = str_to_int(params[1], bytecode, 1 + nbytes1, nbytes=nbytes2)
+    val3 = str_to_int(params[2], bytecode, 1 + nbytes1 + nbytes2, nbytes=nbytes3)
     bytecode.append(opcode)
     bytecode.extend(int_to_bytes(val1, nbytes1))
     bytecode.extend(int_to_bytes(val2, nbytes2))
     bytecode.extend(int_to_bytes(val3, nbytes3))
 
 
-def ternop_rrc(bytecode, params, opcode, nbytes):
+def ternop_rrc(bytecode, params, opcode, nbytes, near=False):
     if len(params) != 3:
         raise ValueError(
             "Operation '{}' expects 3 arguments, got {}".format(opcode, len(params))
         )
     reg1 = register_from_name(params[0])
     reg2 = register_from_name(params[1])
-    val = str_to_int(params[2], bytecode, 3)
+    val = str_to_int(params[2], bytecode, 3, nbytes=nbytes, near=near)
     bytecode.append(opcode)
     bytecode.append(reg1)
     bytecode.append(reg2)
@@ -282,7 +406,7 @@ def process_instruction(bytecode, line):
     elif opcode == "dup":
         singleop(bytecode, params, Opcodes.DUP)
     elif opcode == "call":
-        unop_c(bytecode, params, Opcodes.CALL, 2)
+        unop_c(bytecode, params, Opcodes.CALL, 2, near=True)
     elif opcode == "ret":
         singleop(bytecode, params, Opcodes.RET)
     elif opcode == "stor":
@@ -368,33 +492,33 @@ def process_instruction(bytecode, line):
     elif opcode == "f2i":
         binop(bytecode, params, Opcodes.F2I)
     elif opcode == "jmp":
-        unop_c(bytecode, params, Opcodes.JMP, 2)
+        unop_c(bytecode, params, Opcodes.JMP, 2, near=True)
     elif opcode == "jr":
         unop(bytecode, params, Opcodes.JR)
     elif opcode == "jz":
-        binop_rc(bytecode, params, Opcodes.JZ, 2)
+        binop_rc(bytecode, params, Opcodes.JZ, 2, near=True)
     elif opcode == "jnz":
-        binop_rc(bytecode, params, Opcodes.JNZ, 2)
+        binop_rc(bytecode, params, Opcodes.JNZ, 2, near=True)
     elif opcode == "je":
-        ternop_rrc(bytecode, params, Opcodes.JE, 2)
+        ternop_rrc(bytecode, params, Opcodes.JE, 2, near=True)
     elif opcode == "jne":
-        ternop_rrc(bytecode, params, Opcodes.JNE, 2)
+        ternop_rrc(bytecode, params, Opcodes.JNE, 2, near=True)
     elif opcode == "ja":
-        ternop_rrc(bytecode, params, Opcodes.JA, 2)
+        ternop_rrc(bytecode, params, Opcodes.JA, 2, near=True)
     elif opcode == "jg":
-        ternop_rrc(bytecode, params, Opcodes.JG, 2)
+        ternop_rrc(bytecode, params, Opcodes.JG, 2, near=True)
     elif opcode == "jae":
-        ternop_rrc(bytecode, params, Opcodes.JAE, 2)
+        ternop_rrc(bytecode, params, Opcodes.JAE, 2, near=True)
     elif opcode == "jge":
-        ternop_rrc(bytecode, params, Opcodes.JGE, 2)
+        ternop_rrc(bytecode, params, Opcodes.JGE, 2, near=True)
     elif opcode == "jb":
-        ternop_rrc(bytecode, params, Opcodes.JB, 2)
+        ternop_rrc(bytecode, params, Opcodes.JB, 2, near=True)
     elif opcode == "jl":
-        ternop_rrc(bytecode, params, Opcodes.JL, 2)
+        ternop_rrc(bytecode, params, Opcodes.JL, 2, near=True)
     elif opcode == "jbe":
-        ternop_rrc(bytecode, params, Opcodes.JBE, 2)
+        ternop_rrc(bytecode, params, Opcodes.JBE, 2, near=True)
     elif opcode == "jle":
-        ternop_rrc(bytecode, params, Opcodes.JLE, 2)
+        ternop_rrc(bytecode, params, Opcodes.JLE, 2, near=True)
     elif opcode == "print":
         binop_rc(bytecode, params, Opcodes.PRINT, 1)
     elif opcode == "printi":
@@ -417,6 +541,10 @@ def process_instruction(bytecode, line):
         unop(bytecode, params, Opcodes.READC)
     elif opcode == "reads":
         binop_cc(bytecode, params, Opcodes.READS, 2, 2)
+    elif opcode == "ljmp":
+        unop_c(bytecode, params, Opcodes.LJMP, 4)
+    elif opcode == "lcall":
+        unop_c(bytecode, params, Opcodes.LCALL, 4)
     elif opcode == "halt":
         singleop(bytecode, params, Opcodes.HALT)
     elif opcode == "int":
@@ -7,13 +7,11 @@
     lconsb      r4, 0
 
 .loopStart:
-    mov         r3, r0
-    mod         r3, r2
+    mod         r3, r0, r2
 
     jnz         r3, .loopEnd
     
-    printi      r0
-    println
+    printi      r0, 1
 
 .loopEnd:
     inc         r0
@@ -0,0 +1,20 @@
+; print 10 million unsigned, signed and float values each
+; runtime: 0,812s (9,201s with printf formatting)
+    lconsb      r0, 0
+    lcons       r1, 10000000
+; the signed values count down from 1000, the floats are them in thousandths
+    lcons       r5, 1000
+    i2f         r2, r5
+
+.loop:
+    print       r0, 1
+    sub         r3, r5, r0
+    printi      r3, 1
+    i2f         r4, r3
+    fdiv        r4, r4, r2
+    printf      r4, 1
+
+    inc         r0
+    jb          r0, r1, .loop
+
+    halt
@@ -0,0 +1,20 @@
+; read a count, then that many integer and float pairs, and print their sums
+; input: python3 -c "print(5000000); [print(i - 2500000, i / 1000) for i in range(5000000)]"
+; runtime: 0,461s (1,818s with scanf)
+    lconsb      r0, 0
+    read        r1
+    lconsb      r3, 0
+    lconsb      r5, 0
+
+.loop:
+    readi       r2
+    add         r3, r3, r2
+    readf       r4
+    fadd        r5, r5, r4
+
+    inc         r0
+    jb          r0, r1, .loop
+
+    printi      r3, 1
+    printf      r5, 1
+    halt
@@ -2,8 +2,7 @@
     jmp     .entry
 .start:
     mul     r2, r2, r0
-    printi  r2
-    println
+    printi  r2, 1
 
     inc     r0
     jne     r0, r1, .start
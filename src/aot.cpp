@@ -0,0 +1,477 @@
+// Translates a program to C++ ahead of time. The generated function works on
+// the VM's own registers and memory and hands anything it can't do (I/O,
+// interrupts, errors, jumps to unknown addresses...) back to the interpreter,
+// see VM::setCompiled().
+
+#include <vector>
+#include "vm.h"
+#include "decode.h"
+
+#define DEFAULT_STACK_SIZE 2192
+
+struct AotProgram
+{
+    const uint8_t *code;
+    uint32_t progLen;
+    uint32_t entry;
+    std::vector<bool> isStart;  // an instruction starts here
+    std::vector<bool> isLeader; // a block starts here (entry, jump target, ...)
+    std::vector<bool> isCode;   // byte belongs to a reachable instruction
+};
+
+static bool isCondBranch(uint8_t instr)
+{
+    return instr >= OP_JZ && instr <= OP_JLE;
+}
+
+static bool endsBlock(uint8_t instr)
+{
+    return instr == OP_HALT || instr == OP_JMP || instr == OP_LJMP || instr == OP_JR || instr == OP_RET;
+}
+
+// recursive traversal from the entry point, data mixed with the code is never
+// reached as long as the program jumps over it
+static void discover(AotProgram &p)
+{
+    std::vector<uint32_t> pending(1, p.entry);
+    p.isLeader[p.entry] = true;
+
+    while (!pending.empty())
+    {
+        uint32_t addr = pending.back();
+        pending.pop_back();
+
+        while (addr < p.progLen && !p.isStart[addr])
+        {
+            const uint8_t instr = p.code[addr];
+            p.isStart[addr] = true;
+            if (instr >= INSTRUCTION_COUNT || addr + instrLength[instr] > p.progLen)
+                break;
+            for (uint32_t i = addr; i < addr + instrLength[instr]; i++)
+                p.isCode[i] = true;
+
+            uint32_t target = UINT32_MAX;
+            if (instr == OP_JMP || instr == OP_CALL)
+                target = VM_NEAR_TARGET(addr, p.code[addr + 1] | p.code[addr + 2] << 8);
+            else if (instr == OP_LJMP || instr == OP_LCALL)
+                target = p.code[addr + 1] | p.code[addr + 2] << 8 | p.code[addr + 3] << 16 | (uint32_t)p.code[addr + 4] << 24;
+            else if (instr == OP_JZ || instr == OP_JNZ)
+                target = VM_NEAR_TARGET(addr, p.code[addr + 2] | p.code[addr + 3] << 8);
+            else if (isCondBranch(instr))
+                target = VM_NEAR_TARGET(addr, p.code[addr + 3] | p.code[addr + 4] << 8);
+            if (target < p.progLen)
+            {
+                p.isLeader[target] = true;
+                pending.push_back(target);
+            }
+
+            if (endsBlock(instr))
+                break;
+            addr += instrLength[instr];
+        }
+    }
+}
+
+// whether the generated code can run the instruction at addr itself
+static bool decodeNative(const AotProgram &p, uint32_t addr, DecodedInstr &d)
+{
+    if (!decodeInstr(p.code, addr, p.progLen, UINT32_MAX, d))
+        return false;
+
+    switch (d.op)
+    {
+    case OP_HALT:
+    case OP_INT:
+    case OP_MEMCPY:
+    case OP_MEMCPY_P:
+        return false;
+    case OP_STOR:
+    case OP_STORW:
+    case OP_STORB:
+        // writes to the program go through the interpreter, which keeps its caches up to date
+        return d.imm >= p.progLen;
+    default:
+        return d.op < OP_PRINT;
+    }
+}
+
+// the interpreter resumes compiled code after anything it had to run
+static void findLeaders(AotProgram &p)
+{
+    for (uint32_t addr = 0; addr < p.progLen; addr++)
+    {
+        if (!p.isStart[addr])
+            continue;
+        DecodedInstr d;
+        const uint8_t instr = p.code[addr];
+        const bool native = decodeNative(p, addr, d);
+        if (instr < INSTRUCTION_COUNT && (!native || isCondBranch(instr) || instr == OP_CALL || instr == OP_LCALL))
+        {
+            const uint32_t next = addr + instrLength[instr];
+            if (next < p.progLen && p.isStart[next])
+                p.isLeader[next] = true;
+        }
+    }
+}
+
+// load/store with a constant address only needs a runtime check past the program
+static void emitAddrCheck(FILE *out, const AotProgram &p, uint32_t addr, uint8_t size, uint32_t ip, uint32_t left)
+{
+    if (addr + size > p.progLen)
+        fprintf(out, "    if (%uu > memSize) { r[IP] = %u; return executed - %u; }\n", addr + size, ip, left);
+}
+
+#define EXIT_IF(cond) fprintf(out, "        if (" cond ") { r[IP] = %u; return executed - %u; }\n", ip, left)
+
+static void emitJump(FILE *out, const AotProgram &p, uint32_t target)
+{
+    if (target < p.progLen && p.isLeader[target])
+        fprintf(out, "goto L_%u;", target);
+    else
+        fprintf(out, "{ r[IP] = %u; return executed; }", target);
+}
+
+// left is the number of instructions of the block from this one on, which
+// haven't run yet if the instruction bails out
+static void emitInstr(FILE *out, const AotProgram &p, const DecodedInstr &d, uint32_t ip, uint32_t left)
+{
+    static const char *const condOps[] = {"==", "!=", ">", ">", ">=", ">=", "<", "<", "<=", "<="};
+    const unsigned a = d.a, b = d.b, c = d.c;
+
+    fprintf(out, "    // %u: %s\n", ip, instrName[d.op]);
+    switch (d.op)
+    {
+    case OP_NOP:
+    case OP_U2I:
+    case OP_I2U:
+        break;
+    case OP_LCONS:
+    case OP_LCONSW:
+    case OP_LCONSB:
+        fprintf(out, "    r[%u] = %uu;\n", a, d.imm);
+        break;
+    case OP_MOV:
+        fprintf(out, "    r[%u] = r[%u];\n", a, b);
+        break;
+    case OP_PUSH:
+        fprintf(out, "    {\n");
+        EXIT_IF("r[SP] < PROG_LEN + 4 || r[SP] > memSize");
+        fprintf(out, "        r[SP] -= 4;\n");
+        fprintf(out, "        memcpy(&m[r[SP]], &r[%u], sizeof(uint32_t));\n", a);
+        fprintf(out, "    }\n");
+        break;
+    case OP_POP:
+        fprintf(out, "    {\n");
+        EXIT_IF("r[SP] < PROG_LEN || r[SP] > memSize || memSize - r[SP] < 4");
+        fprintf(out, "        memcpy(&r[%u], &m[r[SP]], sizeof(uint32_t));\n", a);
+        fprintf(out, "        r[SP] += 4;\n");
+        fprintf(out, "    }\n");
+        break;
+    case OP_POP2:
+        fprintf(out, "    {\n");
+        EXIT_IF("r[SP] < PROG_LEN || r[SP] > memSize || memSize - r[SP] < 8");
+        fprintf(out, "        memcpy(&r[%u], &m[r[SP]], sizeof(uint32_t));\n", a);
+        fprintf(out, "        r[SP] += 4;\n");
+        fprintf(out, "        memcpy(&r[%u], &m[r[SP]], sizeof(uint32_t));\n", b);
+        fprintf(out, "        r[SP] += 4;\n");
+        fprintf(out, "    }\n");
+        break;
+    case OP_DUP:
+        fprintf(out, "    {\n");
+        EXIT_IF("r[SP] < PROG_LEN + 4 || r[SP] > memSize || memSize - r[SP] < 4");
+        fprintf(out, "        r[SP] -= 4;\n");
+        fprintf(out, "        memcpy(&m[r[SP]], &m[r[SP]] + 4, sizeof(uint32_t));\n");
+        fprintf(out, "    }\n");
+        break;
+    case OP_CALL:
+        fprintf(out, "    r[RA] = %u;\n    ", ip + d.len);
+        emitJump(out, p, d.imm);
+        fprintf(out, "\n");
+        break;
+    case OP_RET:
+        fprintf(out, "    r[IP] = r[RA];\n    goto dispatch;\n");
+        break;
+    case OP_JR:
+        fprintf(out, "    r[IP] = r[%u];\n    goto dispatch;\n", a);
+        break;
+    case OP_STOR:
+    case OP_STORW:
+    case OP_STORB:
+    {
+        const uint8_t size = d.op == OP_STOR ? 4 : d.op == OP_STORW ? 2 : 1;
+        emitAddrCheck(out, p, d.imm, size, ip, left);
+        fprintf(out, "    memcpy(&m[%u], &r[%u], %u);\n", d.imm, a, size);
+        break;
+    }
+    case OP_STOR_P:
+    case OP_STORW_P:
+    case OP_STORB_P:
+    {
+        const uint8_t size = d.op == OP_STOR_P ? 4 : d.op == OP_STORW_P ? 2 : 1;
+        fprintf(out, "    {\n");
+        fprintf(out, "        const uint32_t dest = r[%u];\n", a);
+        fprintf(out, "        if (dest < PROG_LEN || (uint64_t)dest + %u > memSize) { r[IP] = %u; return executed - %u; }\n",
+                size, ip, left);
+        fprintf(out, "        memcpy(&m[dest], &r[%u], %u);\n", b, size);
+        fprintf(out, "    }\n");
+        break;
+    }
+    case OP_LOAD:
+        emitAddrCheck(out, p, d.imm, 4, ip, left);
+        fprintf(out, "    memcpy(&r[%u], &m[%u], sizeof(uint32_t));\n", a, d.imm);
+        break;
+    case OP_LOADW:
+        emitAddrCheck(out, p, d.imm, 2, ip, left);
+        fprintf(out, "    r[%u] = m[%u] | m[%u] << 8;\n", a, d.imm, d.imm + 1);
+        break;
+    case OP_LOADB:
+        emitAddrCheck(out, p, d.imm, 1, ip, left);
+        fprintf(out, "    r[%u] = m[%u];\n", a, d.imm);
+        break;
+    case OP_LOAD_P:
+    case OP_LOADW_P:
+    case OP_LOADB_P:
+    {
+        const uint8_t size = d.op == OP_LOAD_P ? 4 : d.op == OP_LOADW_P ? 2 : 1;
+        fprintf(out, "    {\n");
+        fprintf(out, "        const uint32_t src = r[%u];\n", b);
+        fprintf(out, "        if ((uint64_t)src + %u > memSize) { r[IP] = %u; return executed - %u; }\n", size, ip, left);
+        if (size == 4)
+            fprintf(out, "        memcpy(&r[%u], &m[src], sizeof(uint32_t));\n", a);
+        else if (size == 2)
+            fprintf(out, "        r[%u] = m[src] | m[src + 1] << 8;\n", a);
+        else
+            fprintf(out, "        r[%u] = m[src];\n", a);
+        fprintf(out, "    }\n");
+        break;
+    }
+    case OP_INC:
+        fprintf(out, "    r[%u]++;\n", a);
+        break;
+    case OP_DEC:
+        fprintf(out, "    r[%u]--;\n", a);
+        break;
+    case OP_FINC:
+        fprintf(out, "    (*((float *)&r[%u]))++;\n", a);
+        break;
+    case OP_FDEC:
+        fprintf(out, "    (*((float *)&r[%u]))--;\n", a);
+        break;
+    case OP_ADD:
+        fprintf(out, "    r[%u] = r[%u] + r[%u];\n", a, b, c);
+        break;
+    case OP_SUB:
+        fprintf(out, "    r[%u] = r[%u] - r[%u];\n", a, b, c);
+        break;
+    case OP_MUL:
+    case OP_IMUL:
+        // same low 32 bits either way
+        fprintf(out, "    r[%u] = r[%u] * r[%u];\n", a, b, c);
+        break;
+    case OP_AND:
+        fprintf(out, "    r[%u] = r[%u] & r[%u];\n", a, b, c);
+        break;
+    case OP_OR:
+        fprintf(out, "    r[%u] = r[%u] | r[%u];\n", a, b, c);
+        break;
+    case OP_XOR:
+        fprintf(out, "    r[%u] = r[%u] ^ r[%u];\n", a, b, c);
+        break;
+    case OP_NOT:
+        fprintf(out, "    r[%u] = ~r[%u];\n", a, b);
+        break;
+    case OP_SHL:
+        fprintf(out, "    r[%u] = r[%u] << r[%u];\n", a, b, c);
+        break;
+    case OP_SHR:
+        fprintf(out, "    r[%u] = r[%u] >> r[%u];\n", a, b, c);
+        break;
+    case OP_ISHR:
+        fprintf(out, "    *((int32_t *)&r[%u]) = *((int32_t *)&r[%u]) >> *((int32_t *)&r[%u]);\n", a, b, c);
+        break;
+    case OP_DIV:
+    case OP_MOD:
+        // division traps are left to the interpreter
+        fprintf(out, "    {\n");
+        fprintf(out, "        if (r[%u] == 0) { r[IP] = %u; return executed - %u; }\n", c, ip, left);
+        fprintf(out, "        r[%u] = r[%u] %s r[%u];\n", a, b, d.op == OP_DIV ? "/" : "%", c);
+        fprintf(out, "    }\n");
+        break;
+    case OP_IDIV:
+    case OP_IMOD:
+        fprintf(out, "    {\n");
+        fprintf(out, "        if (r[%u] == 0 || r[%u] == 0xFFFFFFFFu) { r[IP] = %u; return executed - %u; }\n", c, c, ip, left);
+        fprintf(out, "        *((int32_t *)&r[%u]) = *((int32_t *)&r[%u]) %s *((int32_t *)&r[%u]);\n",
+                a, b, d.op == OP_IDIV ? "/" : "%", c);
+        fprintf(out, "    }\n");
+        break;
+    case OP_FADD:
+    case OP_FMUL:
+        fprintf(out, "    *((float *)&r[%u]) = %s(*((float *)&r[%u]), *((float *)&r[%u]));\n", a,
+                d.op == OP_FADD ? "floatAdd" : "floatMul", b, c);
+        break;
+    case OP_FSUB:
+    case OP_FDIV:
+        fprintf(out, "    *((float *)&r[%u]) = *((float *)&r[%u]) %c *((float *)&r[%u]);\n", a, b,
+                d.op == OP_FSUB ? '-' : '/', c);
+        break;
+    case OP_I2F:
+        fprintf(out, "    *((float *)&r[%u]) = (float)*((int32_t *)&r[%u]);\n", a, b);
+        break;
+    case OP_F2I:
+        fprintf(out, "    *((int32_t *)&r[%u]) = (int32_t) * ((float *)&r[%u]);\n", a, b);
+        break;
+    case OP_JMP:
+        fprintf(out, "    ");
+        emitJump(out, p, d.imm);
+        fprintf(out, "\n");
+        break;
+    case OP_JZ:
+    case OP_JNZ:
+        fprintf(out, "    if (r[%u] %s 0)\n        ", a, d.op == OP_JZ ? "==" : "!=");
+        emitJump(out, p, d.imm);
+        fprintf(out, "\n");
+        break;
+    default:
+    {
+        // the remaining conditional branches
+        const bool isSigned = d.op == OP_JG || d.op == OP_JGE || d.op == OP_JL || d.op == OP_JLE;
+        const char *cast = isSigned ? "(int32_t)" : "";
+        fprintf(out, "    if (%sr[%u] %s %sr[%u])\n        ", cast, a, condOps[d.op - OP_JE], cast, b);
+        emitJump(out, p, d.imm);
+        fprintf(out, "\n");
+        break;
+    }
+    }
+}
+
+static void emitBlock(FILE *out, const AotProgram &p, uint32_t start)
+{
+    // the block runs until control leaves it, the interpreter is needed or another block starts
+    uint32_t count = 0;
+    uint32_t addr = start;
+    DecodedInstr d;
+    while (addr < p.progLen && (addr == start || !p.isLeader[addr]) && decodeNative(p, addr, d))
+    {
+        count++;
+        addr += d.len;
+        if (endsBlock(d.op) || isCondBranch(d.op) || d.op == OP_CALL)
+            break;
+    }
+
+
+    fprintf(out, "L_%u:\n", start);
+    if (count == 0)
+    {
+        fprintf(out, "    r[IP] = %u;\n    return executed;\n\n", start);
+        return;
+    }
+    fprintf(out, "    if (budget - executed < %u) { r[IP] = %u; return executed; }\n", count, start);
+    fprintf(out, "    executed += %u;\n", count);
+
+    addr = start;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        decodeNative(p, addr, d);
+        emitInstr(out, p, d, addr, count - i);
+        addr += d.len;
+    }
+
+    if (endsBlock(d.op) || d.op == OP_CALL)
+        fprintf(out, "\n");
+    else if (addr < p.progLen && p.isLeader[addr])
+        fprintf(out, "    goto L_%u;\n\n", addr);
+    else
+        fprintf(out, "    r[IP] = %u;\n    return executed;\n\n", addr);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 3 && argc != 4)
+    {
+        printf("Usage: %s bin_file cpp_file [symbol]\n", argv[0]);
+        printf("Without a symbol, the output includes a main() like the vm executable's\n");
+        return 1;
+    }
+
+    // images are compiled as laid out in memory, zeroed data included
+    ImageError error;
+    Program *loaded = Program::map(argv[1], DEFAULT_STACK_SIZE, &error);
+    if (loaded == nullptr)
+    {
+        if (error == IMAGE_ERR_FILE)
+            printf("Could not open %s\n", argv[1]);
+        else
+            printf("Invalid image %s: %s\n", argv[1], imageErrorString(error));
+        return 1;
+    }
+    const uint8_t *code = loaded->code();
+
+    AotProgram p;
+    p.code = code;
+    p.progLen = loaded->progLen();
+    p.entry = loaded->entry();
+    p.isStart.assign(p.progLen, false);
+    p.isLeader.assign(p.progLen, false);
+    p.isCode.assign(p.progLen, false);
+    discover(p);
+    findLeaders(p);
+
+    FILE *out = fopen(argv[2], "w");
+    if (out == nullptr)
+    {
+        printf("Could not open %s\n", argv[2]);
+        return 1;
+    }
+    const char *symbol = argc == 4 ? argv[3] : "compiledProgram";
+
+    fprintf(out, "// generated by risvm-aot from %s, do not edit\n", argv[1]);
+    fprintf(out, "#include \"vm.h\"\n\n");
+    fprintf(out, "#define PROG_LEN %uu\n\n", p.progLen);
+
+    fprintf(out, "static const uint8_t program[PROG_LEN] = {");
+    for (uint32_t i = 0; i < p.progLen; i++)
+        fprintf(out, "%s0x%02X,", i % 16 == 0 ? "\n    " : " ", code[i]);
+    fprintf(out, "\n};\n\n");
+
+    fprintf(out, "static const uint8_t codeMap[(PROG_LEN + 7) / 8] = {");
+    for (uint32_t i = 0; i < p.progLen; i += 8)
+    {
+        uint8_t bits = 0;
+        for (uint32_t j = i; j < i + 8 && j < p.progLen; j++)
+            bits |= p.isCode[j] << (j - i);
+        fprintf(out, "%s0x%02X,", (i / 8) % 16 == 0 ? "\n    " : " ", bits);
+    }
+    fprintf(out, "\n};\n\n");
+
+    fprintf(out, "static uint32_t run(uint32_t *r, uint8_t *m, uint32_t memSize, uint32_t budget)\n{\n");
+    fprintf(out, "    uint32_t executed = 0;\n    goto dispatch;\n\n");
+    fprintf(out, "dispatch:\n    switch (r[IP])\n    {\n");
+    for (uint32_t addr = 0; addr < p.progLen; addr++)
+        if (p.isLeader[addr])
+            fprintf(out, "    case %u:\n        goto L_%u;\n", addr, addr);
+    fprintf(out, "    default:\n        return executed;\n    }\n\n");
+    for (uint32_t addr = 0; addr < p.progLen; addr++)
+        if (p.isLeader[addr])
+            emitBlock(out, p, addr);
+    fprintf(out, "}\n\n");
+
+    if (argc == 4)
+        fprintf(out, "extern const CompiledProgram %s;\n", symbol);
+    else
+        fprintf(out, "static ");
+    fprintf(out, "const CompiledProgram %s = {run, program, codeMap, PROG_LEN};\n", symbol);
+
+    if (argc == 3)
+    {
+        fprintf(out, "\nint main(int argc, char *argv[])\n{\n");
+        fprintf(out, "    VM vm((uint8_t *)program, PROG_LEN, %u);\n", loaded->stackSize());
+        fprintf(out, "    vm.setRegister(IP, %u);\n", p.entry);
+        fprintf(out, "    vm.setCompiled(&%s);\n", symbol);
+        fprintf(out, "    return vm.run();\n}\n");
+    }
+
+    fclose(out);
+    loaded->release();
+    return 0;
+}
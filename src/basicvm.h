@@ -0,0 +1,1364 @@
+#ifndef __BASICVM_H__
+#define __BASICVM_H__
+
+#include "vm.h"
+
+// Print and read instructions write to and parse from the VM's own buffers,
+// with whatever setOutput() and setInput() picked
+struct VMBufferedIO
+{
+    static void print(VM *vm, uint8_t op, uint32_t value, bool newline)
+    {
+        vm->_outputValue(op, value, newline);
+    }
+    static void printChar(VM *vm, char c)
+    {
+        vm->_outputChar(c);
+    }
+    static void printString(VM *vm, const char *str, uint32_t len)
+    {
+        vm->_output(str, len);
+    }
+    static bool readInteger(VM *vm, uint32_t &value)
+    {
+        return vm->_readInteger(value);
+    }
+    static bool readFloat(VM *vm, float &value)
+    {
+        return vm->_readFloat(value);
+    }
+    static uint32_t readChar(VM *vm)
+    {
+        return vm->_readChar();
+    }
+    static void readLine(VM *vm, char *dest, uint32_t maxLen)
+    {
+        vm->_readLine(dest, maxLen);
+    }
+    // when run() returns
+    static void flush(VM *vm)
+    {
+        vm->flush();
+    }
+};
+
+// int instructions call the handlers given to onInterrupt()
+struct VMInterruptHandlers
+{
+    // a RegisterHandler for code, which only gets the registers and is called
+    // straight away, returns whether there was one
+    static bool handleRegisters(VM *vm, uint8_t code)
+    {
+        if (vm->_interrupts == nullptr || vm->_interrupts[code].registers == nullptr)
+            return false;
+        vm->_interrupts[code].registers(vm->_registers, vm->_interrupts[code].context);
+        return true;
+    }
+    // anything else has IP on the code and can look at the whole VM
+    static bool handles(VM *vm, uint8_t code)
+    {
+        return vm->_handlesInterrupt(code);
+    }
+    static InterruptResult handle(VM *vm, uint8_t code)
+    {
+        return vm->_interrupt(code);
+    }
+};
+
+// What BasicVM is compiled for. These are the settings of VM itself, a config
+// of their own can derive from them and change what it needs
+struct VMConfig
+{
+    // bytes of memory (program, data and stack), or 0 for whatever the
+    // program needs. Bounds are checked against a constant if it's fixed,
+    // and constant addresses (16 bits) need no checks at all with 64 KiB
+    static const uint32_t memorySize = 0;
+    // the stack of programs given as bytes, when memory isn't fixed
+    static const uint32_t stackSize = 256;
+    // bounds, register and stack checks of programs verify() didn't pass.
+    // Without them, only programs known to be correct may be run
+#ifdef VM_DISABLE_CHECKS
+    static const bool checks = false;
+#else
+    static const bool checks = true;
+#endif
+    // a class with VMBufferedIO's static functions
+    typedef VMBufferedIO IO;
+    // a class with VMInterruptHandlers' static functions
+    typedef VMInterruptHandlers Interrupts;
+    // count and time every instruction into the profile given to
+    // setProfile(), if there is one
+    static const bool profile = false;
+};
+
+// what VM runs with once it has a profile
+struct VMProfileConfig : VMConfig
+{
+    static const bool profile = true;
+};
+
+// A VM whose interpreter is compiled for Config, for hosts that know at build
+// time how big their programs are, what they may skip and where I/O and
+// interrupts go: bounds are constants where memory is fixed, and print, read
+// and int instructions call Config's functions directly, so they can be
+// inlined. It always runs the byte interpreter (threaded where available,
+// whatever setDispatch() says), and only through BasicVM::run(), as VM's
+// other functions (and the Scheduler and VMPool) run it like any VM.
+// BasicVM<VMConfig> runs exactly like a VM with the threaded engine.
+template <class Config>
+class BasicVM : public VM
+{
+  public:
+    // the stack fills whatever memory the program leaves if it's fixed
+    BasicVM(uint8_t *program, uint32_t progLen)
+        : VM(program, progLen, progLen < Config::memorySize ? Config::memorySize - progLen : Config::stackSize)
+    {
+    }
+    BasicVM(Program *program) : VM(program)
+    {
+    }
+
+    ExecResult run(uint32_t maxInstr = 0);
+};
+
+// The byte interpreter, instantiated by VM for VMConfig (switch and threaded
+// engines) and by BasicVM for its own config
+
+// IP is kept in a local while running verified programs, which can't name it
+// as an operand, and is written back whenever anything else may look at it
+#define _IP (checked ? this->_registers[IP] : ip)
+#define _SYNC     \
+    if (!checked) \
+        this->_registers[IP] = ip;
+
+// Verified programs are charged a whole block of straight-line code when
+// entering it rather than an instruction at a time, so anything that leaves
+// mid-block gives back what it didn't run: all of the block from start on if
+// the current instruction didn't complete, or the rest after it if it did.
+#define _UNCHARGE(completed)                                       \
+    if (!checked)                                                  \
+        instrCount -= this->_blockLen[start] - (completed ? 1 : 0);
+#define _RETURN(res)                          \
+    {                                         \
+        _PROFILE_END                          \
+        _SYNC                                 \
+        _UNCHARGE(false)                      \
+        this->_executed += instrCount;        \
+        return res;                           \
+    }
+
+// charge the block starting at addr, the last one that doesn't fit in the
+// budget is stepped through by the checked engine to pause at the exact spot
+#define _ENTER_BLOCK(addr)                                                     \
+    if (!checked)                                                              \
+    {                                                                          \
+        const uint32_t fuel = this->_blockLen[addr];                           \
+        if (maxInstr != 0 && maxInstr - instrCount < fuel)                     \
+        {                                                                      \
+            _PROFILE_END                                                       \
+            this->_registers[IP] = addr;                                       \
+            this->_executed += instrCount;                                     \
+            if (instrCount == maxInstr)                                        \
+                return ExecResult::VM_PAUSED;                                  \
+            return this->_run<Config, threaded, true>(maxInstr - instrCount);          \
+        }                                                                      \
+        instrCount += fuel;                                                    \
+    }
+// jumps, calls, returns and interrupts end blocks, whether they're taken or not
+#define _END_BLOCK _ENTER_BLOCK(_IP + 1)
+
+#define _NEXT_BYTE mem[++_IP]
+#define _NEXT_SHORT ({ _IP += 2; mem[_IP - 1] | mem[_IP] << 8; })
+#define _NEXT_INT ({                                                       \
+    _IP += 4;                                                              \
+    mem[_IP - 3] | mem[_IP - 2] << 8 | mem[_IP - 1] << 16 | mem[_IP] << 24; \
+})
+
+// VM_DISABLE_CHECKS (VMConfig::checks) or a config without checks leaves
+// the program to stay in bounds
+#define _CHECK_ADDR_VALID(a)                        \
+    if (Config::checks && (a) >= memSize)           \
+        _RETURN(ExecResult::VM_ERR_INVALID_ADDRESS)
+// verify() already proved these for every instruction of a verified program
+#define _CHECK_BYTES_AVAIL(n)                            \
+    if (Config::checks && checked && _IP + n >= memSize) \
+        _RETURN(ExecResult::VM_ERR_INVALID_ADDRESS)
+#define _CHECK_REGISTER_VALID(r)                          \
+    if (Config::checks && checked && r >= REGISTER_COUNT) \
+        _RETURN(ExecResult::VM_ERR_INVALID_REGISTER)
+#define _CHECK_CONST_ADDR_VALID(a)                   \
+    if (Config::checks && checked && (a) >= memSize) \
+        _RETURN(ExecResult::VM_ERR_INVALID_ADDRESS)
+#define _CHECK_CAN_PUSH(n)                                                                        \
+    if (Config::checks && this->_registers[SP] < (uint64_t)this->_progLen + n * sizeof(uint32_t)) \
+        _RETURN(ExecResult::VM_ERR_STACK_OVERFLOW)
+#define _CHECK_CAN_POP(n)                                                                  \
+    if (Config::checks && (uint64_t)this->_registers[SP] + n * sizeof(uint32_t) > memSize) \
+        _RETURN(ExecResult::VM_ERR_STACK_UNDERFLOW)                                        \
+    if (Config::checks && this->_registers[SP] < this->_progLen)                           \
+        _RETURN(ExecResult::VM_ERR_STACK_OVERFLOW)
+
+// verified programs still need to know where indirect jumps land and that
+// code stays the same, which block charging relies on even without checks
+#define _CHECK_JUMP_TARGET                                                                      \
+    if (!checked)                                                                               \
+    {                                                                                           \
+        const uint32_t target = _IP + 1;                                                        \
+        if (target >= this->_codeLen || !(this->_verifyMap[target >> 3] & (1 << (target & 7)))) \
+            _CONTINUE_CHECKED                                                                   \
+    }
+// the checked engine also runs verified programs (budget tails, _step() for
+// the other engines), so whatever it writes to code is unverified as well
+#define _CHECK_CODE_WRITE(addr, len)                                         \
+    if (checked)                                                             \
+        this->_unverify(addr, len);                                          \
+    else if ((addr) < this->_codeLen && this->_writesCode(addr, len))        \
+    {                                                                        \
+        this->_verified = false;                                             \
+        _CONTINUE_CHECKED                                                    \
+    }
+// verify() proved constant addresses don't point at code, but only for the
+// instructions it found
+#define _CHECK_CONST_CODE_WRITE(addr, len) \
+    if (checked)                           \
+        this->_unverify(addr, len);
+
+// Profiling configs charge each instruction with the time until the next one
+// is fetched, or the interpreter returns (or hands over to the checked one)
+#define _PROFILE_NEXT                                                    \
+    if (Config::profile && profile != nullptr)                           \
+    {                                                                    \
+        const uint64_t now = VM_PROFILE_CLOCK();                         \
+        if (profiled != INSTRUCTION_COUNT)                               \
+            profile->record(profiled, now - fetched);                    \
+        profiled = instr;                                                \
+        fetched = now;                                                   \
+    }
+#define _PROFILE_END                                                     \
+    if (Config::profile && profiled != INSTRUCTION_COUNT)                \
+    {                                                                    \
+        profile->record(profiled, VM_PROFILE_CLOCK() - fetched);         \
+        profiled = INSTRUCTION_COUNT;                                    \
+    }
+
+// finish the current instruction and run the rest with every check enabled
+#define _CONTINUE_CHECKED                                                             \
+    {                                                                                 \
+        _PROFILE_END                                                                  \
+        _IP++;                                                                        \
+        _SYNC                                                                         \
+        _UNCHARGE(true)                                                               \
+        if (checked)                                                                  \
+            instrCount++;                                                             \
+        this->_executed += instrCount;                                                \
+        if (maxInstr != 0 && instrCount >= maxInstr)                                  \
+            return ExecResult::VM_PAUSED;                                             \
+        return this->_run<Config, threaded, true>(maxInstr == 0 ? 0 : maxInstr - instrCount); \
+    }
+
+#define _FETCH_INSTR                                \
+    if (checked)                                    \
+    {                                               \
+        _CHECK_ADDR_VALID(_IP)                      \
+    }                                               \
+    start = _IP;                                    \
+    instr = mem[start];                             \
+    if (checked && instr >= INSTRUCTION_COUNT)      \
+        _RETURN(ExecResult::VM_ERR_UNKNOWN_OPCODE)  \
+    _PROFILE_NEXT
+
+#ifdef VM_THREADED_DISPATCH
+// every handler gets both a case label (switch engine) and a label whose
+// address goes in the jump table (threaded engine)
+#define _OP(op) \
+    case op:    \
+    _L_##op:
+// in threaded mode each handler fetches and jumps to the next one itself,
+// giving every opcode its own indirect branch
+#define _DISPATCH                                             \
+    if (threaded)                                             \
+        goto *dispatchTable[instr];
+#define _END_OP                                                          \
+    if (threaded)                                                        \
+    {                                                                    \
+        _IP++;                                                           \
+        if (checked)                                                     \
+        {                                                                \
+            instrCount++;                                                \
+            if (maxInstr != 0 && instrCount >= maxInstr)                 \
+                _RETURN(ExecResult::VM_PAUSED)                           \
+        }                                                                \
+        _FETCH_INSTR                                                     \
+        goto *dispatchTable[instr];                                      \
+    }                                                                    \
+    break;
+#else
+#define _OP(op) case op:
+#define _DISPATCH
+#define _END_OP break;
+#endif
+
+template <class Config, bool threaded, bool checked>
+VM_DISPATCH_ATTR ExecResult VM::_run(uint32_t maxInstr)
+{
+#ifdef VM_THREADED_DISPATCH
+    // must follow the order of the Instruction enum
+    static const void *const dispatchTable[INSTRUCTION_COUNT] = {
+        &&_L_OP_NOP,
+        &&_L_OP_HALT,
+        &&_L_OP_INT,
+        &&_L_OP_LCONS,
+        &&_L_OP_LCONSW,
+        &&_L_OP_LCONSB,
+        &&_L_OP_MOV,
+        &&_L_OP_PUSH,
+        &&_L_OP_POP,
+        &&_L_OP_POP2,
+        &&_L_OP_DUP,
+        &&_L_OP_CALL,
+        &&_L_OP_RET,
+        &&_L_OP_STOR,
+        &&_L_OP_STOR_P,
+        &&_L_OP_STORW,
+        &&_L_OP_STORW_P,
+        &&_L_OP_STORB,
+        &&_L_OP_STORB_P,
+        &&_L_OP_LOAD,
+        &&_L_OP_LOAD_P,
+        &&_L_OP_LOADW,
+        &&_L_OP_LOADW_P,
+        &&_L_OP_LOADB,
+        &&_L_OP_LOADB_P,
+        &&_L_OP_MEMCPY,
+        &&_L_OP_MEMCPY_P,
+        &&_L_OP_INC,
+        &&_L_OP_FINC,
+        &&_L_OP_DEC,
+        &&_L_OP_FDEC,
+        &&_L_OP_ADD,
+        &&_L_OP_FADD,
+        &&_L_OP_SUB,
+        &&_L_OP_FSUB,
+        &&_L_OP_MUL,
+        &&_L_OP_IMUL,
+        &&_L_OP_FMUL,
+        &&_L_OP_DIV,
+        &&_L_OP_IDIV,
+        &&_L_OP_FDIV,
+        &&_L_OP_SHL,
+        &&_L_OP_SHR,
+        &&_L_OP_ISHR,
+        &&_L_OP_MOD,
+        &&_L_OP_IMOD,
+        &&_L_OP_AND,
+        &&_L_OP_OR,
+        &&_L_OP_XOR,
+        &&_L_OP_NOT,
+        &&_L_OP_U2I,
+        &&_L_OP_I2U,
+        &&_L_OP_I2F,
+        &&_L_OP_F2I,
+        &&_L_OP_JMP,
+        &&_L_OP_JR,
+        &&_L_OP_JZ,
+        &&_L_OP_JNZ,
+        &&_L_OP_JE,
+        &&_L_OP_JNE,
+        &&_L_OP_JA,
+        &&_L_OP_JG,
+        &&_L_OP_JAE,
+        &&_L_OP_JGE,
+        &&_L_OP_JB,
+        &&_L_OP_JL,
+        &&_L_OP_JBE,
+        &&_L_OP_JLE,
+        &&_L_OP_PRINT,
+        &&_L_OP_PRINTI,
+        &&_L_OP_PRINTF,
+        &&_L_OP_PRINTC,
+        &&_L_OP_PRINTS,
+        &&_L_OP_PRINTLN,
+        &&_L_OP_READ,
+        &&_L_OP_READI,
+        &&_L_OP_READF,
+        &&_L_OP_READC,
+        &&_L_OP_READS,
+        &&_L_OP_LJMP,
+        &&_L_OP_LCALL};
+#endif
+    // stores through mem could alias any member, so keep the base in a local too
+    uint8_t *const mem = this->_memory;
+    // a constant for configs with memory of a fixed size
+    const uint32_t memSize = Config::memorySize != 0 ? (uint32_t)Config::memorySize : this->_memSize;
+    uint32_t ip = this->_registers[IP];
+    uint32_t start = ip;
+    uint32_t instrCount = 0;
+    uint8_t instr;
+    // the instruction being timed, if any, and when it was fetched
+    Profile *const profile = this->_profile;
+    uint8_t profiled = INSTRUCTION_COUNT;
+    uint64_t fetched = 0;
+
+    _ENTER_BLOCK(ip)
+    while (!checked || maxInstr == 0 || instrCount < maxInstr)
+    {
+        _FETCH_INSTR
+        _DISPATCH
+
+        switch (instr)
+        {
+        _OP(OP_NOP)
+        {
+            _END_OP
+        }
+        _OP(OP_HALT)
+        {
+            _RETURN(ExecResult::VM_FINISHED)
+        }
+        _OP(OP_INT)
+        {
+            _CHECK_BYTES_AVAIL(1)
+            const uint8_t code = _NEXT_BYTE;
+
+            // handlers that only touch registers can't have moved IP or
+            // changed the code, there's nothing to sync or check
+            if (Config::Interrupts::handleRegisters(this, code))
+            {
+                _CHECK_JUMP_TARGET
+                _END_BLOCK
+                _END_OP
+            }
+            if (!Config::Interrupts::handles(this, code))
+                _RETURN(ExecResult::VM_ERR_UNHANDLED_INTERRUPT)
+            _SYNC
+            const InterruptResult result = Config::Interrupts::handle(this, code);
+            // the handler may have patched code or moved IP
+            if (!checked)
+                ip = this->_registers[IP];
+            if (result == VM_INT_FINISH)
+                _RETURN(ExecResult::VM_FINISHED)
+            if (result == VM_INT_WAIT)
+            {
+                // done with the int as far as the program is concerned
+                _IP++;
+                _SYNC
+                _UNCHARGE(true)
+                if (checked)
+                    instrCount++;
+                this->_executed += instrCount;
+                _PROFILE_END
+                return ExecResult::VM_WAITING;
+            }
+            if (!checked && this->_verifyStale)
+                _CONTINUE_CHECKED
+            _CHECK_JUMP_TARGET
+            _END_BLOCK
+            _END_OP
+        }
+        _OP(OP_MOV)
+        {
+            _CHECK_BYTES_AVAIL(2)
+            const uint8_t reg1 = _NEXT_BYTE;
+            const uint8_t reg2 = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(reg1)
+            _CHECK_REGISTER_VALID(reg2)
+            this->_registers[reg1] = this->_registers[reg2];
+            _END_OP
+        }
+        _OP(OP_LCONS)
+        {
+            _CHECK_BYTES_AVAIL(5)
+            const uint8_t reg = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(reg)
+            this->_registers[reg] = _NEXT_INT;
+            _END_OP
+        }
+        _OP(OP_LCONSW)
+        {
+            _CHECK_BYTES_AVAIL(3)
+            const uint8_t reg = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(reg)
+            this->_registers[reg] = _NEXT_SHORT;
+            _END_OP
+        }
+        _OP(OP_LCONSB)
+        {
+            _CHECK_BYTES_AVAIL(2)
+            const uint8_t reg = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(reg)
+            this->_registers[reg] = _NEXT_BYTE;
+            _END_OP
+        }
+        _OP(OP_PUSH)
+        {
+            _CHECK_BYTES_AVAIL(1)
+            const uint8_t reg = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(reg)
+            _CHECK_CAN_PUSH(1)
+            this->_registers[SP] -= 4;
+            memcpy(&mem[this->_registers[SP]], &this->_registers[reg], sizeof(uint32_t));
+            _END_OP
+        }
+        _OP(OP_POP)
+        {
+            _CHECK_BYTES_AVAIL(1)
+            const uint8_t reg = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(reg)
+            _CHECK_CAN_POP(1)
+            memcpy(&this->_registers[reg], &mem[this->_registers[SP]], sizeof(uint32_t));
+            this->_registers[SP] += 4;
+            _END_OP
+        }
+        _OP(OP_POP2)
+        {
+            _CHECK_BYTES_AVAIL(2)
+            const uint8_t reg1 = _NEXT_BYTE;
+            const uint8_t reg2 = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(reg1)
+            _CHECK_REGISTER_VALID(reg2)
+            _CHECK_CAN_POP(2)
+            memcpy(&this->_registers[reg1], &mem[this->_registers[SP]], sizeof(uint32_t));
+            this->_registers[SP] += 4;
+            memcpy(&this->_registers[reg2], &mem[this->_registers[SP]], sizeof(uint32_t));
+            this->_registers[SP] += 4;
+            _END_OP
+        }
+        _OP(OP_DUP)
+        {
+            _CHECK_CAN_POP(1)
+            _CHECK_CAN_PUSH(1)
+            this->_registers[SP] -= 4;
+            memcpy(&mem[this->_registers[SP]], &mem[this->_registers[SP]] + 4, sizeof(uint32_t));
+            _END_OP
+        }
+        _OP(OP_CALL)
+        {
+            _CHECK_BYTES_AVAIL(2)
+            this->_registers[RA] = _IP + 3;
+            _IP = VM_NEAR_TARGET(start, _NEXT_SHORT) - 1;
+            _END_BLOCK
+            _END_OP
+        }
+        _OP(OP_RET)
+        {
+            _IP = this->_registers[RA] - 1;
+            _CHECK_JUMP_TARGET
+            _END_BLOCK
+            _END_OP
+        }
+        _OP(OP_STOR)
+        {
+            _CHECK_BYTES_AVAIL(3)
+            const uint16_t addr = _NEXT_SHORT;
+            const uint8_t reg = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(reg)
+            _CHECK_CONST_ADDR_VALID((uint32_t)addr + 3)
+            memcpy(&mem[addr], &this->_registers[reg], sizeof(uint32_t));
+            _CHECK_CONST_CODE_WRITE(addr, 4)
+            _END_OP
+        }
+        _OP(OP_STOR_P)
+        {
+            _CHECK_BYTES_AVAIL(2)
+            const uint8_t reg1 = _NEXT_BYTE;
+            const uint8_t reg2 = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(reg1)
+            _CHECK_REGISTER_VALID(reg2)
+            const uint32_t dest = this->_registers[reg1];
+            _CHECK_ADDR_VALID((uint64_t)dest + 3)
+            memcpy(&mem[dest], &this->_registers[reg2], sizeof(uint32_t));
+            _CHECK_CODE_WRITE(dest, 4)
+            _END_OP
+        }
+        _OP(OP_STORW)
+        {
+            _CHECK_BYTES_AVAIL(3)
+            const uint16_t addr = _NEXT_SHORT;
+            const uint8_t reg = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(reg)
+            _CHECK_CONST_ADDR_VALID((uint32_t)addr + 1)
+            memcpy(&mem[addr], &this->_registers[reg], sizeof(uint16_t));
+            _CHECK_CONST_CODE_WRITE(addr, 2)
+            _END_OP
+        }
+        _OP(OP_STORW_P)
+        {
+            _CHECK_BYTES_AVAIL(2)
+            const uint8_t reg1 = _NEXT_BYTE;
+            const uint8_t reg2 = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(reg1)
+            _CHECK_REGISTER_VALID(reg2)
+            const uint32_t dest = this->_registers[reg1];
+            _CHECK_ADDR_VALID((uint64_t)dest + 1)
+            memcpy(&mem[dest], &this->_registers[reg2], sizeof(uint16_t));
+            _CHECK_CODE_WRITE(dest, 2)
+            _END_OP
+        }
+        _OP(OP_STORB)
+        {
+            _CHECK_BYTES_AVAIL(3)
+            const uint16_t addr = _NEXT_SHORT;
+            const uint8_t reg = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(reg)
+            _CHECK_CONST_ADDR_VALID(addr)
+            memcpy(&mem[addr], &this->_registers[reg], sizeof(uint8_t));
+            _CHECK_CONST_CODE_WRITE(addr, 1)
+            _END_OP
+        }
+        _OP(OP_STORB_P)
+        {
+            _CHECK_BYTES_AVAIL(2)
+            const uint8_t reg1 = _NEXT_BYTE;
+            const uint8_t reg2 = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(reg1)
+            _CHECK_REGISTER_VALID(reg2)
+            const uint32_t dest = this->_registers[reg1];
+            _CHECK_ADDR_VALID((uint64_t)dest)
+            memcpy(&mem[dest], &this->_registers[reg2], sizeof(uint8_t));
+            _CHECK_CODE_WRITE(dest, 1)
+            _END_OP
+        }
+        _OP(OP_LOAD)
+        {
+            _CHECK_BYTES_AVAIL(3)
+            const uint8_t reg = _NEXT_BYTE;
+            const uint16_t addr = _NEXT_SHORT;
+            _CHECK_REGISTER_VALID(reg)
+            _CHECK_CONST_ADDR_VALID((uint32_t)addr + 3)
+            memcpy(&this->_registers[reg], &mem[addr], sizeof(uint32_t));
+            _END_OP
+        }
+        _OP(OP_LOAD_P)
+        {
+            _CHECK_BYTES_AVAIL(2)
+            const uint8_t reg1 = _NEXT_BYTE;
+            const uint8_t reg2 = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(reg1)
+            _CHECK_REGISTER_VALID(reg2)
+            const uint32_t src = this->_registers[reg2];
+            _CHECK_ADDR_VALID((uint64_t)src + 3)
+            memcpy(&this->_registers[reg1], &mem[src], sizeof(uint32_t));
+            _END_OP
+        }
+        _OP(OP_LOADW)
+        {
+            _CHECK_BYTES_AVAIL(3)
+            const uint8_t reg = _NEXT_BYTE;
+            const uint16_t addr = _NEXT_SHORT;
+            _CHECK_REGISTER_VALID(reg)
+            _CHECK_CONST_ADDR_VALID((uint32_t)addr + 1)
+            this->_registers[reg] = 0;
+            memcpy(&this->_registers[reg], &mem[addr], sizeof(uint16_t));
+            _END_OP
+        }
+        _OP(OP_LOADW_P)
+        {
+            _CHECK_BYTES_AVAIL(2)
+            const uint8_t reg1 = _NEXT_BYTE;
+            const uint8_t reg2 = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(reg1)
+            _CHECK_REGISTER_VALID(reg2)
+            const uint32_t src = this->_registers[reg2];
+            _CHECK_ADDR_VALID((uint64_t)src + 1)
+            this->_registers[reg1] = 0;
+            memcpy(&this->_registers[reg1], &mem[src], sizeof(uint16_t));
+            _END_OP
+        }
+        _OP(OP_LOADB)
+        {
+            _CHECK_BYTES_AVAIL(3)
+            const uint8_t reg = _NEXT_BYTE;
+            const uint16_t addr = _NEXT_SHORT;
+            _CHECK_REGISTER_VALID(reg)
+            _CHECK_CONST_ADDR_VALID((uint32_t)addr)
+            this->_registers[reg] = mem[addr];
+            _END_OP
+        }
+        _OP(OP_LOADB_P)
+        {
+            _CHECK_BYTES_AVAIL(2)
+            const uint8_t reg1 = _NEXT_BYTE;
+            const uint8_t reg2 = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(reg1)
+            _CHECK_REGISTER_VALID(reg2)
+            const uint32_t src = this->_registers[reg2];
+            _CHECK_ADDR_VALID((uint64_t)src)
+            this->_registers[reg1] = mem[src];
+            _END_OP
+        }
+        _OP(OP_MEMCPY)
+        {
+            _CHECK_BYTES_AVAIL(6)
+            const uint16_t dest = _NEXT_SHORT;
+            const uint16_t source = _NEXT_SHORT;
+            const uint16_t bytes = _NEXT_SHORT;
+            _CHECK_CONST_ADDR_VALID((uint32_t)source + bytes - 1)
+            _CHECK_CONST_ADDR_VALID((uint32_t)dest + bytes - 1)
+            memcpy(&mem[dest], &mem[source], bytes);
+            _CHECK_CONST_CODE_WRITE(dest, bytes)
+            _END_OP
+        }
+        _OP(OP_MEMCPY_P)
+        {
+            _CHECK_BYTES_AVAIL(3)
+            const uint8_t reg1 = _NEXT_BYTE;
+            const uint8_t reg2 = _NEXT_BYTE;
+            const uint8_t reg3 = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(reg1)
+            _CHECK_REGISTER_VALID(reg2)
+            _CHECK_REGISTER_VALID(reg3)
+            const uint32_t dest = this->_registers[reg1];
+            const uint32_t source = this->_registers[reg2];
+            const uint32_t bytes = this->_registers[reg3];
+            _CHECK_ADDR_VALID((uint64_t)source + bytes - 1)
+            _CHECK_ADDR_VALID((uint64_t)dest + bytes - 1)
+            memcpy(&mem[dest], &mem[source], bytes);
+            _CHECK_CODE_WRITE(dest, bytes)
+            _END_OP
+        }
+        _OP(OP_INC)
+        {
+            _CHECK_BYTES_AVAIL(1)
+            const uint8_t reg = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(reg)
+            this->_registers[reg]++;
+            _END_OP
+        }
+        _OP(OP_FINC)
+        {
+            _CHECK_BYTES_AVAIL(1)
+            const uint8_t reg = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(reg)
+            (*((float *)&this->_registers[reg]))++;
+            _END_OP
+        }
+        _OP(OP_DEC)
+        {
+            _CHECK_BYTES_AVAIL(1)
+            const uint8_t reg = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(reg)
+            this->_registers[reg]--;
+            _END_OP
+        }
+        _OP(OP_FDEC)
+        {
+            _CHECK_BYTES_AVAIL(1)
+            const uint8_t reg = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(reg)
+            (*((float *)&this->_registers[reg]))--;
+            _END_OP
+        }
+        _OP(OP_ADD)
+        {
+            _CHECK_BYTES_AVAIL(3)
+            const uint8_t rreg = _NEXT_BYTE;
+            const uint8_t reg1 = _NEXT_BYTE;
+            const uint8_t reg2 = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(rreg)
+            _CHECK_REGISTER_VALID(reg1)
+            _CHECK_REGISTER_VALID(reg2)
+            this->_registers[rreg] = this->_registers[reg1] + this->_registers[reg2];
+            _END_OP
+        }
+        _OP(OP_FADD)
+        {
+            _CHECK_BYTES_AVAIL(3)
+            const uint8_t rreg = _NEXT_BYTE;
+            const uint8_t reg1 = _NEXT_BYTE;
+            const uint8_t reg2 = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(rreg)
+            _CHECK_REGISTER_VALID(reg1)
+            _CHECK_REGISTER_VALID(reg2)
+            *((float *)&this->_registers[rreg]) = floatAdd(*((float *)&this->_registers[reg1]), *((float *)&this->_registers[reg2]));
+            _END_OP
+        }
+        _OP(OP_SUB)
+        {
+            _CHECK_BYTES_AVAIL(3)
+            const uint8_t rreg = _NEXT_BYTE;
+            const uint8_t reg1 = _NEXT_BYTE;
+            const uint8_t reg2 = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(rreg)
+            _CHECK_REGISTER_VALID(reg1)
+            _CHECK_REGISTER_VALID(reg2)
+            this->_registers[rreg] = this->_registers[reg1] - this->_registers[reg2];
+            _END_OP
+        }
+        _OP(OP_FSUB)
+        {
+            _CHECK_BYTES_AVAIL(3)
+            const uint8_t rreg = _NEXT_BYTE;
+            const uint8_t reg1 = _NEXT_BYTE;
+            const uint8_t reg2 = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(rreg)
+            _CHECK_REGISTER_VALID(reg1)
+            _CHECK_REGISTER_VALID(reg2)
+            *((float *)&this->_registers[rreg]) = *((float *)&this->_registers[reg1]) - *((float *)&this->_registers[reg2]);
+            _END_OP
+        }
+        _OP(OP_MUL)
+        {
+            _CHECK_BYTES_AVAIL(3)
+            const uint8_t rreg = _NEXT_BYTE;
+            const uint8_t reg1 = _NEXT_BYTE;
+            const uint8_t reg2 = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(rreg)
+            _CHECK_REGISTER_VALID(reg1)
+            _CHECK_REGISTER_VALID(reg2)
+            this->_registers[rreg] = this->_registers[reg1] * this->_registers[reg2];
+            _END_OP
+        }
+        _OP(OP_IMUL)
+        {
+            _CHECK_BYTES_AVAIL(3)
+            const uint8_t rreg = _NEXT_BYTE;
+            const uint8_t reg1 = _NEXT_BYTE;
+            const uint8_t reg2 = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(rreg)
+            _CHECK_REGISTER_VALID(reg1)
+            _CHECK_REGISTER_VALID(reg2)
+            *((int32_t *)&this->_registers[rreg]) = *((int32_t *)&this->_registers[reg1]) * *((int32_t *)&this->_registers[reg2]);
+            _END_OP
+        }
+        _OP(OP_FMUL)
+        {
+            _CHECK_BYTES_AVAIL(3)
+            const uint8_t rreg = _NEXT_BYTE;
+            const uint8_t reg1 = _NEXT_BYTE;
+            const uint8_t reg2 = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(rreg)
+            _CHECK_REGISTER_VALID(reg1)
+            _CHECK_REGISTER_VALID(reg2)
+            *((float *)&this->_registers[rreg]) = floatMul(*((float *)&this->_registers[reg1]), *((float *)&this->_registers[reg2]));
+            _END_OP
+        }
+        _OP(OP_DIV)
+        {
+            _CHECK_BYTES_AVAIL(3)
+            const uint8_t rreg = _NEXT_BYTE;
+            const uint8_t reg1 = _NEXT_BYTE;
+            const uint8_t reg2 = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(rreg)
+            _CHECK_REGISTER_VALID(reg1)
+            _CHECK_REGISTER_VALID(reg2)
+            this->_registers[rreg] = this->_registers[reg1] / this->_registers[reg2];
+            _END_OP
+        }
+        _OP(OP_IDIV)
+        {
+            _CHECK_BYTES_AVAIL(3)
+            const uint8_t rreg = _NEXT_BYTE;
+            const uint8_t reg1 = _NEXT_BYTE;
+            const uint8_t reg2 = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(rreg)
+            _CHECK_REGISTER_VALID(reg1)
+            _CHECK_REGISTER_VALID(reg2)
+            *((int32_t *)&this->_registers[rreg]) = *((int32_t *)&this->_registers[reg1]) / *((int32_t *)&this->_registers[reg2]);
+            _END_OP
+        }
+        _OP(OP_FDIV)
+        {
+            _CHECK_BYTES_AVAIL(3)
+            const uint8_t rreg = _NEXT_BYTE;
+            const uint8_t reg1 = _NEXT_BYTE;
+            const uint8_t reg2 = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(rreg)
+            _CHECK_REGISTER_VALID(reg1)
+            _CHECK_REGISTER_VALID(reg2)
+            *((float *)&this->_registers[rreg]) = *((float *)&this->_registers[reg1]) / *((float *)&this->_registers[reg2]);
+            _END_OP
+        }
+        _OP(OP_SHL)
+        {
+            _CHECK_BYTES_AVAIL(3)
+            const uint8_t rreg = _NEXT_BYTE;
+            const uint8_t reg1 = _NEXT_BYTE;
+            const uint8_t reg2 = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(rreg)
+            _CHECK_REGISTER_VALID(reg1)
+            _CHECK_REGISTER_VALID(reg2)
+            this->_registers[rreg] = this->_registers[reg1] << this->_registers[reg2];
+            _END_OP
+        }
+        _OP(OP_SHR)
+        {
+            _CHECK_BYTES_AVAIL(3)
+            const uint8_t rreg = _NEXT_BYTE;
+            const uint8_t reg1 = _NEXT_BYTE;
+            const uint8_t reg2 = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(rreg)
+            _CHECK_REGISTER_VALID(reg1)
+            _CHECK_REGISTER_VALID(reg2)
+            this->_registers[rreg] = this->_registers[reg1] >> this->_registers[reg2];
+            _END_OP
+        }
+        _OP(OP_ISHR)
+        {
+            _CHECK_BYTES_AVAIL(3)
+            const uint8_t rreg = _NEXT_BYTE;
+            const uint8_t reg1 = _NEXT_BYTE;
+            const uint8_t reg2 = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(rreg)
+            _CHECK_REGISTER_VALID(reg1)
+            _CHECK_REGISTER_VALID(reg2)
+            *((int32_t *)&this->_registers[rreg]) = *((int32_t *)&this->_registers[reg1]) >> *((int32_t *)&this->_registers[reg2]);
+            _END_OP
+        }
+        _OP(OP_MOD)
+        {
+            _CHECK_BYTES_AVAIL(3)
+            const uint8_t rreg = _NEXT_BYTE;
+            const uint8_t reg1 = _NEXT_BYTE;
+            const uint8_t reg2 = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(rreg)
+            _CHECK_REGISTER_VALID(reg1)
+            _CHECK_REGISTER_VALID(reg2)
+            this->_registers[rreg] = this->_registers[reg1] % this->_registers[reg2];
+            _END_OP
+        }
+        _OP(OP_IMOD)
+        {
+            _CHECK_BYTES_AVAIL(3)
+            const uint8_t rreg = _NEXT_BYTE;
+            const uint8_t reg1 = _NEXT_BYTE;
+            const uint8_t reg2 = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(rreg)
+            _CHECK_REGISTER_VALID(reg1)
+            _CHECK_REGISTER_VALID(reg2)
+            *((int32_t *)&this->_registers[rreg]) = *((int32_t *)&this->_registers[reg1]) % *((int32_t *)&this->_registers[reg2]);
+            _END_OP
+        }
+        _OP(OP_AND)
+        {
+            _CHECK_BYTES_AVAIL(3)
+            const uint8_t rreg = _NEXT_BYTE;
+            const uint8_t reg1 = _NEXT_BYTE;
+            const uint8_t reg2 = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(rreg)
+            _CHECK_REGISTER_VALID(reg1)
+            _CHECK_REGISTER_VALID(reg2)
+            this->_registers[rreg] = this->_registers[reg1] & this->_registers[reg2];
+            _END_OP
+        }
+        _OP(OP_OR)
+        {
+            _CHECK_BYTES_AVAIL(3)
+            const uint8_t rreg = _NEXT_BYTE;
+            const uint8_t reg1 = _NEXT_BYTE;
+            const uint8_t reg2 = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(rreg)
+            _CHECK_REGISTER_VALID(reg1)
+            _CHECK_REGISTER_VALID(reg2)
+            this->_registers[rreg] = this->_registers[reg1] | this->_registers[reg2];
+            _END_OP
+        }
+        _OP(OP_XOR)
+        {
+            _CHECK_BYTES_AVAIL(3)
+            const uint8_t rreg = _NEXT_BYTE;
+            const uint8_t reg1 = _NEXT_BYTE;
+            const uint8_t reg2 = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(rreg)
+            _CHECK_REGISTER_VALID(reg1)
+            _CHECK_REGISTER_VALID(reg2)
+            this->_registers[rreg] = this->_registers[reg1] ^ this->_registers[reg2];
+            _END_OP
+        }
+        _OP(OP_NOT)
+        {
+            _CHECK_BYTES_AVAIL(2)
+            const uint8_t rreg = _NEXT_BYTE;
+            const uint8_t reg1 = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(rreg)
+            _CHECK_REGISTER_VALID(reg1)
+            this->_registers[rreg] = ~this->_registers[reg1];
+            _END_OP
+        }
+        _OP(OP_U2I)
+        {
+            _CHECK_BYTES_AVAIL(1)
+            const uint8_t reg = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(reg)
+            *((int32_t *)&this->_registers[reg]) = this->_registers[reg];
+            _END_OP
+        }
+        _OP(OP_I2U)
+        {
+            _CHECK_BYTES_AVAIL(1)
+            const uint8_t reg = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(reg)
+            this->_registers[reg] = *((int32_t *)&this->_registers[reg]);
+            _END_OP
+        }
+        _OP(OP_I2F)
+        {
+            _CHECK_BYTES_AVAIL(2)
+            const uint8_t reg = _NEXT_BYTE;
+            const uint8_t reg1 = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(reg)
+            _CHECK_REGISTER_VALID(reg1)
+            *((float *)&this->_registers[reg]) = (float)*((int32_t *)&this->_registers[reg1]);
+            _END_OP
+        }
+        _OP(OP_F2I)
+        {
+            _CHECK_BYTES_AVAIL(2)
+            const uint8_t reg = _NEXT_BYTE;
+            const uint8_t reg1 = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(reg)
+            _CHECK_REGISTER_VALID(reg1)
+            *((int32_t *)&this->_registers[reg]) = (int32_t) * ((float *)&this->_registers[reg1]);
+            _END_OP
+        }
+        _OP(OP_JMP)
+        {
+            _CHECK_BYTES_AVAIL(2)
+            _IP = VM_NEAR_TARGET(start, _NEXT_SHORT) - 1;
+            _END_BLOCK
+            _END_OP
+        }
+        _OP(OP_JR)
+        {
+            _CHECK_BYTES_AVAIL(1)
+            const uint8_t reg = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(reg)
+            _IP = this->_registers[reg] - 1;
+            _CHECK_JUMP_TARGET
+            _END_BLOCK
+            _END_OP
+        }
+        _OP(OP_JZ)
+        {
+            _CHECK_BYTES_AVAIL(3)
+            const uint8_t reg = _NEXT_BYTE;
+            const uint16_t addr = _NEXT_SHORT;
+            _CHECK_REGISTER_VALID(reg)
+
+            if (this->_registers[reg] == 0)
+                _IP = VM_NEAR_TARGET(start, addr) - 1;
+            _END_BLOCK
+            _END_OP
+        }
+        _OP(OP_JNZ)
+        {
+            _CHECK_BYTES_AVAIL(3)
+            const uint8_t reg = _NEXT_BYTE;
+            const uint16_t addr = _NEXT_SHORT;
+            _CHECK_REGISTER_VALID(reg)
+
+            if (this->_registers[reg] != 0)
+                _IP = VM_NEAR_TARGET(start, addr) - 1;
+            _END_BLOCK
+            _END_OP
+        }
+        _OP(OP_JE)
+        {
+            _CHECK_BYTES_AVAIL(4)
+            const uint8_t reg1 = _NEXT_BYTE;
+            const uint8_t reg2 = _NEXT_BYTE;
+            const uint16_t addr = _NEXT_SHORT;
+            _CHECK_REGISTER_VALID(reg1)
+            _CHECK_REGISTER_VALID(reg2)
+
+            if (this->_registers[reg1] == this->_registers[reg2])
+                _IP = VM_NEAR_TARGET(start, addr) - 1;
+            _END_BLOCK
+            _END_OP
+        }
+        _OP(OP_JNE)
+        {
+            _CHECK_BYTES_AVAIL(4)
+            const uint8_t reg1 = _NEXT_BYTE;
+            const uint8_t reg2 = _NEXT_BYTE;
+            const uint16_t addr = _NEXT_SHORT;
+            _CHECK_REGISTER_VALID(reg1)
+            _CHECK_REGISTER_VALID(reg2)
+
+            if (this->_registers[reg1] != this->_registers[reg2])
+                _IP = VM_NEAR_TARGET(start, addr) - 1;
+            _END_BLOCK
+            _END_OP
+        }
+        _OP(OP_JA)
+        {
+            _CHECK_BYTES_AVAIL(4)
+            const uint8_t reg1 = _NEXT_BYTE;
+            const uint8_t reg2 = _NEXT_BYTE;
+            const uint16_t addr = _NEXT_SHORT;
+            _CHECK_REGISTER_VALID(reg1)
+            _CHECK_REGISTER_VALID(reg2)
+
+            if (this->_registers[reg1] > this->_registers[reg2])
+                _IP = VM_NEAR_TARGET(start, addr) - 1;
+            _END_BLOCK
+            _END_OP
+        }
+        _OP(OP_JG)
+        {
+            _CHECK_BYTES_AVAIL(4)
+            const uint8_t reg1 = _NEXT_BYTE;
+            const uint8_t reg2 = _NEXT_BYTE;
+            const uint16_t addr = _NEXT_SHORT;
+            _CHECK_REGISTER_VALID(reg1)
+            _CHECK_REGISTER_VALID(reg2)
+
+            if (*((int32_t *)&this->_registers[reg1]) > *((int32_t *)&this->_registers[reg2]))
+                _IP = VM_NEAR_TARGET(start, addr) - 1;
+            _END_BLOCK
+            _END_OP
+        }
+        _OP(OP_JAE)
+        {
+            _CHECK_BYTES_AVAIL(4)
+            const uint8_t reg1 = _NEXT_BYTE;
+            const uint8_t reg2 = _NEXT_BYTE;
+            const uint16_t addr = _NEXT_SHORT;
+            _CHECK_REGISTER_VALID(reg1)
+            _CHECK_REGISTER_VALID(reg2)
+
+            if (this->_registers[reg1] >= this->_registers[reg2])
+                _IP = VM_NEAR_TARGET(start, addr) - 1;
+            _END_BLOCK
+            _END_OP
+        }
+        _OP(OP_JGE)
+        {
+            _CHECK_BYTES_AVAIL(4)
+            const uint8_t reg1 = _NEXT_BYTE;
+            const uint8_t reg2 = _NEXT_BYTE;
+            const uint16_t addr = _NEXT_SHORT;
+            _CHECK_REGISTER_VALID(reg1)
+            _CHECK_REGISTER_VALID(reg2)
+
+            if (*((int32_t *)&this->_registers[reg1]) >= *((int32_t *)&this->_registers[reg2]))
+                _IP = VM_NEAR_TARGET(start, addr) - 1;
+            _END_BLOCK
+            _END_OP
+        }
+        _OP(OP_JB)
+        {
+            _CHECK_BYTES_AVAIL(4)
+            const uint8_t reg1 = _NEXT_BYTE;
+            const uint8_t reg2 = _NEXT_BYTE;
+            const uint16_t addr = _NEXT_SHORT;
+            _CHECK_REGISTER_VALID(reg1)
+            _CHECK_REGISTER_VALID(reg2)
+
+            if (this->_registers[reg1] < this->_registers[reg2])
+                _IP = VM_NEAR_TARGET(start, addr) - 1;
+            _END_BLOCK
+            _END_OP
+        }
+        _OP(OP_JL)
+        {
+            _CHECK_BYTES_AVAIL(4)
+            const uint8_t reg1 = _NEXT_BYTE;
+            const uint8_t reg2 = _NEXT_BYTE;
+            const uint16_t addr = _NEXT_SHORT;
+            _CHECK_REGISTER_VALID(reg1)
+            _CHECK_REGISTER_VALID(reg2)
+
+            if (*((int32_t *)&this->_registers[reg1]) < *((int32_t *)&this->_registers[reg2]))
+                _IP = VM_NEAR_TARGET(start, addr) - 1;
+            _END_BLOCK
+            _END_OP
+        }
+        _OP(OP_JBE)
+        {
+            _CHECK_BYTES_AVAIL(4)
+            const uint8_t reg1 = _NEXT_BYTE;
+            const uint8_t reg2 = _NEXT_BYTE;
+            const uint16_t addr = _NEXT_SHORT;
+            _CHECK_REGISTER_VALID(reg1)
+            _CHECK_REGISTER_VALID(reg2)
+
+            if (this->_registers[reg1] <= this->_registers[reg2])
+                _IP = VM_NEAR_TARGET(start, addr) - 1;
+            _END_BLOCK
+            _END_OP
+        }
+        _OP(OP_JLE)
+        {
+            _CHECK_BYTES_AVAIL(4)
+            const uint8_t reg1 = _NEXT_BYTE;
+            const uint8_t reg2 = _NEXT_BYTE;
+            const uint16_t addr = _NEXT_SHORT;
+            _CHECK_REGISTER_VALID(reg1)
+            _CHECK_REGISTER_VALID(reg2)
+
+            if (*((int32_t *)&this->_registers[reg1]) <= *((int32_t *)&this->_registers[reg2]))
+                _IP = VM_NEAR_TARGET(start, addr) - 1;
+            _END_BLOCK
+            _END_OP
+        }
+        _OP(OP_PRINT)
+        {
+            _CHECK_BYTES_AVAIL(2)
+            const uint8_t reg = _NEXT_BYTE;
+            const uint8_t ln = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(reg)
+
+            Config::IO::print(this, OP_PRINT, this->_registers[reg], ln != 0);
+            _END_OP
+        }
+        _OP(OP_PRINTI)
+        {
+            _CHECK_BYTES_AVAIL(2)
+            const uint8_t reg = _NEXT_BYTE;
+            const uint8_t ln = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(reg)
+
+            Config::IO::print(this, OP_PRINTI, this->_registers[reg], ln != 0);
+            _END_OP
+        }
+        _OP(OP_PRINTF)
+        {
+            _CHECK_BYTES_AVAIL(2)
+            const uint8_t reg = _NEXT_BYTE;
+            const uint8_t ln = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(reg)
+
+            Config::IO::print(this, OP_PRINTF, this->_registers[reg], ln != 0);
+            _END_OP
+        }
+        _OP(OP_PRINTC)
+        {
+            _CHECK_BYTES_AVAIL(1)
+            const uint8_t reg = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(reg)
+            Config::IO::printChar(this, *(char *)&this->_registers[reg]);
+            _END_OP
+        }
+        _OP(OP_PRINTS)
+        {
+            _CHECK_BYTES_AVAIL(2)
+            const uint16_t addr = _NEXT_SHORT;
+            _CHECK_CONST_ADDR_VALID(addr)
+            // strings running off the end of memory are printed up to there
+            const char *str = (char *)&mem[addr];
+            const char *end = (char *)memchr(str, '\0', memSize - addr);
+            Config::IO::printString(this, str, end != nullptr ? end - str : memSize - addr);
+            if (end == nullptr)
+                _CHECK_ADDR_VALID(memSize)
+            _END_OP
+        }
+        _OP(OP_PRINTLN)
+        {
+            Config::IO::printChar(this, '\n');
+            _END_OP
+        }
+        _OP(OP_READ)
+        {
+            _CHECK_BYTES_AVAIL(1)
+            const uint8_t reg = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(reg)
+            Config::IO::readInteger(this, this->_registers[reg]);
+            _END_OP
+        }
+        _OP(OP_READI)
+        {
+            _CHECK_BYTES_AVAIL(1)
+            const uint8_t reg = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(reg)
+            Config::IO::readInteger(this, this->_registers[reg]);
+            _END_OP
+        }
+        _OP(OP_READF)
+        {
+            _CHECK_BYTES_AVAIL(1)
+            const uint8_t reg = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(reg)
+            Config::IO::readFloat(this, *(float *)&this->_registers[reg]);
+            _END_OP
+        }
+        _OP(OP_READC)
+        {
+            _CHECK_BYTES_AVAIL(1)
+            const uint8_t reg = _NEXT_BYTE;
+            _CHECK_REGISTER_VALID(reg)
+            this->_registers[reg] = Config::IO::readChar(this);
+            _END_OP
+        }
+        _OP(OP_READS)
+        {
+            _CHECK_BYTES_AVAIL(4)
+            const uint16_t addr = _NEXT_SHORT;
+            const uint16_t maxLen = _NEXT_SHORT;
+            _CHECK_CONST_ADDR_VALID((uint32_t)addr + maxLen)
+            Config::IO::readLine(this, (char *)&mem[addr], maxLen);
+            _CHECK_CONST_CODE_WRITE(addr, (uint32_t)maxLen + 1)
+            _END_OP
+        }
+        _OP(OP_LJMP)
+        {
+            _CHECK_BYTES_AVAIL(4)
+            _IP = _NEXT_INT - 1;
+            _END_BLOCK
+            _END_OP
+        }
+        _OP(OP_LCALL)
+        {
+            _CHECK_BYTES_AVAIL(4)
+            this->_registers[RA] = _IP + 5;
+            _IP = _NEXT_INT - 1;
+            _END_BLOCK
+            _END_OP
+        }
+        }
+
+        _IP++;
+        if (checked)
+            instrCount++;
+    }
+
+    _RETURN(ExecResult::VM_PAUSED)
+}
+
+// a program whose memory doesn't have the size Config fixed can't be run,
+// and fails with VM_ERR_INVALID_ADDRESS
+template <class Config>
+ExecResult BasicVM<Config>::run(uint32_t maxInstr)
+{
+    this->_executed = 0;
+    if (Config::memorySize != 0 && this->_memSize != Config::memorySize)
+        return ExecResult::VM_ERR_INVALID_ADDRESS;
+
+    if (this->_verifyStale)
+        this->verify();
+    const bool checked = !this->_verified || !this->_verifiedStart(this->_registers[IP]);
+#ifdef VM_THREADED_DISPATCH
+    const ExecResult res = checked ? this->template _run<Config, true, true>(maxInstr) : this->template _run<Config, true, false>(maxInstr);
+#else
+    const ExecResult res = checked ? this->template _run<Config, false, true>(maxInstr) : this->template _run<Config, false, false>(maxInstr);
+#endif
+    Config::IO::flush(this);
+    return res;
+}
+
+#undef _IP
+#undef _SYNC
+#undef _UNCHARGE
+#undef _RETURN
+#undef _ENTER_BLOCK
+#undef _END_BLOCK
+#undef _NEXT_BYTE
+#undef _NEXT_SHORT
+#undef _NEXT_INT
+#undef _CHECK_ADDR_VALID
+#undef _CHECK_BYTES_AVAIL
+#undef _CHECK_REGISTER_VALID
+#undef _CHECK_CONST_ADDR_VALID
+#undef _CHECK_CAN_PUSH
+#undef _CHECK_CAN_POP
+#undef _CHECK_JUMP_TARGET
+#undef _CHECK_CODE_WRITE
+#undef _CHECK_CONST_CODE_WRITE
+#undef _PROFILE_NEXT
+#undef _PROFILE_END
+#undef _CONTINUE_CHECKED
+#undef _FETCH_INSTR
+#undef _OP
+#undef _DISPATCH
+#undef _END_OP
+
+#endif
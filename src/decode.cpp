@@ -0,0 +1,1473 @@
+#include "decode.h"
+#include "jit.h"
+
+const OperandFormat instrFormat[INSTRUCTION_COUNT] = {
+    FMT_NONE,         // OP_NOP
+    FMT_NONE,         // OP_HALT
+    FMT_C8,           // OP_INT
+    FMT_R_C32,        // OP_LCONS
+    FMT_R_C16,        // OP_LCONSW
+    FMT_R_C8,         // OP_LCONSB
+    FMT_RR,           // OP_MOV
+    FMT_R,            // OP_PUSH
+    FMT_R,            // OP_POP
+    FMT_RR,           // OP_POP2
+    FMT_NONE,         // OP_DUP
+    FMT_C16,          // OP_CALL
+    FMT_NONE,         // OP_RET
+    FMT_C16_R,        // OP_STOR
+    FMT_RR,           // OP_STOR_P
+    FMT_C16_R,        // OP_STORW
+    FMT_RR,           // OP_STORW_P
+    FMT_C16_R,        // OP_STORB
+    FMT_RR,           // OP_STORB_P
+    FMT_R_C16,        // OP_LOAD
+    FMT_RR,           // OP_LOAD_P
+    FMT_R_C16,        // OP_LOADW
+    FMT_RR,           // OP_LOADW_P
+    FMT_R_C16,        // OP_LOADB
+    FMT_RR,           // OP_LOADB_P
+    FMT_C16_C16_C16,  // OP_MEMCPY
+    FMT_RRR,          // OP_MEMCPY_P
+    FMT_R,            // OP_INC
+    FMT_R,            // OP_FINC
+    FMT_R,            // OP_DEC
+    FMT_R,            // OP_FDEC
+    FMT_RRR,          // OP_ADD
+    FMT_RRR,          // OP_FADD
+    FMT_RRR,          // OP_SUB
+    FMT_RRR,          // OP_FSUB
+    FMT_RRR,          // OP_MUL
+    FMT_RRR,          // OP_IMUL
+    FMT_RRR,          // OP_FMUL
+    FMT_RRR,          // OP_DIV
+    FMT_RRR,          // OP_IDIV
+    FMT_RRR,          // OP_FDIV
+    FMT_RRR,          // OP_SHL
+    FMT_RRR,          // OP_SHR
+    FMT_RRR,          // OP_ISHR
+    FMT_RRR,          // OP_MOD
+    FMT_RRR,          // OP_IMOD
+    FMT_RRR,          // OP_AND
+    FMT_RRR,          // OP_OR
+    FMT_RRR,          // OP_XOR
+    FMT_RR,           // OP_NOT
+    FMT_R,            // OP_U2I
+    FMT_R,            // OP_I2U
+    FMT_RR,           // OP_I2F
+    FMT_RR,           // OP_F2I
+    FMT_C16,          // OP_JMP
+    FMT_R,            // OP_JR
+    FMT_R_C16,        // OP_JZ
+    FMT_R_C16,        // OP_JNZ
+    FMT_RR_C16,       // OP_JE
+    FMT_RR_C16,       // OP_JNE
+    FMT_RR_C16,       // OP_JA
+    FMT_RR_C16,       // OP_JG
+    FMT_RR_C16,       // OP_JAE
+    FMT_RR_C16,       // OP_JGE
+    FMT_RR_C16,       // OP_JB
+    FMT_RR_C16,       // OP_JL
+    FMT_RR_C16,       // OP_JBE
+    FMT_RR_C16,       // OP_JLE
+    FMT_R_C8,         // OP_PRINT
+    FMT_R_C8,         // OP_PRINTI
+    FMT_R_C8,         // OP_PRINTF
+    FMT_R,            // OP_PRINTC
+    FMT_C16,          // OP_PRINTS
+    FMT_NONE,         // OP_PRINTLN
+    FMT_R,            // OP_READ
+    FMT_R,            // OP_READI
+    FMT_R,            // OP_READF
+    FMT_R,            // OP_READC
+    FMT_C16_C16,      // OP_READS
+    FMT_C32,          // OP_LJMP
+    FMT_C32,          // OP_LCALL
+};
+
+const uint8_t instrLength[INSTRUCTION_COUNT] = {
+    1,  // OP_NOP
+    1,  // OP_HALT
+    2,  // OP_INT
+    6,  // OP_LCONS
+    4,  // OP_LCONSW
+    3,  // OP_LCONSB
+    3,  // OP_MOV
+    2,  // OP_PUSH
+    2,  // OP_POP
+    3,  // OP_POP2
+    1,  // OP_DUP
+    3,  // OP_CALL
+    1,  // OP_RET
+    4,  // OP_STOR
+    3,  // OP_STOR_P
+    4,  // OP_STORW
+    3,  // OP_STORW_P
+    4,  // OP_STORB
+    3,  // OP_STORB_P
+    4,  // OP_LOAD
+    3,  // OP_LOAD_P
+    4,  // OP_LOADW
+    3,  // OP_LOADW_P
+    4,  // OP_LOADB
+    3,  // OP_LOADB_P
+    7,  // OP_MEMCPY
+    4,  // OP_MEMCPY_P
+    2,  // OP_INC
+    2,  // OP_FINC
+    2,  // OP_DEC
+    2,  // OP_FDEC
+    4,  // OP_ADD
+    4,  // OP_FADD
+    4,  // OP_SUB
+    4,  // OP_FSUB
+    4,  // OP_MUL
+    4,  // OP_IMUL
+    4,  // OP_FMUL
+    4,  // OP_DIV
+    4,  // OP_IDIV
+    4,  // OP_FDIV
+    4,  // OP_SHL
+    4,  // OP_SHR
+    4,  // OP_ISHR
+    4,  // OP_MOD
+    4,  // OP_IMOD
+    4,  // OP_AND
+    4,  // OP_OR
+    4,  // OP_XOR
+    3,  // OP_NOT
+    2,  // OP_U2I
+    2,  // OP_I2U
+    3,  // OP_I2F
+    3,  // OP_F2I
+    3,  // OP_JMP
+    2,  // OP_JR
+    4,  // OP_JZ
+    4,  // OP_JNZ
+    5,  // OP_JE
+    5,  // OP_JNE
+    5,  // OP_JA
+    5,  // OP_JG
+    5,  // OP_JAE
+    5,  // OP_JGE
+    5,  // OP_JB
+    5,  // OP_JL
+    5,  // OP_JBE
+    5,  // OP_JLE
+    3,  // OP_PRINT
+    3,  // OP_PRINTI
+    3,  // OP_PRINTF
+    2,  // OP_PRINTC
+    3,  // OP_PRINTS
+    1,  // OP_PRINTLN
+    2,  // OP_READ
+    2,  // OP_READI
+    2,  // OP_READF
+    2,  // OP_READC
+    5,  // OP_READS
+    5,  // OP_LJMP
+    5,  // OP_LCALL
+};
+
+const char *const instrName[INSTRUCTION_COUNT] = {
+    "nop",
+    "halt",
+    "int",
+    "lcons",
+    "lconsw",
+    "lconsb",
+    "mov",
+    "push",
+    "pop",
+    "pop2",
+    "dup",
+    "call",
+    "ret",
+    "stor",
+    "stor_p",
+    "storw",
+    "storw_p",
+    "storb",
+    "storb_p",
+    "load",
+    "load_p",
+    "loadw",
+    "loadw_p",
+    "loadb",
+    "loadb_p",
+    "memcpy",
+    "memcpy_p",
+    "inc",
+    "finc",
+    "dec",
+    "fdec",
+    "add",
+    "fadd",
+    "sub",
+    "fsub",
+    "mul",
+    "imul",
+    "fmul",
+    "div",
+    "idiv",
+    "fdiv",
+    "shl",
+    "shr",
+    "ishr",
+    "mod",
+    "imod",
+    "and",
+    "or",
+    "xor",
+    "not",
+    "u2i",
+    "i2u",
+    "i2f",
+    "f2i",
+    "jmp",
+    "jr",
+    "jz",
+    "jnz",
+    "je",
+    "jne",
+    "ja",
+    "jg",
+    "jae",
+    "jge",
+    "jb",
+    "jl",
+    "jbe",
+    "jle",
+    "print",
+    "printi",
+    "printf",
+    "printc",
+    "prints",
+    "println",
+    "read",
+    "readi",
+    "readf",
+    "readc",
+    "reads",
+    "ljmp",
+    "lcall",
+};
+
+#define _REGISTER_DECODABLE(r) ((r) < REGISTER_COUNT && (r) != IP)
+
+bool decodeInstr(const uint8_t *code, uint32_t addr, uint32_t codeLen, uint32_t memSize, DecodedInstr &out)
+{
+    const uint8_t instr = code[addr];
+    if (instr >= INSTRUCTION_COUNT)
+        return false;
+
+    const uint8_t len = instrLength[instr];
+    if (addr + len > codeLen)
+        return false;
+
+    const uint8_t *operands = &code[addr + 1];
+    out.op = instr;
+    out.len = len;
+    out.a = out.b = out.c = 0;
+    out.imm = out.imm2 = 0;
+
+    switch (instrFormat[instr])
+    {
+    case FMT_NONE:
+        break;
+    case FMT_R:
+        out.a = operands[0];
+        break;
+    case FMT_RR:
+        out.a = operands[0];
+        out.b = operands[1];
+        break;
+    case FMT_RRR:
+        out.a = operands[0];
+        out.b = operands[1];
+        out.c = operands[2];
+        break;
+    case FMT_C8:
+        out.imm = operands[0];
+        break;
+    case FMT_C16:
+        out.imm = operands[0] | operands[1] << 8;
+        break;
+    case FMT_C32:
+        out.imm = operands[0] | operands[1] << 8 | operands[2] << 16 | (uint32_t)operands[3] << 24;
+        break;
+    case FMT_R_C8:
+        out.a = operands[0];
+        out.imm = operands[1];
+        break;
+    case FMT_R_C16:
+        out.a = operands[0];
+        out.imm = operands[1] | operands[2] << 8;
+        break;
+    case FMT_R_C32:
+        out.a = operands[0];
+        out.imm = operands[1] | operands[2] << 8 | operands[3] << 16 | (uint32_t)operands[4] << 24;
+        break;
+    case FMT_C16_R:
+        out.imm = operands[0] | operands[1] << 8;
+        out.a = operands[2];
+        break;
+    case FMT_RR_C16:
+        out.a = operands[0];
+        out.b = operands[1];
+        out.imm = operands[2] | operands[3] << 8;
+        break;
+    case FMT_C16_C16:
+        out.imm = operands[0] | operands[1] << 8;
+        out.imm2 = operands[2] | operands[3] << 8;
+        break;
+    case FMT_C16_C16_C16:
+        out.imm = operands[0] | operands[1] << 8 | operands[2] << 16 | operands[3] << 24;
+        out.imm2 = operands[4] | operands[5] << 8;
+        break;
+    }
+
+    // IP lives outside the register file while running decoded code
+    if (!_REGISTER_DECODABLE(out.a) || !_REGISTER_DECODABLE(out.b) || !_REGISTER_DECODABLE(out.c))
+        return false;
+
+    // near jumps stay in their 64 KiB page, far ones run like them with a wider target
+    if (instr == OP_JMP || instr == OP_CALL || (instr >= OP_JZ && instr <= OP_JLE))
+        out.imm = VM_NEAR_TARGET(addr, out.imm);
+    else if (instr == OP_LJMP)
+        out.op = OP_JMP;
+    else if (instr == OP_LCALL)
+        out.op = OP_CALL;
+
+    // constant addresses are validated once here
+    switch (instr)
+    {
+    case OP_STOR:
+    case OP_LOAD:
+        return out.imm + 3 < memSize;
+    case OP_STORW:
+    case OP_LOADW:
+        return out.imm + 1 < memSize;
+    case OP_STORB:
+    case OP_LOADB:
+    case OP_PRINTS:
+        return out.imm < memSize;
+    case OP_MEMCPY:
+        return (out.imm >> 16) + out.imm2 - 1 < memSize && (out.imm & 0xFFFF) + out.imm2 - 1 < memSize;
+    case OP_READS:
+        return out.imm + out.imm2 < memSize;
+    }
+
+    return true;
+}
+
+struct FusedPattern
+{
+    uint8_t op;
+    uint8_t count;
+    uint8_t instrs[MAX_FUSED_INSTRS];
+};
+
+// longest patterns first
+static const FusedPattern fusedPatterns[] = {
+    {DOP_LCONSW_SUB_LOAD_P, 3, {OP_LCONSW, OP_SUB, OP_LOAD_P}},
+    {DOP_LCONSW_SUB, 2, {OP_LCONSW, OP_SUB}},
+    {DOP_LOAD_P_PUSH, 2, {OP_LOAD_P, OP_PUSH}},
+    {DOP_LOAD_P_POP, 2, {OP_LOAD_P, OP_POP}},
+    {DOP_MOD_JZ, 2, {OP_MOD, OP_JZ}},
+    {DOP_MOD_JNZ, 2, {OP_MOD, OP_JNZ}},
+    {DOP_INC_JMP, 2, {OP_INC, OP_JMP}},
+    {DOP_INC_JB, 2, {OP_INC, OP_JB}},
+};
+
+void fuseInstr(const uint8_t *code, uint32_t addr, uint32_t codeLen, uint32_t memSize, DecodedInstr *decoded)
+{
+    for (const FusedPattern &pattern : fusedPatterns)
+    {
+        uint32_t next = addr;
+        uint8_t i = 0;
+        for (; i < pattern.count; i++)
+        {
+            if (next >= codeLen || code[next] != pattern.instrs[i])
+                break;
+            next += instrLength[pattern.instrs[i]];
+        }
+        if (i != pattern.count)
+            continue;
+
+        // every instruction after the first must have a valid decoded entry
+        next = addr + decoded[addr].len;
+        for (i = 1; i < pattern.count; i++)
+        {
+            DecodedInstr &entry = decoded[next];
+            if (entry.op == DOP_UNDECODED && !decodeInstr(code, next, codeLen, memSize, entry))
+                entry.op = DOP_FALLBACK;
+            if (entry.op == DOP_FALLBACK)
+                return;
+            next += entry.len;
+        }
+
+        decoded[addr].op = pattern.op;
+        return;
+    }
+}
+
+void decodeProgram(const uint8_t *code, uint32_t codeLen, uint32_t memSize, const uint32_t *roots, uint8_t rootCount,
+                   DecodedInstr *decoded, uint8_t *codeMap)
+{
+    for (uint32_t i = 0; i < codeLen; i++)
+        decoded[i].op = DOP_UNDECODED;
+    decoded[codeLen].op = DOP_FALLBACK;
+    memset(codeMap, 0, codeLen + 4);
+
+    // entries waiting in pending are DOP_FALLBACK until they're decoded
+    uint32_t *pending = new uint32_t[codeLen];
+    uint32_t pendingCount = 0;
+    for (uint8_t i = 0; i < rootCount; i++)
+    {
+        if (roots[i] < codeLen && decoded[roots[i]].op == DOP_UNDECODED)
+        {
+            decoded[roots[i]].op = DOP_FALLBACK;
+            pending[pendingCount++] = roots[i];
+        }
+    }
+
+    // unlike verification, the walk goes on past instructions that can't be
+    // decoded, the byte interpreter runs them and carries on after them
+    while (pendingCount > 0)
+    {
+        const uint32_t addr = pending[--pendingCount];
+        if (!decodeInstr(code, addr, codeLen, memSize, decoded[addr]))
+            decoded[addr].op = DOP_FALLBACK;
+        const uint8_t instr = code[addr];
+        if (instr >= INSTRUCTION_COUNT || addr + instrLength[instr] > codeLen)
+            continue;
+        memset(&codeMap[addr], 1, instrLength[instr]);
+
+        uint32_t successors[2];
+        const uint8_t successorCount = instrSuccessors(code, addr, successors);
+        for (uint8_t i = 0; i < successorCount; i++)
+        {
+            const uint32_t target = successors[i];
+            if (target < codeLen && decoded[target].op == DOP_UNDECODED)
+            {
+                decoded[target].op = DOP_FALLBACK;
+                pending[pendingCount++] = target;
+            }
+        }
+    }
+    delete[] pending;
+
+    for (uint32_t i = 0; i < codeLen; i++)
+    {
+        if (decoded[i].op < INSTRUCTION_COUNT)
+            fuseInstr(code, i, codeLen, memSize, decoded);
+    }
+}
+
+uint32_t decodedSpan(const DecodedInstr *decoded, uint32_t addr)
+{
+    const uint8_t op = decoded[addr].op;
+    if (op < INSTRUCTION_COUNT)
+        return decoded[addr].len;
+    if (op == DOP_FALLBACK)
+        return MAX_INSTR_LEN;
+    for (const FusedPattern &pattern : fusedPatterns)
+    {
+        if (pattern.op != op)
+            continue;
+        uint32_t span = 0;
+        for (uint8_t i = 0; i < pattern.count; i++)
+            span += instrLength[pattern.instrs[i]];
+        return span;
+    }
+    return 0;
+}
+
+#ifndef VM_DISABLE_CHECKS
+#define _DCHECK_ADDR_VALID(a) \
+    if (a >= this->_memSize)  \
+        _DFAIL(ExecResult::VM_ERR_INVALID_ADDRESS)
+#define _DCHECK_CAN_PUSH(n)                                                     \
+    if (this->_registers[SP] < (uint64_t)this->_progLen + n * sizeof(uint32_t)) \
+        _DFAIL(ExecResult::VM_ERR_STACK_OVERFLOW)
+#define _DCHECK_CAN_POP(n)                                                      \
+    if ((uint64_t)this->_registers[SP] + n * sizeof(uint32_t) > this->_memSize) \
+        _DFAIL(ExecResult::VM_ERR_STACK_UNDERFLOW)                              \
+    if (this->_registers[SP] < this->_progLen)                                  \
+        _DFAIL(ExecResult::VM_ERR_STACK_OVERFLOW)
+#else
+#define _DCHECK_ADDR_VALID(a)
+#define _DCHECK_CAN_PUSH(n)
+#define _DCHECK_CAN_POP(n)
+#endif
+
+// current IP, the decoded array is indexed by memory address
+#define _DIP ((uint32_t)(d - this->_decoded))
+
+// every exit adds what this engine ran to the count of the whole run()
+#define _DRETURN(res)                   \
+    {                                   \
+        this->_executed += instrCount;  \
+        return res;                     \
+    }
+
+// runtime errors leave IP on the last operand byte, like the byte interpreter
+#define _DFAIL(err)                                \
+    {                                              \
+        this->_registers[IP] = _DIP + d->len - 1;  \
+        _DRETURN(err)                              \
+    }
+
+#ifdef VM_THREADED_DISPATCH
+#define _DOP(op) _D_##op:
+#define _DDISPATCH goto *decodedTable[d->op];
+#else
+#define _DOP(op) case op:
+#define _DDISPATCH continue;
+#endif
+
+#define _DCOUNT(ip)                              \
+    instrCount++;                                \
+    if (maxInstr != 0 && instrCount >= maxInstr) \
+    {                                            \
+        this->_registers[IP] = ip;               \
+        _DRETURN(ExecResult::VM_PAUSED)          \
+    }
+
+// handlers advance by a constant so the next fetch doesn't wait on a load
+#define _DNEXT(len) \
+    d += len;       \
+    _DCOUNT(_DIP)   \
+    _DDISPATCH
+
+// superinstructions of n instructions only run if the whole sequence fits in
+// the instruction budget, otherwise the first instruction is stepped on its own
+#define _DFUSED(n)                                          \
+    if (maxInstr != 0 && maxInstr - instrCount < n)         \
+        goto fallback;
+
+// move on to the next instruction of a superinstruction
+#define _DFUSE(len) \
+    d += len;       \
+    instrCount++;
+
+// jump targets are where blocks start, so that's where the JIT counts, and
+// jumping backwards to one means it's the head of a loop
+#ifdef VM_JIT
+#define _DJIT_COUNT(addr)                                  \
+    if (this->_jit != nullptr && this->_jit->hot(addr))    \
+        this->_compileJit(addr, addr <= _DIP);
+#else
+#define _DJIT_COUNT(addr)
+#endif
+
+#define _DJUMP(addr)                                       \
+    {                                                      \
+        const uint32_t target = addr;                      \
+        _DCOUNT(target)                                    \
+        if (target >= this->_codeLen)                      \
+        {                                                  \
+            this->_registers[IP] = target;                 \
+            goto outside;                                  \
+        }                                                  \
+        _DJIT_COUNT(target)                                \
+        d = &this->_decoded[target];                       \
+        _DDISPATCH                                         \
+    }
+
+// the first write to code gives the VM its own decoded instructions, d moves
+// over to them
+#define _DINVALIDATE(addr, len)                   \
+    {                                             \
+        const uint32_t here = _DIP;               \
+        this->_invalidateDecoded(addr, len);      \
+        d = &this->_decoded[here];                \
+    }
+
+// whether a store of a T at addr (inside the code) hits anything in the code
+// map, which has 4 zero bytes past the end for reading all of it at once
+template <typename T>
+static inline bool storesCode(const uint8_t *codeMap, uint32_t addr)
+{
+    T mapped;
+    memcpy(&mapped, &codeMap[addr], sizeof(T));
+    return mapped != 0;
+}
+
+// stores into decoded code, or anywhere a compiled program may have come
+// from. Stores to data kept in the program cost no more than stack stores
+#define _DSTORED(addr, T)                                                   \
+    if (((addr) < this->_codeLen && storesCode<T>(this->_codeMap, addr)) || \
+        ((addr) < this->_progLen && this->_compiled != nullptr))            \
+        _DINVALIDATE(addr, sizeof(T))
+#define _DSTORED_RANGE(addr, len)                                     \
+    if (((addr) < this->_codeLen && this->_decodedCode(addr, len)) || \
+        ((addr) < this->_progLen && this->_compiled != nullptr))      \
+        _DINVALIDATE(addr, len)
+
+#define _DJUMP_IF(len, cond) \
+    if (cond)                \
+        _DJUMP(d->imm)       \
+    _DNEXT(len)
+
+// Where the instruction at ip will write to memory, if it does, worked out
+// before the byte interpreter steps through it: registers are read after the
+// operands, so IP as an operand is the address of the last one
+static bool writeRange(const uint8_t *mem, uint32_t memSize, const uint32_t *regs, uint32_t ip, uint32_t &addr, uint32_t &len)
+{
+    if (ip >= memSize)
+        return false;
+    const uint8_t instr = mem[ip];
+    if (instr >= INSTRUCTION_COUNT || (uint64_t)ip + instrLength[instr] > memSize)
+        return false;
+    const uint8_t *operands = &mem[ip + 1];
+    const uint32_t last = ip + instrLength[instr] - 1;
+    switch (instr)
+    {
+    case OP_STOR:
+    case OP_STORW:
+    case OP_STORB:
+        addr = operands[0] | operands[1] << 8;
+        len = instr == OP_STOR ? 4 : instr == OP_STORW ? 2 : 1;
+        return true;
+    case OP_STOR_P:
+    case OP_STORW_P:
+    case OP_STORB_P:
+        if (operands[0] >= REGISTER_COUNT)
+            return false;
+        addr = operands[0] == IP ? last : regs[operands[0]];
+        len = instr == OP_STOR_P ? 4 : instr == OP_STORW_P ? 2 : 1;
+        return true;
+    case OP_MEMCPY:
+        addr = operands[0] | operands[1] << 8;
+        len = operands[4] | operands[5] << 8;
+        return true;
+    case OP_MEMCPY_P:
+        if (operands[0] >= REGISTER_COUNT || operands[2] >= REGISTER_COUNT)
+            return false;
+        addr = operands[0] == IP ? last : regs[operands[0]];
+        len = operands[2] == IP ? last : regs[operands[2]];
+        return true;
+    case OP_READS:
+        addr = operands[0] | operands[1] << 8;
+        len = (operands[2] | operands[3] << 8) + 1;
+        return true;
+    default:
+        return false;
+    }
+}
+
+void VM::_invalidateDecoded(uint32_t addr, uint32_t len)
+{
+    if (addr >= this->_progLen)
+        return;
+
+    // writes to data kept in the program are fine, writes to code aren't
+    if (this->_compiled != nullptr)
+    {
+        for (uint32_t i = addr; i < addr + len && i < this->_progLen; i++)
+        {
+            if (this->_compiled->codeMap[i / 8] & (1 << (i % 8)))
+            {
+                this->_compiled = nullptr;
+                break;
+            }
+        }
+    }
+
+    // verified code is decoded too, so nothing else can have gone stale
+    if (!this->_decodedCode(addr, len))
+        return;
+    this->_unverify(addr, len);
+    this->_ownDecoded();
+
+#ifdef VM_JIT
+    // native blocks can be much longer than a superinstruction
+    if (this->_jit != nullptr)
+        this->_jit->invalidate(addr, len, this->_decoded);
+#endif
+
+    // an instruction (or superinstruction) starting up to MAX_FUSED_LEN - 1
+    // bytes earlier may cover addr, but only the ones that reach it go
+    uint32_t from = addr >= MAX_FUSED_LEN - 1 ? addr - (MAX_FUSED_LEN - 1) : 0;
+    uint32_t to = addr + len < this->_codeLen ? addr + len : this->_codeLen;
+    for (uint32_t i = from; i < to; i++)
+    {
+        if (i >= addr || i + decodedSpan(this->_decoded, i) > addr)
+            this->_decoded[i].op = DOP_UNDECODED;
+    }
+}
+
+// whether a write to addr hits code that was decoded, compiled or verified
+bool VM::_decodedCode(uint32_t addr, uint32_t len)
+{
+    const uint32_t to = addr + len < this->_codeLen ? addr + len : this->_codeLen;
+    for (uint32_t i = addr; i < to; i++)
+        if (this->_codeMap[i])
+            return true;
+    return false;
+}
+
+// an instruction the program's walk didn't reach (through an indirect jump),
+// or one a write invalidated, decoded in this VM's own entries
+void VM::_decodeAt(uint32_t addr)
+{
+    this->_ownDecoded();
+    if (decodeInstr(this->_memory, addr, this->_codeLen, this->_memSize, this->_decoded[addr]))
+    {
+        fuseInstr(this->_memory, addr, this->_codeLen, this->_memSize, this->_decoded);
+        this->_markCode(addr, decodedSpan(this->_decoded, addr));
+    }
+    else
+        this->_decoded[addr].op = DOP_FALLBACK;
+}
+
+void VM::_markCode(uint32_t addr, uint32_t len)
+{
+    const uint32_t to = addr + len < this->_codeLen ? addr + len : this->_codeLen;
+    if (addr < to)
+        memset(&this->_codeMap[addr], 1, to - addr);
+#ifdef VM_JIT
+    if (this->_jit != nullptr)
+        this->_jit->markCode(addr, len, this->_decoded);
+#endif
+}
+
+// forgets the decoded instructions and native code, the next run shares the
+// program's again if the code is still the same, or decodes its own
+void VM::_resetDecoded()
+{
+#ifdef VM_JIT
+    if (this->_jit != nullptr)
+        this->_jit->reset();
+#endif
+    if (this->_ownsDecoded)
+    {
+        delete[] this->_decoded;
+        delete[] this->_codeMap;
+        this->_ownsDecoded = false;
+    }
+    this->_decoded = nullptr;
+    this->_codeMap = nullptr;
+}
+
+// a copy of the program's decoded instructions (or its own, decoded from
+// memory) this VM can change, once it writes to its code
+void VM::_ownDecoded()
+{
+    if (this->_ownsDecoded)
+        return;
+    const DecodedInstr *shared = this->_decoded;
+    const uint8_t *sharedMap = this->_codeMap;
+    this->_decoded = new DecodedInstr[this->_codeLen + 1];
+    this->_codeMap = new uint8_t[this->_codeLen + 4];
+    this->_ownsDecoded = true;
+    if (shared != nullptr)
+    {
+        memcpy(this->_decoded, shared, (this->_codeLen + 1) * sizeof(DecodedInstr));
+        memcpy(this->_codeMap, sharedMap, this->_codeLen + 4);
+    }
+    else
+    {
+        const uint32_t roots[] = {this->_program->_registers[IP], this->_program->_entry};
+        decodeProgram(this->_memory, this->_codeLen, this->_memSize, roots, 2, this->_decoded, this->_codeMap);
+    }
+}
+
+// as long as the code is the program's, so are its decoded instructions
+void VM::_useDecoded()
+{
+    if (this->_decoded != nullptr)
+        return;
+    if (memcmp(this->_memory, this->_program->_code, this->_codeLen) == 0)
+    {
+        this->_decoded = this->_program->_decodedInstrs();
+        this->_codeMap = this->_program->_codeMap;
+    }
+    else
+        this->_ownDecoded();
+}
+
+VM_DISPATCH_ATTR ExecResult VM::_runDecoded(uint32_t maxInstr)
+{
+#ifdef VM_THREADED_DISPATCH
+    // must follow the order of the Instruction and DecodedOp enums
+    static const void *const decodedTable[DECODED_OP_COUNT] = {
+        &&_D_OP_NOP,
+        &&_D_OP_HALT,
+        &&_D_OP_INT,
+        &&_D_OP_LCONS,
+        &&_D_OP_LCONSW,
+        &&_D_OP_LCONSB,
+        &&_D_OP_MOV,
+        &&_D_OP_PUSH,
+        &&_D_OP_POP,
+        &&_D_OP_POP2,
+        &&_D_OP_DUP,
+        &&_D_OP_CALL,
+        &&_D_OP_RET,
+        &&_D_OP_STOR,
+        &&_D_OP_STOR_P,
+        &&_D_OP_STORW,
+        &&_D_OP_STORW_P,
+        &&_D_OP_STORB,
+        &&_D_OP_STORB_P,
+        &&_D_OP_LOAD,
+        &&_D_OP_LOAD_P,
+        &&_D_OP_LOADW,
+        &&_D_OP_LOADW_P,
+        &&_D_OP_LOADB,
+        &&_D_OP_LOADB_P,
+        &&_D_OP_MEMCPY,
+        &&_D_OP_MEMCPY_P,
+        &&_D_OP_INC,
+        &&_D_OP_FINC,
+        &&_D_OP_DEC,
+        &&_D_OP_FDEC,
+        &&_D_OP_ADD,
+        &&_D_OP_FADD,
+        &&_D_OP_SUB,
+        &&_D_OP_FSUB,
+        &&_D_OP_MUL,
+        &&_D_OP_IMUL,
+        &&_D_OP_FMUL,
+        &&_D_OP_DIV,
+        &&_D_OP_IDIV,
+        &&_D_OP_FDIV,
+        &&_D_OP_SHL,
+        &&_D_OP_SHR,
+        &&_D_OP_ISHR,
+        &&_D_OP_MOD,
+        &&_D_OP_IMOD,
+        &&_D_OP_AND,
+        &&_D_OP_OR,
+        &&_D_OP_XOR,
+        &&_D_OP_NOT,
+        &&_D_OP_U2I,
+        &&_D_OP_I2U,
+        &&_D_OP_I2F,
+        &&_D_OP_F2I,
+        &&_D_OP_JMP,
+        &&_D_OP_JR,
+        &&_D_OP_JZ,
+        &&_D_OP_JNZ,
+        &&_D_OP_JE,
+        &&_D_OP_JNE,
+        &&_D_OP_JA,
+        &&_D_OP_JG,
+        &&_D_OP_JAE,
+        &&_D_OP_JGE,
+        &&_D_OP_JB,
+        &&_D_OP_JL,
+        &&_D_OP_JBE,
+        &&_D_OP_JLE,
+        &&_D_OP_PRINT,
+        &&_D_OP_PRINTI,
+        &&_D_OP_PRINTF,
+        &&_D_OP_PRINTC,
+        &&_D_OP_PRINTS,
+        &&_D_OP_PRINTLN,
+        &&_D_OP_READ,
+        &&_D_OP_READI,
+        &&_D_OP_READF,
+        &&_D_OP_READC,
+        &&_D_OP_READS,
+        &&_D_DOP_FALLBACK, // OP_LJMP, decoded as OP_JMP
+        &&_D_DOP_FALLBACK, // OP_LCALL, decoded as OP_CALL
+        &&_D_DOP_UNDECODED,
+        &&_D_DOP_FALLBACK,
+        &&_D_DOP_JIT,
+        &&_D_DOP_LCONSW_SUB_LOAD_P,
+        &&_D_DOP_LCONSW_SUB,
+        &&_D_DOP_LOAD_P_PUSH,
+        &&_D_DOP_LOAD_P_POP,
+        &&_D_DOP_MOD_JZ,
+        &&_D_DOP_MOD_JNZ,
+        &&_D_DOP_INC_JMP,
+        &&_D_DOP_INC_JB};
+#endif
+
+    this->_useDecoded();
+
+    uint32_t instrCount = 0;
+    const DecodedInstr *d = &this->_decoded[this->_codeLen];
+    if (this->_registers[IP] >= this->_codeLen)
+        goto outside;
+    d = &this->_decoded[this->_registers[IP]];
+
+#ifdef VM_THREADED_DISPATCH
+    _DDISPATCH
+#else
+    for (;;)
+    {
+        switch (d->op)
+        {
+#endif
+    _DOP(DOP_UNDECODED)
+    {
+        const uint32_t here = _DIP;
+        this->_decodeAt(here);
+        d = &this->_decoded[here];
+        _DDISPATCH
+    }
+    _DOP(DOP_FALLBACK)
+    fallback:
+        this->_registers[IP] = _DIP;
+    // code outside the program isn't decoded, IP is already set
+    outside:
+    {
+        // what the step writes to code mustn't be run from stale decoded
+        // instructions or native blocks
+        uint32_t dest, len;
+        const bool writes = writeRange(this->_memory, this->_memSize, this->_registers, this->_registers[IP], dest, len);
+        const ExecResult res = this->_step();
+        if (res != ExecResult::VM_PAUSED)
+            _DRETURN(res)
+        // an interrupt handler may have patched code through memory()
+        this->_useDecoded();
+        if (writes && len != 0)
+            this->_invalidateDecoded(dest, len);
+        _DJUMP(this->_registers[IP])
+    }
+    _DOP(DOP_JIT)
+    {
+#ifdef VM_JIT
+        // the block only runs if all of it fits in the budget, it stops early
+        // (before anything it can't do natively) and reports how far it got
+        const JitBlock *block = this->_jit->blockAt(_DIP);
+        const uint32_t budget = maxInstr == 0 ? UINT32_MAX : maxInstr - instrCount;
+        if (block->count <= budget)
+        {
+            const uint64_t exit = block->fn(this->_registers, this->_memory, budget);
+            const uint32_t executed = exit >> 32;
+            if (executed != 0)
+            {
+                instrCount += executed - 1;
+                _DJUMP((uint32_t)exit)
+            }
+        }
+#endif
+        goto fallback;
+    }
+    _DOP(DOP_LCONSW_SUB_LOAD_P)
+    {
+        _DFUSED(3)
+        this->_registers[d->a] = d->imm;
+        _DFUSE(4)
+        this->_registers[d->a] = this->_registers[d->b] - this->_registers[d->c];
+        _DFUSE(4)
+        const uint32_t src = this->_registers[d->b];
+        _DCHECK_ADDR_VALID((uint64_t)src + 3)
+        memcpy(&this->_registers[d->a], &this->_memory[src], sizeof(uint32_t));
+        _DNEXT(3)
+    }
+    _DOP(DOP_LCONSW_SUB)
+    {
+        _DFUSED(2)
+        this->_registers[d->a] = d->imm;
+        _DFUSE(4)
+        this->_registers[d->a] = this->_registers[d->b] - this->_registers[d->c];
+        _DNEXT(4)
+    }
+    _DOP(DOP_LOAD_P_PUSH)
+    {
+        _DFUSED(2)
+        const uint32_t src = this->_registers[d->b];
+        _DCHECK_ADDR_VALID((uint64_t)src + 3)
+        memcpy(&this->_registers[d->a], &this->_memory[src], sizeof(uint32_t));
+        _DFUSE(3)
+        _DCHECK_CAN_PUSH(1)
+        this->_registers[SP] -= 4;
+        memcpy(&this->_memory[this->_registers[SP]], &this->_registers[d->a], sizeof(uint32_t));
+        _DNEXT(2)
+    }
+    _DOP(DOP_LOAD_P_POP)
+    {
+        _DFUSED(2)
+        const uint32_t src = this->_registers[d->b];
+        _DCHECK_ADDR_VALID((uint64_t)src + 3)
+        memcpy(&this->_registers[d->a], &this->_memory[src], sizeof(uint32_t));
+        _DFUSE(3)
+        _DCHECK_CAN_POP(1)
+        memcpy(&this->_registers[d->a], &this->_memory[this->_registers[SP]], sizeof(uint32_t));
+        this->_registers[SP] += 4;
+        _DNEXT(2)
+    }
+    _DOP(DOP_MOD_JZ)
+    {
+        _DFUSED(2)
+        this->_registers[d->a] = this->_registers[d->b] % this->_registers[d->c];
+        _DFUSE(4)
+        _DJUMP_IF(4, this->_registers[d->a] == 0)
+    }
+    _DOP(DOP_MOD_JNZ)
+    {
+        _DFUSED(2)
+        this->_registers[d->a] = this->_registers[d->b] % this->_registers[d->c];
+        _DFUSE(4)
+        _DJUMP_IF(4, this->_registers[d->a] != 0)
+    }
+    _DOP(DOP_INC_JMP)
+    {
+        _DFUSED(2)
+        this->_registers[d->a]++;
+        _DFUSE(2)
+        _DJUMP(d->imm)
+    }
+    _DOP(DOP_INC_JB)
+    {
+        _DFUSED(2)
+        this->_registers[d->a]++;
+        _DFUSE(2)
+        _DJUMP_IF(5, this->_registers[d->a] < this->_registers[d->b])
+    }
+    _DOP(OP_NOP)
+    {
+        _DNEXT(1)
+    }
+    _DOP(OP_HALT)
+    {
+        this->_registers[IP] = _DIP;
+        _DRETURN(ExecResult::VM_FINISHED)
+    }
+    _DOP(OP_INT)
+    {
+        // handlers that only touch registers can't have moved IP or changed
+        // the code
+        if (this->_interrupts != nullptr && this->_interrupts[d->imm].registers != nullptr)
+        {
+            this->_interrupts[d->imm].registers(this->_registers, this->_interrupts[d->imm].context);
+            _DJUMP(_DIP + 2)
+        }
+        if (!this->_handlesInterrupt(d->imm))
+            _DFAIL(ExecResult::VM_ERR_UNHANDLED_INTERRUPT)
+        this->_registers[IP] = _DIP + 1;
+        const InterruptResult result = this->_interrupt(d->imm);
+        if (result == VM_INT_FINISH)
+            _DRETURN(ExecResult::VM_FINISHED)
+        // the handler may have moved IP or patched code through memory()
+        this->_useDecoded();
+        if (result == VM_INT_WAIT)
+        {
+            this->_registers[IP]++;
+            instrCount++;
+            _DRETURN(ExecResult::VM_WAITING)
+        }
+        _DJUMP(this->_registers[IP] + 1)
+    }
+    _DOP(OP_MOV)
+    {
+        this->_registers[d->a] = this->_registers[d->b];
+        _DNEXT(3)
+    }
+    _DOP(OP_LCONS)
+    {
+        this->_registers[d->a] = d->imm;
+        _DNEXT(6)
+    }
+    _DOP(OP_LCONSW)
+    {
+        this->_registers[d->a] = d->imm;
+        _DNEXT(4)
+    }
+    _DOP(OP_LCONSB)
+    {
+        this->_registers[d->a] = d->imm;
+        _DNEXT(3)
+    }
+    _DOP(OP_PUSH)
+    {
+        _DCHECK_CAN_PUSH(1)
+        this->_registers[SP] -= 4;
+        memcpy(&this->_memory[this->_registers[SP]], &this->_registers[d->a], sizeof(uint32_t));
+        _DNEXT(2)
+    }
+    _DOP(OP_POP)
+    {
+        _DCHECK_CAN_POP(1)
+        memcpy(&this->_registers[d->a], &this->_memory[this->_registers[SP]], sizeof(uint32_t));
+        this->_registers[SP] += 4;
+        _DNEXT(2)
+    }
+    _DOP(OP_POP2)
+    {
+        _DCHECK_CAN_POP(2)
+        memcpy(&this->_registers[d->a], &this->_memory[this->_registers[SP]], sizeof(uint32_t));
+        this->_registers[SP] += 4;
+        memcpy(&this->_registers[d->b], &this->_memory[this->_registers[SP]], sizeof(uint32_t));
+        this->_registers[SP] += 4;
+        _DNEXT(3)
+    }
+    _DOP(OP_DUP)
+    {
+        _DCHECK_CAN_POP(1)
+        _DCHECK_CAN_PUSH(1)
+        this->_registers[SP] -= 4;
+        memcpy(&this->_memory[this->_registers[SP]], &this->_memory[this->_registers[SP]] + 4, sizeof(uint32_t));
+        _DNEXT(1)
+    }
+    _DOP(OP_CALL)
+    {
+        this->_registers[RA] = _DIP + d->len;
+        _DJUMP(d->imm)
+    }
+    _DOP(OP_RET)
+    {
+        _DJUMP(this->_registers[RA])
+    }
+    _DOP(OP_STOR)
+    {
+        memcpy(&this->_memory[d->imm], &this->_registers[d->a], sizeof(uint32_t));
+        _DSTORED(d->imm, uint32_t)
+        _DNEXT(4)
+    }
+    _DOP(OP_STOR_P)
+    {
+        const uint32_t dest = this->_registers[d->a];
+        _DCHECK_ADDR_VALID((uint64_t)dest + 3)
+        memcpy(&this->_memory[dest], &this->_registers[d->b], sizeof(uint32_t));
+        _DSTORED(dest, uint32_t)
+        _DNEXT(3)
+    }
+    _DOP(OP_STORW)
+    {
+        memcpy(&this->_memory[d->imm], &this->_registers[d->a], sizeof(uint16_t));
+        _DSTORED(d->imm, uint16_t)
+        _DNEXT(4)
+    }
+    _DOP(OP_STORW_P)
+    {
+        const uint32_t dest = this->_registers[d->a];
+        _DCHECK_ADDR_VALID((uint64_t)dest + 1)
+        memcpy(&this->_memory[dest], &this->_registers[d->b], sizeof(uint16_t));
+        _DSTORED(dest, uint16_t)
+        _DNEXT(3)
+    }
+    _DOP(OP_STORB)
+    {
+        memcpy(&this->_memory[d->imm], &this->_registers[d->a], sizeof(uint8_t));
+        _DSTORED(d->imm, uint8_t)
+        _DNEXT(4)
+    }
+    _DOP(OP_STORB_P)
+    {
+        const uint32_t dest = this->_registers[d->a];
+        _DCHECK_ADDR_VALID((uint64_t)dest)
+        memcpy(&this->_memory[dest], &this->_registers[d->b], sizeof(uint8_t));
+        _DSTORED(dest, uint8_t)
+        _DNEXT(3)
+    }
+    _DOP(OP_LOAD)
+    {
+        memcpy(&this->_registers[d->a], &this->_memory[d->imm], sizeof(uint32_t));
+        _DNEXT(4)
+    }
+    _DOP(OP_LOAD_P)
+    {
+        const uint32_t src = this->_registers[d->b];
+        _DCHECK_ADDR_VALID((uint64_t)src + 3)
+        memcpy(&this->_registers[d->a], &this->_memory[src], sizeof(uint32_t));
+        _DNEXT(3)
+    }
+    _DOP(OP_LOADW)
+    {
+        this->_registers[d->a] = 0;
+        memcpy(&this->_registers[d->a], &this->_memory[d->imm], sizeof(uint16_t));
+        _DNEXT(4)
+    }
+    _DOP(OP_LOADW_P)
+    {
+        const uint32_t src = this->_registers[d->b];
+        _DCHECK_ADDR_VALID((uint64_t)src + 1)
+        this->_registers[d->a] = 0;
+        memcpy(&this->_registers[d->a], &this->_memory[src], sizeof(uint16_t));
+        _DNEXT(3)
+    }
+    _DOP(OP_LOADB)
+    {
+        this->_registers[d->a] = this->_memory[d->imm];
+        _DNEXT(4)
+    }
+    _DOP(OP_LOADB_P)
+    {
+        const uint32_t src = this->_registers[d->b];
+        _DCHECK_ADDR_VALID((uint64_t)src)
+        this->_registers[d->a] = this->_memory[src];
+        _DNEXT(3)
+    }
+    _DOP(OP_MEMCPY)
+    {
+        const uint16_t dest = d->imm & 0xFFFF;
+        memcpy(&this->_memory[dest], &this->_memory[d->imm >> 16], d->imm2);
+        _DSTORED_RANGE(dest, d->imm2)
+        _DNEXT(7)
+    }
+    _DOP(OP_MEMCPY_P)
+    {
+        const uint32_t dest = this->_registers[d->a];
+        const uint32_t source = this->_registers[d->b];
+        const uint32_t bytes = this->_registers[d->c];
+        _DCHECK_ADDR_VALID((uint64_t)source + bytes - 1)
+        _DCHECK_ADDR_VALID((uint64_t)dest + bytes - 1)
+        memcpy(&this->_memory[dest], &this->_memory[source], bytes);
+        _DSTORED_RANGE(dest, bytes)
+        _DNEXT(4)
+    }
+    _DOP(OP_INC)
+    {
+        this->_registers[d->a]++;
+        _DNEXT(2)
+    }
+    _DOP(OP_FINC)
+    {
+        (*((float *)&this->_registers[d->a]))++;
+        _DNEXT(2)
+    }
+    _DOP(OP_DEC)
+    {
+        this->_registers[d->a]--;
+        _DNEXT(2)
+    }
+    _DOP(OP_FDEC)
+    {
+        (*((float *)&this->_registers[d->a]))--;
+        _DNEXT(2)
+    }
+    _DOP(OP_ADD)
+    {
+        this->_registers[d->a] = this->_registers[d->b] + this->_registers[d->c];
+        _DNEXT(4)
+    }
+    _DOP(OP_FADD)
+    {
+        *((float *)&this->_registers[d->a]) = floatAdd(*((float *)&this->_registers[d->b]), *((float *)&this->_registers[d->c]));
+        _DNEXT(4)
+    }
+    _DOP(OP_SUB)
+    {
+        this->_registers[d->a] = this->_registers[d->b] - this->_registers[d->c];
+        _DNEXT(4)
+    }
+    _DOP(OP_FSUB)
+    {
+        *((float *)&this->_registers[d->a]) = *((float *)&this->_registers[d->b]) - *((float *)&this->_registers[d->c]);
+        _DNEXT(4)
+    }
+    _DOP(OP_MUL)
+    {
+        this->_registers[d->a] = this->_registers[d->b] * this->_registers[d->c];
+        _DNEXT(4)
+    }
+    _DOP(OP_IMUL)
+    {
+        *((int32_t *)&this->_registers[d->a]) = *((int32_t *)&this->_registers[d->b]) * *((int32_t *)&this->_registers[d->c]);
+        _DNEXT(4)
+    }
+    _DOP(OP_FMUL)
+    {
+        *((float *)&this->_registers[d->a]) = floatMul(*((float *)&this->_registers[d->b]), *((float *)&this->_registers[d->c]));
+        _DNEXT(4)
+    }
+    _DOP(OP_DIV)
+    {
+        this->_registers[d->a] = this->_registers[d->b] / this->_registers[d->c];
+        _DNEXT(4)
+    }
+    _DOP(OP_IDIV)
+    {
+        *((int32_t *)&this->_registers[d->a]) = *((int32_t *)&this->_registers[d->b]) / *((int32_t *)&this->_registers[d->c]);
+        _DNEXT(4)
+    }
+    _DOP(OP_FDIV)
+    {
+        *((float *)&this->_registers[d->a]) = *((float *)&this->_registers[d->b]) / *((float *)&this->_registers[d->c]);
+        _DNEXT(4)
+    }
+    _DOP(OP_SHL)
+    {
+        this->_registers[d->a] = this->_registers[d->b] << this->_registers[d->c];
+        _DNEXT(4)
+    }
+    _DOP(OP_SHR)
+    {
+        this->_registers[d->a] = this->_registers[d->b] >> this->_registers[d->c];
+        _DNEXT(4)
+    }
+    _DOP(OP_ISHR)
+    {
+        *((int32_t *)&this->_registers[d->a]) = *((int32_t *)&this->_registers[d->b]) >> *((int32_t *)&this->_registers[d->c]);
+        _DNEXT(4)
+    }
+    _DOP(OP_MOD)
+    {
+        this->_registers[d->a] = this->_registers[d->b] % this->_registers[d->c];
+        _DNEXT(4)
+    }
+    _DOP(OP_IMOD)
+    {
+        *((int32_t *)&this->_registers[d->a]) = *((int32_t *)&this->_registers[d->b]) % *((int32_t *)&this->_registers[d->c]);
+        _DNEXT(4)
+    }
+    _DOP(OP_AND)
+    {
+        this->_registers[d->a] = this->_registers[d->b] & this->_registers[d->c];
+        _DNEXT(4)
+    }
+    _DOP(OP_OR)
+    {
+        this->_registers[d->a] = this->_registers[d->b] | this->_registers[d->c];
+        _DNEXT(4)
+    }
+    _DOP(OP_XOR)
+    {
+        this->_registers[d->a] = this->_registers[d->b] ^ this->_registers[d->c];
+        _DNEXT(4)
+    }
+    _DOP(OP_NOT)
+    {
+        this->_registers[d->a] = ~this->_registers[d->b];
+        _DNEXT(3)
+    }
+    _DOP(OP_U2I)
+    {
+        *((int32_t *)&this->_registers[d->a]) = this->_registers[d->a];
+        _DNEXT(2)
+    }
+    _DOP(OP_I2U)
+    {
+        this->_registers[d->a] = *((int32_t *)&this->_registers[d->a]);
+        _DNEXT(2)
+    }
+    _DOP(OP_I2F)
+    {
+        *((float *)&this->_registers[d->a]) = (float)*((int32_t *)&this->_registers[d->b]);
+        _DNEXT(3)
+    }
+    _DOP(OP_F2I)
+    {
+        *((int32_t *)&this->_registers[d->a]) = (int32_t) * ((float *)&this->_registers[d->b]);
+        _DNEXT(3)
+    }
+    _DOP(OP_JMP)
+    {
+        _DJUMP(d->imm)
+    }
+    _DOP(OP_JR)
+    {
+        _DJUMP(this->_registers[d->a])
+    }
+    _DOP(OP_JZ)
+    {
+        _DJUMP_IF(4, this->_registers[d->a] == 0)
+    }
+    _DOP(OP_JNZ)
+    {
+        _DJUMP_IF(4, this->_registers[d->a] != 0)
+    }
+    _DOP(OP_JE)
+    {
+        _DJUMP_IF(5, this->_registers[d->a] == this->_registers[d->b])
+    }
+    _DOP(OP_JNE)
+    {
+        _DJUMP_IF(5, this->_registers[d->a] != this->_registers[d->b])
+    }
+    _DOP(OP_JA)
+    {
+        _DJUMP_IF(5, this->_registers[d->a] > this->_registers[d->b])
+    }
+    _DOP(OP_JG)
+    {
+        _DJUMP_IF(5, *((int32_t *)&this->_registers[d->a]) > *((int32_t *)&this->_registers[d->b]))
+    }
+    _DOP(OP_JAE)
+    {
+        _DJUMP_IF(5, this->_registers[d->a] >= this->_registers[d->b])
+    }
+    _DOP(OP_JGE)
+    {
+        _DJUMP_IF(5, *((int32_t *)&this->_registers[d->a]) >= *((int32_t *)&this->_registers[d->b]))
+    }
+    _DOP(OP_JB)
+    {
+        _DJUMP_IF(5, this->_registers[d->a] < this->_registers[d->b])
+    }
+    _DOP(OP_JL)
+    {
+        _DJUMP_IF(5, *((int32_t *)&this->_registers[d->a]) < *((int32_t *)&this->_registers[d->b]))
+    }
+    _DOP(OP_JBE)
+    {
+        _DJUMP_IF(5, this->_registers[d->a] <= this->_registers[d->b])
+    }
+    _DOP(OP_JLE)
+    {
+        _DJUMP_IF(5, *((int32_t *)&this->_registers[d->a]) <= *((int32_t *)&this->_registers[d->b]))
+    }
+    _DOP(OP_PRINT)
+    {
+        this->_outputValue(OP_PRINT, this->_registers[d->a], d->imm != 0);
+        _DNEXT(3)
+    }
+    _DOP(OP_PRINTI)
+    {
+        this->_outputValue(OP_PRINTI, this->_registers[d->a], d->imm != 0);
+        _DNEXT(3)
+    }
+    _DOP(OP_PRINTF)
+    {
+        this->_outputValue(OP_PRINTF, this->_registers[d->a], d->imm != 0);
+        _DNEXT(3)
+    }
+    _DOP(OP_PRINTC)
+    {
+        this->_outputChar(*(char *)&this->_registers[d->a]);
+        _DNEXT(2)
+    }
+    _DOP(OP_PRINTS)
+    {
+        // strings running off the end of memory are printed up to there
+        const char *str = (char *)&this->_memory[d->imm];
+        const char *end = (char *)memchr(str, '\0', this->_memSize - d->imm);
+        this->_output(str, end != nullptr ? end - str : this->_memSize - d->imm);
+        if (end == nullptr)
+            _DCHECK_ADDR_VALID(this->_memSize)
+        _DNEXT(3)
+    }
+    _DOP(OP_PRINTLN)
+    {
+        this->_outputChar('\n');
+        _DNEXT(1)
+    }
+    _DOP(OP_READ)
+    {
+        this->_readInteger(this->_registers[d->a]);
+        _DNEXT(2)
+    }
+    _DOP(OP_READI)
+    {
+        this->_readInteger(this->_registers[d->a]);
+        _DNEXT(2)
+    }
+    _DOP(OP_READF)
+    {
+        this->_readFloat(*(float *)&this->_registers[d->a]);
+        _DNEXT(2)
+    }
+    _DOP(OP_READC)
+    {
+        this->_registers[d->a] = this->_readChar();
+        _DNEXT(2)
+    }
+    _DOP(OP_READS)
+    {
+        this->_readLine((char *)&this->_memory[d->imm], d->imm2);
+        _DSTORED_RANGE(d->imm, d->imm2 + 1)
+        _DNEXT(5)
+    }
+#ifndef VM_THREADED_DISPATCH
+        }
+    }
+#endif
+}
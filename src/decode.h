@@ -0,0 +1,97 @@
+#ifndef __DECODE_H__
+#define __DECODE_H__
+
+#include "vm.h"
+
+// longest encoded instruction (memcpy with three 16-bit operands)
+#define MAX_INSTR_LEN 7
+// longest superinstruction, in instructions and in bytes
+#define MAX_FUSED_INSTRS 3
+#define MAX_FUSED_LEN (MAX_FUSED_INSTRS * MAX_INSTR_LEN)
+
+enum OperandFormat : uint8_t
+{
+    FMT_NONE,        // e.g.: halt
+    FMT_R,           // e.g.: inc r0
+    FMT_RR,          // e.g.: mov r0, r1
+    FMT_RRR,         // e.g.: add r0, r1, r2
+    FMT_C8,          // e.g.: int 0x01
+    FMT_C16,         // e.g.: jmp 0x0A 0x00
+    FMT_C32,         // e.g.: ljmp 0x0A 0x00 0x01 0x00
+    FMT_R_C8,        // e.g.: lconsb r0, 0xA2
+    FMT_R_C16,       // e.g.: load r0, 0x08 0x00
+    FMT_R_C32,       // e.g.: lcons r0, 0xA2 0x00 0x00 0x00
+    FMT_C16_R,       // e.g.: stor 0x08 0x00, r0
+    FMT_RR_C16,      // e.g.: je r0, r1, 0x0A 0x00
+    FMT_C16_C16,     // e.g.: reads 0x08 0x00, 0x0A 0x00
+    FMT_C16_C16_C16, // e.g.: memcpy 0x08 0x00, 0x10 0x00, 0x04 0x00
+};
+
+// operand layout and encoded length (in bytes, including the opcode) of every instruction
+extern const OperandFormat instrFormat[INSTRUCTION_COUNT];
+extern const uint8_t instrLength[INSTRUCTION_COUNT];
+// assembler mnemonic of every instruction
+extern const char *const instrName[INSTRUCTION_COUNT];
+
+// internal operations that only exist in decoded form
+enum DecodedOp : uint8_t
+{
+    DOP_UNDECODED = INSTRUCTION_COUNT, // not decoded yet (or invalidated by a write)
+    DOP_FALLBACK,                      // let the byte interpreter execute this one
+    DOP_JIT,                           // start of a block compiled to native code
+    // superinstructions, picked from seqmine profiles of compiled and hand-written code:
+    DOP_LCONSW_SUB_LOAD_P, // load a local variable, e.g.: lconsw r5, 4; sub r5, bp, r5; load_p r0, r5
+    DOP_LCONSW_SUB,        // address of a local variable, e.g.: lconsw r5, 4; sub r5, bp, r5
+    DOP_LOAD_P_PUSH,       // e.g.: load_p r0, r5; push r0
+    DOP_LOAD_P_POP,        // e.g.: load_p r0, r5; pop r1
+    DOP_MOD_JZ,            // divisibility test, e.g.: mod r3, r0, r2; jz r3, .notPrime
+    DOP_MOD_JNZ,           // e.g.: mod r3, r0, r2; jnz r3, .next
+    DOP_INC_JMP,           // e.g.: inc r2; jmp .innerLoop
+    DOP_INC_JB,            // counted loop, e.g.: inc r0; jb r0, r1, .loop
+    DECODED_OP_COUNT
+};
+
+// fixed-width form of an instruction, registers go in a, b, c (in order) and
+// immediates in imm (two 16-bit ones are packed in imm for memcpy) and imm2.
+// A superinstruction keeps the operands of its first instruction, the others
+// are read from their own entries further on.
+struct DecodedInstr
+{
+    uint8_t op;
+    uint8_t len;
+    uint8_t a;
+    uint8_t b;
+    uint8_t c;
+    uint16_t imm2;
+    uint32_t imm;
+};
+
+// decode the instruction at addr, returns false if it must go through the byte
+// interpreter (invalid operands, runs past the code, touches IP, ...)
+bool decodeInstr(const uint8_t *code, uint32_t addr, uint32_t codeLen, uint32_t memSize, DecodedInstr &out);
+
+// turn the (already decoded) instruction at addr into a superinstruction if it
+// starts a known sequence, decoding the following instructions as needed
+void fuseInstr(const uint8_t *code, uint32_t addr, uint32_t codeLen, uint32_t memSize, DecodedInstr *decoded);
+
+// addresses the valid instruction at addr goes on to without looking at
+// registers (direct jump targets, then the next instruction), at most two
+uint8_t instrSuccessors(const uint8_t *code, uint32_t addr, uint32_t *successors);
+
+// decodes (and fuses) every instruction reachable from the roots through
+// fallthroughs and direct jumps, leaving the rest of the codeLen + 1 entries
+// DOP_UNDECODED. codeMap (codeLen bytes and 4 more that stay zero) gets a
+// nonzero byte for every byte of code they cover
+void decodeProgram(const uint8_t *code, uint32_t codeLen, uint32_t memSize, const uint32_t *roots, uint8_t rootCount,
+                   DecodedInstr *decoded, uint8_t *codeMap);
+
+// bytes of code the decoded entry at addr stands for: the whole sequence for
+// a superinstruction, the longest an instruction can be for one left to the
+// byte interpreter, nothing for one that isn't decoded
+uint32_t decodedSpan(const DecodedInstr *decoded, uint32_t addr);
+
+// what VM::verify() does, for any copy of a program: fills verifyMap (one bit
+// per instruction start, then one per code byte) and blockLen (codeLen entries)
+bool verifyProgram(const uint8_t *code, uint32_t codeLen, uint32_t memSize, uint32_t entry, uint8_t *verifyMap, uint32_t *blockLen);
+
+#endif // __DECODE_H__
@@ -0,0 +1,424 @@
+#include "vm.h"
+
+#ifdef _WIN32
+#include <io.h>
+#define read _read
+#define flockfile _lock_file
+#define funlockfile _unlock_file
+#define getc_unlocked _getc_nolock
+#else
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include <errno.h>
+#include <math.h>
+
+// a line at a time, so that a program reading from a terminal doesn't wait
+// for more than has been typed, with the stream locked once per line
+static uint32_t readFile(char *data, uint32_t len, void *context)
+{
+    FILE *file = (FILE *)context;
+    uint32_t count = 0;
+    flockfile(file);
+    while (count < len)
+    {
+        const int c = getc_unlocked(file);
+        if (c == EOF)
+            break;
+        data[count++] = (char)c;
+        if (c == '\n')
+            break;
+    }
+    funlockfile(file);
+    return count;
+}
+
+static uint32_t readFd(char *data, uint32_t len, void *context)
+{
+    const int fd = (int)(intptr_t)context;
+    for (;;)
+    {
+        const long count = read(fd, data, len);
+        if (count < 0 && errno == EINTR)
+            continue;
+        return count > 0 ? (uint32_t)count : 0;
+    }
+}
+
+// memory given to the VM is read where it is, so there's never more to fill
+static uint32_t readNothing(char *, uint32_t, void *)
+{
+    return 0;
+}
+
+// a stdio stream, stdin unless told otherwise. Input the VM has buffered
+// but not read yet is dropped when the source changes
+void VM::setInput(FILE *file)
+{
+    this->setInput(readFile, file);
+}
+
+void VM::setInput(int fd)
+{
+    this->setInput(readFd, (void *)(intptr_t)fd);
+}
+
+// reads data in place, so it has to stay around until the VM is done with it
+void VM::setInput(const char *data, uint32_t len)
+{
+    this->setInput(readNothing, nullptr);
+    this->_inputPos = data;
+    this->_inputEnd = data + len;
+}
+
+// calls read whenever everything it returned so far has been read
+void VM::setInput(InputFn read, void *context)
+{
+    this->_closeInput();
+    this->_inputFn = read;
+    this->_inputContext = context;
+    this->_inputPos = nullptr;
+    this->_inputEnd = nullptr;
+}
+
+// reads a whole file from memory, returns false if it can't be read. The file
+// is mapped rather than read where possible, and mustn't change while in use
+bool VM::mapInput(const char *path)
+{
+#ifdef __linux__
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    void *data = nullptr;
+    const bool ok = fstat(fd, &st) == 0 && (st.st_size == 0 ||
+                    (data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) != MAP_FAILED);
+    close(fd);
+    if (!ok)
+        return false;
+    this->setInput((const char *)data, st.st_size);
+    this->_inputMap = data;
+    this->_inputMapLen = st.st_size;
+#else
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr)
+        return false;
+    std::string contents;
+    char chunk[4096];
+    size_t len;
+    while ((len = fread(chunk, 1, sizeof(chunk), file)) > 0)
+        contents.append(chunk, len);
+    const bool ok = !ferror(file);
+    fclose(file);
+    if (!ok)
+        return false;
+    char *data = new char[contents.size() + 1];
+    memcpy(data, contents.data(), contents.size());
+    this->setInput(data, contents.size());
+    this->_inputMap = data;
+    this->_inputMapLen = contents.size();
+#endif
+    return true;
+}
+
+void VM::_closeInput()
+{
+    if (this->_inputMap == nullptr)
+        return;
+#ifdef __linux__
+    munmap(this->_inputMap, this->_inputMapLen);
+#else
+    delete[] (char *)this->_inputMap;
+#endif
+    this->_inputMap = nullptr;
+    this->_inputMapLen = 0;
+}
+
+// a clone reads from the same source, and memory given to setInput() from
+// where this VM is. A mapped file belongs to the VM that mapped it though
+void VM::_copyInput(const VM *from)
+{
+    this->_inputFn = from->_inputFn;
+    this->_inputContext = from->_inputContext;
+    if (from->_inputFn == readNothing && from->_inputMap == nullptr)
+    {
+        this->_inputPos = from->_inputPos;
+        this->_inputEnd = from->_inputEnd;
+    }
+}
+
+// replaces what has been read with whatever the source has next, returns
+// false at the end of the input. Anything printed so far is written out
+// first, in case the input is an answer to it
+bool VM::_fillInput()
+{
+    if (this->_inputFn == readNothing)
+        return false;
+    this->flush();
+    if (this->_inputBuffer == nullptr)
+        this->_inputBuffer = new char[VM_INPUT_BUFFER_SIZE];
+    const uint32_t len = this->_inputFn != nullptr ? this->_inputFn(this->_inputBuffer, VM_INPUT_BUFFER_SIZE, this->_inputContext)
+                                                   : readFile(this->_inputBuffer, VM_INPUT_BUFFER_SIZE, stdin);
+    this->_inputPos = this->_inputBuffer;
+    this->_inputEnd = this->_inputBuffer + len;
+    return len > 0;
+}
+
+// the next character without reading it, or -1 at the end of the input
+int VM::_peekInput()
+{
+    if (this->_inputPos == this->_inputEnd && !this->_fillInput())
+        return -1;
+    return (uint8_t)*this->_inputPos;
+}
+
+static bool isSpace(char c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static bool isDigit(char c)
+{
+    return (uint8_t)(c - '0') < 10;
+}
+
+// reads whitespace up to the next character, which it returns like _peekInput()
+int VM::_skipSpace()
+{
+    for (;;)
+    {
+        const char *pos = this->_inputPos;
+        const char *end = this->_inputEnd;
+        while (pos < end && isSpace(*pos))
+            pos++;
+        this->_inputPos = pos;
+        if (pos < end)
+            return (uint8_t)*pos;
+        if (!this->_fillInput())
+            return -1;
+    }
+}
+
+// the next byte, or 0xFFFFFFFF (EOF) at the end of the input
+uint32_t VM::_readChar()
+{
+    const int c = this->_peekInput();
+    if (c < 0)
+        return (uint32_t)EOF;
+    this->_inputPos++;
+    return c;
+}
+
+// a decimal integer after any whitespace, with an optional sign, the way
+// scanf's %u and %d read it: anything out of range wraps around. Leaves value
+// alone if there isn't one, and stops at the first character that's not a
+// digit, which is left for the next read
+bool VM::_readInteger(uint32_t &value)
+{
+    int c = this->_skipSpace();
+    const bool negative = c == '-';
+    if (c == '-' || c == '+')
+    {
+        this->_inputPos++;
+        c = this->_peekInput();
+    }
+    if (c < 0 || !isDigit(c))
+        return false;
+
+    uint32_t result = 0;
+    do
+    {
+        const char *pos = this->_inputPos;
+        const char *end = this->_inputEnd;
+        while (pos < end && isDigit(*pos))
+            result = result * 10 + (*pos++ - '0');
+        this->_inputPos = pos;
+        if (pos < end)
+            break;
+    } while (this->_fillInput());
+    value = negative ? 0 - result : result;
+    return true;
+}
+
+// digits beyond this many can only matter as whether any of them isn't a
+// zero: no float, or point halfway between two, has more significant ones
+#define FLOAT_DIGITS 120
+
+// a float after any whitespace, like scanf's %f: decimal digits with an
+// optional sign, point and exponent, or inf, infinity and nan. Rounded
+// correctly, straight from the digits when they fit in a float exactly and
+// through strtof otherwise. Leaves value alone if there isn't one
+bool VM::_readFloat(float &value)
+{
+    int c = this->_skipSpace();
+    const bool negative = c == '-';
+    if (c == '-' || c == '+')
+    {
+        this->_inputPos++;
+        c = this->_peekInput();
+    }
+    if (c < 0)
+        return false;
+
+    // inf, infinity and nan in any case
+    if ((c | 0x20) == 'i' || (c | 0x20) == 'n')
+    {
+        const char *word = (c | 0x20) == 'i' ? "inf" : "nan";
+        for (const char *w = word; *w != '\0'; w++)
+        {
+            c = this->_peekInput();
+            if (c < 0 || (c | 0x20) != *w)
+                return false;
+            this->_inputPos++;
+        }
+        if (word[0] == 'i')
+        {
+            for (const char *w = "inity"; *w != '\0'; w++)
+            {
+                c = this->_peekInput();
+                if (c < 0 || (c | 0x20) != *w)
+                    break;
+                this->_inputPos++;
+            }
+            value = negative ? -INFINITY : INFINITY;
+        }
+        else
+            value = negative ? -NAN : NAN;
+        return true;
+    }
+
+    // the significant digits, without leading zeros or the point, and the
+    // power of ten they are multiplied by
+    char digits[FLOAT_DIGITS + 16];
+    uint32_t count = 0;
+    int32_t exponent = 0;
+    bool any = false;
+    bool dropped = false;
+    bool point = false;
+    while ((c = this->_peekInput()) >= 0)
+    {
+        if (isDigit(c))
+        {
+            any = true;
+            if (count < FLOAT_DIGITS && (count > 0 || c != '0'))
+            {
+                digits[count++] = c;
+                exponent -= point;
+            }
+            else if (count == 0)
+                exponent -= point;
+            else
+            {
+                exponent += !point;
+                dropped |= c != '0';
+            }
+        }
+        else if (c == '.' && !point)
+            point = true;
+        else
+            break;
+        this->_inputPos++;
+    }
+    if (!any)
+        return false;
+
+    if (c == 'e' || c == 'E')
+    {
+        this->_inputPos++;
+        c = this->_peekInput();
+        const bool negativeExp = c == '-';
+        if (c == '-' || c == '+')
+        {
+            this->_inputPos++;
+            c = this->_peekInput();
+        }
+        // anything this large is 0 or inf anyway
+        int32_t exp = 0;
+        while (c >= 0 && isDigit(c))
+        {
+            if (exp < 100000)
+                exp = exp * 10 + (c - '0');
+            this->_inputPos++;
+            c = this->_peekInput();
+        }
+        exponent += negativeExp ? -exp : exp;
+    }
+
+    float result;
+    if (count == 0)
+        result = 0.0f;
+    else
+    {
+        // trailing zeros only make the exponent larger
+        while (!dropped && digits[count - 1] == '0')
+        {
+            count--;
+            exponent++;
+        }
+
+        // up to 7 digits and powers of ten up to 10^10 are floats exactly,
+        // so a single multiplication or division rounds them correctly
+        static const float powers[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+        if (!dropped && count <= 7 && exponent >= -10 && exponent <= 10)
+        {
+            uint32_t mantissa = 0;
+            for (uint32_t i = 0; i < count; i++)
+                mantissa = mantissa * 10 + (digits[i] - '0');
+            result = exponent < 0 ? (float)mantissa / powers[-exponent] : (float)mantissa * powers[exponent];
+        }
+        else
+        {
+            // a nonzero digit below the ones kept, so halfway cases round up
+            if (dropped)
+            {
+                digits[count++] = '1';
+                exponent--;
+            }
+            char *end = &digits[count];
+            *end++ = 'e';
+            uint32_t exp = exponent < 0 ? 0 - (uint32_t)exponent : exponent;
+            if (exponent < 0)
+                *end++ = '-';
+            char text[12];
+            char *start = &text[sizeof(text)];
+            do
+            {
+                *--start = '0' + exp % 10;
+                exp /= 10;
+            } while (exp > 0);
+            memcpy(end, start, &text[sizeof(text)] - start);
+            end[&text[sizeof(text)] - start] = '\0';
+            result = strtof(digits, nullptr);
+        }
+    }
+    value = negative ? -result : result;
+    return true;
+}
+
+// a line like fgets() reads it, without ever writing more than maxLen + 1
+// bytes: up to maxLen characters, the newline included if there's room for
+// it, then a 0. The rest of a longer line is left for the next read, and an
+// empty string means the input has ended
+void VM::_readLine(char *dest, uint32_t maxLen)
+{
+    char *out = dest;
+    while (maxLen > 0 && (this->_inputPos < this->_inputEnd || this->_fillInput()))
+    {
+        uint32_t len = this->_inputEnd - this->_inputPos;
+        len = len < maxLen ? len : maxLen;
+        const char *newline = (const char *)memchr(this->_inputPos, '\n', len);
+        if (newline != nullptr)
+            len = newline - this->_inputPos + 1;
+        memcpy(out, this->_inputPos, len);
+        out += len;
+        maxLen -= len;
+        this->_inputPos += len;
+        if (newline != nullptr)
+            break;
+    }
+    *out = '\0';
+}
@@ -0,0 +1,853 @@
+#include "jit.h"
+
+#ifdef VM_JIT
+
+#include <sys/mman.h>
+
+// native registers: rdi holds the register file, rsi the memory, r8d counts
+// the instructions run by previous iterations of the block and r9d keeps the budget
+#define EAX 0
+#define ECX 1
+#define EDX 2
+
+// condition codes (low nibble of jcc)
+#define CC_B 0x2
+#define CC_AE 0x3
+#define CC_E 0x4
+#define CC_NE 0x5
+#define CC_BE 0x6
+#define CC_A 0x7
+#define CC_L 0xC
+#define CC_GE 0xD
+#define CC_LE 0xE
+#define CC_G 0xF
+
+JitCompiler::JitCompiler(uint32_t codeLen, uint32_t progLen, uint32_t memSize, bool stencils)
+    : _codeLen(codeLen), _progLen(progLen), _memSize(memSize)
+{
+#ifdef VM_JIT_STENCILS
+    this->_stencils = stencils;
+#else
+    (void)stencils;
+#endif
+    this->_counters = new uint32_t[codeLen]();
+    this->_blocks = new JitBlock *[codeLen]();
+    this->_blockPool = new JitBlock[codeLen];
+    this->_stored = new uint8_t[codeLen]();
+
+    // code is written while the buffer is RW and only ever run while it is RX
+    void *code = mmap(nullptr, VM_JIT_CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    this->_code = code == MAP_FAILED ? nullptr : (uint8_t *)code;
+    if (this->_code != nullptr)
+        mprotect(this->_code, VM_JIT_CODE_SIZE, PROT_READ | PROT_EXEC);
+}
+
+JitCompiler::~JitCompiler()
+{
+    if (this->_code != nullptr)
+        munmap(this->_code, VM_JIT_CODE_SIZE);
+    delete[] this->_counters;
+    delete[] this->_blocks;
+    delete[] this->_blockPool;
+    delete[] this->_stored;
+}
+
+bool JitCompiler::hot(uint32_t addr)
+{
+    return addr < this->_codeLen && ++this->_counters[addr] == VM_JIT_THRESHOLD;
+}
+
+bool JitCompiler::stencils()
+{
+    return this->_stencils;
+}
+
+const JitBlock *JitCompiler::blockAt(uint32_t addr)
+{
+    return this->_blocks[addr];
+}
+
+void JitCompiler::invalidate(uint32_t addr, uint32_t len, DecodedInstr *decoded)
+{
+    for (uint32_t i = 0; i < this->_blockCount; i++)
+    {
+        const JitBlock &block = this->_blockPool[i];
+        if (this->_blocks[block.start] != &block || block.low >= addr + len || block.end <= addr)
+            continue;
+
+        this->_blocks[block.start] = nullptr;
+        this->_counters[block.start] = 0;
+        if (decoded != nullptr && decoded[block.start].op == DOP_JIT)
+            decoded[block.start].op = DOP_UNDECODED;
+    }
+}
+
+// code found at addr since blocks were compiled (decoded, or compiled by
+// another block): stores the blocks make there natively would go unnoticed,
+// so all of them go
+void JitCompiler::markCode(uint32_t addr, uint32_t len, DecodedInstr *decoded)
+{
+    for (uint32_t i = addr; i < addr + len && i < this->_codeLen; i++)
+    {
+        if (this->_stored[i])
+        {
+            this->invalidate(0, this->_codeLen, decoded);
+            memset(this->_stored, 0, this->_codeLen);
+            return;
+        }
+    }
+}
+
+void JitCompiler::reset()
+{
+    memset(this->_counters, 0, this->_codeLen * sizeof(uint32_t));
+    memset(this->_blocks, 0, this->_codeLen * sizeof(JitBlock *));
+    memset(this->_stored, 0, this->_codeLen);
+    this->_blockCount = 0;
+    this->_codeUsed = 0;
+}
+
+bool JitCompiler::compile(const uint8_t *code, const uint8_t *codeMap, uint32_t addr)
+{
+    if (!this->_canCompile(addr))
+        return false;
+    this->_codeMap = codeMap;
+
+    // a block leaving before its first instruction hands it to the byte
+    // interpreter, which doesn't invalidate anything when a store hits code
+    if (code[addr] == OP_STOR_P || code[addr] == OP_STORW_P || code[addr] == OP_STORB_P)
+        return false;
+
+    const uint32_t codeStart = this->_begin(addr);
+    uint32_t ip = addr;
+    uint8_t count = 0;
+    bool ended = false;
+    while (count < JIT_MAX_BLOCK_INSTRS)
+    {
+        DecodedInstr instr;
+        if (!decodeInstr(code, ip, this->_codeLen, this->_memSize, instr))
+            break;
+#ifdef VM_JIT_STENCILS
+        if (this->_stencils ? !this->_patchInstr(instr, ip, count, JIT_NO_TRACE) : !this->_emitInstr(instr, ip, count, JIT_NO_TRACE))
+            break;
+#else
+        if (!this->_emitInstr(instr, ip, count, JIT_NO_TRACE))
+            break;
+#endif
+        count++;
+        ip += instr.len;
+        if (instr.op == OP_CALL || instr.op == OP_RET || instr.op == OP_JMP || instr.op == OP_JR)
+        {
+            ended = true;
+            break;
+        }
+    }
+
+    if (count > 0 && !ended)
+        this->_emitExit(ip, count);
+    return this->_finish(codeStart, addr, ip, count);
+}
+
+// Compiles one recorded iteration of a loop: path holds the address of every
+// instruction it ran, starting at the loop head. Branches that went the other
+// way, and returns or indirect jumps to anywhere else, leave the trace, while
+// jumps and calls along it cost nothing.
+bool JitCompiler::compileTrace(const uint8_t *code, const uint8_t *codeMap, const uint32_t *path, uint8_t length)
+{
+    const uint32_t head = path[0];
+    if (length == 0 || !this->_canCompile(head) ||
+        code[head] == OP_STOR_P || code[head] == OP_STORW_P || code[head] == OP_STORB_P)
+        return false;
+    this->_codeMap = codeMap;
+
+    const uint32_t codeStart = this->_begin(head);
+    uint32_t low = head;
+    uint32_t end = head;
+    uint8_t count = 0;
+    while (count < length)
+    {
+        DecodedInstr instr;
+        const uint32_t ip = path[count];
+        const uint32_t next = count + 1 < length ? path[count + 1] : head;
+        if (!decodeInstr(code, ip, this->_codeLen, this->_memSize, instr))
+            break;
+#ifdef VM_JIT_STENCILS
+        if (this->_stencils ? !this->_patchInstr(instr, ip, count, next) : !this->_emitInstr(instr, ip, count, next))
+            break;
+#else
+        if (!this->_emitInstr(instr, ip, count, next))
+            break;
+#endif
+        count++;
+        low = ip < low ? ip : low;
+        end = ip + instr.len > end ? ip + instr.len : end;
+    }
+
+    // an instruction native code can't run cuts the trace short
+    if (count == length)
+        this->_emitJump(head, count);
+    else if (count > 0)
+        this->_emitExit(path[count], count);
+    return this->_finish(codeStart, low, end, count);
+}
+
+bool JitCompiler::_canCompile(uint32_t addr)
+{
+    // blocks dropped by invalidate() keep their space, so code that keeps
+    // rewriting itself eventually runs out of it and stays interpreted
+    return this->_code != nullptr && addr < this->_codeLen && this->_blocks[addr] == nullptr &&
+           this->_blockCount < this->_codeLen && this->_codeUsed + JIT_MAX_BLOCK_BYTES <= VM_JIT_CODE_SIZE;
+}
+
+// whether a store of size bytes to the constant addr hits code, which only
+// the interpreter may write to. Stores elsewhere in the code section are
+// remembered in case code turns up there later
+bool JitCompiler::_storesCode(uint32_t addr, uint8_t size)
+{
+    for (uint32_t i = addr; i < addr + size && i < this->_codeLen; i++)
+        if (this->_codeMap[i])
+            return true;
+    for (uint32_t i = addr; i < addr + size && i < this->_codeLen; i++)
+        this->_stored[i] = 1;
+    return false;
+}
+
+uint32_t JitCompiler::_begin(uint32_t addr)
+{
+    const uint32_t codeStart = this->_codeUsed;
+    mprotect(this->_code, VM_JIT_CODE_SIZE, PROT_READ | PROT_WRITE);
+
+    this->_blockStart = addr;
+    this->_pendingCount = 0;
+    this->_loopCheckCount = 0;
+#ifdef VM_JIT_STENCILS
+    if (this->_stencils)
+    {
+        this->_patchEnter();
+        this->_blockEntry = this->_codeUsed;
+        return codeStart;
+    }
+#endif
+    this->_byte(0x45); // xor r8d, r8d
+    this->_byte(0x31);
+    this->_byte(0xC0);
+    this->_byte(0x41); // mov r9d, edx
+    this->_byte(0x89);
+    this->_byte(0xD1);
+    this->_blockEntry = this->_codeUsed;
+    return codeStart;
+}
+
+// emits the out of line exits and registers the block, or drops it if it
+// doesn't hold a single instruction
+bool JitCompiler::_finish(uint32_t codeStart, uint32_t low, uint32_t end, uint8_t count)
+{
+    if (count == 0)
+    {
+        this->_codeUsed = codeStart;
+        mprotect(this->_code, VM_JIT_CODE_SIZE, PROT_READ | PROT_EXEC);
+        return false;
+    }
+
+    for (uint8_t i = 0; i < this->_pendingCount; i++)
+    {
+        const PendingExit pending = this->_pending[i];
+        this->_resolve(pending.patch, pending.addend, this->_codeUsed);
+#ifdef VM_JIT_STENCILS
+        if (pending.jump)
+        {
+            this->_patchJump(pending.addr, pending.executed, count);
+            continue;
+        }
+#endif
+        this->_emitExit(pending.addr, pending.executed);
+    }
+
+    // going around again is only allowed if the longest way around still fits
+    const uint32_t full = count;
+    for (uint8_t i = 0; i < this->_loopCheckCount; i++)
+        memcpy(&this->_code[this->_loopChecks[i]], &full, sizeof(uint32_t));
+
+    mprotect(this->_code, VM_JIT_CODE_SIZE, PROT_READ | PROT_EXEC);
+
+    JitBlock &block = this->_blockPool[this->_blockCount++];
+    block.start = this->_blockStart;
+    block.low = low;
+    block.end = end;
+    block.count = count;
+    block.fn = (JitFn)(this->_code + codeStart);
+    this->_blocks[block.start] = &block;
+    return true;
+}
+
+void JitCompiler::_byte(uint8_t b)
+{
+    this->_code[this->_codeUsed++] = b;
+}
+
+void JitCompiler::_dword(uint32_t w)
+{
+    memcpy(&this->_code[this->_codeUsed], &w, sizeof(uint32_t));
+    this->_codeUsed += 4;
+}
+
+// opcode reg, [rdi + vmReg * 4]
+void JitCompiler::_regOp(uint8_t opcode, uint8_t reg, uint8_t vmReg)
+{
+    this->_byte(opcode);
+    this->_byte(0x47 | reg << 3);
+    this->_byte(vmReg * sizeof(uint32_t));
+}
+
+// opcode reg, [rsi + addr]
+void JitCompiler::_memOp(uint8_t opcode, uint8_t reg, uint32_t addr)
+{
+    this->_byte(opcode);
+    this->_byte(0x86 | reg << 3);
+    this->_dword(addr);
+}
+
+// opcode reg, [rsi + rax]
+void JitCompiler::_idxOp(uint8_t opcode, uint8_t reg)
+{
+    this->_byte(opcode);
+    this->_byte(0x04 | reg << 3);
+    this->_byte(0x06);
+}
+
+// return to the interpreter at addr, having run executed more instructions
+void JitCompiler::_emitExit(uint32_t addr, uint32_t executed)
+{
+#ifdef VM_JIT_STENCILS
+    if (this->_stencils)
+    {
+        this->_patchExit(addr, executed);
+        return;
+    }
+#endif
+    this->_byte(0xB8); // mov eax, addr
+    this->_dword(addr);
+    this->_emitDynamicExit(executed);
+}
+
+// same as above, with the address already in eax
+void JitCompiler::_emitDynamicExit(uint32_t executed)
+{
+    if (executed != 0)
+    {
+        this->_byte(0x41); // add r8d, executed
+        this->_byte(0x81);
+        this->_byte(0xC0);
+        this->_dword(executed);
+    }
+    this->_byte(0x49); // shl r8, 32
+    this->_byte(0xC1);
+    this->_byte(0xE0);
+    this->_byte(32);
+    this->_byte(0x4C); // or rax, r8
+    this->_byte(0x09);
+    this->_byte(0xC0);
+    this->_byte(0xC3); // ret
+}
+
+// leave before the instruction at addr (the index-th of the block) if cond
+// holds, so the interpreter runs it and reports any error exactly
+void JitCompiler::_emitDeopt(uint8_t cond, uint32_t addr, uint8_t index)
+{
+    this->_byte(0x0F);
+    this->_byte(0x80 | cond);
+    PendingExit &pending = this->_pending[this->_pendingCount++];
+    pending.patch = this->_codeUsed;
+    pending.addend = -4;
+    pending.addr = addr;
+    pending.executed = index;
+    pending.jump = false;
+    this->_dword(0);
+}
+
+// points the rel32 at patch to target, addend being where it is relative to
+void JitCompiler::_resolve(uint32_t patch, int32_t addend, uint32_t target)
+{
+    const uint32_t rel = target + addend - patch;
+    memcpy(&this->_code[patch], &rel, sizeof(uint32_t));
+}
+
+// end of the block, jumps back to its start stay in native code while the budget allows
+void JitCompiler::_emitJump(uint32_t target, uint8_t count)
+{
+#ifdef VM_JIT_STENCILS
+    if (this->_stencils)
+    {
+        this->_patchJump(target, count, count);
+        return;
+    }
+#endif
+    if (target != this->_blockStart)
+    {
+        this->_emitExit(target, count);
+        return;
+    }
+
+    this->_byte(0x41); // add r8d, count
+    this->_byte(0x81);
+    this->_byte(0xC0);
+    this->_dword(count);
+    this->_byte(0x44); // mov eax, r9d
+    this->_byte(0x89);
+    this->_byte(0xC8);
+    this->_byte(0x44); // sub eax, r8d
+    this->_byte(0x29);
+    this->_byte(0xC0);
+    this->_byte(0x3D); // cmp eax, instructions in the block (patched in once known)
+    this->_loopChecks[this->_loopCheckCount++] = this->_codeUsed;
+    this->_dword(count);
+    this->_byte(0x0F); // jae entry
+    this->_byte(0x80 | CC_AE);
+    this->_dword(this->_blockEntry - (this->_codeUsed + 4));
+    this->_emitExit(target, 0);
+}
+
+// flags are already set, cond selects the taken path and the block goes on
+// with the next instruction otherwise
+void JitCompiler::_emitBranch(uint8_t cond, uint32_t target, uint8_t count)
+{
+    this->_byte(0x0F); // j!cond over the exit
+    this->_byte(0x80 | (cond ^ 1));
+    const uint32_t patch = this->_codeUsed;
+    this->_dword(0);
+    this->_emitJump(target, count);
+
+    const uint32_t rel = this->_codeUsed - (patch + 4);
+    memcpy(&this->_code[patch], &rel, sizeof(uint32_t));
+}
+
+// in a trace, a conditional jump leaves it only when it goes the other way
+// than it did while recording
+void JitCompiler::_emitCondJump(uint8_t cond, const DecodedInstr &instr, uint32_t addr, uint8_t count, uint32_t next)
+{
+    const uint32_t fallthrough = addr + instr.len;
+    if (next != JIT_NO_TRACE && next == instr.imm && next != fallthrough)
+        this->_emitBranch(cond ^ 1, fallthrough, count);
+    else
+        this->_emitBranch(cond, instr.imm, count);
+}
+
+// in a trace, indirect jumps anywhere else than while recording are left to the interpreter
+void JitCompiler::_emitGuardTarget(uint8_t vmReg, uint32_t target, uint32_t addr, uint8_t index)
+{
+    this->_regOp(0x81, 7, vmReg); // cmp dword [reg], target
+    this->_dword(target);
+    this->_emitDeopt(CC_NE, addr, index);
+}
+
+// next is where a trace goes on after this instruction, jumps along it are free
+bool JitCompiler::_emitInstr(const DecodedInstr &instr, uint32_t addr, uint8_t index, uint32_t next)
+{
+    const uint8_t count = index + 1;
+
+    switch (instr.op)
+    {
+    case OP_NOP:
+    case OP_U2I:
+    case OP_I2U:
+        return true;
+    case OP_LCONS:
+    case OP_LCONSW:
+    case OP_LCONSB:
+        this->_byte(0xC7); // mov dword [a], imm
+        this->_byte(0x47);
+        this->_byte(instr.a * sizeof(uint32_t));
+        this->_dword(instr.imm);
+        return true;
+    case OP_MOV:
+        this->_regOp(0x8B, EAX, instr.b);
+        this->_regOp(0x89, EAX, instr.a);
+        return true;
+    case OP_PUSH:
+        if (instr.a == SP || this->_memSize < this->_progLen + 4)
+            return false;
+        this->_regOp(0x8B, EAX, SP);
+        this->_byte(0x83); // sub eax, 4
+        this->_byte(0xE8);
+        this->_byte(4);
+        this->_byte(0x3D); // cmp eax, progLen
+        this->_dword(this->_progLen);
+        this->_emitDeopt(CC_B, addr, index);
+        this->_byte(0x3D); // cmp eax, memSize - 4
+        this->_dword(this->_memSize - 4);
+        this->_emitDeopt(CC_A, addr, index);
+        this->_regOp(0x89, EAX, SP);
+        this->_regOp(0x8B, ECX, instr.a);
+        this->_idxOp(0x89, ECX);
+        return true;
+    case OP_POP:
+    case OP_POP2:
+    {
+        const uint8_t n = instr.op == OP_POP ? 1 : 2;
+        if (instr.a == SP || (n == 2 && instr.b == SP) || this->_memSize < this->_progLen + 4 * n)
+            return false;
+        this->_regOp(0x8B, EAX, SP);
+        this->_byte(0x3D); // cmp eax, progLen
+        this->_dword(this->_progLen);
+        this->_emitDeopt(CC_B, addr, index);
+        this->_byte(0x3D); // cmp eax, memSize - 4n
+        this->_dword(this->_memSize - 4 * n);
+        this->_emitDeopt(CC_A, addr, index);
+        this->_idxOp(0x8B, ECX);
+        this->_regOp(0x89, ECX, instr.a);
+        if (n == 2)
+        {
+            this->_byte(0x8B); // mov ecx, [rsi + rax + 4]
+            this->_byte(0x4C);
+            this->_byte(0x06);
+            this->_byte(4);
+            this->_regOp(0x89, ECX, instr.b);
+        }
+        this->_byte(0x83); // add dword [sp], 4n
+        this->_byte(0x47);
+        this->_byte(SP * sizeof(uint32_t));
+        this->_byte(4 * n);
+        return true;
+    }
+    case OP_DUP:
+        if (this->_memSize < this->_progLen + 8)
+            return false;
+        this->_regOp(0x8B, EAX, SP);
+        this->_byte(0x83); // sub eax, 4
+        this->_byte(0xE8);
+        this->_byte(4);
+        this->_byte(0x3D); // cmp eax, progLen
+        this->_dword(this->_progLen);
+        this->_emitDeopt(CC_B, addr, index);
+        this->_byte(0x3D); // cmp eax, memSize - 8
+        this->_dword(this->_memSize - 8);
+        this->_emitDeopt(CC_A, addr, index);
+        this->_byte(0x8B); // mov ecx, [rsi + rax + 4]
+        this->_byte(0x4C);
+        this->_byte(0x06);
+        this->_byte(4);
+        this->_idxOp(0x89, ECX);
+        this->_regOp(0x89, EAX, SP);
+        return true;
+    case OP_CALL:
+        this->_byte(0xC7); // mov dword [ra], addr + len
+        this->_byte(0x47);
+        this->_byte(RA * sizeof(uint32_t));
+        this->_dword(addr + instr.len);
+        if (next == JIT_NO_TRACE)
+            this->_emitJump(instr.imm, count);
+        return true;
+    case OP_RET:
+        if (next != JIT_NO_TRACE)
+        {
+            this->_emitGuardTarget(RA, next, addr, index);
+            return true;
+        }
+        this->_regOp(0x8B, EAX, RA);
+        this->_emitDynamicExit(count);
+        return true;
+    case OP_STOR:
+    case OP_STORW:
+    case OP_STORB:
+        // writes to code go through the interpreter, which invalidates
+        if (this->_storesCode(instr.imm, instr.op == OP_STOR ? 4 : instr.op == OP_STORW ? 2 : 1))
+            return false;
+        this->_regOp(0x8B, EAX, instr.a);
+        if (instr.op == OP_STORW)
+            this->_byte(0x66);
+        this->_memOp(instr.op == OP_STORB ? 0x88 : 0x89, EAX, instr.imm);
+        return true;
+    case OP_STOR_P:
+    case OP_STORW_P:
+    case OP_STORB_P:
+    {
+        const uint8_t size = instr.op == OP_STOR_P ? 4 : instr.op == OP_STORW_P ? 2 : 1;
+        if (this->_memSize < size)
+            return false;
+        this->_regOp(0x8B, EAX, instr.a); // mov eax, [a]
+        this->_byte(0x3D); // cmp eax, memSize - size
+        this->_dword(this->_memSize - size);
+        this->_emitDeopt(CC_A, addr, index);
+        // inside the code section, only bytes the code map has as code are off
+        // limits (the map has room for a whole word past its end)
+        this->_byte(0x3D); // cmp eax, codeLen
+        this->_dword(this->_codeLen);
+        this->_byte(0x73); // jae .store
+        this->_byte(0);
+        const uint32_t skip = this->_codeUsed;
+        this->_byte(0x48); // mov rcx, codeMap
+        this->_byte(0xB9);
+        const uint64_t codeMap = (uint64_t)this->_codeMap;
+        memcpy(&this->_code[this->_codeUsed], &codeMap, sizeof(codeMap));
+        this->_codeUsed += sizeof(codeMap);
+        if (size == 2)
+            this->_byte(0x66);
+        this->_byte(size == 1 ? 0x80 : 0x83); // cmp [rcx + rax], 0
+        this->_byte(0x3C);
+        this->_byte(0x01);
+        this->_byte(0x00);
+        this->_emitDeopt(CC_NE, addr, index);
+        this->_code[skip - 1] = this->_codeUsed - skip;
+        this->_regOp(0x8B, ECX, instr.b);
+        if (size == 2)
+            this->_byte(0x66);
+        this->_idxOp(size == 1 ? 0x88 : 0x89, ECX);
+        return true;
+    }
+    case OP_LOAD:
+        this->_memOp(0x8B, EAX, instr.imm);
+        this->_regOp(0x89, EAX, instr.a);
+        return true;
+    case OP_LOADW:
+    case OP_LOADB:
+        this->_byte(0x0F); // movzx eax, word/byte [imm]
+        this->_memOp(instr.op == OP_LOADW ? 0xB7 : 0xB6, EAX, instr.imm);
+        this->_regOp(0x89, EAX, instr.a);
+        return true;
+    case OP_LOAD_P:
+    case OP_LOADW_P:
+    case OP_LOADB_P:
+    {
+        const uint8_t size = instr.op == OP_LOAD_P ? 4 : instr.op == OP_LOADW_P ? 2 : 1;
+        if (this->_memSize < size)
+            return false;
+        this->_regOp(0x8B, EAX, instr.b); // mov eax, [b]
+        this->_byte(0x3D); // cmp eax, memSize - size
+        this->_dword(this->_memSize - size);
+        this->_emitDeopt(CC_A, addr, index);
+        if (size == 4)
+            this->_idxOp(0x8B, ECX);
+        else
+        {
+            this->_byte(0x0F); // movzx ecx, word/byte [rsi + rax]
+            this->_idxOp(size == 2 ? 0xB7 : 0xB6, ECX);
+        }
+        this->_regOp(0x89, ECX, instr.a);
+        return true;
+    }
+    case OP_INC:
+        this->_regOp(0xFF, 0, instr.a); // inc dword [a]
+        return true;
+    case OP_DEC:
+        this->_regOp(0xFF, 1, instr.a); // dec dword [a]
+        return true;
+    case OP_FINC:
+    case OP_FDEC:
+        this->_byte(0xF3); // movss xmm0, [a]
+        this->_byte(0x0F);
+        this->_regOp(0x10, 0, instr.a);
+        this->_byte(0xB8); // mov eax, 1.0f
+        this->_dword(0x3F800000);
+        this->_byte(0x66); // movd xmm1, eax
+        this->_byte(0x0F);
+        this->_byte(0x6E);
+        this->_byte(0xC8);
+        this->_byte(0xF3); // addss/subss xmm0, xmm1
+        this->_byte(0x0F);
+        this->_byte(instr.op == OP_FINC ? 0x58 : 0x5C);
+        this->_byte(0xC1);
+        this->_byte(0xF3); // movss [a], xmm0
+        this->_byte(0x0F);
+        this->_regOp(0x11, 0, instr.a);
+        return true;
+    case OP_ADD:
+    case OP_SUB:
+    case OP_AND:
+    case OP_OR:
+    case OP_XOR:
+    {
+        const uint8_t opcode = instr.op == OP_ADD ? 0x03 : instr.op == OP_SUB ? 0x2B : instr.op == OP_AND ? 0x23 : instr.op == OP_OR ? 0x0B : 0x33;
+        this->_regOp(0x8B, EAX, instr.b);
+        this->_regOp(opcode, EAX, instr.c);
+        this->_regOp(0x89, EAX, instr.a);
+        return true;
+    }
+    case OP_MUL:
+    case OP_IMUL:
+        this->_regOp(0x8B, EAX, instr.b);
+        this->_byte(0x0F); // imul eax, [c]
+        this->_regOp(0xAF, EAX, instr.c);
+        this->_regOp(0x89, EAX, instr.a);
+        return true;
+    case OP_DIV:
+    case OP_MOD:
+    case OP_IDIV:
+    case OP_IMOD:
+    {
+        const bool isSigned = instr.op == OP_IDIV || instr.op == OP_IMOD;
+        // anything that would trap is left to the interpreter
+        this->_regOp(0x83, 7, instr.c); // cmp dword [c], 0
+        this->_byte(0);
+        this->_emitDeopt(CC_E, addr, index);
+        if (isSigned)
+        {
+            this->_regOp(0x83, 7, instr.c); // cmp dword [c], -1
+            this->_byte(0xFF);
+            this->_emitDeopt(CC_E, addr, index);
+        }
+        this->_regOp(0x8B, EAX, instr.b);
+        if (isSigned)
+            this->_byte(0x99); // cdq
+        else
+        {
+            this->_byte(0x31); // xor edx, edx
+            this->_byte(0xD2);
+        }
+        this->_regOp(0xF7, isSigned ? 7 : 6, instr.c); // (i)div dword [c]
+        this->_regOp(0x89, instr.op == OP_DIV || instr.op == OP_IDIV ? EAX : EDX, instr.a);
+        return true;
+    }
+    case OP_FADD:
+    case OP_FSUB:
+    case OP_FMUL:
+    case OP_FDIV:
+    {
+        const uint8_t opcode = instr.op == OP_FADD ? 0x58 : instr.op == OP_FSUB ? 0x5C : instr.op == OP_FMUL ? 0x59 : 0x5E;
+        this->_byte(0xF3); // movss xmm0, [b]
+        this->_byte(0x0F);
+        this->_regOp(0x10, 0, instr.b);
+        this->_byte(0xF3); // op xmm0, [c]
+        this->_byte(0x0F);
+        this->_regOp(opcode, 0, instr.c);
+        this->_byte(0xF3); // movss [a], xmm0
+        this->_byte(0x0F);
+        this->_regOp(0x11, 0, instr.a);
+        return true;
+    }
+    case OP_SHL:
+    case OP_SHR:
+    case OP_ISHR:
+        this->_regOp(0x8B, ECX, instr.c);
+        this->_regOp(0x8B, EAX, instr.b);
+        this->_byte(0xD3); // shl/shr/sar eax, cl
+        this->_byte(instr.op == OP_SHL ? 0xE0 : instr.op == OP_SHR ? 0xE8 : 0xF8);
+        this->_regOp(0x89, EAX, instr.a);
+        return true;
+    case OP_NOT:
+        this->_regOp(0x8B, EAX, instr.b);
+        this->_byte(0xF7); // not eax
+        this->_byte(0xD0);
+        this->_regOp(0x89, EAX, instr.a);
+        return true;
+    case OP_I2F:
+        this->_byte(0xF3); // cvtsi2ss xmm0, [b]
+        this->_byte(0x0F);
+        this->_regOp(0x2A, 0, instr.b);
+        this->_byte(0xF3); // movss [a], xmm0
+        this->_byte(0x0F);
+        this->_regOp(0x11, 0, instr.a);
+        return true;
+    case OP_F2I:
+        this->_byte(0xF3); // cvttss2si eax, [b]
+        this->_byte(0x0F);
+        this->_regOp(0x2C, EAX, instr.b);
+        this->_regOp(0x89, EAX, instr.a);
+        return true;
+    case OP_JMP:
+        if (next == JIT_NO_TRACE)
+            this->_emitJump(instr.imm, count);
+        return true;
+    case OP_JR:
+        if (next != JIT_NO_TRACE)
+        {
+            this->_emitGuardTarget(instr.a, next, addr, index);
+            return true;
+        }
+        this->_regOp(0x8B, EAX, instr.a);
+        this->_emitDynamicExit(count);
+        return true;
+    case OP_JZ:
+    case OP_JNZ:
+        this->_regOp(0x83, 7, instr.a); // cmp dword [a], 0
+        this->_byte(0);
+        this->_emitCondJump(instr.op == OP_JZ ? CC_E : CC_NE, instr, addr, count, next);
+        return true;
+    case OP_JE:
+    case OP_JNE:
+    case OP_JA:
+    case OP_JG:
+    case OP_JAE:
+    case OP_JGE:
+    case OP_JB:
+    case OP_JL:
+    case OP_JBE:
+    case OP_JLE:
+    {
+        static const uint8_t conds[] = {CC_E, CC_NE, CC_A, CC_G, CC_AE, CC_GE, CC_B, CC_L, CC_BE, CC_LE};
+        this->_regOp(0x8B, EAX, instr.a);
+        this->_regOp(0x3B, EAX, instr.b); // cmp eax, [b]
+        this->_emitCondJump(conds[instr.op - OP_JE], instr, addr, count, next);
+        return true;
+    }
+    default:
+        // system calls, memcpy and I/O stay in the interpreter
+        return false;
+    }
+}
+
+void VM::_compileJit(uint32_t addr, bool backward)
+{
+    // native blocks are entered from decoded entries, which can't be shared
+    this->_ownDecoded();
+    DecodedInstr &entry = this->_decoded[addr];
+    if (entry.op == DOP_UNDECODED)
+        this->_decodeAt(addr);
+    if (entry.op == DOP_FALLBACK)
+        return;
+
+    // loops get a trace of the way they actually went around, anything else
+    // (or a loop that can't be traced) a block. Stores to what they cover
+    // have to find it in the code map
+    uint32_t path[JIT_MAX_BLOCK_INSTRS];
+    uint8_t length;
+    if (backward && this->_recordTrace(addr, path, length) &&
+        this->_jit->compileTrace(this->_memory, this->_codeMap, path, length))
+    {
+        entry.op = DOP_JIT;
+        for (uint8_t i = 0; i < length; i++)
+            this->_markCode(path[i], instrLength[this->_memory[path[i]]]);
+    }
+    else if (this->_jit->compile(this->_memory, this->_codeMap, addr))
+    {
+        entry.op = DOP_JIT;
+        const JitBlock *block = this->_jit->blockAt(addr);
+        this->_markCode(block->low, block->end - block->low);
+    }
+}
+
+// Runs one iteration of the loop at head on a copy of the registers and
+// memory, writing down every instruction it goes through. Fails on anything a
+// trace can't hold (interrupts, I/O, errors, halting) or if it doesn't get
+// back to head within JIT_MAX_BLOCK_INSTRS instructions.
+bool VM::_recordTrace(uint32_t head, uint32_t *path, uint8_t &length)
+{
+    uint32_t registers[REGISTER_COUNT];
+    memcpy(registers, this->_registers, sizeof(registers));
+    uint8_t *const memory = this->_memory;
+    this->_memory = new uint8_t[this->_memSize];
+    memcpy(this->_memory, memory, this->_memSize);
+    this->_registers[IP] = head;
+
+    bool closed = false;
+    length = 0;
+    while (!closed && length < JIT_MAX_BLOCK_INSTRS)
+    {
+        const uint32_t ip = this->_registers[IP];
+        if (ip >= this->_codeLen)
+            break;
+        const uint8_t op = this->_memory[ip];
+        if (op == OP_HALT || op == OP_INT || (op >= OP_PRINT && op <= OP_READS))
+            break;
+        path[length++] = ip;
+        if (this->_step() != ExecResult::VM_PAUSED)
+            break;
+        closed = this->_registers[IP] == head;
+    }
+
+    delete[] this->_memory;
+    this->_memory = memory;
+    memcpy(this->_registers, registers, sizeof(registers));
+    return closed;
+}
+
+#endif // VM_JIT
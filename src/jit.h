@@ -0,0 +1,155 @@
+#ifndef __JIT_H__
+#define __JIT_H__
+
+#include "vm.h"
+#include "decode.h"
+
+#ifdef VM_JIT
+
+// number of jumps to an address before the block starting there is compiled
+#ifndef VM_JIT_THRESHOLD
+#define VM_JIT_THRESHOLD 1000
+#endif
+
+// size of the executable buffer of every VM, compilation stops once it is full
+#ifndef VM_JIT_CODE_SIZE
+#define VM_JIT_CODE_SIZE (1024 * 1024)
+#endif
+
+// most instructions in a single block and an upper bound of its native size
+#define JIT_MAX_BLOCK_INSTRS 64
+#define JIT_MAX_BLOCK_BYTES (JIT_MAX_BLOCK_INSTRS * 96 + 64)
+
+// native code runs at most budget instructions and returns the address to
+// continue from in the low 32 bits and the instructions it executed in the
+// high 32 bits. Anything it can't handle (errors, writes to the program, ...)
+// makes it stop right before the offending instruction.
+typedef uint64_t (*JitFn)(uint32_t *registers, uint8_t *memory, uint32_t budget);
+
+// address of the next instruction passed to _emitInstr() outside of traces
+#define JIT_NO_TRACE UINT32_MAX
+
+#ifdef VM_JIT_STENCILS
+// what a hole in a stencil is patched with: register operands, immediates, or
+// jumps to the next stencil and out of the block
+enum StencilHoleKind : uint8_t
+{
+    HOLE_A,
+    HOLE_B,
+    HOLE_C,
+    HOLE_IMM,
+    HOLE_IMM2,
+    HOLE_CONTINUE,
+    HOLE_TARGET,
+};
+
+struct StencilHole
+{
+    uint16_t offset; // of the 32-bit field in the stencil
+    StencilHoleKind kind;
+    int32_t addend;
+};
+
+// machine code compiled from src/stencils.cpp, see src/stencils.h
+struct Stencil
+{
+    const uint8_t *code;
+    uint16_t size;
+    const StencilHole *holes;
+    uint8_t holeCount;
+};
+#endif
+
+struct JitBlock
+{
+    uint32_t start; // address it runs from
+    uint32_t low;   // first byte of code it covers
+    uint32_t end;   // one past the last byte of code it covers
+    uint32_t count; // instructions in a full run of the block
+    JitFn fn;
+};
+
+class JitCompiler
+{
+  public:
+    // only the first codeLen bytes are compiled, progLen is where the stack
+    // ends. stencils selects the copy-and-patch backend where it is available
+    JitCompiler(uint32_t codeLen, uint32_t progLen, uint32_t memSize, bool stencils = false);
+    ~JitCompiler();
+
+    bool hot(uint32_t addr);
+    bool compile(const uint8_t *code, const uint8_t *codeMap, uint32_t addr);
+    bool compileTrace(const uint8_t *code, const uint8_t *codeMap, const uint32_t *path, uint8_t length);
+    const JitBlock *blockAt(uint32_t addr);
+    void invalidate(uint32_t addr, uint32_t len, DecodedInstr *decoded);
+    void markCode(uint32_t addr, uint32_t len, DecodedInstr *decoded);
+    void reset();
+    bool stencils();
+
+  protected:
+    bool _canCompile(uint32_t addr);
+    bool _storesCode(uint32_t addr, uint8_t size);
+    uint32_t _begin(uint32_t addr);
+    bool _finish(uint32_t codeStart, uint32_t low, uint32_t end, uint8_t count);
+    bool _emitInstr(const DecodedInstr &instr, uint32_t addr, uint8_t index, uint32_t next);
+    void _emitExit(uint32_t addr, uint32_t executed);
+    void _emitDynamicExit(uint32_t executed);
+    void _emitDeopt(uint8_t cond, uint32_t addr, uint8_t index);
+    void _emitJump(uint32_t target, uint8_t count);
+    void _emitBranch(uint8_t cond, uint32_t target, uint8_t count);
+    void _emitCondJump(uint8_t cond, const DecodedInstr &instr, uint32_t addr, uint8_t count, uint32_t next);
+    void _emitGuardTarget(uint8_t vmReg, uint32_t target, uint32_t addr, uint8_t index);
+    void _resolve(uint32_t patch, int32_t addend, uint32_t target);
+
+#ifdef VM_JIT_STENCILS
+    bool _patchInstr(const DecodedInstr &instr, uint32_t addr, uint8_t index, uint32_t next);
+    void _patchEnter();
+    void _patch(const Stencil &stencil, const uint32_t *values, uint32_t exitAddr, uint8_t executed, bool jump);
+    void _patchJump(uint32_t target, uint8_t executed, uint8_t full);
+    void _patchExit(uint32_t addr, uint8_t executed);
+#endif
+
+    void _byte(uint8_t b);
+    void _dword(uint32_t w);
+    void _regOp(uint8_t opcode, uint8_t reg, uint8_t vmReg);
+    void _memOp(uint8_t opcode, uint8_t reg, uint32_t addr);
+    void _idxOp(uint8_t opcode, uint8_t reg);
+
+    const uint32_t _codeLen;
+    const uint32_t _progLen;
+    const uint32_t _memSize;
+    bool _stencils = false;
+    uint32_t *_counters;
+    JitBlock **_blocks;
+    JitBlock *_blockPool;
+    uint32_t _blockCount = 0;
+    // the VM's code map, which blocks check stores through pointers against,
+    // and the bytes of the code section blocks store to with constant
+    // addresses, which must not turn into code while they're around
+    const uint8_t *_codeMap = nullptr;
+    uint8_t *_stored;
+
+    uint8_t *_code;
+    uint32_t _codeUsed = 0;
+    // block being compiled and the offset of its loop head
+    uint32_t _blockStart;
+    uint32_t _blockEntry;
+
+    struct PendingExit
+    {
+        uint32_t patch; // offset of the rel32 to patch
+        uint32_t addr;
+        int32_t addend;
+        uint8_t executed;
+        bool jump; // branch that may go around the block again rather than an exit
+    };
+    PendingExit _pending[JIT_MAX_BLOCK_INSTRS * 2];
+    uint8_t _pendingCount;
+    // budget checks of jumps back to the start, which need the full count
+    uint32_t _loopChecks[JIT_MAX_BLOCK_INSTRS + 1];
+    uint8_t _loopCheckCount;
+};
+
+#endif // VM_JIT
+
+#endif // __JIT_H__
@@ -1,24 +1,38 @@
 #include "vm.h"
 
+#define STACK_SIZE 2192
+
 int main(int argc, char *argv[])
 {
-    if (argc != 2)
+    // --profile counts and times every instruction, reported once it's done
+    const bool profiling = argc == 3 && strcmp(argv[1], "--profile") == 0;
+    if (argc != 2 && !profiling)
     {
-        printf("Usage: %s bin_file\n", argv[0]);
+        printf("Usage: %s [--profile] bin_file\n", argv[0]);
         return 1;
     }
+    const char *path = argv[argc - 1];
 
-    uint8_t *program;
-
-    FILE *f = fopen(argv[1], "rb");
-    fseek(f, 0, SEEK_END);
-    long fileLen = ftell(f);
-    rewind(f);
-
-    program = (uint8_t *)malloc(fileLen);
-    size_t s = fread(program, fileLen, 1, f);
-    fclose(f);
+    ImageError error;
+    VM *vm = VM::fromFile(path, STACK_SIZE, &error);
+    if (vm == nullptr)
+    {
+        if (error == IMAGE_ERR_FILE)
+            printf("Could not open %s\n", path);
+        else
+            printf("Invalid image %s: %s\n", path, imageErrorString(error));
+        return 1;
+    }
 
-    VM vm(program, fileLen, 2192);
-    return vm.run();
+    vm->setDispatch(VM_DISPATCH_JIT);
+    Profile *profile = profiling ? new Profile() : nullptr;
+    vm->setProfile(profile);
+    const ExecResult result = vm->run();
+    delete vm;
+    if (profile != nullptr)
+    {
+        profile->report(stderr);
+        delete profile;
+    }
+    return result;
 }
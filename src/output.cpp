@@ -0,0 +1,243 @@
+#include "vm.h"
+
+#ifdef _WIN32
+#include <io.h>
+#define write _write
+#else
+#include <unistd.h>
+#endif
+#include <errno.h>
+
+static void writeFile(const char *data, uint32_t len, void *context)
+{
+    fwrite(data, 1, len, (FILE *)context);
+}
+
+static void writeFd(const char *data, uint32_t len, void *context)
+{
+    const int fd = (int)(intptr_t)context;
+    while (len > 0)
+    {
+        const long written = write(fd, data, len);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return;
+        data += written;
+        len -= written;
+    }
+}
+
+static void writeString(const char *data, uint32_t len, void *context)
+{
+    ((std::string *)context)->append(data, len);
+}
+
+// a stdio stream, stdout unless told otherwise. Other streams (and other
+// VMs) don't wait on each other's locks except when a buffer is written out
+void VM::setOutput(FILE *file)
+{
+    this->setOutput(writeFile, file);
+}
+
+void VM::setOutput(int fd)
+{
+    this->setOutput(writeFd, (void *)(intptr_t)fd);
+}
+
+// appends to buffer
+void VM::setOutput(std::string *buffer)
+{
+    this->setOutput(writeString, buffer);
+}
+
+// calls write with whatever has been printed since the last time and context
+void VM::setOutput(OutputFn write, void *context)
+{
+    this->flush();
+    this->_outputFn = write;
+    this->_outputContext = context;
+}
+
+// hands everything printed so far to the output. run() does it before
+// returning, so only hosts that need output during a run have to
+void VM::flush()
+{
+    if (this->_outputLen == 0)
+        return;
+    if (this->_outputFn != nullptr)
+        this->_outputFn(this->_outputBuffer, this->_outputLen, this->_outputContext);
+    else
+        fwrite(this->_outputBuffer, 1, this->_outputLen, stdout);
+    this->_outputLen = 0;
+}
+
+void VM::_output(const char *data, uint32_t len)
+{
+    if (this->_outputBuffer == nullptr)
+        this->_outputBuffer = new char[VM_OUTPUT_BUFFER_SIZE];
+    while (len > 0)
+    {
+        if (this->_outputLen == VM_OUTPUT_BUFFER_SIZE)
+            this->flush();
+        uint32_t chunk = VM_OUTPUT_BUFFER_SIZE - this->_outputLen;
+        chunk = chunk < len ? chunk : len;
+        memcpy(&this->_outputBuffer[this->_outputLen], data, chunk);
+        this->_outputLen += chunk;
+        data += chunk;
+        len -= chunk;
+    }
+}
+
+void VM::_outputChar(char c)
+{
+    if (this->_outputBuffer == nullptr)
+        this->_outputBuffer = new char[VM_OUTPUT_BUFFER_SIZE];
+    else if (this->_outputLen == VM_OUTPUT_BUFFER_SIZE)
+        this->flush();
+    this->_outputBuffer[this->_outputLen++] = c;
+}
+
+// "00" to "99", for writing two digits at a time
+static const char digitPairs[] = "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+                                 "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+                                 "8081828384858687888990919293949596979899";
+
+// the formatters write backwards from end, and return where they stopped
+
+static char *formatUnsigned(char *end, uint32_t value)
+{
+    while (value >= 100)
+    {
+        const uint32_t pair = value % 100 * 2;
+        value /= 100;
+        *--end = digitPairs[pair + 1];
+        *--end = digitPairs[pair];
+    }
+    if (value >= 10)
+    {
+        *--end = digitPairs[value * 2 + 1];
+        *--end = digitPairs[value * 2];
+    }
+    else
+        *--end = '0' + value;
+    return end;
+}
+
+// exactly count digits, with leading zeroes
+static char *formatDigits(char *end, uint32_t value, uint8_t count)
+{
+    for (uint8_t i = 0; i < count; i++)
+    {
+        *--end = '0' + value % 10;
+        value /= 10;
+    }
+    return end;
+}
+
+// mantissa << shift, which takes up to 128 bits
+static char *formatWide(char *end, uint32_t mantissa, uint32_t shift)
+{
+    uint32_t limbs[5] = {0};
+    const uint64_t shifted = (uint64_t)mantissa << (shift % 32);
+    limbs[shift / 32] = (uint32_t)shifted;
+    limbs[shift / 32 + 1] = shifted >> 32;
+    for (;;)
+    {
+        // nine digits at a time, from the remainder of dividing by a billion
+        uint64_t rest = 0;
+        bool more = false;
+        for (int i = 4; i >= 0; i--)
+        {
+            const uint64_t part = rest << 32 | limbs[i];
+            limbs[i] = part / 1000000000;
+            rest = part % 1000000000;
+            more = more || limbs[i] != 0;
+        }
+        if (!more)
+            return formatUnsigned(end, rest);
+        end = formatDigits(end, rest, 9);
+    }
+}
+
+// what printf("%f") makes of a float: its exact value (a 24-bit integer
+// times a power of two) rounded to six decimals, ties to even
+static char *formatFloat(char *end, uint32_t bits)
+{
+    const uint32_t exponent = bits >> 23 & 0xFF;
+    uint32_t mantissa = bits & 0x7FFFFF;
+    char *start;
+    if (exponent == 0xFF)
+    {
+        start = end - 3;
+        memcpy(start, mantissa != 0 ? "nan" : "inf", 3);
+    }
+    else
+    {
+        // the value is mantissa * 2^shift
+        int shift = -149;
+        if (exponent != 0)
+        {
+            mantissa |= 1 << 23;
+            shift = exponent - 150;
+        }
+
+        if (shift >= 0)
+        {
+            start = end - 7;
+            memcpy(start, ".000000", 7);
+            start = formatWide(start, mantissa, shift);
+        }
+        else
+        {
+            // the fraction times a million still fits in 44 bits, so anything
+            // past 2^-64 rounds to nothing
+            const uint32_t k = -shift;
+            uint32_t whole = k < 32 ? mantissa >> k : 0;
+            const uint64_t scaled = (k < 32 ? mantissa & ((1u << k) - 1) : mantissa) * (uint64_t)1000000;
+            uint32_t millionths = 0;
+            if (k < 64)
+            {
+                millionths = scaled >> k;
+                const uint64_t rest = scaled & ((1ull << k) - 1);
+                const uint64_t half = 1ull << (k - 1);
+                if (rest > half || (rest == half && (millionths & 1)))
+                    millionths++;
+            }
+            if (millionths == 1000000)
+            {
+                whole++;
+                millionths = 0;
+            }
+            start = formatDigits(end, millionths, 6);
+            *--start = '.';
+            start = formatUnsigned(start, whole);
+        }
+    }
+    if (bits >> 31)
+        *--start = '-';
+    return start;
+}
+
+// print, printi and printf of a register's value, the same as printf's %u,
+// %d and %f would write them
+void VM::_outputValue(uint8_t op, uint32_t value, bool newline)
+{
+    // the longest float is 47 characters
+    char text[64];
+    char *end = &text[sizeof(text) - 1];
+    *end = '\n';
+    char *start;
+    if (op == OP_PRINT)
+        start = formatUnsigned(end, value);
+    else if (op == OP_PRINTI)
+    {
+        // the magnitude of INT32_MIN only fits unsigned
+        start = formatUnsigned(end, (int32_t)value < 0 ? 0u - value : value);
+        if ((int32_t)value < 0)
+            *--start = '-';
+    }
+    else
+        start = formatFloat(end, value);
+    this->_output(start, end - start + (newline ? 1 : 0));
+}
@@ -0,0 +1,302 @@
+#include "jit.h"
+
+#ifdef VM_JIT_STENCILS
+
+#include "stencils.h"
+
+// The copy-and-patch backend: instead of encoding x86 instructions itself, it
+// copies the machine code the C++ compiler made for every instruction out of
+// src/stencils.cpp and fills in the register offsets, immediates and jumps.
+// Blocks, exits and the way they are run are the same as for the other backend.
+
+#define _STENCIL_CASE(op)          \
+    case OP_##op:                  \
+        stencil = &stencil_##op;   \
+        break;
+
+// copies a stencil to the end of the block and fills in its holes, its way out
+// (if it has one) goes on at exitAddr after executed instructions
+void JitCompiler::_patch(const Stencil &stencil, const uint32_t *values, uint32_t exitAddr, uint8_t executed, bool jump)
+{
+    const uint32_t start = this->_codeUsed;
+    memcpy(&this->_code[start], stencil.code, stencil.size);
+    this->_codeUsed += stencil.size;
+
+    for (uint8_t i = 0; i < stencil.holeCount; i++)
+    {
+        const StencilHole &hole = stencil.holes[i];
+        const uint32_t patch = start + hole.offset;
+        if (hole.kind == HOLE_CONTINUE)
+            this->_resolve(patch, hole.addend, this->_codeUsed);
+        else if (hole.kind == HOLE_TARGET)
+        {
+            PendingExit &pending = this->_pending[this->_pendingCount++];
+            pending.patch = patch;
+            pending.addend = hole.addend;
+            pending.addr = exitAddr;
+            pending.executed = executed;
+            pending.jump = jump;
+        }
+        else
+        {
+            const uint32_t value = values[hole.kind] + hole.addend;
+            memcpy(&this->_code[patch], &value, sizeof(uint32_t));
+        }
+    }
+}
+
+void JitCompiler::_patchEnter()
+{
+    this->_patch(stencil_ENTER, nullptr, 0, 0, false);
+}
+
+// goes on at target after executed instructions, back around the block while
+// the budget allows a full run of it (full instructions)
+void JitCompiler::_patchJump(uint32_t target, uint8_t executed, uint8_t full)
+{
+    if (target == this->_blockStart)
+    {
+        const uint32_t values[] = {0, 0, 0, executed, full};
+        const uint8_t first = this->_pendingCount;
+        this->_patch(stencil_LOOP, values, 0, 0, false);
+        while (this->_pendingCount > first)
+        {
+            const PendingExit &pending = this->_pending[--this->_pendingCount];
+            this->_resolve(pending.patch, pending.addend, this->_blockEntry);
+        }
+        executed = 0;
+    }
+    this->_patchExit(target, executed);
+}
+
+void JitCompiler::_patchExit(uint32_t addr, uint8_t executed)
+{
+    const uint32_t values[] = {0, 0, 0, addr, executed};
+    this->_patch(stencil_EXIT, values, 0, 0, false);
+}
+
+// conditional jump taken when the given one isn't
+static uint8_t inverse(uint8_t op)
+{
+    switch (op)
+    {
+    case OP_JZ:
+        return OP_JNZ;
+    case OP_JNZ:
+        return OP_JZ;
+    case OP_JE:
+        return OP_JNE;
+    case OP_JNE:
+        return OP_JE;
+    case OP_JA:
+        return OP_JBE;
+    case OP_JBE:
+        return OP_JA;
+    case OP_JG:
+        return OP_JLE;
+    case OP_JLE:
+        return OP_JG;
+    case OP_JAE:
+        return OP_JB;
+    case OP_JB:
+        return OP_JAE;
+    case OP_JGE:
+        return OP_JL;
+    default:
+        return OP_JGE;
+    }
+}
+
+// same contract as _emitInstr()
+bool JitCompiler::_patchInstr(const DecodedInstr &instr, uint32_t addr, uint8_t index, uint32_t next)
+{
+    // an instruction takes at most two stencils, and every exit they add (plus
+    // the one at the end of the block) may need a loop and an exit stencil
+    const uint32_t exitBytes = stencil_LOOP.size + stencil_EXIT.size;
+    if (this->_pendingCount + 3u > sizeof(this->_pending) / sizeof(this->_pending[0]) ||
+        this->_codeUsed + 2 * STENCIL_MAX_BYTES + (this->_pendingCount + 3) * exitBytes > VM_JIT_CODE_SIZE)
+        return false;
+
+    const uint8_t count = index + 1;
+    uint32_t values[] = {instr.a * 4u, instr.b * 4u, instr.c * 4u, instr.imm, 0};
+    const Stencil *stencil = nullptr;
+    // checks that fail leave right before the instruction
+    uint32_t exitAddr = addr;
+    uint8_t executed = index;
+    bool jump = false;
+
+    switch (instr.op)
+    {
+    case OP_NOP:
+    case OP_U2I:
+    case OP_I2U:
+        return true;
+    case OP_LCONS:
+    case OP_LCONSW:
+    case OP_LCONSB:
+        stencil = &stencil_LCONS;
+        break;
+    case OP_PUSH:
+        if (instr.a == SP || this->_memSize < this->_progLen + 4)
+            return false;
+        values[HOLE_IMM] = this->_progLen;
+        values[HOLE_IMM2] = this->_memSize - 4;
+        stencil = &stencil_PUSH;
+        break;
+    case OP_POP:
+    case OP_POP2:
+    {
+        const uint8_t n = instr.op == OP_POP ? 1 : 2;
+        if (instr.a == SP || (n == 2 && instr.b == SP) || this->_memSize < this->_progLen + 4 * n)
+            return false;
+        values[HOLE_IMM] = this->_progLen;
+        values[HOLE_IMM2] = this->_memSize - 4 * n;
+        stencil = n == 1 ? &stencil_POP : &stencil_POP2;
+        break;
+    }
+    case OP_DUP:
+        if (this->_memSize < this->_progLen + 8)
+            return false;
+        values[HOLE_IMM] = this->_progLen;
+        values[HOLE_IMM2] = this->_memSize - 8;
+        stencil = &stencil_DUP;
+        break;
+    case OP_CALL:
+        values[HOLE_A] = RA * 4;
+        values[HOLE_IMM] = addr + instr.len;
+        this->_patch(stencil_LCONS, values, 0, 0, false);
+        if (next == JIT_NO_TRACE)
+            this->_patchJump(instr.imm, count, count);
+        return true;
+    case OP_JMP:
+        if (next == JIT_NO_TRACE)
+            this->_patchJump(instr.imm, count, count);
+        return true;
+    case OP_RET:
+    case OP_JR:
+        values[HOLE_A] = (instr.op == OP_RET ? RA : instr.a) * 4;
+        // in a trace, going anywhere else than while recording leaves it
+        if (next != JIT_NO_TRACE)
+        {
+            values[HOLE_IMM] = next;
+            stencil = &stencil_GUARD;
+            break;
+        }
+        values[HOLE_IMM2] = count;
+        this->_patch(stencil_EXIT_REG, values, 0, 0, false);
+        return true;
+    case OP_STOR:
+    case OP_STORW:
+    case OP_STORB:
+        // writes to code go through the interpreter, which invalidates
+        if (this->_storesCode(instr.imm, instr.op == OP_STOR ? 4 : instr.op == OP_STORW ? 2 : 1))
+            return false;
+        stencil = instr.op == OP_STOR ? &stencil_STOR : instr.op == OP_STORW ? &stencil_STORW : &stencil_STORB;
+        break;
+    case OP_STOR_P:
+    case OP_STORW_P:
+    case OP_STORB_P:
+    case OP_LOAD_P:
+    case OP_LOADW_P:
+    case OP_LOADB_P:
+    {
+        const uint8_t size = instr.op == OP_STOR_P || instr.op == OP_LOAD_P ? 4 : instr.op == OP_STORW_P || instr.op == OP_LOADW_P ? 2 : 1;
+        if (this->_memSize < size)
+            return false;
+        // stores through pointers leave the block anywhere in the code
+        // section, a 32-bit hole can't hold the code map to check them with
+        values[HOLE_IMM] = this->_memSize - size;
+        values[HOLE_IMM2] = this->_codeLen;
+        switch (instr.op)
+        {
+            _STENCIL_CASE(STOR_P)
+            _STENCIL_CASE(STORW_P)
+            _STENCIL_CASE(STORB_P)
+            _STENCIL_CASE(LOAD_P)
+            _STENCIL_CASE(LOADW_P)
+            _STENCIL_CASE(LOADB_P)
+        }
+        break;
+    }
+    case OP_FINC:
+        values[HOLE_IMM] = 0x3F800000; // 1.0f
+        stencil = &stencil_FADDI;
+        break;
+    case OP_FDEC:
+        values[HOLE_IMM] = 0xBF800000; // -1.0f
+        stencil = &stencil_FADDI;
+        break;
+    case OP_JZ:
+    case OP_JNZ:
+    case OP_JE:
+    case OP_JNE:
+    case OP_JA:
+    case OP_JG:
+    case OP_JAE:
+    case OP_JGE:
+    case OP_JB:
+    case OP_JL:
+    case OP_JBE:
+    case OP_JLE:
+    {
+        // in a trace, a conditional jump leaves it when it goes the other way
+        // than it did while recording
+        const uint32_t fallthrough = addr + instr.len;
+        const bool taken = next != JIT_NO_TRACE && next == instr.imm && next != fallthrough;
+        exitAddr = taken ? fallthrough : instr.imm;
+        executed = count;
+        jump = true;
+        switch (taken ? inverse(instr.op) : instr.op)
+        {
+            _STENCIL_CASE(JZ)
+            _STENCIL_CASE(JNZ)
+            _STENCIL_CASE(JE)
+            _STENCIL_CASE(JNE)
+            _STENCIL_CASE(JA)
+            _STENCIL_CASE(JG)
+            _STENCIL_CASE(JAE)
+            _STENCIL_CASE(JGE)
+            _STENCIL_CASE(JB)
+            _STENCIL_CASE(JL)
+            _STENCIL_CASE(JBE)
+            _STENCIL_CASE(JLE)
+        }
+        break;
+    }
+        _STENCIL_CASE(MOV)
+        _STENCIL_CASE(LOAD)
+        _STENCIL_CASE(LOADW)
+        _STENCIL_CASE(LOADB)
+        _STENCIL_CASE(INC)
+        _STENCIL_CASE(DEC)
+        _STENCIL_CASE(ADD)
+        _STENCIL_CASE(SUB)
+        _STENCIL_CASE(MUL)
+        _STENCIL_CASE(IMUL)
+        _STENCIL_CASE(AND)
+        _STENCIL_CASE(OR)
+        _STENCIL_CASE(XOR)
+        _STENCIL_CASE(NOT)
+        _STENCIL_CASE(SHL)
+        _STENCIL_CASE(SHR)
+        _STENCIL_CASE(ISHR)
+        _STENCIL_CASE(DIV)
+        _STENCIL_CASE(MOD)
+        _STENCIL_CASE(IDIV)
+        _STENCIL_CASE(IMOD)
+        _STENCIL_CASE(FADD)
+        _STENCIL_CASE(FSUB)
+        _STENCIL_CASE(FMUL)
+        _STENCIL_CASE(FDIV)
+        _STENCIL_CASE(I2F)
+        _STENCIL_CASE(F2I)
+    default:
+        // system calls, memcpy and I/O stay in the interpreter
+        return false;
+    }
+
+    this->_patch(*stencil, values, exitAddr, executed, jump);
+    return true;
+}
+
+#endif // VM_JIT_STENCILS
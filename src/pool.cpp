@@ -0,0 +1,45 @@
+#include "vm.h"
+
+VMPool::VMPool(Program *program, uint32_t count)
+    : _program(program)
+{
+    program->retain();
+    this->_free.reserve(count);
+    for (uint32_t i = 0; i < count; i++)
+        this->_free.push_back(new VM(program));
+}
+
+VMPool::~VMPool()
+{
+    for (VM *vm : this->_free)
+        delete vm;
+    this->_program->release();
+}
+
+// a VM ready to run from the start of the program, a new one if they're all in use
+VM *VMPool::acquire()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->_lock);
+        if (!this->_free.empty())
+        {
+            VM *vm = this->_free.back();
+            this->_free.pop_back();
+            return vm;
+        }
+    }
+    return new VM(this->_program);
+}
+
+void VMPool::release(VM *vm)
+{
+    vm->restore();
+    std::lock_guard<std::mutex> lock(this->_lock);
+    this->_free.push_back(vm);
+}
+
+uint32_t VMPool::available()
+{
+    std::lock_guard<std::mutex> lock(this->_lock);
+    return this->_free.size();
+}
@@ -0,0 +1,68 @@
+#include <algorithm>
+#include "vm.h"
+#include "decode.h"
+
+// the overhead is what the clock says an instruction that does nothing takes:
+// the least time between two records, of many in a row
+Profile::Profile()
+{
+    this->overhead = 0;
+    uint64_t least = UINT64_MAX;
+    uint64_t last = VM_PROFILE_CLOCK();
+    for (uint32_t i = 0; i < 1000; i++)
+    {
+        const uint64_t now = VM_PROFILE_CLOCK();
+        this->record(OP_NOP, now - last);
+        least = std::min(least, now - last);
+        last = now;
+    }
+    this->clear();
+    this->overhead = least;
+}
+
+void Profile::clear()
+{
+    memset(this->entries, 0, sizeof(this->entries));
+}
+
+// every instruction executed at least once, the most time first: count,
+// cycles in all and on average, share of the total and a histogram of the
+// cycles each execution took, with a darker mark for more of them
+void Profile::report(FILE *file) const
+{
+    std::vector<uint8_t> sorted;
+    uint64_t count = 0;
+    uint64_t cycles = 0;
+    for (uint32_t instr = 0; instr < INSTRUCTION_COUNT; instr++)
+    {
+        if (this->entries[instr].count == 0)
+            continue;
+        sorted.push_back(instr);
+        count += this->entries[instr].count;
+        cycles += this->entries[instr].cycles;
+    }
+    std::sort(sorted.begin(), sorted.end(), [this](uint8_t a, uint8_t b) {
+        return this->entries[a].cycles > this->entries[b].cycles;
+    });
+
+    fprintf(file, "\n%llu instructions in %llu cycles, less %llu per instruction for profiling\n",
+            (unsigned long long)count, (unsigned long long)cycles, (unsigned long long)this->overhead);
+    fprintf(file, "%-8s %12s %14s %7s %9s  cycles 1, 2, 4 ... %u+\n", "instr", "count", "cycles", "share", "average",
+            1u << (VM_PROFILE_BUCKETS - 1));
+    static const char marks[] = " .:-=+*#%@";
+    for (uint8_t instr : sorted)
+    {
+        const Entry &entry = this->entries[instr];
+        fprintf(file, "%-8s %12llu %14llu %6.2f%% %9.1f  |", instrName[instr], (unsigned long long)entry.count,
+                (unsigned long long)entry.cycles, cycles == 0 ? 0.0 : 100.0 * entry.cycles / cycles,
+                (double)entry.cycles / entry.count);
+        const uint64_t most = *std::max_element(entry.histogram, entry.histogram + VM_PROFILE_BUCKETS);
+        for (uint32_t bucket = 0; bucket < VM_PROFILE_BUCKETS; bucket++)
+        {
+            // any at all shows
+            const uint64_t n = entry.histogram[bucket];
+            fputc(n == 0 ? ' ' : marks[1 + n * (sizeof(marks) - 3) / most], file);
+        }
+        fputs("|\n", file);
+    }
+}
@@ -0,0 +1,404 @@
+#include "vm.h"
+#include "decode.h"
+#include <stddef.h>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+Program::Program(const uint8_t *code, uint32_t progLen, uint32_t stackSize)
+    : Program(code, progLen, progLen, progLen, stackSize, nullptr)
+{
+}
+
+// image holds the first imageLen bytes of memory (the program, or only the
+// part of it before zeroed data, and for snapshots the stack too), codeLen
+// how much of the program is code, registers the ones VMs start with (nullptr
+// for zeroed ones and an empty stack). fd is a file with the image at
+// fileOffset, mapped instead of copied if it can be
+Program::Program(const uint8_t *image, uint32_t imageLen, uint32_t progLen, uint32_t codeLen, uint32_t stackSize,
+                 const uint32_t *registers, int fd, uint32_t fileOffset)
+    : _refs(1), _code(nullptr), _imageLen(imageLen), _progLen(progLen), _codeLen(codeLen), _stackSize(stackSize)
+{
+    // the program is always all there for copying it into memory
+    const uint32_t mapLen = imageLen > progLen ? imageLen : progLen;
+    if (registers != nullptr)
+        memcpy(this->_registers, registers, sizeof(this->_registers));
+    else
+    {
+        memset(this->_registers, 0, sizeof(this->_registers));
+        this->_registers[SP] = progLen + stackSize;
+    }
+    this->_entry = this->_registers[IP];
+
+#ifdef __linux__
+    // programs of a page or more go in a memory file, so that every VM maps
+    // the same pages and only copies the ones it writes to. Whole pages after
+    // the code of an image at a page boundary of its file are used straight
+    // from it instead, the page cache then holds the only copy. The code is
+    // always copied, it is verified once and mustn't change with the file
+    const uint32_t page = sysconf(_SC_PAGESIZE);
+    const uint32_t codeEnd = (codeLen + page - 1) / page * page;
+    const uint32_t copied = fd >= 0 && fileOffset % page == 0 && imageLen / page * page > codeEnd ? codeEnd : mapLen;
+    if (mapLen >= page)
+    {
+        void *mapped = mmap(nullptr, mapLen, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        this->_fd = memfd_create("risvm-program", MFD_CLOEXEC);
+        if (mapped != MAP_FAILED && this->_fd >= 0 && ftruncate(this->_fd, copied) == 0 &&
+            mmap(mapped, copied, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, this->_fd, 0) != MAP_FAILED)
+        {
+            memcpy(mapped, image, copied < imageLen ? copied : imageLen);
+            mprotect(mapped, copied, PROT_READ);
+            if (copied == mapLen ||
+                (mmap((uint8_t *)mapped + copied, imageLen - copied, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, fileOffset + copied) != MAP_FAILED &&
+                 (this->_file = fcntl(fd, F_DUPFD_CLOEXEC, 0)) >= 0))
+            {
+                this->_code = (uint8_t *)mapped;
+                this->_copiedLen = copied;
+                this->_fileOffset = fileOffset;
+            }
+        }
+        if (this->_code == nullptr)
+        {
+            if (mapped != MAP_FAILED)
+                munmap(mapped, mapLen);
+            if (this->_fd >= 0)
+                close(this->_fd);
+            this->_fd = -1;
+        }
+    }
+#endif
+    if (this->_code == nullptr)
+    {
+        this->_code = new uint8_t[mapLen]();
+        memcpy(this->_code, image, imageLen);
+    }
+
+    this->_verifyMap = new uint8_t[(codeLen + 7) / 8 * 2];
+    this->_blockLen = new uint32_t[codeLen];
+    this->_verified = verifyProgram(this->_code, codeLen, progLen + stackSize, this->_registers[IP], this->_verifyMap, this->_blockLen);
+}
+
+// CRC-32 as computed by zlib (and so by the assembler)
+struct CrcTable
+{
+    uint32_t entries[256];
+
+    CrcTable()
+    {
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t crc = i;
+            for (uint8_t bit = 0; bit < 8; bit++)
+                crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+            this->entries[i] = crc;
+        }
+    }
+};
+
+static uint32_t crc32(uint32_t crc, const uint8_t *data, uint32_t len)
+{
+    static const CrcTable table;
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; i++)
+        crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+const char *imageErrorString(ImageError error)
+{
+    switch (error)
+    {
+    case IMAGE_OK:
+        return "no error";
+    case IMAGE_ERR_TRUNCATED:
+        return "truncated";
+    case IMAGE_ERR_VERSION:
+        return "unsupported version";
+    case IMAGE_ERR_SIZE:
+        return "invalid sizes or entry point";
+    case IMAGE_ERR_CHECKSUM:
+        return "checksum mismatch";
+    default:
+        return "could not be read";
+    }
+}
+
+// checks an image file as written by the assembler, or plain program bytes,
+// and finds where the image for memory starts in it, how long it is and how
+// much of it is code. Images get at least the stack they ask for
+static ImageError parseImage(const uint8_t *data, uint32_t len, uint32_t &stackSize, uint32_t &offset, uint32_t &imageLen,
+                             uint32_t &progLen, uint32_t &codeLen, uint32_t *registers)
+{
+    memset(registers, 0, REGISTER_COUNT * sizeof(uint32_t));
+    if (len < sizeof(ImageHeader::magic) || memcmp(data, VM_IMAGE_MAGIC, sizeof(ImageHeader::magic)) != 0)
+    {
+        if (len == 0 || (uint64_t)len + stackSize > UINT32_MAX)
+            return IMAGE_ERR_SIZE;
+        offset = 0;
+        imageLen = progLen = codeLen = len;
+        registers[SP] = progLen + stackSize;
+        return IMAGE_OK;
+    }
+
+    ImageHeader header;
+    if (len < sizeof(header))
+        return IMAGE_ERR_TRUNCATED;
+    memcpy(&header, data, sizeof(header));
+    if (header.version != VM_IMAGE_VERSION)
+        return IMAGE_ERR_VERSION;
+
+    const uint64_t fileLen = (uint64_t)header.headerSize + header.codeSize + header.rodataSize;
+    if (header.headerSize < sizeof(header) || fileLen > len)
+        return IMAGE_ERR_TRUNCATED;
+    if (header.stackSize > stackSize)
+        stackSize = header.stackSize;
+    const uint64_t sectionsLen = (uint64_t)header.codeSize + header.rodataSize + header.bssSize;
+    if (fileLen < len || sectionsLen + stackSize > UINT32_MAX || header.entry >= header.codeSize)
+        return IMAGE_ERR_SIZE;
+
+    const uint8_t zero[sizeof(header.checksum)] = {0};
+    const uint32_t checksumAt = offsetof(ImageHeader, checksum);
+    uint32_t crc = crc32(0, data, checksumAt);
+    crc = crc32(crc, zero, sizeof(zero));
+    crc = crc32(crc, data + checksumAt + sizeof(zero), len - checksumAt - sizeof(zero));
+    if (crc != header.checksum)
+        return IMAGE_ERR_CHECKSUM;
+
+    offset = header.headerSize;
+    imageLen = header.codeSize + header.rodataSize;
+    progLen = sectionsLen;
+    codeLen = header.codeSize;
+    registers[IP] = header.entry;
+    registers[SP] = progLen + stackSize;
+    return IMAGE_OK;
+}
+
+Program *Program::load(const uint8_t *data, uint32_t len, uint32_t stackSize, ImageError *error)
+{
+    ImageError unused;
+    if (error == nullptr)
+        error = &unused;
+    uint32_t offset, imageLen, progLen, codeLen, registers[REGISTER_COUNT];
+    *error = parseImage(data, len, stackSize, offset, imageLen, progLen, codeLen, registers);
+    if (*error != IMAGE_OK)
+        return nullptr;
+    return new Program(data + offset, imageLen, progLen, codeLen, stackSize, registers);
+}
+
+// the same as load() on the contents of the file at path. Where the image
+// sits at a page boundary of the file (the assembler puts large images
+// there), VMs run the whole pages after its code from the file's pages
+// rather than a copy of them, so those mustn't change while it's in use.
+// The code itself is copied, replacing the file can't change what runs
+Program *Program::map(const char *path, uint32_t stackSize, ImageError *error)
+{
+    ImageError unused;
+    if (error == nullptr)
+        error = &unused;
+    *error = IMAGE_ERR_FILE;
+#ifdef __linux__
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return nullptr;
+    struct stat st;
+    void *data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0 && st.st_size <= UINT32_MAX)
+        data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+    {
+        close(fd);
+        return nullptr;
+    }
+
+    const uint32_t len = st.st_size;
+    Program *program = nullptr;
+    uint32_t offset, imageLen, progLen, codeLen, registers[REGISTER_COUNT];
+    *error = parseImage((const uint8_t *)data, len, stackSize, offset, imageLen, progLen, codeLen, registers);
+    if (*error == IMAGE_OK)
+        program = new Program((const uint8_t *)data + offset, imageLen, progLen, codeLen, stackSize, registers, fd, offset);
+    munmap(data, len);
+    close(fd);
+    return program;
+#else
+    FILE *f = fopen(path, "rb");
+    if (f == nullptr)
+        return nullptr;
+    fseek(f, 0, SEEK_END);
+    const long len = ftell(f);
+    rewind(f);
+    Program *program = nullptr;
+    if (len > 0 && (unsigned long)len <= UINT32_MAX)
+    {
+        uint8_t *data = new uint8_t[len];
+        if (fread(data, len, 1, f) == 1)
+            program = Program::load(data, len, stackSize, error);
+        delete[] data;
+    }
+    fclose(f);
+    return program;
+#endif
+}
+
+Program::~Program()
+{
+#ifdef __linux__
+    if (this->_fd >= 0)
+    {
+        munmap(this->_code, this->_imageLen > this->_progLen ? this->_imageLen : this->_progLen);
+        close(this->_fd);
+        if (this->_file >= 0)
+            close(this->_file);
+    }
+    else
+#endif
+        delete[] this->_code;
+    delete[] this->_verifyMap;
+    delete[] this->_blockLen;
+    delete[] this->_decoded;
+    delete[] this->_codeMap;
+}
+
+void Program::retain()
+{
+    this->_refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Program::release()
+{
+    if (this->_refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        delete this;
+}
+
+const uint8_t *Program::code()
+{
+    return this->_code;
+}
+
+uint32_t Program::progLen()
+{
+    return this->_progLen;
+}
+
+uint32_t Program::codeLen()
+{
+    return this->_codeLen;
+}
+
+uint32_t Program::stackSize()
+{
+    return this->_stackSize;
+}
+
+uint32_t Program::entry()
+{
+    return this->_entry;
+}
+
+// memory for a VM: the image followed by zeroes
+uint8_t *Program::_mapMemory(bool &mapped)
+{
+    const uint32_t memSize = this->_progLen + this->_stackSize;
+#ifdef __linux__
+    // anything of a page or more is mapped, so that untouched pages cost
+    // nothing and resets can hand back the touched ones
+    const uint32_t page = sysconf(_SC_PAGESIZE);
+    if (memSize >= page)
+    {
+        // whole pages of the image are private mappings of the memory file
+        // and, past the code, of the program's file, the rest fresh zeroed
+        // pages
+        const uint32_t shared = this->_fd >= 0 ? this->_imageLen / page * page : 0;
+        const uint32_t copied = shared < this->_copiedLen ? shared : this->_copiedLen;
+        void *memory = mmap(nullptr, memSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory != MAP_FAILED)
+        {
+            if ((copied == 0 ||
+                 mmap(memory, copied, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, this->_fd, 0) != MAP_FAILED) &&
+                (shared == copied ||
+                 mmap((uint8_t *)memory + copied, shared - copied, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, this->_file,
+                      this->_fileOffset + copied) != MAP_FAILED))
+            {
+                memcpy((uint8_t *)memory + shared, this->_code + shared, this->_imageLen - shared);
+                mapped = true;
+                return (uint8_t *)memory;
+            }
+            munmap(memory, memSize);
+        }
+    }
+#endif
+    mapped = false;
+    uint8_t *memory = new uint8_t[memSize]();
+    memcpy(memory, this->_code, this->_imageLen);
+    return memory;
+}
+
+// zeroes the stack or, unless keepProgram, puts back all of the image over
+// whatever the VM wrote
+void Program::_resetMemory(uint8_t *memory, bool mapped, bool keepProgram)
+{
+    const uint32_t memSize = this->_progLen + this->_stackSize;
+#ifdef __linux__
+    if (mapped)
+    {
+        // dropping whole pages only costs for the ones that were touched, they
+        // come back zeroed, or from the files for the image's
+        const uint32_t page = sysconf(_SC_PAGESIZE);
+        const uint32_t fileEnd = this->_fd >= 0 ? this->_imageLen / page * page : 0;
+        if (keepProgram)
+        {
+            uint32_t start = (this->_progLen + page - 1) / page * page;
+            start = start > fileEnd ? start : fileEnd;
+            start = start < memSize ? start : memSize;
+            memset(&memory[this->_progLen], 0, start - this->_progLen);
+            if (start < memSize)
+                madvise(memory + start, memSize - start, MADV_DONTNEED);
+        }
+        else
+        {
+            madvise(memory, memSize, MADV_DONTNEED);
+            memcpy(&memory[fileEnd], &this->_code[fileEnd], this->_imageLen - fileEnd);
+        }
+        return;
+    }
+#endif
+    if (keepProgram)
+        memset(&memory[this->_progLen], 0, this->_stackSize);
+    else
+    {
+        memcpy(memory, this->_code, this->_imageLen);
+        memset(&memory[this->_imageLen], 0, memSize - this->_imageLen);
+    }
+}
+
+void Program::_unmapMemory(uint8_t *memory, bool mapped)
+{
+#ifdef __linux__
+    if (mapped)
+    {
+        munmap(memory, this->_progLen + this->_stackSize);
+        return;
+    }
+#endif
+    delete[] memory;
+}
+
+// the code reachable from the entry point decoded up front, so VMs can read
+// it without locking once they have it. A VM reaching anything else (through
+// an indirect jump) decodes it in its own copy
+DecodedInstr *Program::_decodedInstrs()
+{
+    std::lock_guard<std::mutex> lock(this->_decodeLock);
+    if (this->_decoded != nullptr)
+        return this->_decoded;
+
+    DecodedInstr *decoded = new DecodedInstr[this->_codeLen + 1];
+    this->_codeMap = new uint8_t[this->_codeLen + 4];
+    const uint32_t roots[] = {this->_registers[IP], this->_entry};
+    decodeProgram(this->_code, this->_codeLen, this->_progLen + this->_stackSize, roots, 2, decoded, this->_codeMap);
+    this->_decoded = decoded;
+    return decoded;
+}
@@ -0,0 +1,130 @@
+#include "vm.h"
+
+// threads = 0 for one per core, slice = instructions a VM runs before giving
+// its thread to the next one
+Scheduler::Scheduler(uint32_t threads, uint32_t slice)
+    : _slice(slice), _queued(0), _pending(0), _next(0)
+{
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    if (threads == 0)
+        threads = 1;
+    for (uint32_t i = 0; i < threads; i++)
+        this->_workers.push_back(new Worker());
+    for (uint32_t i = 0; i < threads; i++)
+        this->_workers[i]->thread = std::thread(&Scheduler::_work, this, i);
+}
+
+// runs everything submitted to the end first
+Scheduler::~Scheduler()
+{
+    this->wait();
+    {
+        std::lock_guard<std::mutex> lock(this->_idleLock);
+        this->_stopping = true;
+    }
+    this->_wake.notify_all();
+    // the others may still look in a thread's queue until they've all stopped
+    for (Worker *worker : this->_workers)
+        worker->thread.join();
+    for (Worker *worker : this->_workers)
+        delete worker;
+}
+
+// runs vm from where it is until it stops for anything but a pause, then
+// calls done with the result. The VM is the scheduler's until then, and can
+// be submitted from any thread, done callbacks included
+void Scheduler::submit(VM *vm, DoneCallback done, void *context)
+{
+    this->_pending.fetch_add(1, std::memory_order_relaxed);
+    const Job job = {vm, done, context};
+    this->_push(this->_next.fetch_add(1, std::memory_order_relaxed) % this->_workers.size(), job, true);
+}
+
+// until every VM submitted so far has finished
+void Scheduler::wait()
+{
+    std::unique_lock<std::mutex> lock(this->_idleLock);
+    this->_done.wait(lock, [this] { return this->_pending.load() == 0; });
+}
+
+uint32_t Scheduler::threads()
+{
+    return this->_workers.size();
+}
+
+void Scheduler::_push(uint32_t index, const Job &job, bool wake)
+{
+    Worker *worker = this->_workers[index];
+    {
+        std::lock_guard<std::mutex> lock(worker->lock);
+        worker->jobs.push_back(job);
+        // a queue with more than one job has some to spare for idle threads
+        wake = wake || worker->jobs.size() > 1;
+    }
+    this->_queued.fetch_add(1);
+    if (!wake)
+        return;
+    std::lock_guard<std::mutex> lock(this->_idleLock);
+    if (this->_idle > 0)
+        this->_wake.notify_one();
+}
+
+// the oldest job in the thread's own queue, or else the newest one in another's
+bool Scheduler::_take(uint32_t index, Job &job)
+{
+    const uint32_t count = this->_workers.size();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        Worker *worker = this->_workers[(index + i) % count];
+        std::lock_guard<std::mutex> lock(worker->lock);
+        if (worker->jobs.empty())
+            continue;
+        if (i == 0)
+        {
+            job = worker->jobs.front();
+            worker->jobs.pop_front();
+        }
+        else
+        {
+            job = worker->jobs.back();
+            worker->jobs.pop_back();
+        }
+        this->_queued.fetch_sub(1);
+        return true;
+    }
+    return false;
+}
+
+void Scheduler::_work(uint32_t index)
+{
+    Job job;
+    for (;;)
+    {
+        if (!this->_take(index, job))
+        {
+            std::unique_lock<std::mutex> lock(this->_idleLock);
+            this->_idle++;
+            this->_wake.wait(lock, [this] { return this->_stopping || this->_queued.load() > 0; });
+            this->_idle--;
+            if (this->_stopping && this->_queued.load() == 0)
+                return;
+            continue;
+        }
+
+        // paused VMs go to the back of the queue, behind the ones waiting
+        const ExecResult result = job.vm->run(this->_slice);
+        if (result == VM_PAUSED)
+        {
+            this->_push(index, job, false);
+            continue;
+        }
+        if (job.done != nullptr)
+            job.done(job.vm, result, job.context);
+        if (this->_pending.fetch_sub(1) == 1)
+        {
+            std::lock_guard<std::mutex> lock(this->_idleLock);
+            this->_done.notify_all();
+        }
+    }
+}
@@ -0,0 +1,110 @@
+// Runs a program one instruction at a time and reports the most frequently
+// executed straight-line opcode sequences, i.e. superinstruction candidates.
+
+#include <map>
+#include <vector>
+#include <algorithm>
+#include "vm.h"
+#include "decode.h"
+
+#define MAX_SEQ_LEN 3
+#define STACK_SIZE 2192
+
+static bool endsSequence(uint8_t instr)
+{
+    return instr == OP_HALT || instr == OP_INT || instr == OP_CALL || instr == OP_RET ||
+           (instr >= OP_JMP && instr <= OP_JLE) || instr == OP_LJMP || instr == OP_LCALL;
+}
+
+static bool compareCounts(const std::pair<uint32_t, uint64_t> &a, const std::pair<uint32_t, uint64_t> &b)
+{
+    return a.second > b.second;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2 && argc != 3)
+    {
+        printf("Usage: %s bin_file [top_n]\n", argv[0]);
+        return 1;
+    }
+
+    const int topN = argc == 3 ? atoi(argv[2]) : 20;
+    ImageError error;
+    Program *loaded = Program::map(argv[1], STACK_SIZE, &error);
+    if (loaded == nullptr)
+    {
+        if (error == IMAGE_ERR_FILE)
+            printf("Could not open %s\n", argv[1]);
+        else
+            printf("Invalid image %s: %s\n", argv[1], imageErrorString(error));
+        return 1;
+    }
+    VM vm(loaded);
+    vm.setDispatch(VM_DISPATCH_SWITCH);
+    const uint32_t memSize = loaded->progLen() + loaded->stackSize();
+    loaded->release();
+
+    // sequences are keyed by their opcodes, one per byte, with the length in the top byte
+    std::map<uint32_t, uint64_t> counts;
+    uint8_t window[MAX_SEQ_LEN];
+    uint8_t windowLen = 0;
+    uint32_t nextIp = UINT32_MAX;
+    uint64_t total = 0;
+    ExecResult res;
+
+    do
+    {
+        const uint32_t ip = vm.getRegister(IP);
+        if (ip >= memSize)
+        {
+            res = vm.run(1);
+            break;
+        }
+        const uint8_t instr = *vm.peek(ip);
+
+        // only instructions that fall through into each other can be fused
+        if (ip != nextIp || windowLen == 0 || endsSequence(window[windowLen - 1]))
+            windowLen = 0;
+        if (windowLen == MAX_SEQ_LEN)
+        {
+            memmove(window, window + 1, MAX_SEQ_LEN - 1);
+            windowLen--;
+        }
+        window[windowLen++] = instr;
+        nextIp = instr < INSTRUCTION_COUNT ? ip + instrLength[instr] : UINT32_MAX;
+
+        res = vm.run(1);
+        if (res != ExecResult::VM_PAUSED)
+            break;
+        total++;
+
+        for (uint8_t n = 2; n <= windowLen; n++)
+        {
+            uint32_t key = n << 24;
+            for (uint8_t i = 0; i < n; i++)
+                key |= window[windowLen - n + i] << (8 * i);
+            counts[key]++;
+        }
+    } while (true);
+
+    std::vector<std::pair<uint32_t, uint64_t>> sorted(counts.begin(), counts.end());
+    std::sort(sorted.begin(), sorted.end(), compareCounts);
+
+    fprintf(stderr, "\nexit code %d after %llu instructions\n", res, (unsigned long long)total);
+    fprintf(stderr, "%12s %7s  %s\n", "count", "share", "sequence");
+    for (size_t i = 0; i < sorted.size() && (int)i < topN; i++)
+    {
+        const uint32_t key = sorted[i].first;
+        const uint8_t n = key >> 24;
+        fprintf(stderr, "%12llu %6.2f%%  ", (unsigned long long)sorted[i].second, 100.0 * sorted[i].second / total);
+        for (uint8_t j = 0; j < n; j++)
+        {
+            const uint8_t instr = (key >> (8 * j)) & 0xFF;
+            fprintf(stderr, "%s%s", j > 0 ? ", " : "", instr < INSTRUCTION_COUNT ? instrName[instr] : "?");
+        }
+        fputc('\n', stderr);
+    }
+
+    return res;
+}
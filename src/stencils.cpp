@@ -0,0 +1,520 @@
+// Stencils of the copy-and-patch JIT. This file isn't part of any executable:
+// the Makefile compiles it on its own and src/stencils.py cuts every stencil_*
+// function out of the object into src/stencils.h, along with the places its
+// holes (the _JIT_* symbols, which are never defined) have to be patched.
+//
+// Every stencil takes the register file, the memory, the budget and the
+// instructions executed by previous iterations of the block, and passes them
+// on unchanged to _JIT_CONTINUE, which becomes the next stencil. Leaving the
+// block goes through _JIT_TARGET, which is patched to jump to an exit.
+#include "vm.h"
+
+extern "C"
+{
+    // byte offsets of register operands
+    extern uint8_t _JIT_A[], _JIT_B[], _JIT_C[];
+    // immediates, addresses and limits
+    extern uint8_t _JIT_IMM[], _JIT_IMM2[];
+
+    uint64_t _JIT_CONTINUE(uint32_t *regs, uint8_t *mem, uint32_t budget, uint32_t executed);
+    uint64_t _JIT_TARGET(uint32_t *regs, uint8_t *mem, uint32_t budget, uint32_t executed);
+}
+
+#define _SARGS uint32_t *regs, uint8_t *mem, uint32_t budget, uint32_t executed
+#define _STENCIL(name) extern "C" uint64_t stencil_##name(_SARGS)
+#define _CONTINUE return _JIT_CONTINUE(regs, mem, budget, executed);
+#define _TARGET return _JIT_TARGET(regs, mem, budget, executed);
+
+// without -fpic the holes end up as 32-bit immediates and displacements
+#define _HOLE(h) ((uint32_t)(uintptr_t)(h))
+#define _REG(h) (*(uint32_t *)((uint8_t *)regs + (uintptr_t)(h)))
+#define _IREG(h) (*(int32_t *)((uint8_t *)regs + (uintptr_t)(h)))
+#define _FREG(h) (*(float *)((uint8_t *)regs + (uintptr_t)(h)))
+
+template <typename T>
+static inline uint32_t _load(const uint8_t *p)
+{
+    T v;
+    memcpy(&v, p, sizeof(T));
+    return v;
+}
+
+template <typename T>
+static inline void _store(uint8_t *p, uint32_t v)
+{
+    const T t = v;
+    memcpy(p, &t, sizeof(T));
+}
+
+template <uint8_t op>
+static inline uint32_t _binary(uint32_t b, uint32_t c);
+
+template <>
+inline uint32_t _binary<OP_ADD>(uint32_t b, uint32_t c) { return b + c; }
+template <>
+inline uint32_t _binary<OP_SUB>(uint32_t b, uint32_t c) { return b - c; }
+template <>
+inline uint32_t _binary<OP_MUL>(uint32_t b, uint32_t c) { return b * c; }
+template <>
+inline uint32_t _binary<OP_IMUL>(uint32_t b, uint32_t c) { return (uint32_t)((int32_t)b * (int32_t)c); }
+template <>
+inline uint32_t _binary<OP_AND>(uint32_t b, uint32_t c) { return b & c; }
+template <>
+inline uint32_t _binary<OP_OR>(uint32_t b, uint32_t c) { return b | c; }
+template <>
+inline uint32_t _binary<OP_XOR>(uint32_t b, uint32_t c) { return b ^ c; }
+// shift counts wrap like they do on x86 and in the interpreter
+template <>
+inline uint32_t _binary<OP_SHL>(uint32_t b, uint32_t c) { return b << (c & 31); }
+template <>
+inline uint32_t _binary<OP_SHR>(uint32_t b, uint32_t c) { return b >> (c & 31); }
+template <>
+inline uint32_t _binary<OP_ISHR>(uint32_t b, uint32_t c) { return (uint32_t)((int32_t)b >> (c & 31)); }
+
+template <uint8_t op>
+static inline float _fbinary(float b, float c);
+
+template <>
+inline float _fbinary<OP_FADD>(float b, float c) { return floatAdd(b, c); }
+template <>
+inline float _fbinary<OP_FSUB>(float b, float c) { return b - c; }
+template <>
+inline float _fbinary<OP_FMUL>(float b, float c) { return floatMul(b, c); }
+template <>
+inline float _fbinary<OP_FDIV>(float b, float c) { return b / c; }
+
+template <uint8_t op>
+static inline bool _cond(uint32_t a, uint32_t b);
+
+template <>
+inline bool _cond<OP_JE>(uint32_t a, uint32_t b) { return a == b; }
+template <>
+inline bool _cond<OP_JNE>(uint32_t a, uint32_t b) { return a != b; }
+template <>
+inline bool _cond<OP_JA>(uint32_t a, uint32_t b) { return a > b; }
+template <>
+inline bool _cond<OP_JG>(uint32_t a, uint32_t b) { return (int32_t)a > (int32_t)b; }
+template <>
+inline bool _cond<OP_JAE>(uint32_t a, uint32_t b) { return a >= b; }
+template <>
+inline bool _cond<OP_JGE>(uint32_t a, uint32_t b) { return (int32_t)a >= (int32_t)b; }
+template <>
+inline bool _cond<OP_JB>(uint32_t a, uint32_t b) { return a < b; }
+template <>
+inline bool _cond<OP_JL>(uint32_t a, uint32_t b) { return (int32_t)a < (int32_t)b; }
+template <>
+inline bool _cond<OP_JBE>(uint32_t a, uint32_t b) { return a <= b; }
+template <>
+inline bool _cond<OP_JLE>(uint32_t a, uint32_t b) { return (int32_t)a <= (int32_t)b; }
+
+// a: result, b and c: operands
+template <uint8_t op>
+static inline uint64_t _arith(_SARGS)
+{
+    _REG(_JIT_A) = _binary<op>(_REG(_JIT_B), _REG(_JIT_C));
+    _CONTINUE
+}
+
+template <uint8_t op>
+static inline uint64_t _farith(_SARGS)
+{
+    _FREG(_JIT_A) = _fbinary<op>(_FREG(_JIT_B), _FREG(_JIT_C));
+    _CONTINUE
+}
+
+// a and b: operands, leaves when the condition holds
+template <uint8_t op>
+static inline uint64_t _branch(_SARGS)
+{
+    if (_cond<op>(_REG(_JIT_A), _REG(_JIT_B)))
+        _TARGET
+    _CONTINUE
+}
+
+// imm: highest valid address, b: address register
+template <typename T>
+static inline uint64_t _loadPtr(_SARGS)
+{
+    const uint32_t addr = _REG(_JIT_B);
+    if (addr > _HOLE(_JIT_IMM))
+        _TARGET
+    _REG(_JIT_A) = _load<T>(mem + addr);
+    _CONTINUE
+}
+
+// imm: highest valid address, imm2: code length, a: address register
+template <typename T>
+static inline uint64_t _storePtr(_SARGS)
+{
+    const uint32_t addr = _REG(_JIT_A);
+    if (addr > _HOLE(_JIT_IMM) || addr < _HOLE(_JIT_IMM2))
+        _TARGET
+    _store<T>(mem + addr, _REG(_JIT_B));
+    _CONTINUE
+}
+
+// block entry, nothing has run yet
+_STENCIL(ENTER)
+{
+    return _JIT_CONTINUE(regs, mem, budget, 0);
+}
+
+// imm: address to go on from, imm2: instructions run since the start of the block
+_STENCIL(EXIT)
+{
+    return (uint64_t)(executed + _HOLE(_JIT_IMM2)) << 32 | _HOLE(_JIT_IMM);
+}
+
+// same, going on from the address in a
+_STENCIL(EXIT_REG)
+{
+    return (uint64_t)(executed + _HOLE(_JIT_IMM2)) << 32 | _REG(_JIT_A);
+}
+
+// imm: instructions run by this iteration, imm2: instructions in the longest
+// one. The target is the start of the block, which is only run again if the
+// budget is enough for all of it, otherwise the exit that follows is taken.
+_STENCIL(LOOP)
+{
+    executed += _HOLE(_JIT_IMM);
+    if (budget - executed >= _HOLE(_JIT_IMM2))
+        _TARGET
+    _CONTINUE
+}
+
+// in a trace, imm: where the indirect jump through a went while recording
+_STENCIL(GUARD)
+{
+    if (_REG(_JIT_A) != _HOLE(_JIT_IMM))
+        _TARGET
+    _CONTINUE
+}
+
+// imm: value
+_STENCIL(LCONS)
+{
+    _REG(_JIT_A) = _HOLE(_JIT_IMM);
+    _CONTINUE
+}
+
+_STENCIL(MOV)
+{
+    _REG(_JIT_A) = _REG(_JIT_B);
+    _CONTINUE
+}
+
+// imm: program length, imm2: highest address a value fits at
+_STENCIL(PUSH)
+{
+    const uint32_t sp = regs[SP] - 4;
+    if (sp < _HOLE(_JIT_IMM) || sp > _HOLE(_JIT_IMM2))
+        _TARGET
+    regs[SP] = sp;
+    _store<uint32_t>(mem + sp, _REG(_JIT_A));
+    _CONTINUE
+}
+
+_STENCIL(POP)
+{
+    const uint32_t sp = regs[SP];
+    if (sp < _HOLE(_JIT_IMM) || sp > _HOLE(_JIT_IMM2))
+        _TARGET
+    _REG(_JIT_A) = _load<uint32_t>(mem + sp);
+    regs[SP] = sp + 4;
+    _CONTINUE
+}
+
+_STENCIL(POP2)
+{
+    const uint32_t sp = regs[SP];
+    if (sp < _HOLE(_JIT_IMM) || sp > _HOLE(_JIT_IMM2))
+        _TARGET
+    _REG(_JIT_A) = _load<uint32_t>(mem + sp);
+    _REG(_JIT_B) = _load<uint32_t>(mem + sp + 4);
+    regs[SP] = sp + 8;
+    _CONTINUE
+}
+
+_STENCIL(DUP)
+{
+    const uint32_t sp = regs[SP] - 4;
+    if (sp < _HOLE(_JIT_IMM) || sp > _HOLE(_JIT_IMM2))
+        _TARGET
+    _store<uint32_t>(mem + sp, _load<uint32_t>(mem + sp + 4));
+    regs[SP] = sp;
+    _CONTINUE
+}
+
+// imm: address
+_STENCIL(STOR)
+{
+    _store<uint32_t>(mem + _HOLE(_JIT_IMM), _REG(_JIT_A));
+    _CONTINUE
+}
+
+_STENCIL(STORW)
+{
+    _store<uint16_t>(mem + _HOLE(_JIT_IMM), _REG(_JIT_A));
+    _CONTINUE
+}
+
+_STENCIL(STORB)
+{
+    _store<uint8_t>(mem + _HOLE(_JIT_IMM), _REG(_JIT_A));
+    _CONTINUE
+}
+
+_STENCIL(STOR_P)
+{
+    return _storePtr<uint32_t>(regs, mem, budget, executed);
+}
+
+_STENCIL(STORW_P)
+{
+    return _storePtr<uint16_t>(regs, mem, budget, executed);
+}
+
+_STENCIL(STORB_P)
+{
+    return _storePtr<uint8_t>(regs, mem, budget, executed);
+}
+
+_STENCIL(LOAD)
+{
+    _REG(_JIT_A) = _load<uint32_t>(mem + _HOLE(_JIT_IMM));
+    _CONTINUE
+}
+
+_STENCIL(LOADW)
+{
+    _REG(_JIT_A) = _load<uint16_t>(mem + _HOLE(_JIT_IMM));
+    _CONTINUE
+}
+
+_STENCIL(LOADB)
+{
+    _REG(_JIT_A) = _load<uint8_t>(mem + _HOLE(_JIT_IMM));
+    _CONTINUE
+}
+
+_STENCIL(LOAD_P)
+{
+    return _loadPtr<uint32_t>(regs, mem, budget, executed);
+}
+
+_STENCIL(LOADW_P)
+{
+    return _loadPtr<uint16_t>(regs, mem, budget, executed);
+}
+
+_STENCIL(LOADB_P)
+{
+    return _loadPtr<uint8_t>(regs, mem, budget, executed);
+}
+
+_STENCIL(INC)
+{
+    _REG(_JIT_A)++;
+    _CONTINUE
+}
+
+_STENCIL(DEC)
+{
+    _REG(_JIT_A)--;
+    _CONTINUE
+}
+
+// imm: bits of the float to add, a constant would end up in .rodata
+_STENCIL(FADDI)
+{
+    const uint32_t bits = _HOLE(_JIT_IMM);
+    float f;
+    memcpy(&f, &bits, sizeof(float));
+    _FREG(_JIT_A) += f;
+    _CONTINUE
+}
+
+_STENCIL(ADD)
+{
+    return _arith<OP_ADD>(regs, mem, budget, executed);
+}
+
+_STENCIL(SUB)
+{
+    return _arith<OP_SUB>(regs, mem, budget, executed);
+}
+
+_STENCIL(MUL)
+{
+    return _arith<OP_MUL>(regs, mem, budget, executed);
+}
+
+_STENCIL(IMUL)
+{
+    return _arith<OP_IMUL>(regs, mem, budget, executed);
+}
+
+_STENCIL(AND)
+{
+    return _arith<OP_AND>(regs, mem, budget, executed);
+}
+
+_STENCIL(OR)
+{
+    return _arith<OP_OR>(regs, mem, budget, executed);
+}
+
+_STENCIL(XOR)
+{
+    return _arith<OP_XOR>(regs, mem, budget, executed);
+}
+
+_STENCIL(SHL)
+{
+    return _arith<OP_SHL>(regs, mem, budget, executed);
+}
+
+_STENCIL(SHR)
+{
+    return _arith<OP_SHR>(regs, mem, budget, executed);
+}
+
+_STENCIL(ISHR)
+{
+    return _arith<OP_ISHR>(regs, mem, budget, executed);
+}
+
+_STENCIL(NOT)
+{
+    _REG(_JIT_A) = ~_REG(_JIT_B);
+    _CONTINUE
+}
+
+// anything that would trap is left to the interpreter
+_STENCIL(DIV)
+{
+    if (_REG(_JIT_C) == 0)
+        _TARGET
+    _REG(_JIT_A) = _REG(_JIT_B) / _REG(_JIT_C);
+    _CONTINUE
+}
+
+_STENCIL(MOD)
+{
+    if (_REG(_JIT_C) == 0)
+        _TARGET
+    _REG(_JIT_A) = _REG(_JIT_B) % _REG(_JIT_C);
+    _CONTINUE
+}
+
+_STENCIL(IDIV)
+{
+    if (_IREG(_JIT_C) == 0 || _IREG(_JIT_C) == -1)
+        _TARGET
+    _IREG(_JIT_A) = _IREG(_JIT_B) / _IREG(_JIT_C);
+    _CONTINUE
+}
+
+_STENCIL(IMOD)
+{
+    if (_IREG(_JIT_C) == 0 || _IREG(_JIT_C) == -1)
+        _TARGET
+    _IREG(_JIT_A) = _IREG(_JIT_B) % _IREG(_JIT_C);
+    _CONTINUE
+}
+
+_STENCIL(FADD)
+{
+    return _farith<OP_FADD>(regs, mem, budget, executed);
+}
+
+_STENCIL(FSUB)
+{
+    return _farith<OP_FSUB>(regs, mem, budget, executed);
+}
+
+_STENCIL(FMUL)
+{
+    return _farith<OP_FMUL>(regs, mem, budget, executed);
+}
+
+_STENCIL(FDIV)
+{
+    return _farith<OP_FDIV>(regs, mem, budget, executed);
+}
+
+_STENCIL(I2F)
+{
+    _FREG(_JIT_A) = (float)_IREG(_JIT_B);
+    _CONTINUE
+}
+
+_STENCIL(F2I)
+{
+    _IREG(_JIT_A) = (int32_t)_FREG(_JIT_B);
+    _CONTINUE
+}
+
+_STENCIL(JZ)
+{
+    if (_REG(_JIT_A) == 0)
+        _TARGET
+    _CONTINUE
+}
+
+_STENCIL(JNZ)
+{
+    if (_REG(_JIT_A) != 0)
+        _TARGET
+    _CONTINUE
+}
+
+_STENCIL(JE)
+{
+    return _branch<OP_JE>(regs, mem, budget, executed);
+}
+
+_STENCIL(JNE)
+{
+    return _branch<OP_JNE>(regs, mem, budget, executed);
+}
+
+_STENCIL(JA)
+{
+    return _branch<OP_JA>(regs, mem, budget, executed);
+}
+
+_STENCIL(JG)
+{
+    return _branch<OP_JG>(regs, mem, budget, executed);
+}
+
+_STENCIL(JAE)
+{
+    return _branch<OP_JAE>(regs, mem, budget, executed);
+}
+
+_STENCIL(JGE)
+{
+    return _branch<OP_JGE>(regs, mem, budget, executed);
+}
+
+_STENCIL(JB)
+{
+    return _branch<OP_JB>(regs, mem, budget, executed);
+}
+
+_STENCIL(JL)
+{
+    return _branch<OP_JL>(regs, mem, budget, executed);
+}
+
+_STENCIL(JBE)
+{
+    return _branch<OP_JBE>(regs, mem, budget, executed);
+}
+
+_STENCIL(JLE)
+{
+    return _branch<OP_JLE>(regs, mem, budget, executed);
+}
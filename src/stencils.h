@@ -0,0 +1,180 @@
+// generated by src/stencils.py from src/stencils.cpp, do not edit
+
+static const uint8_t stencil_ADD_code[] = {0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x03, 0x87, 0x00, 0x00, 0x00, 0x00, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_ADD_holes[] = {{2, HOLE_B, 0}, {8, HOLE_C, 0}, {14, HOLE_A, 0}};
+static const Stencil stencil_ADD = {stencil_ADD_code, 18, stencil_ADD_holes, 3};
+static const uint8_t stencil_AND_code[] = {0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x23, 0x87, 0x00, 0x00, 0x00, 0x00, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_AND_holes[] = {{2, HOLE_C, 0}, {8, HOLE_B, 0}, {14, HOLE_A, 0}};
+static const Stencil stencil_AND = {stencil_AND_code, 18, stencil_AND_holes, 3};
+static const uint8_t stencil_DEC_code[] = {0x83, 0xAF, 0x00, 0x00, 0x00, 0x00, 0x01};
+static const StencilHole stencil_DEC_holes[] = {{2, HOLE_A, 0}};
+static const Stencil stencil_DEC = {stencil_DEC_code, 7, stencil_DEC_holes, 1};
+static const uint8_t stencil_DIV_code[] = {0x44, 0x8B, 0x8F, 0x00, 0x00, 0x00, 0x00, 0x41, 0x89, 0xD0, 0x45, 0x85, 0xC9, 0x75, 0x05, 0xE9, 0x00, 0x00, 0x00, 0x00, 0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x31, 0xD2, 0x41, 0xF7, 0xF1, 0x44, 0x89, 0xC2, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_DIV_holes[] = {{3, HOLE_C, 0}, {16, HOLE_TARGET, -4}, {22, HOLE_B, 0}, {36, HOLE_A, 0}};
+static const Stencil stencil_DIV = {stencil_DIV_code, 40, stencil_DIV_holes, 4};
+static const uint8_t stencil_DUP_code[] = {0x8B, 0x47, 0x48, 0x41, 0xBA, 0x00, 0x00, 0x00, 0x00, 0x83, 0xE8, 0x04, 0x44, 0x39, 0xD0, 0x72, 0x0B, 0x41, 0xBB, 0x00, 0x00, 0x00, 0x00, 0x41, 0x39, 0xC3, 0x73, 0x05, 0xE9, 0x00, 0x00, 0x00, 0x00, 0x41, 0x89, 0xC0, 0x46, 0x8B, 0x4C, 0x06, 0x04, 0x46, 0x89, 0x0C, 0x06, 0x89, 0x47, 0x48};
+static const StencilHole stencil_DUP_holes[] = {{5, HOLE_IMM, 0}, {19, HOLE_IMM2, 0}, {29, HOLE_TARGET, -4}};
+static const Stencil stencil_DUP = {stencil_DUP_code, 48, stencil_DUP_holes, 3};
+static const uint8_t stencil_ENTER_code[] = {0x31, 0xC9};
+static const Stencil stencil_ENTER = {stencil_ENTER_code, 2, nullptr, 0};
+static const uint8_t stencil_EXIT_code[] = {0xB8, 0x00, 0x00, 0x00, 0x00, 0xBE, 0x00, 0x00, 0x00, 0x00, 0x01, 0xC8, 0x8D, 0x16, 0x89, 0xC0, 0x48, 0xC1, 0xE0, 0x20, 0x48, 0x09, 0xD0, 0xC3};
+static const StencilHole stencil_EXIT_holes[] = {{1, HOLE_IMM2, 0}, {6, HOLE_IMM, 0}};
+static const Stencil stencil_EXIT = {stencil_EXIT_code, 24, stencil_EXIT_holes, 2};
+static const uint8_t stencil_EXIT_REG_code[] = {0xB8, 0x00, 0x00, 0x00, 0x00, 0x8B, 0x97, 0x00, 0x00, 0x00, 0x00, 0x01, 0xC8, 0x89, 0xC0, 0x48, 0xC1, 0xE0, 0x20, 0x48, 0x09, 0xD0, 0xC3};
+static const StencilHole stencil_EXIT_REG_holes[] = {{1, HOLE_IMM2, 0}, {7, HOLE_A, 0}};
+static const Stencil stencil_EXIT_REG = {stencil_EXIT_REG_code, 23, stencil_EXIT_REG_holes, 2};
+static const uint8_t stencil_F2I_code[] = {0xF3, 0x0F, 0x2C, 0x87, 0x00, 0x00, 0x00, 0x00, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_F2I_holes[] = {{4, HOLE_B, 0}, {10, HOLE_A, 0}};
+static const Stencil stencil_F2I = {stencil_F2I_code, 14, stencil_F2I_holes, 2};
+static const uint8_t stencil_FADD_code[] = {0xF3, 0x0F, 0x10, 0x8F, 0x00, 0x00, 0x00, 0x00, 0xF3, 0x0F, 0x10, 0x87, 0x00, 0x00, 0x00, 0x00, 0xF3, 0x0F, 0x58, 0xC1, 0xF3, 0x0F, 0x11, 0x87, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_FADD_holes[] = {{4, HOLE_C, 0}, {12, HOLE_B, 0}, {24, HOLE_A, 0}};
+static const Stencil stencil_FADD = {stencil_FADD_code, 28, stencil_FADD_holes, 3};
+static const uint8_t stencil_FADDI_code[] = {0xB8, 0x00, 0x00, 0x00, 0x00, 0x66, 0x0F, 0x6E, 0xC0, 0xF3, 0x0F, 0x58, 0x87, 0x00, 0x00, 0x00, 0x00, 0xF3, 0x0F, 0x11, 0x87, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_FADDI_holes[] = {{1, HOLE_IMM, 0}, {13, HOLE_A, 0}, {21, HOLE_A, 0}};
+static const Stencil stencil_FADDI = {stencil_FADDI_code, 25, stencil_FADDI_holes, 3};
+static const uint8_t stencil_FDIV_code[] = {0xF3, 0x0F, 0x10, 0x87, 0x00, 0x00, 0x00, 0x00, 0xF3, 0x0F, 0x5E, 0x87, 0x00, 0x00, 0x00, 0x00, 0xF3, 0x0F, 0x11, 0x87, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_FDIV_holes[] = {{4, HOLE_B, 0}, {12, HOLE_C, 0}, {20, HOLE_A, 0}};
+static const Stencil stencil_FDIV = {stencil_FDIV_code, 24, stencil_FDIV_holes, 3};
+static const uint8_t stencil_FMUL_code[] = {0xF3, 0x0F, 0x10, 0x8F, 0x00, 0x00, 0x00, 0x00, 0xF3, 0x0F, 0x10, 0x87, 0x00, 0x00, 0x00, 0x00, 0xF3, 0x0F, 0x59, 0xC1, 0xF3, 0x0F, 0x11, 0x87, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_FMUL_holes[] = {{4, HOLE_C, 0}, {12, HOLE_B, 0}, {24, HOLE_A, 0}};
+static const Stencil stencil_FMUL = {stencil_FMUL_code, 28, stencil_FMUL_holes, 3};
+static const uint8_t stencil_FSUB_code[] = {0xF3, 0x0F, 0x10, 0x87, 0x00, 0x00, 0x00, 0x00, 0xF3, 0x0F, 0x5C, 0x87, 0x00, 0x00, 0x00, 0x00, 0xF3, 0x0F, 0x11, 0x87, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_FSUB_holes[] = {{4, HOLE_B, 0}, {12, HOLE_C, 0}, {20, HOLE_A, 0}};
+static const Stencil stencil_FSUB = {stencil_FSUB_code, 24, stencil_FSUB_holes, 3};
+static const uint8_t stencil_GUARD_code[] = {0xB8, 0x00, 0x00, 0x00, 0x00, 0x39, 0x87, 0x00, 0x00, 0x00, 0x00, 0x74, 0x05, 0xE9, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_GUARD_holes[] = {{1, HOLE_IMM, 0}, {7, HOLE_A, 0}, {14, HOLE_TARGET, -4}};
+static const Stencil stencil_GUARD = {stencil_GUARD_code, 18, stencil_GUARD_holes, 3};
+static const uint8_t stencil_I2F_code[] = {0x66, 0x0F, 0xEF, 0xC0, 0xF3, 0x0F, 0x2A, 0x87, 0x00, 0x00, 0x00, 0x00, 0xF3, 0x0F, 0x11, 0x87, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_I2F_holes[] = {{8, HOLE_B, 0}, {16, HOLE_A, 0}};
+static const Stencil stencil_I2F = {stencil_I2F_code, 20, stencil_I2F_holes, 2};
+static const uint8_t stencil_IDIV_code[] = {0x44, 0x8B, 0x8F, 0x00, 0x00, 0x00, 0x00, 0x41, 0x89, 0xD0, 0x41, 0x8D, 0x41, 0x01, 0x83, 0xF8, 0x01, 0x76, 0x18, 0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x99, 0x41, 0xF7, 0xF9, 0x44, 0x89, 0xC2, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00, 0xE9, 0x00, 0x00, 0x00, 0x00, 0xE9, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_IDIV_holes[] = {{3, HOLE_C, 0}, {21, HOLE_B, 0}, {34, HOLE_A, 0}, {39, HOLE_CONTINUE, -4}, {44, HOLE_TARGET, -4}};
+static const Stencil stencil_IDIV = {stencil_IDIV_code, 48, stencil_IDIV_holes, 5};
+static const uint8_t stencil_IMOD_code[] = {0x44, 0x8B, 0x8F, 0x00, 0x00, 0x00, 0x00, 0x41, 0x89, 0xD0, 0x41, 0x8D, 0x41, 0x01, 0x83, 0xF8, 0x01, 0x76, 0x18, 0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x99, 0x41, 0xF7, 0xF9, 0x89, 0x97, 0x00, 0x00, 0x00, 0x00, 0x44, 0x89, 0xC2, 0xE9, 0x00, 0x00, 0x00, 0x00, 0xE9, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_IMOD_holes[] = {{3, HOLE_C, 0}, {21, HOLE_B, 0}, {31, HOLE_A, 0}, {39, HOLE_CONTINUE, -4}, {44, HOLE_TARGET, -4}};
+static const Stencil stencil_IMOD = {stencil_IMOD_code, 48, stencil_IMOD_holes, 5};
+static const uint8_t stencil_IMUL_code[] = {0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x0F, 0xAF, 0x87, 0x00, 0x00, 0x00, 0x00, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_IMUL_holes[] = {{2, HOLE_B, 0}, {9, HOLE_C, 0}, {15, HOLE_A, 0}};
+static const Stencil stencil_IMUL = {stencil_IMUL_code, 19, stencil_IMUL_holes, 3};
+static const uint8_t stencil_INC_code[] = {0x83, 0x87, 0x00, 0x00, 0x00, 0x00, 0x01};
+static const StencilHole stencil_INC_holes[] = {{2, HOLE_A, 0}};
+static const Stencil stencil_INC = {stencil_INC_code, 7, stencil_INC_holes, 1};
+static const uint8_t stencil_ISHR_code[] = {0x89, 0xC8, 0x44, 0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x8B, 0x8F, 0x00, 0x00, 0x00, 0x00, 0x41, 0xD3, 0xF8, 0x89, 0xC1, 0x44, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_ISHR_holes[] = {{5, HOLE_B, 0}, {11, HOLE_C, 0}, {23, HOLE_A, 0}};
+static const Stencil stencil_ISHR = {stencil_ISHR_code, 27, stencil_ISHR_holes, 3};
+static const uint8_t stencil_JA_code[] = {0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x39, 0x87, 0x00, 0x00, 0x00, 0x00, 0x73, 0x05, 0xE9, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_JA_holes[] = {{2, HOLE_A, 0}, {8, HOLE_B, 0}, {15, HOLE_TARGET, -4}};
+static const Stencil stencil_JA = {stencil_JA_code, 19, stencil_JA_holes, 3};
+static const uint8_t stencil_JAE_code[] = {0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x39, 0x87, 0x00, 0x00, 0x00, 0x00, 0x72, 0x05, 0xE9, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_JAE_holes[] = {{2, HOLE_B, 0}, {8, HOLE_A, 0}, {15, HOLE_TARGET, -4}};
+static const Stencil stencil_JAE = {stencil_JAE_code, 19, stencil_JAE_holes, 3};
+static const uint8_t stencil_JB_code[] = {0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x39, 0x87, 0x00, 0x00, 0x00, 0x00, 0x73, 0x05, 0xE9, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_JB_holes[] = {{2, HOLE_B, 0}, {8, HOLE_A, 0}, {15, HOLE_TARGET, -4}};
+static const Stencil stencil_JB = {stencil_JB_code, 19, stencil_JB_holes, 3};
+static const uint8_t stencil_JBE_code[] = {0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x39, 0x87, 0x00, 0x00, 0x00, 0x00, 0x72, 0x05, 0xE9, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_JBE_holes[] = {{2, HOLE_A, 0}, {8, HOLE_B, 0}, {15, HOLE_TARGET, -4}};
+static const Stencil stencil_JBE = {stencil_JBE_code, 19, stencil_JBE_holes, 3};
+static const uint8_t stencil_JE_code[] = {0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x39, 0x87, 0x00, 0x00, 0x00, 0x00, 0x74, 0x05, 0xE9, 0x00, 0x00, 0x00, 0x00, 0xE9, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_JE_holes[] = {{2, HOLE_A, 0}, {8, HOLE_B, 0}, {15, HOLE_CONTINUE, -4}, {20, HOLE_TARGET, -4}};
+static const Stencil stencil_JE = {stencil_JE_code, 24, stencil_JE_holes, 4};
+static const uint8_t stencil_JG_code[] = {0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x39, 0x87, 0x00, 0x00, 0x00, 0x00, 0x7E, 0x05, 0xE9, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_JG_holes[] = {{2, HOLE_B, 0}, {8, HOLE_A, 0}, {15, HOLE_TARGET, -4}};
+static const Stencil stencil_JG = {stencil_JG_code, 19, stencil_JG_holes, 3};
+static const uint8_t stencil_JGE_code[] = {0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x39, 0x87, 0x00, 0x00, 0x00, 0x00, 0x7C, 0x05, 0xE9, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_JGE_holes[] = {{2, HOLE_B, 0}, {8, HOLE_A, 0}, {15, HOLE_TARGET, -4}};
+static const Stencil stencil_JGE = {stencil_JGE_code, 19, stencil_JGE_holes, 3};
+static const uint8_t stencil_JL_code[] = {0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x39, 0x87, 0x00, 0x00, 0x00, 0x00, 0x7D, 0x05, 0xE9, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_JL_holes[] = {{2, HOLE_B, 0}, {8, HOLE_A, 0}, {15, HOLE_TARGET, -4}};
+static const Stencil stencil_JL = {stencil_JL_code, 19, stencil_JL_holes, 3};
+static const uint8_t stencil_JLE_code[] = {0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x39, 0x87, 0x00, 0x00, 0x00, 0x00, 0x7F, 0x05, 0xE9, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_JLE_holes[] = {{2, HOLE_B, 0}, {8, HOLE_A, 0}, {15, HOLE_TARGET, -4}};
+static const Stencil stencil_JLE = {stencil_JLE_code, 19, stencil_JLE_holes, 3};
+static const uint8_t stencil_JNE_code[] = {0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x39, 0x87, 0x00, 0x00, 0x00, 0x00, 0x74, 0x05, 0xE9, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_JNE_holes[] = {{2, HOLE_A, 0}, {8, HOLE_B, 0}, {15, HOLE_TARGET, -4}};
+static const Stencil stencil_JNE = {stencil_JNE_code, 19, stencil_JNE_holes, 3};
+static const uint8_t stencil_JNZ_code[] = {0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x85, 0xC0, 0x74, 0x05, 0xE9, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_JNZ_holes[] = {{2, HOLE_A, 0}, {11, HOLE_TARGET, -4}};
+static const Stencil stencil_JNZ = {stencil_JNZ_code, 15, stencil_JNZ_holes, 2};
+static const uint8_t stencil_JZ_code[] = {0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x85, 0xC0, 0x75, 0x05, 0xE9, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_JZ_holes[] = {{2, HOLE_A, 0}, {11, HOLE_TARGET, -4}};
+static const Stencil stencil_JZ = {stencil_JZ_code, 15, stencil_JZ_holes, 2};
+static const uint8_t stencil_LCONS_code[] = {0xB8, 0x00, 0x00, 0x00, 0x00, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_LCONS_holes[] = {{1, HOLE_IMM, 0}, {7, HOLE_A, 0}};
+static const Stencil stencil_LCONS = {stencil_LCONS_code, 11, stencil_LCONS_holes, 2};
+static const uint8_t stencil_LOAD_code[] = {0xB8, 0x00, 0x00, 0x00, 0x00, 0x8D, 0x00, 0x8B, 0x04, 0x06, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_LOAD_holes[] = {{1, HOLE_IMM, 0}, {12, HOLE_A, 0}};
+static const Stencil stencil_LOAD = {stencil_LOAD_code, 16, stencil_LOAD_holes, 2};
+static const uint8_t stencil_LOADB_code[] = {0xB8, 0x00, 0x00, 0x00, 0x00, 0x8D, 0x00, 0x0F, 0xB6, 0x04, 0x06, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_LOADB_holes[] = {{1, HOLE_IMM, 0}, {13, HOLE_A, 0}};
+static const Stencil stencil_LOADB = {stencil_LOADB_code, 17, stencil_LOADB_holes, 2};
+static const uint8_t stencil_LOADB_P_code[] = {0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x41, 0xB9, 0x00, 0x00, 0x00, 0x00, 0x41, 0x39, 0xC1, 0x73, 0x05, 0xE9, 0x00, 0x00, 0x00, 0x00, 0x0F, 0xB6, 0x04, 0x06, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_LOADB_P_holes[] = {{2, HOLE_B, 0}, {8, HOLE_IMM, 0}, {18, HOLE_TARGET, -4}, {28, HOLE_A, 0}};
+static const Stencil stencil_LOADB_P = {stencil_LOADB_P_code, 32, stencil_LOADB_P_holes, 4};
+static const uint8_t stencil_LOADW_code[] = {0xB8, 0x00, 0x00, 0x00, 0x00, 0x8D, 0x00, 0x0F, 0xB7, 0x04, 0x06, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_LOADW_holes[] = {{1, HOLE_IMM, 0}, {13, HOLE_A, 0}};
+static const Stencil stencil_LOADW = {stencil_LOADW_code, 17, stencil_LOADW_holes, 2};
+static const uint8_t stencil_LOADW_P_code[] = {0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x41, 0xB9, 0x00, 0x00, 0x00, 0x00, 0x41, 0x39, 0xC1, 0x73, 0x05, 0xE9, 0x00, 0x00, 0x00, 0x00, 0x0F, 0xB7, 0x04, 0x06, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_LOADW_P_holes[] = {{2, HOLE_B, 0}, {8, HOLE_IMM, 0}, {18, HOLE_TARGET, -4}, {28, HOLE_A, 0}};
+static const Stencil stencil_LOADW_P = {stencil_LOADW_P_code, 32, stencil_LOADW_P_holes, 4};
+static const uint8_t stencil_LOAD_P_code[] = {0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x41, 0xB9, 0x00, 0x00, 0x00, 0x00, 0x41, 0x39, 0xC1, 0x73, 0x05, 0xE9, 0x00, 0x00, 0x00, 0x00, 0x8B, 0x04, 0x06, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_LOAD_P_holes[] = {{2, HOLE_B, 0}, {8, HOLE_IMM, 0}, {18, HOLE_TARGET, -4}, {27, HOLE_A, 0}};
+static const Stencil stencil_LOAD_P = {stencil_LOAD_P_code, 31, stencil_LOAD_P_holes, 4};
+static const uint8_t stencil_LOOP_code[] = {0x89, 0xC8, 0xB9, 0x00, 0x00, 0x00, 0x00, 0x41, 0x89, 0xD0, 0x01, 0xC1, 0xB8, 0x00, 0x00, 0x00, 0x00, 0x41, 0x29, 0xC8, 0x41, 0x39, 0xC0, 0x72, 0x05, 0xE9, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_LOOP_holes[] = {{3, HOLE_IMM, 0}, {13, HOLE_IMM2, 0}, {26, HOLE_TARGET, -4}};
+static const Stencil stencil_LOOP = {stencil_LOOP_code, 30, stencil_LOOP_holes, 3};
+static const uint8_t stencil_MOD_code[] = {0x44, 0x8B, 0x8F, 0x00, 0x00, 0x00, 0x00, 0x41, 0x89, 0xD0, 0x45, 0x85, 0xC9, 0x75, 0x05, 0xE9, 0x00, 0x00, 0x00, 0x00, 0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x31, 0xD2, 0x41, 0xF7, 0xF1, 0x89, 0x97, 0x00, 0x00, 0x00, 0x00, 0x44, 0x89, 0xC2};
+static const StencilHole stencil_MOD_holes[] = {{3, HOLE_C, 0}, {16, HOLE_TARGET, -4}, {22, HOLE_B, 0}, {33, HOLE_A, 0}};
+static const Stencil stencil_MOD = {stencil_MOD_code, 40, stencil_MOD_holes, 4};
+static const uint8_t stencil_MOV_code[] = {0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_MOV_holes[] = {{2, HOLE_B, 0}, {8, HOLE_A, 0}};
+static const Stencil stencil_MOV = {stencil_MOV_code, 12, stencil_MOV_holes, 2};
+static const uint8_t stencil_MUL_code[] = {0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x0F, 0xAF, 0x87, 0x00, 0x00, 0x00, 0x00, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_MUL_holes[] = {{2, HOLE_C, 0}, {9, HOLE_B, 0}, {15, HOLE_A, 0}};
+static const Stencil stencil_MUL = {stencil_MUL_code, 19, stencil_MUL_holes, 3};
+static const uint8_t stencil_NOT_code[] = {0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0xF7, 0xD0, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_NOT_holes[] = {{2, HOLE_B, 0}, {10, HOLE_A, 0}};
+static const Stencil stencil_NOT = {stencil_NOT_code, 14, stencil_NOT_holes, 2};
+static const uint8_t stencil_OR_code[] = {0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x0B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_OR_holes[] = {{2, HOLE_C, 0}, {8, HOLE_B, 0}, {14, HOLE_A, 0}};
+static const Stencil stencil_OR = {stencil_OR_code, 18, stencil_OR_holes, 3};
+static const uint8_t stencil_POP_code[] = {0x8B, 0x47, 0x48, 0x41, 0xB9, 0x00, 0x00, 0x00, 0x00, 0x44, 0x39, 0xC8, 0x72, 0x0B, 0x41, 0xBA, 0x00, 0x00, 0x00, 0x00, 0x41, 0x39, 0xC2, 0x73, 0x05, 0xE9, 0x00, 0x00, 0x00, 0x00, 0x41, 0x89, 0xC0, 0x83, 0xC0, 0x04, 0x46, 0x8B, 0x04, 0x06, 0x44, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00, 0x89, 0x47, 0x48};
+static const StencilHole stencil_POP_holes[] = {{5, HOLE_IMM, 0}, {16, HOLE_IMM2, 0}, {26, HOLE_TARGET, -4}, {43, HOLE_A, 0}};
+static const Stencil stencil_POP = {stencil_POP_code, 50, stencil_POP_holes, 4};
+static const uint8_t stencil_POP2_code[] = {0x8B, 0x47, 0x48, 0x41, 0xBA, 0x00, 0x00, 0x00, 0x00, 0x44, 0x39, 0xD0, 0x72, 0x0B, 0x41, 0xBB, 0x00, 0x00, 0x00, 0x00, 0x41, 0x39, 0xC3, 0x73, 0x05, 0xE9, 0x00, 0x00, 0x00, 0x00, 0x41, 0x89, 0xC0, 0x83, 0xC0, 0x08, 0x46, 0x8B, 0x0C, 0x06, 0x44, 0x89, 0x8F, 0x00, 0x00, 0x00, 0x00, 0x46, 0x8B, 0x44, 0x06, 0x04, 0x44, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00, 0x89, 0x47, 0x48};
+static const StencilHole stencil_POP2_holes[] = {{5, HOLE_IMM, 0}, {16, HOLE_IMM2, 0}, {26, HOLE_TARGET, -4}, {43, HOLE_A, 0}, {55, HOLE_B, 0}};
+static const Stencil stencil_POP2 = {stencil_POP2_code, 62, stencil_POP2_holes, 5};
+static const uint8_t stencil_PUSH_code[] = {0x8B, 0x47, 0x48, 0x41, 0xB9, 0x00, 0x00, 0x00, 0x00, 0x83, 0xE8, 0x04, 0x44, 0x39, 0xC8, 0x72, 0x0B, 0x41, 0xBA, 0x00, 0x00, 0x00, 0x00, 0x41, 0x39, 0xC2, 0x73, 0x05, 0xE9, 0x00, 0x00, 0x00, 0x00, 0x89, 0x47, 0x48, 0x44, 0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x44, 0x89, 0x04, 0x06};
+static const StencilHole stencil_PUSH_holes[] = {{5, HOLE_IMM, 0}, {19, HOLE_IMM2, 0}, {29, HOLE_TARGET, -4}, {39, HOLE_A, 0}};
+static const Stencil stencil_PUSH = {stencil_PUSH_code, 47, stencil_PUSH_holes, 4};
+static const uint8_t stencil_SHL_code[] = {0x89, 0xC8, 0x44, 0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x8B, 0x8F, 0x00, 0x00, 0x00, 0x00, 0x41, 0xD3, 0xE0, 0x89, 0xC1, 0x44, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_SHL_holes[] = {{5, HOLE_B, 0}, {11, HOLE_C, 0}, {23, HOLE_A, 0}};
+static const Stencil stencil_SHL = {stencil_SHL_code, 27, stencil_SHL_holes, 3};
+static const uint8_t stencil_SHR_code[] = {0x89, 0xC8, 0x44, 0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x8B, 0x8F, 0x00, 0x00, 0x00, 0x00, 0x41, 0xD3, 0xE8, 0x89, 0xC1, 0x44, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_SHR_holes[] = {{5, HOLE_B, 0}, {11, HOLE_C, 0}, {23, HOLE_A, 0}};
+static const Stencil stencil_SHR = {stencil_SHR_code, 27, stencil_SHR_holes, 3};
+static const uint8_t stencil_STOR_code[] = {0x44, 0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0xB8, 0x00, 0x00, 0x00, 0x00, 0x8D, 0x00, 0x44, 0x89, 0x04, 0x06};
+static const StencilHole stencil_STOR_holes[] = {{3, HOLE_A, 0}, {8, HOLE_IMM, 0}};
+static const Stencil stencil_STOR = {stencil_STOR_code, 18, stencil_STOR_holes, 2};
+static const uint8_t stencil_STORB_code[] = {0x44, 0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0xB8, 0x00, 0x00, 0x00, 0x00, 0x8D, 0x00, 0x44, 0x88, 0x04, 0x06};
+static const StencilHole stencil_STORB_holes[] = {{3, HOLE_A, 0}, {8, HOLE_IMM, 0}};
+static const Stencil stencil_STORB = {stencil_STORB_code, 18, stencil_STORB_holes, 2};
+static const uint8_t stencil_STORB_P_code[] = {0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x41, 0xB9, 0x00, 0x00, 0x00, 0x00, 0x41, 0x39, 0xC1, 0x72, 0x0B, 0x41, 0xBA, 0x00, 0x00, 0x00, 0x00, 0x44, 0x39, 0xD0, 0x73, 0x05, 0xE9, 0x00, 0x00, 0x00, 0x00, 0x44, 0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x44, 0x88, 0x04, 0x06};
+static const StencilHole stencil_STORB_P_holes[] = {{2, HOLE_A, 0}, {8, HOLE_IMM, 0}, {19, HOLE_IMM2, 0}, {29, HOLE_TARGET, -4}, {36, HOLE_B, 0}};
+static const Stencil stencil_STORB_P = {stencil_STORB_P_code, 44, stencil_STORB_P_holes, 5};
+static const uint8_t stencil_STORW_code[] = {0x44, 0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0xB8, 0x00, 0x00, 0x00, 0x00, 0x8D, 0x00, 0x66, 0x44, 0x89, 0x04, 0x06};
+static const StencilHole stencil_STORW_holes[] = {{3, HOLE_A, 0}, {8, HOLE_IMM, 0}};
+static const Stencil stencil_STORW = {stencil_STORW_code, 19, stencil_STORW_holes, 2};
+static const uint8_t stencil_STORW_P_code[] = {0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x41, 0xB9, 0x00, 0x00, 0x00, 0x00, 0x41, 0x39, 0xC1, 0x72, 0x0B, 0x41, 0xBA, 0x00, 0x00, 0x00, 0x00, 0x44, 0x39, 0xD0, 0x73, 0x05, 0xE9, 0x00, 0x00, 0x00, 0x00, 0x44, 0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x66, 0x44, 0x89, 0x04, 0x06};
+static const StencilHole stencil_STORW_P_holes[] = {{2, HOLE_A, 0}, {8, HOLE_IMM, 0}, {19, HOLE_IMM2, 0}, {29, HOLE_TARGET, -4}, {36, HOLE_B, 0}};
+static const Stencil stencil_STORW_P = {stencil_STORW_P_code, 45, stencil_STORW_P_holes, 5};
+static const uint8_t stencil_STOR_P_code[] = {0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x41, 0xB9, 0x00, 0x00, 0x00, 0x00, 0x41, 0x39, 0xC1, 0x72, 0x0B, 0x41, 0xBA, 0x00, 0x00, 0x00, 0x00, 0x44, 0x39, 0xD0, 0x73, 0x05, 0xE9, 0x00, 0x00, 0x00, 0x00, 0x44, 0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x44, 0x89, 0x04, 0x06};
+static const StencilHole stencil_STOR_P_holes[] = {{2, HOLE_A, 0}, {8, HOLE_IMM, 0}, {19, HOLE_IMM2, 0}, {29, HOLE_TARGET, -4}, {36, HOLE_B, 0}};
+static const Stencil stencil_STOR_P = {stencil_STOR_P_code, 44, stencil_STOR_P_holes, 5};
+static const uint8_t stencil_SUB_code[] = {0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x2B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_SUB_holes[] = {{2, HOLE_B, 0}, {8, HOLE_C, 0}, {14, HOLE_A, 0}};
+static const Stencil stencil_SUB = {stencil_SUB_code, 18, stencil_SUB_holes, 3};
+static const uint8_t stencil_XOR_code[] = {0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x33, 0x87, 0x00, 0x00, 0x00, 0x00, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00};
+static const StencilHole stencil_XOR_holes[] = {{2, HOLE_C, 0}, {8, HOLE_B, 0}, {14, HOLE_A, 0}};
+static const Stencil stencil_XOR = {stencil_XOR_code, 18, stencil_XOR_holes, 3};
+
+#define STENCIL_MAX_BYTES 62
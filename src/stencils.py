@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+# Cuts the stencils of the copy-and-patch JIT out of the ELF object built from
+# src/stencils.cpp and writes them to a header, as their machine code plus the
+# holes to patch. Usage: python3 src/stencils.py src/stencils.o src/stencils.h
+
+import struct
+import sys
+
+R_X86_64_PC32 = 2
+R_X86_64_PLT32 = 4
+R_X86_64_32 = 10
+R_X86_64_32S = 11
+
+SHT_SYMTAB = 2
+SHT_RELA = 4
+STT_FUNC = 2
+
+# symbols standing in for the holes and the kind of hole they make
+HOLES = {
+    '_JIT_A': 'HOLE_A',
+    '_JIT_B': 'HOLE_B',
+    '_JIT_C': 'HOLE_C',
+    '_JIT_IMM': 'HOLE_IMM',
+    '_JIT_IMM2': 'HOLE_IMM2',
+    '_JIT_CONTINUE': 'HOLE_CONTINUE',
+    '_JIT_TARGET': 'HOLE_TARGET',
+}
+JUMPS = ('_JIT_CONTINUE', '_JIT_TARGET')
+
+
+def fail(message):
+    sys.stderr.write('stencils.py: %s\n' % message)
+    sys.exit(1)
+
+
+def cstring(data, offset):
+    return data[offset:data.index(b'\0', offset)].decode()
+
+
+def read_object(data):
+    if data[:4] != b'\x7fELF' or data[4] != 2 or data[5] != 1:
+        fail('not a little endian 64-bit ELF object')
+    shoff, = struct.unpack_from('<Q', data, 0x28)
+    shentsize, shnum, shstrndx = struct.unpack_from('<HHH', data, 0x3A)
+
+    sections = []
+    for i in range(shnum):
+        name, kind, _, _, offset, size, link, info, _, entsize = struct.unpack_from(
+            '<IIQQQQIIQQ', data, shoff + i * shentsize)
+        sections.append({'name': name, 'type': kind, 'offset': offset, 'size': size,
+                         'link': link, 'info': info, 'entsize': entsize})
+    names = sections[shstrndx]
+    for section in sections:
+        section['name'] = cstring(data, names['offset'] + section['name'])
+
+    symtab = next(s for s in sections if s['type'] == SHT_SYMTAB)
+    strtab = sections[symtab['link']]
+    symbols = []
+    for i in range(symtab['size'] // symtab['entsize']):
+        name, info, _, shndx, value, size = struct.unpack_from(
+            '<IBBHQQ', data, symtab['offset'] + i * symtab['entsize'])
+        symbols.append({'name': cstring(data, strtab['offset'] + name), 'type': info & 0xF,
+                        'section': shndx, 'value': value, 'size': size})
+
+    relocations = {}
+    for section in sections:
+        if section['type'] != SHT_RELA:
+            continue
+        entries = relocations.setdefault(section['info'], [])
+        for i in range(section['size'] // section['entsize']):
+            offset, info, addend = struct.unpack_from('<QQq', data, section['offset'] + i * section['entsize'])
+            entries.append((offset, symbols[info >> 32]['name'], info & 0xFFFFFFFF, addend))
+    return sections, symbols, relocations
+
+
+def extract(data, sections, symbol, relocations):
+    section = sections[symbol['section']]
+    start = symbol['value']
+    code = bytearray(data[section['offset'] + start:section['offset'] + start + symbol['size']])
+
+    holes = []
+    for offset, name, kind, addend in relocations.get(symbol['section'], []):
+        if offset < start or offset >= start + len(code):
+            continue
+        if name not in HOLES:
+            fail('%s refers to %s, stencils can only use holes' % (symbol['name'], name))
+        pcrel = kind in (R_X86_64_PC32, R_X86_64_PLT32)
+        if pcrel != (name in JUMPS) or kind not in (R_X86_64_PC32, R_X86_64_PLT32, R_X86_64_32, R_X86_64_32S):
+            fail('%s: unexpected relocation %d against %s' % (symbol['name'], kind, name))
+        holes.append([offset - start, HOLES[name], addend])
+
+    # going on to the next stencil is free when it's the last instruction
+    holes.sort()
+    if holes and holes[-1][1] == 'HOLE_CONTINUE' and holes[-1][0] == len(code) - 4 and code[-5] == 0xE9:
+        holes.pop()
+        del code[-5:]
+    return code, holes
+
+
+def main():
+    if len(sys.argv) != 3:
+        fail('usage: stencils.py stencils.o stencils.h')
+    with open(sys.argv[1], 'rb') as f:
+        data = f.read()
+    sections, symbols, relocations = read_object(data)
+
+    stencils = [s for s in symbols if s['type'] == STT_FUNC and s['name'].startswith('stencil_')]
+    if not stencils:
+        fail('no stencils in %s' % sys.argv[1])
+
+    out = ['// generated by src/stencils.py from src/stencils.cpp, do not edit', '']
+    largest = 0
+    for symbol in sorted(stencils, key=lambda s: s['name']):
+        name = symbol['name']
+        code, holes = extract(data, sections, symbol, relocations)
+        largest = max(largest, len(code))
+        out.append('static const uint8_t %s_code[] = {%s};' % (name, ', '.join('0x%02X' % b for b in code)))
+        if holes:
+            out.append('static const StencilHole %s_holes[] = {%s};' % (
+                name, ', '.join('{%d, %s, %d}' % tuple(h) for h in holes)))
+            out.append('static const Stencil %s = {%s_code, %d, %s_holes, %d};' % (name, name, len(code), name, len(holes)))
+        else:
+            out.append('static const Stencil %s = {%s_code, %d, nullptr, 0};' % (name, name, len(code)))
+    out.append('')
+    out.append('#define STENCIL_MAX_BYTES %d' % largest)
+
+    with open(sys.argv[2], 'w') as f:
+        f.write('\n'.join(out) + '\n')
+
+
+if __name__ == '__main__':
+    main()
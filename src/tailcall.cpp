@@ -0,0 +1,686 @@
+#include "vm.h"
+
+#ifdef VM_TAILCALL_DISPATCH
+
+// Every handler is its own function and ends by calling the next one with the
+// same arguments, which the compiler turns into a jump. IP, SP, the register
+// file and the remaining budget travel in argument registers, so each handler
+// gets its own register allocation and its own indirect branch. SP is also
+// kept up to date in the register file, where any instruction may read it.
+#ifdef VM_MUSTTAIL
+#define _TAIL VM_MUSTTAIL return
+#define VM_TAILCALL_ATTR
+#else
+// without musttail, GCC only turns the calls into jumps when optimizing
+#define _TAIL return
+#define VM_TAILCALL_ATTR __attribute__((optimize("optimize-sibling-calls")))
+#endif
+
+#define _TARGS vm, mem, regs, ip, sp, left
+#define _TOP(op) \
+    template <>  \
+    VM_TAILCALL_ATTR ExecResult VM::_tailOp<op>(VM * vm, uint8_t * mem, uint32_t * regs, uint32_t ip, uint32_t sp, uint32_t left)
+
+// run() added the whole budget to the count up front
+#define _TRETURN(res)                \
+    {                                \
+        regs[IP] = ip;               \
+        vm->_executed -= left;       \
+        return res;                  \
+    }
+
+// anything unusual (running off memory, invalid or special registers, errors)
+// is handed to the byte interpreter before the instruction changes anything,
+// so it behaves exactly the same
+#define _TSTEP _TAIL VM::_tailStep(_TARGS);
+
+#define _TNEXT(len)                              \
+    ip += len;                                   \
+    if (--left == 0)                             \
+        _TRETURN(ExecResult::VM_PAUSED)          \
+    if (ip >= vm->_memSize)                      \
+        _TSTEP                                   \
+    _TAIL VM::_tailHandlers[mem[ip]](_TARGS);
+
+#define _TJUMP(addr) \
+    ip = addr;       \
+    _TNEXT(0)
+
+// conditional jumps keep their target in the last two bytes
+#define _TJUMP_IF(len, cond)                                                   \
+    if (cond)                                                                  \
+    {                                                                          \
+        _TJUMP(VM_NEAR_TARGET(ip, mem[ip + len - 2] | mem[ip + len - 1] << 8)) \
+    }                                                                          \
+    _TNEXT(len)
+
+#define _TCHECK_BYTES_AVAIL(n)    \
+    if (ip + n >= vm->_memSize)   \
+        _TSTEP
+// writing IP through an operand is a jump, which the byte interpreter handles
+#define _TCHECK_REGISTER_VALID(r)           \
+    if (r >= REGISTER_COUNT || r == IP)     \
+        _TSTEP
+#define _TCHECK_ADDR_VALID(a)   \
+    if ((a) >= vm->_memSize)    \
+        _TSTEP
+#define _TCHECK_CAN_PUSH(n)                                 \
+    if (sp < (uint64_t)vm->_progLen + n * sizeof(uint32_t)) \
+        _TSTEP
+#define _TCHECK_CAN_POP(n)                                                       \
+    if ((uint64_t)sp + n * sizeof(uint32_t) > vm->_memSize || sp < vm->_progLen) \
+        _TSTEP
+
+// code written here has to be verified again before the verified
+// interpreter may run it
+#define _TCODE_WRITE(addr, len)     \
+    if ((addr) < vm->_codeLen)      \
+        vm->_unverify(addr, len);
+
+// instructions writing a register operand keep the SP argument in sync
+#define _TWROTE(r)         \
+    if (r == SP)           \
+        sp = regs[SP];
+
+#define _TREG1                 \
+    _TCHECK_BYTES_AVAIL(1)     \
+    const uint8_t a = mem[ip + 1]; \
+    _TCHECK_REGISTER_VALID(a)
+#define _TREG2                 \
+    _TCHECK_BYTES_AVAIL(2)     \
+    const uint8_t a = mem[ip + 1]; \
+    const uint8_t b = mem[ip + 2]; \
+    _TCHECK_REGISTER_VALID(a)  \
+    _TCHECK_REGISTER_VALID(b)
+#define _TREG3                 \
+    _TCHECK_BYTES_AVAIL(3)     \
+    const uint8_t a = mem[ip + 1]; \
+    const uint8_t b = mem[ip + 2]; \
+    const uint8_t c = mem[ip + 3]; \
+    _TCHECK_REGISTER_VALID(a)  \
+    _TCHECK_REGISTER_VALID(b)  \
+    _TCHECK_REGISTER_VALID(c)
+
+#define _TARITH(expr) \
+    _TREG3            \
+    expr;             \
+    _TWROTE(a)        \
+    _TNEXT(4)
+
+#define _I32(r) (*((int32_t *)&regs[r]))
+#define _F32(r) (*((float *)&regs[r]))
+
+ExecResult VM::_runTailCall(uint32_t maxInstr)
+{
+    for (;;)
+    {
+        // the handlers only count down, so unlimited runs go a chunk at a time
+        const uint32_t budget = maxInstr == 0 ? UINT32_MAX : maxInstr;
+        const uint32_t ip = this->_registers[IP];
+        const uint32_t sp = this->_registers[SP];
+        this->_executed += budget;
+
+        const ExecResult res = ip < this->_memSize
+                                   ? _tailHandlers[this->_memory[ip]](this, this->_memory, this->_registers, ip, sp, budget)
+                                   : _tailStep(this, this->_memory, this->_registers, ip, sp, budget);
+        if (res != ExecResult::VM_PAUSED || maxInstr != 0)
+            return res;
+    }
+}
+
+// runs one instruction in the byte interpreter, which also reports errors with
+// the same IP, and carries on from wherever it left the registers
+VM_TAILCALL_ATTR ExecResult VM::_tailStep(VM *vm, uint8_t *mem, uint32_t *regs, uint32_t ip, uint32_t sp, uint32_t left)
+{
+    regs[IP] = ip;
+    const ExecResult res = vm->_step();
+    if (res != ExecResult::VM_PAUSED)
+    {
+        vm->_executed -= left;
+        return res;
+    }
+    ip = regs[IP];
+    sp = regs[SP];
+    _TNEXT(0)
+}
+
+// interrupts, I/O and unknown opcodes
+template <uint8_t op>
+VM_TAILCALL_ATTR ExecResult VM::_tailOp(VM *vm, uint8_t *mem, uint32_t *regs, uint32_t ip, uint32_t sp, uint32_t left)
+{
+    _TSTEP
+}
+
+_TOP(OP_NOP)
+{
+    _TNEXT(1)
+}
+
+_TOP(OP_HALT)
+{
+    _TRETURN(ExecResult::VM_FINISHED)
+}
+
+_TOP(OP_LCONS)
+{
+    _TREG1
+    _TCHECK_BYTES_AVAIL(5)
+    regs[a] = mem[ip + 2] | mem[ip + 3] << 8 | mem[ip + 4] << 16 | mem[ip + 5] << 24;
+    _TWROTE(a)
+    _TNEXT(6)
+}
+
+_TOP(OP_LCONSW)
+{
+    _TREG1
+    _TCHECK_BYTES_AVAIL(3)
+    regs[a] = mem[ip + 2] | mem[ip + 3] << 8;
+    _TWROTE(a)
+    _TNEXT(4)
+}
+
+_TOP(OP_LCONSB)
+{
+    _TREG1
+    _TCHECK_BYTES_AVAIL(2)
+    regs[a] = mem[ip + 2];
+    _TWROTE(a)
+    _TNEXT(3)
+}
+
+_TOP(OP_MOV)
+{
+    _TREG2
+    regs[a] = regs[b];
+    _TWROTE(a)
+    _TNEXT(3)
+}
+
+// popping into or pushing SP itself is left to the byte interpreter
+_TOP(OP_PUSH)
+{
+    _TREG1
+    if (a == SP)
+        _TSTEP
+    _TCHECK_CAN_PUSH(1)
+    sp -= 4;
+    regs[SP] = sp;
+    memcpy(&mem[sp], &regs[a], sizeof(uint32_t));
+    _TNEXT(2)
+}
+
+_TOP(OP_POP)
+{
+    _TREG1
+    if (a == SP)
+        _TSTEP
+    _TCHECK_CAN_POP(1)
+    memcpy(&regs[a], &mem[sp], sizeof(uint32_t));
+    sp += 4;
+    regs[SP] = sp;
+    _TNEXT(2)
+}
+
+_TOP(OP_POP2)
+{
+    _TREG2
+    if (a == SP || b == SP)
+        _TSTEP
+    _TCHECK_CAN_POP(2)
+    memcpy(&regs[a], &mem[sp], sizeof(uint32_t));
+    memcpy(&regs[b], &mem[sp + 4], sizeof(uint32_t));
+    sp += 8;
+    regs[SP] = sp;
+    _TNEXT(3)
+}
+
+_TOP(OP_DUP)
+{
+    _TCHECK_CAN_POP(1)
+    _TCHECK_CAN_PUSH(1)
+    sp -= 4;
+    regs[SP] = sp;
+    memcpy(&mem[sp], &mem[sp + 4], sizeof(uint32_t));
+    _TNEXT(1)
+}
+
+_TOP(OP_CALL)
+{
+    _TCHECK_BYTES_AVAIL(2)
+    regs[RA] = ip + 3;
+    _TJUMP(VM_NEAR_TARGET(ip, mem[ip + 1] | mem[ip + 2] << 8))
+}
+
+_TOP(OP_RET)
+{
+    _TJUMP(regs[RA])
+}
+
+_TOP(OP_STOR)
+{
+    _TCHECK_BYTES_AVAIL(3)
+    const uint16_t addr = mem[ip + 1] | mem[ip + 2] << 8;
+    const uint8_t a = mem[ip + 3];
+    _TCHECK_REGISTER_VALID(a)
+    _TCHECK_ADDR_VALID((uint32_t)addr + 3)
+    memcpy(&mem[addr], &regs[a], sizeof(uint32_t));
+    _TCODE_WRITE(addr, 4)
+    _TNEXT(4)
+}
+
+_TOP(OP_STOR_P)
+{
+    _TREG2
+    const uint32_t dest = regs[a];
+    _TCHECK_ADDR_VALID((uint64_t)dest + 3)
+    memcpy(&mem[dest], &regs[b], sizeof(uint32_t));
+    _TCODE_WRITE(dest, 4)
+    _TNEXT(3)
+}
+
+_TOP(OP_STORW)
+{
+    _TCHECK_BYTES_AVAIL(3)
+    const uint16_t addr = mem[ip + 1] | mem[ip + 2] << 8;
+    const uint8_t a = mem[ip + 3];
+    _TCHECK_REGISTER_VALID(a)
+    _TCHECK_ADDR_VALID((uint32_t)addr + 1)
+    memcpy(&mem[addr], &regs[a], sizeof(uint16_t));
+    _TCODE_WRITE(addr, 2)
+    _TNEXT(4)
+}
+
+_TOP(OP_STORW_P)
+{
+    _TREG2
+    const uint32_t dest = regs[a];
+    _TCHECK_ADDR_VALID((uint64_t)dest + 1)
+    memcpy(&mem[dest], &regs[b], sizeof(uint16_t));
+    _TCODE_WRITE(dest, 2)
+    _TNEXT(3)
+}
+
+_TOP(OP_STORB)
+{
+    _TCHECK_BYTES_AVAIL(3)
+    const uint16_t addr = mem[ip + 1] | mem[ip + 2] << 8;
+    const uint8_t a = mem[ip + 3];
+    _TCHECK_REGISTER_VALID(a)
+    _TCHECK_ADDR_VALID((uint32_t)addr)
+    mem[addr] = regs[a];
+    _TCODE_WRITE(addr, 1)
+    _TNEXT(4)
+}
+
+_TOP(OP_STORB_P)
+{
+    _TREG2
+    const uint32_t dest = regs[a];
+    _TCHECK_ADDR_VALID((uint64_t)dest)
+    mem[dest] = regs[b];
+    _TCODE_WRITE(dest, 1)
+    _TNEXT(3)
+}
+
+_TOP(OP_LOAD)
+{
+    _TREG1
+    _TCHECK_BYTES_AVAIL(3)
+    const uint16_t addr = mem[ip + 2] | mem[ip + 3] << 8;
+    _TCHECK_ADDR_VALID((uint32_t)addr + 3)
+    memcpy(&regs[a], &mem[addr], sizeof(uint32_t));
+    _TWROTE(a)
+    _TNEXT(4)
+}
+
+_TOP(OP_LOAD_P)
+{
+    _TREG2
+    const uint32_t src = regs[b];
+    _TCHECK_ADDR_VALID((uint64_t)src + 3)
+    memcpy(&regs[a], &mem[src], sizeof(uint32_t));
+    _TWROTE(a)
+    _TNEXT(3)
+}
+
+_TOP(OP_LOADW)
+{
+    _TREG1
+    _TCHECK_BYTES_AVAIL(3)
+    const uint16_t addr = mem[ip + 2] | mem[ip + 3] << 8;
+    _TCHECK_ADDR_VALID((uint32_t)addr + 1)
+    regs[a] = mem[addr] | mem[addr + 1] << 8;
+    _TWROTE(a)
+    _TNEXT(4)
+}
+
+_TOP(OP_LOADW_P)
+{
+    _TREG2
+    const uint32_t src = regs[b];
+    _TCHECK_ADDR_VALID((uint64_t)src + 1)
+    regs[a] = mem[src] | mem[src + 1] << 8;
+    _TWROTE(a)
+    _TNEXT(3)
+}
+
+_TOP(OP_LOADB)
+{
+    _TREG1
+    _TCHECK_BYTES_AVAIL(3)
+    const uint16_t addr = mem[ip + 2] | mem[ip + 3] << 8;
+    _TCHECK_ADDR_VALID((uint32_t)addr)
+    regs[a] = mem[addr];
+    _TWROTE(a)
+    _TNEXT(4)
+}
+
+_TOP(OP_LOADB_P)
+{
+    _TREG2
+    const uint32_t src = regs[b];
+    _TCHECK_ADDR_VALID((uint64_t)src)
+    regs[a] = mem[src];
+    _TWROTE(a)
+    _TNEXT(3)
+}
+
+_TOP(OP_MEMCPY)
+{
+    _TCHECK_BYTES_AVAIL(6)
+    const uint16_t dest = mem[ip + 1] | mem[ip + 2] << 8;
+    const uint16_t source = mem[ip + 3] | mem[ip + 4] << 8;
+    const uint16_t bytes = mem[ip + 5] | mem[ip + 6] << 8;
+    _TCHECK_ADDR_VALID((uint32_t)source + bytes - 1)
+    _TCHECK_ADDR_VALID((uint32_t)dest + bytes - 1)
+    memcpy(&mem[dest], &mem[source], bytes);
+    _TCODE_WRITE(dest, bytes)
+    _TNEXT(7)
+}
+
+_TOP(OP_MEMCPY_P)
+{
+    _TREG3
+    const uint32_t dest = regs[a];
+    const uint32_t source = regs[b];
+    const uint32_t bytes = regs[c];
+    _TCHECK_ADDR_VALID((uint64_t)source + bytes - 1)
+    _TCHECK_ADDR_VALID((uint64_t)dest + bytes - 1)
+    memcpy(&mem[dest], &mem[source], bytes);
+    _TCODE_WRITE(dest, bytes)
+    _TNEXT(4)
+}
+
+_TOP(OP_INC)
+{
+    _TREG1
+    regs[a]++;
+    _TWROTE(a)
+    _TNEXT(2)
+}
+
+_TOP(OP_FINC)
+{
+    _TREG1
+    _F32(a)++;
+    _TWROTE(a)
+    _TNEXT(2)
+}
+
+_TOP(OP_DEC)
+{
+    _TREG1
+    regs[a]--;
+    _TWROTE(a)
+    _TNEXT(2)
+}
+
+_TOP(OP_FDEC)
+{
+    _TREG1
+    _F32(a)--;
+    _TWROTE(a)
+    _TNEXT(2)
+}
+
+_TOP(OP_ADD)
+{
+    _TARITH(regs[a] = regs[b] + regs[c])
+}
+
+_TOP(OP_FADD)
+{
+    _TARITH(_F32(a) = floatAdd(_F32(b), _F32(c)))
+}
+
+_TOP(OP_SUB)
+{
+    _TARITH(regs[a] = regs[b] - regs[c])
+}
+
+_TOP(OP_FSUB)
+{
+    _TARITH(_F32(a) = _F32(b) - _F32(c))
+}
+
+_TOP(OP_MUL)
+{
+    _TARITH(regs[a] = regs[b] * regs[c])
+}
+
+_TOP(OP_IMUL)
+{
+    _TARITH(_I32(a) = _I32(b) * _I32(c))
+}
+
+_TOP(OP_FMUL)
+{
+    _TARITH(_F32(a) = floatMul(_F32(b), _F32(c)))
+}
+
+_TOP(OP_DIV)
+{
+    _TARITH(regs[a] = regs[b] / regs[c])
+}
+
+_TOP(OP_IDIV)
+{
+    _TARITH(_I32(a) = _I32(b) / _I32(c))
+}
+
+_TOP(OP_FDIV)
+{
+    _TARITH(_F32(a) = _F32(b) / _F32(c))
+}
+
+_TOP(OP_SHL)
+{
+    _TARITH(regs[a] = regs[b] << regs[c])
+}
+
+_TOP(OP_SHR)
+{
+    _TARITH(regs[a] = regs[b] >> regs[c])
+}
+
+_TOP(OP_ISHR)
+{
+    _TARITH(_I32(a) = _I32(b) >> _I32(c))
+}
+
+_TOP(OP_MOD)
+{
+    _TARITH(regs[a] = regs[b] % regs[c])
+}
+
+_TOP(OP_IMOD)
+{
+    _TARITH(_I32(a) = _I32(b) % _I32(c))
+}
+
+_TOP(OP_AND)
+{
+    _TARITH(regs[a] = regs[b] & regs[c])
+}
+
+_TOP(OP_OR)
+{
+    _TARITH(regs[a] = regs[b] | regs[c])
+}
+
+_TOP(OP_XOR)
+{
+    _TARITH(regs[a] = regs[b] ^ regs[c])
+}
+
+_TOP(OP_NOT)
+{
+    _TREG2
+    regs[a] = ~regs[b];
+    _TWROTE(a)
+    _TNEXT(3)
+}
+
+_TOP(OP_U2I)
+{
+    _TREG1
+    _TNEXT(2)
+}
+
+_TOP(OP_I2U)
+{
+    _TREG1
+    _TNEXT(2)
+}
+
+_TOP(OP_I2F)
+{
+    _TREG2
+    _F32(a) = (float)_I32(b);
+    _TWROTE(a)
+    _TNEXT(3)
+}
+
+_TOP(OP_F2I)
+{
+    _TREG2
+    _I32(a) = (int32_t)_F32(b);
+    _TWROTE(a)
+    _TNEXT(3)
+}
+
+_TOP(OP_JMP)
+{
+    _TCHECK_BYTES_AVAIL(2)
+    _TJUMP(VM_NEAR_TARGET(ip, mem[ip + 1] | mem[ip + 2] << 8))
+}
+
+_TOP(OP_JR)
+{
+    _TREG1
+    _TJUMP(regs[a])
+}
+
+_TOP(OP_JZ)
+{
+    _TREG1
+    _TCHECK_BYTES_AVAIL(3)
+    _TJUMP_IF(4, regs[a] == 0)
+}
+
+_TOP(OP_JNZ)
+{
+    _TREG1
+    _TCHECK_BYTES_AVAIL(3)
+    _TJUMP_IF(4, regs[a] != 0)
+}
+
+// the two compared registers come first, the target is read only if taken
+#define _TCOMPARE        \
+    _TREG2               \
+    _TCHECK_BYTES_AVAIL(4)
+
+_TOP(OP_JE)
+{
+    _TCOMPARE
+    _TJUMP_IF(5, regs[a] == regs[b])
+}
+
+_TOP(OP_JNE)
+{
+    _TCOMPARE
+    _TJUMP_IF(5, regs[a] != regs[b])
+}
+
+_TOP(OP_JA)
+{
+    _TCOMPARE
+    _TJUMP_IF(5, regs[a] > regs[b])
+}
+
+_TOP(OP_JG)
+{
+    _TCOMPARE
+    _TJUMP_IF(5, _I32(a) > _I32(b))
+}
+
+_TOP(OP_JAE)
+{
+    _TCOMPARE
+    _TJUMP_IF(5, regs[a] >= regs[b])
+}
+
+_TOP(OP_JGE)
+{
+    _TCOMPARE
+    _TJUMP_IF(5, _I32(a) >= _I32(b))
+}
+
+_TOP(OP_JB)
+{
+    _TCOMPARE
+    _TJUMP_IF(5, regs[a] < regs[b])
+}
+
+_TOP(OP_JL)
+{
+    _TCOMPARE
+    _TJUMP_IF(5, _I32(a) < _I32(b))
+}
+
+_TOP(OP_JBE)
+{
+    _TCOMPARE
+    _TJUMP_IF(5, regs[a] <= regs[b])
+}
+
+_TOP(OP_JLE)
+{
+    _TCOMPARE
+    _TJUMP_IF(5, _I32(a) <= _I32(b))
+}
+
+#define _TFAR_TARGET (mem[ip + 1] | mem[ip + 2] << 8 | mem[ip + 3] << 16 | (uint32_t)mem[ip + 4] << 24)
+
+_TOP(OP_LJMP)
+{
+    _TCHECK_BYTES_AVAIL(4)
+    _TJUMP(_TFAR_TARGET)
+}
+
+_TOP(OP_LCALL)
+{
+    _TCHECK_BYTES_AVAIL(4)
+    regs[RA] = ip + 5;
+    _TJUMP(_TFAR_TARGET)
+}
+
+// one entry per byte value, so fetching never needs an opcode check
+#define _T1(n) &VM::_tailOp<n>,
+#define _T4(n) _T1(n) _T1(n + 1) _T1(n + 2) _T1(n + 3)
+#define _T16(n) _T4(n) _T4(n + 4) _T4(n + 8) _T4(n + 12)
+#define _T64(n) _T16(n) _T16(n + 16) _T16(n + 32) _T16(n + 48)
+
+const VM::TailHandler VM::_tailHandlers[256] = {_T64(0) _T64(64) _T64(128) _T64(192)};
+
+#endif // VM_TAILCALL_DISPATCH
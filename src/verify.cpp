@@ -0,0 +1,239 @@
+#include "vm.h"
+#include "decode.h"
+
+#define _BIT_SET(map, i) ((map)[(i) >> 3] & (1 << ((i) & 7)))
+#define _SET_BIT(map, i) (map)[(i) >> 3] |= 1 << ((i) & 7)
+
+// operands of a single instruction are valid no matter what the registers hold
+static bool operandsValid(const uint8_t *code, uint32_t addr, uint32_t memSize)
+{
+    const uint8_t instr = code[addr];
+    const uint8_t *operands = &code[addr + 1];
+    uint8_t regs[3] = {0, 0, 0};
+
+    switch (instrFormat[instr])
+    {
+    case FMT_RRR:
+        regs[2] = operands[2];
+        // fall through
+    case FMT_RR:
+    case FMT_RR_C16:
+        regs[1] = operands[1];
+        // fall through
+    case FMT_R:
+    case FMT_R_C8:
+    case FMT_R_C16:
+    case FMT_R_C32:
+        regs[0] = operands[0];
+        break;
+    case FMT_C16_R:
+        regs[0] = operands[2];
+        break;
+    default:
+        break;
+    }
+
+    // writing IP through a register operand would be an unchecked jump
+    for (uint8_t reg : regs)
+        if (reg >= REGISTER_COUNT || reg == IP)
+            return false;
+
+    // shorter instructions have no constant address, and may end the code
+    if (instrLength[instr] < 3)
+        return true;
+    const uint32_t imm = instrFormat[instr] == FMT_R_C16 ? operands[1] | operands[2] << 8 : operands[0] | operands[1] << 8;
+    switch (instr)
+    {
+    case OP_STOR:
+    case OP_LOAD:
+        return imm + 3 < memSize;
+    case OP_STORW:
+    case OP_LOADW:
+        return imm + 1 < memSize;
+    case OP_STORB:
+    case OP_LOADB:
+    case OP_PRINTS:
+        return imm < memSize;
+    case OP_MEMCPY:
+    {
+        const uint32_t source = operands[2] | operands[3] << 8;
+        const uint32_t bytes = operands[4] | operands[5] << 8;
+        return imm + bytes - 1 < memSize && source + bytes - 1 < memSize;
+    }
+    case OP_READS:
+        return imm + (operands[2] | operands[3] << 8) < memSize;
+    }
+    return true;
+}
+
+// bytes written by an instruction with a constant destination, if any
+static void constantWrite(const uint8_t *code, uint32_t addr, uint32_t &dest, uint32_t &len)
+{
+    const uint8_t *operands = &code[addr + 1];
+    if (instrLength[code[addr]] < 3)
+    {
+        dest = len = 0;
+        return;
+    }
+    dest = operands[0] | operands[1] << 8;
+    switch (code[addr])
+    {
+    case OP_STOR:
+        len = 4;
+        break;
+    case OP_STORW:
+        len = 2;
+        break;
+    case OP_STORB:
+        len = 1;
+        break;
+    case OP_MEMCPY:
+        len = operands[4] | operands[5] << 8;
+        break;
+    case OP_READS:
+        len = (operands[2] | operands[3] << 8) + 1;
+        break;
+    default:
+        len = 0;
+    }
+}
+
+uint8_t instrSuccessors(const uint8_t *code, uint32_t addr, uint32_t *successors)
+{
+    const uint8_t instr = code[addr];
+    const uint32_t next = addr + instrLength[instr];
+    uint8_t count = 0;
+    // direct jumps keep their target in the last two bytes, far ones in the last four
+    if (instr == OP_JMP || instr == OP_CALL || (instr >= OP_JZ && instr <= OP_JLE))
+        successors[count++] = VM_NEAR_TARGET(addr, code[next - 2] | code[next - 1] << 8);
+    else if (instr == OP_LJMP || instr == OP_LCALL)
+        successors[count++] = code[next - 4] | code[next - 3] << 8 | code[next - 2] << 16 | (uint32_t)code[next - 1] << 24;
+    if (instr != OP_HALT && instr != OP_JMP && instr != OP_LJMP && instr != OP_JR && instr != OP_RET)
+        successors[count++] = next;
+    return count;
+}
+
+// Walks every instruction reachable from the entry point through fallthroughs
+// and direct jumps. The program is verified if all of them have valid opcodes,
+// registers and constant addresses, stay inside the code and never write
+// over code with a constant address. Indirect jumps and pointer writes are left
+// to run().
+bool verifyProgram(const uint8_t *code, uint32_t codeLen, uint32_t memSize, uint32_t entry, uint8_t *verifyMap, uint32_t *blockLen)
+{
+    const uint32_t mapLen = (codeLen + 7) / 8;
+    memset(verifyMap, 0, mapLen * 2);
+    uint8_t *starts = verifyMap;
+    uint8_t *codeMap = verifyMap + mapLen;
+
+    if (entry >= codeLen)
+        return false;
+
+    uint32_t *pending = new uint32_t[codeLen];
+    uint32_t pendingCount = 0;
+    pending[pendingCount++] = entry;
+    _SET_BIT(starts, entry);
+
+    bool valid = true;
+    while (valid && pendingCount > 0)
+    {
+        const uint32_t addr = pending[--pendingCount];
+        const uint8_t instr = code[addr];
+        if (instr >= INSTRUCTION_COUNT || addr + instrLength[instr] > codeLen ||
+            !operandsValid(code, addr, memSize))
+        {
+            valid = false;
+            break;
+        }
+
+        const uint32_t next = addr + instrLength[instr];
+        for (uint32_t i = addr; i < next; i++)
+            _SET_BIT(codeMap, i);
+
+        uint32_t successors[2];
+        const uint8_t successorCount = instrSuccessors(code, addr, successors);
+        for (uint8_t i = 0; i < successorCount; i++)
+        {
+            const uint32_t target = successors[i];
+            if (target >= codeLen)
+            {
+                valid = false;
+                break;
+            }
+            if (!_BIT_SET(starts, target))
+            {
+                _SET_BIT(starts, target);
+                pending[pendingCount++] = target;
+            }
+        }
+    }
+    delete[] pending;
+
+    // constant writes into code would need the checks back
+    for (uint32_t addr = 0; valid && addr < codeLen; addr++)
+    {
+        if (!_BIT_SET(starts, addr))
+            continue;
+        uint32_t dest, len;
+        constantWrite(code, addr, dest, len);
+        for (uint32_t i = dest; i < dest + len && i < codeLen; i++)
+            if (_BIT_SET(codeMap, i))
+                valid = false;
+    }
+
+    // straight-line code from every instruction up to and including the next
+    // one that can go anywhere else, working backwards so the rest is known
+    if (valid)
+    {
+        for (uint32_t addr = codeLen; addr-- > 0;)
+        {
+            if (!_BIT_SET(starts, addr))
+                continue;
+            const uint8_t instr = code[addr];
+            if (instr == OP_HALT || instr == OP_INT || instr == OP_CALL || instr == OP_RET ||
+                (instr >= OP_JMP && instr <= OP_JLE) || instr == OP_LJMP || instr == OP_LCALL)
+                blockLen[addr] = 1;
+            else
+                blockLen[addr] = blockLen[addr + instrLength[instr]] + 1;
+        }
+    }
+
+    return valid;
+}
+
+bool VM::verify()
+{
+    // the program's own results are shared, the VM needs its own once it changed the code
+    if (!this->_ownsVerify)
+    {
+        this->_verifyMap = new uint8_t[(this->_codeLen + 7) / 8 * 2];
+        this->_blockLen = new uint32_t[this->_codeLen];
+        this->_ownsVerify = true;
+    }
+    this->_verifyStale = false;
+    this->_verified = verifyProgram(this->_memory, this->_codeLen, this->_memSize, this->_program->_registers[IP],
+                                     this->_verifyMap, this->_blockLen);
+    return this->_verified;
+}
+
+bool VM::_verifiedStart(uint32_t addr)
+{
+    return addr < this->_codeLen && _BIT_SET(this->_verifyMap, addr);
+}
+
+bool VM::_writesCode(uint32_t addr, uint32_t len)
+{
+    const uint8_t *codeMap = this->_verifyMap + (this->_codeLen + 7) / 8;
+    for (uint32_t i = addr; i < addr + len && i < this->_codeLen; i++)
+        if (_BIT_SET(codeMap, i))
+            return true;
+    return false;
+}
+
+// a write to code by an engine that checks everything anyway: the verified
+// interpreter can't trust what verify() found any more, so the VM runs checked
+// until it verifies again
+void VM::_unverify(uint32_t addr, uint32_t len)
+{
+    if (this->_verified && addr < this->_codeLen && this->_writesCode(addr, len))
+        this->_verified = false;
+}
@@ -1,61 +1,195 @@
 #include "vm.h"
+#include "basicvm.h"
+#include "decode.h"
+#include "jit.h"
 
-#define _NEXT_BYTE this->_memory[++this->_registers[IP]]
-#define _NEXT_SHORT ({ this->_registers[IP] += 2; this->_memory[this->_registers[IP]-1]\
-                     | this->_memory[this->_registers[IP]] << 8; })
-#define _NEXT_INT ({                                                                               \
-    this->_registers[IP] += 4;                                                                     \
-    this->_memory[this->_registers[IP] - 3] | this->_memory[this->_registers[IP] - 2] << 8 |       \
-        this->_memory[this->_registers[IP] - 1] << 16 | this->_memory[this->_registers[IP]] << 24; \
-})
-
-#ifndef VM_DISABLE_CHECKS
-#define _CHECK_ADDR_VALID(a) \
-    if (a >= this->_memSize) \
-        return ExecResult::VM_ERR_INVALID_ADDRESS;
-#define _CHECK_BYTES_AVAIL(n) \
-    _CHECK_ADDR_VALID(this->_registers[IP] + n)
-#define _CHECK_REGISTER_VALID(r) \
-    if (r >= REGISTER_COUNT)     \
-        return ExecResult::VM_ERR_INVALID_REGISTER;
-#define _CHECK_CAN_PUSH(n)                                              \
-    if (this->_registers[SP] - (n * sizeof(uint32_t)) < this->_progLen) \
-        return ExecResult::VM_ERR_STACK_OVERFLOW;
-#define _CHECK_CAN_POP(n)                                               \
-    if (this->_registers[SP] + (n * sizeof(uint32_t)) > this->_memSize) \
-        return ExecResult::VM_ERR_STACK_UNDERFLOW;                      \
-    if (this->_registers[SP] < this->_progLen)                          \
-        return ExecResult::VM_ERR_STACK_OVERFLOW;
-#else
-#define _CHECK_ADDR_VALID(a)
-#define _CHECK_BYTES_AVAIL(n)
-#define _CHECK_REGISTER_VALID(r)
-#define _CHECK_CAN_PUSH(n)
-#define _CHECK_CAN_POP(n)
-#endif
+VM::VM(uint8_t *program, uint32_t progLen, uint32_t stackSize)
+    : VM(new Program(program, progLen, stackSize))
+{
+    this->_program->release();
+}
 
-VM::VM(uint8_t *program, uint16_t progLen, uint16_t stackSize)
-    : _memory(new uint8_t[progLen + stackSize]), _memSize(progLen + stackSize), _progLen(progLen), _stackSize(stackSize)
+// the program's memory is already zeroed and verified, so a new VM only has
+// to map it and set up its registers
+VM::VM(Program *program)
+    : _program(program), _memory(program->_mapMemory(this->_mapped)), _memSize(program->_progLen + program->_stackSize),
+      _stackSize(program->_stackSize), _progLen(program->_progLen),
+      _codeLen(program->_codeLen)
 {
-    memcpy(this->_memory, program, progLen);
-    this->reset();
+    program->retain();
+    this->_verifyMap = program->_verifyMap;
+    this->_blockLen = program->_blockLen;
+    this->_verified = program->_verified;
+    memcpy(this->_registers, program->_registers, sizeof(this->_registers));
+}
+
+// a VM running the program in an image file, mapped rather than read when
+// the host allows it
+VM *VM::fromFile(const char *path, uint32_t stackSize, ImageError *error)
+{
+    Program *program = Program::map(path, stackSize, error);
+    if (program == nullptr)
+        return nullptr;
+    VM *vm = new VM(program);
+    program->release();
+    return vm;
 }
 
 VM::~VM()
 {
-    delete[] this->_memory;
+    this->_program->_unmapMemory(this->_memory, this->_mapped);
+    if (this->_ownsDecoded)
+    {
+        delete[] this->_decoded;
+        delete[] this->_codeMap;
+    }
+    if (this->_ownsVerify)
+    {
+        delete[] this->_verifyMap;
+        delete[] this->_blockLen;
+    }
+#ifdef VM_JIT
+    delete this->_jit;
+#endif
+    delete[] this->_interrupts;
+    this->flush();
+    delete[] this->_outputBuffer;
+    this->_closeInput();
+    delete[] this->_inputBuffer;
+    this->_program->release();
 }
 
+// starts over from the program's entry point with an empty stack and every
+// other register zeroed
 void VM::reset()
 {
-    memset(&this->_memory[this->_progLen], 0, this->_stackSize);
+    this->_program->_resetMemory(this->_memory, this->_mapped, true);
     memset(this->_registers, 0, REGISTER_COUNT * sizeof(uint32_t));
+    this->_registers[IP] = this->_program->_entry;
     this->_registers[SP] = this->_progLen + this->_stackSize;
+    this->_resetDecoded();
 }
 
+// back to how the VM was created, program data and code included, for the
+// next unrelated run. Only the pages that were touched cost anything
+void VM::restore()
+{
+    this->_program->_resetMemory(this->_memory, this->_mapped, false);
+    memcpy(this->_registers, this->_program->_registers, sizeof(this->_registers));
+    this->_executed = 0;
+
+    // the code is the program's again, and so are its decoded instructions
+    // and verification
+    this->_resetDecoded();
+    if (this->_ownsVerify)
+    {
+        delete[] this->_verifyMap;
+        delete[] this->_blockLen;
+        this->_verifyMap = this->_program->_verifyMap;
+        this->_blockLen = this->_program->_blockLen;
+        this->_ownsVerify = false;
+    }
+    this->_verified = this->_program->_verified;
+    this->_verifyStale = false;
+    this->_compiledStale = this->_compiled != nullptr;
+}
+
+// a program starting from where this VM is now, registers, stack and all:
+// VMs created from it skip whatever it has run so far, and map its memory
+// copy-on-write like any other program's. reset() still goes back to the
+// original program's entry point
+Program *VM::snapshot()
+{
+    Program *snapshot = new Program(this->_memory, this->_memSize, this->_progLen, this->_codeLen, this->_stackSize,
+                                     this->_registers);
+    snapshot->_entry = this->_program->_entry;
+    return snapshot;
+}
+
+// a new VM in the same state, with the same callback and dispatch mode
+VM *VM::clone()
+{
+    Program *snapshot = this->snapshot();
+    VM *vm = new VM(snapshot);
+    snapshot->release();
+    vm->_interruptCallback = this->_interruptCallback;
+    vm->_interruptHandler = this->_interruptHandler;
+    if (this->_interrupts != nullptr)
+    {
+        vm->_interrupts = new InterruptEntry[256];
+        memcpy(vm->_interrupts, this->_interrupts, 256 * sizeof(InterruptEntry));
+    }
+    vm->_outputFn = this->_outputFn;
+    vm->_outputContext = this->_outputContext;
+    vm->_copyInput(this);
+    vm->_dispatch = this->_dispatch;
+    return vm;
+}
+
+// callback returns whether to go on with the next instruction
 void VM::onInterrupt(bool (*callback)(uint8_t))
 {
     this->_interruptCallback = callback;
+    this->_interruptHandler = nullptr;
+}
+
+// callback can also leave the interrupt pending: the VM stops with
+// VM_WAITING, and the host runs it again once it has set up the result
+void VM::onInterrupt(InterruptResult (*callback)(uint8_t))
+{
+    this->_interruptHandler = callback;
+    this->_interruptCallback = nullptr;
+}
+
+// handler for a single code, called with this VM and context. It takes
+// precedence over the callbacks above, nullptr removes it
+void VM::onInterrupt(uint8_t code, InterruptHandler handler, void *context)
+{
+    if (this->_interrupts == nullptr)
+        this->_interrupts = new InterruptEntry[256]();
+    this->_interrupts[code].handler = handler;
+    this->_interrupts[code].registers = nullptr;
+    this->_interrupts[code].context = context;
+}
+
+// handler for a single code that only works on registers, which the engines
+// call straight away and carry on from
+void VM::onInterrupt(uint8_t code, RegisterHandler handler, void *context)
+{
+    if (this->_interrupts == nullptr)
+        this->_interrupts = new InterruptEntry[256]();
+    this->_interrupts[code].handler = nullptr;
+    this->_interrupts[code].registers = handler;
+    this->_interrupts[code].context = context;
+}
+
+bool VM::_handlesInterrupt(uint8_t code)
+{
+    if (this->_interrupts != nullptr &&
+        (this->_interrupts[code].handler != nullptr || this->_interrupts[code].registers != nullptr))
+        return true;
+    return this->_interruptCallback != nullptr || this->_interruptHandler != nullptr;
+}
+
+// IP is on the interrupt code while the handler runs, and output is flushed
+// in case it writes to the same place
+InterruptResult VM::_interrupt(uint8_t code)
+{
+    this->flush();
+    if (this->_interrupts != nullptr)
+    {
+        const InterruptEntry &entry = this->_interrupts[code];
+        if (entry.handler != nullptr)
+            return entry.handler(this, code, entry.context);
+        if (entry.registers != nullptr)
+        {
+            entry.registers(this->_registers, entry.context);
+            return VM_INT_RESUME;
+        }
+    }
+    if (this->_interruptHandler != nullptr)
+        return this->_interruptHandler(code);
+    return this->_interruptCallback(code) ? VM_INT_RESUME : VM_INT_FINISH;
 }
 
 uint32_t VM::stackCount()
@@ -77,7 +211,22 @@ uint32_t VM::stackPop()
     return val;
 }
 
-uint8_t *VM::memory(uint16_t addr)
+uint8_t *VM::memory(uint32_t addr)
+{
+    // the caller may patch code, so drop any decoded instructions
+    if (addr < this->_codeLen)
+    {
+        // the VM checks again on its next run whether the program's decoded
+        // instructions are still its own
+        this->_resetDecoded();
+        this->_verifyStale = true;
+    }
+    if (addr < this->_progLen)
+        this->_compiledStale = this->_compiled != nullptr;
+    return &this->_memory[addr];
+}
+
+const uint8_t *VM::peek(uint32_t addr) const
 {
     return &this->_memory[addr];
 }
@@ -92,859 +241,142 @@ void VM::setRegister(Register reg, uint32_t val)
     this->_registers[reg] = val;
 }
 
+void VM::setDispatch(DispatchMode mode)
+{
+#ifdef VM_JIT
+    // drop native code, the decoded entries pointing to it go with it
+    if (mode != this->_dispatch && this->_jit != nullptr)
+    {
+        delete this->_jit;
+        this->_jit = nullptr;
+        this->_resetDecoded();
+    }
+#endif
+    this->_dispatch = mode;
+}
+
+DispatchMode VM::dispatch()
+{
+    return this->_dispatch;
+}
+
+// adds every instruction run() executes from now on to profile, whatever the
+// dispatch mode or compiled program, which are only used again once it's
+// nullptr. Runs without a profile don't pay anything for this. Clones don't
+// profile into it, as they may well run alongside this VM
+void VM::setProfile(Profile *profile)
+{
+    this->_profile = profile;
+}
+
+// only accepted if it was compiled from the program currently in memory
+bool VM::setCompiled(const CompiledProgram *program)
+{
+    if (program != nullptr &&
+        (program->progLen != this->_progLen || memcmp(program->program, this->_memory, this->_progLen) != 0))
+        return false;
+    this->_compiled = program;
+    this->_compiledStale = false;
+    return true;
+}
+
 ExecResult VM::run(uint32_t maxInstr)
 {
-    uint32_t instrCount = 0;
+    this->_executed = 0;
+    const ExecResult res = this->_execute(maxInstr);
+    this->flush();
+    return res;
+}
+
+// instructions run by the last call to run(), exact even for verified programs
+// that are charged a block at a time
+uint32_t VM::instructionsExecuted()
+{
+    return this->_executed;
+}
 
-    while (maxInstr == 0 || instrCount < maxInstr)
+ExecResult VM::_execute(uint32_t maxInstr)
+{
+    // compiled code is dropped if the host changed the program through memory()
+    if (this->_compiledStale && !this->setCompiled(this->_compiled))
+        this->_compiled = nullptr;
+    if (this->_compiled != nullptr && this->_profile == nullptr)
+        return this->_runCompiled(maxInstr);
+
+    // verified programs skip the checks verify() has already done
+    if (this->_verifyStale)
+        this->verify();
+    const bool checked = !this->_verified || !this->_verifiedStart(this->_registers[IP]);
+
+    // only the byte interpreter goes an instruction at a time, so it's what
+    // profiles are kept with, in an instantiation of its own
+    if (this->_profile != nullptr)
     {
-        _CHECK_ADDR_VALID(this->_registers[IP])
-        const uint8_t instr = this->_memory[this->_registers[IP]];
-        if (instr >= INSTRUCTION_COUNT)
-            return ExecResult::VM_ERR_UNKNOWN_OPCODE;
+#ifdef VM_THREADED_DISPATCH
+        return checked ? this->_run<VMProfileConfig, true, true>(maxInstr) : this->_run<VMProfileConfig, true, false>(maxInstr);
+#else
+        return checked ? this->_run<VMProfileConfig, false, true>(maxInstr) : this->_run<VMProfileConfig, false, false>(maxInstr);
+#endif
+    }
 
-        switch (instr)
-        {
-        case OP_NOP:
-        {
-            break;
-        }
-        case OP_HALT:
-        {
-            return ExecResult::VM_FINISHED;
-        }
-        case OP_INT:
-        {
-            _CHECK_BYTES_AVAIL(1)
-            const uint8_t code = _NEXT_BYTE;
-
-            if (this->_interruptCallback == nullptr)
-                return ExecResult::VM_ERR_UNHANDLED_INTERRUPT;
-            if (!this->_interruptCallback(code))
-                return ExecResult::VM_FINISHED;
-            break;
-        }
-        case OP_MOV:
-        {
-            _CHECK_BYTES_AVAIL(2)
-            const uint8_t reg1 = _NEXT_BYTE;
-            const uint8_t reg2 = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(reg1)
-            _CHECK_REGISTER_VALID(reg2)
-            this->_registers[reg1] = this->_registers[reg2];
-            break;
-        }
-        case OP_LCONS:
-        {
-            _CHECK_BYTES_AVAIL(5)
-            const uint8_t reg = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(reg)
-            this->_registers[reg] = _NEXT_INT;
-            break;
-        }
-        case OP_LCONSW:
-        {
-            _CHECK_BYTES_AVAIL(3)
-            const uint8_t reg = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(reg)
-            this->_registers[reg] = _NEXT_SHORT;
-            break;
-        }
-        case OP_LCONSB:
-        {
-            _CHECK_BYTES_AVAIL(2)
-            const uint8_t reg = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(reg)
-            this->_registers[reg] = _NEXT_BYTE;
-            break;
-        }
-        case OP_PUSH:
-        {
-            _CHECK_BYTES_AVAIL(1)
-            const uint8_t reg = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(reg)
-            _CHECK_CAN_PUSH(1)
-            this->_registers[SP] -= 4;
-            memcpy(&this->_memory[this->_registers[SP]], &this->_registers[reg], sizeof(uint32_t));
-            break;
-        }
-        case OP_POP:
-        {
-            _CHECK_BYTES_AVAIL(1)
-            const uint8_t reg = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(reg)
-            _CHECK_CAN_POP(1)
-            memcpy(&this->_registers[reg], &this->_memory[this->_registers[SP]], sizeof(uint32_t));
-            this->_registers[SP] += 4;
-            break;
-        }
-        case OP_POP2:
-        {
-            _CHECK_BYTES_AVAIL(2)
-            const uint8_t reg1 = _NEXT_BYTE;
-            const uint8_t reg2 = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(reg1)
-            _CHECK_REGISTER_VALID(reg2)
-            _CHECK_CAN_POP(2)
-            memcpy(&this->_registers[reg1], &this->_memory[this->_registers[SP]], sizeof(uint32_t));
-            this->_registers[SP] += 4;
-            memcpy(&this->_registers[reg2], &this->_memory[this->_registers[SP]], sizeof(uint32_t));
-            this->_registers[SP] += 4;
-            break;
-        }
-        case OP_DUP:
-        {
-            _CHECK_CAN_PUSH(1)
-            this->_registers[SP] -= 4;
-            memcpy(&this->_memory[this->_registers[SP]], &this->_memory[this->_registers[SP]] + 4, sizeof(uint32_t));
-            break;
-        }
-        case OP_CALL:
-        {
-            _CHECK_BYTES_AVAIL(2)
-            this->_registers[RA] = this->_registers[IP] + 3;
-            this->_registers[IP] = _NEXT_SHORT - 1;
-            break;
-        }
-        case OP_RET:
-        {
-            this->_registers[IP] = this->_registers[RA] - 1;
-            break;
-        }
-        case OP_STOR:
-        {
-            _CHECK_BYTES_AVAIL(3)
-            const uint16_t addr = _NEXT_SHORT;
-            const uint8_t reg = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(reg)
-            _CHECK_ADDR_VALID((uint32_t)addr + 3)
-            memcpy(&this->_memory[addr], &this->_registers[reg], sizeof(uint32_t));
-            break;
-        }
-        case OP_STOR_P:
-        {
-            _CHECK_BYTES_AVAIL(2)
-            const uint8_t reg1 = _NEXT_BYTE;
-            const uint8_t reg2 = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(reg1)
-            _CHECK_REGISTER_VALID(reg2)
-            const uint16_t dest = this->_registers[reg1];
-            _CHECK_ADDR_VALID((uint32_t)dest + 3)
-            memcpy(&this->_memory[dest], &this->_registers[reg2], sizeof(uint32_t));
-            break;
-        }
-        case OP_STORW:
-        {
-            _CHECK_BYTES_AVAIL(3)
-            const uint16_t addr = _NEXT_SHORT;
-            const uint8_t reg = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(reg)
-            _CHECK_ADDR_VALID((uint32_t)addr + 1)
-            memcpy(&this->_memory[addr], &this->_registers[reg], sizeof(uint16_t));
-            break;
-        }
-        case OP_STORW_P:
-        {
-            _CHECK_BYTES_AVAIL(2)
-            const uint8_t reg1 = _NEXT_BYTE;
-            const uint8_t reg2 = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(reg1)
-            _CHECK_REGISTER_VALID(reg2)
-            const uint16_t dest = this->_registers[reg1];
-            _CHECK_ADDR_VALID((uint32_t)dest + 1)
-            memcpy(&this->_memory[dest], &this->_registers[reg2], sizeof(uint16_t));
-            break;
-        }
-        case OP_STORB:
-        {
-            _CHECK_BYTES_AVAIL(3)
-            const uint16_t addr = _NEXT_SHORT;
-            const uint8_t reg = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(reg)
-            _CHECK_ADDR_VALID(addr)
-            memcpy(&this->_memory[addr], &this->_registers[reg], sizeof(uint8_t));
-            break;
-        }
-        case OP_STORB_P:
-        {
-            _CHECK_BYTES_AVAIL(2)
-            const uint8_t reg1 = _NEXT_BYTE;
-            const uint8_t reg2 = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(reg1)
-            _CHECK_REGISTER_VALID(reg2)
-            const uint16_t dest = this->_registers[reg1];
-            _CHECK_ADDR_VALID((uint32_t)dest)
-            memcpy(&this->_memory[dest], &this->_registers[reg2], sizeof(uint8_t));
-            break;
-        }
-        case OP_LOAD:
-        {
-            _CHECK_BYTES_AVAIL(3)
-            const uint8_t reg = _NEXT_BYTE;
-            const uint16_t addr = _NEXT_SHORT;
-            _CHECK_REGISTER_VALID(reg)
-            _CHECK_ADDR_VALID((uint32_t)addr + 3)
-            memcpy(&this->_registers[reg], &this->_memory[addr], sizeof(uint32_t));
-            break;
-        }
-        case OP_LOAD_P:
-        {
-            _CHECK_BYTES_AVAIL(2)
-            const uint8_t reg1 = _NEXT_BYTE;
-            const uint8_t reg2 = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(reg1)
-            _CHECK_REGISTER_VALID(reg2)
-            const uint16_t src = this->_registers[reg2];
-            _CHECK_ADDR_VALID((uint32_t)src + 3)
-            memcpy(&this->_registers[reg1], &this->_memory[src], sizeof(uint32_t));
-            break;
-        }
-        case OP_LOADW:
-        {
-            _CHECK_BYTES_AVAIL(3)
-            const uint8_t reg = _NEXT_BYTE;
-            const uint16_t addr = _NEXT_SHORT;
-            _CHECK_REGISTER_VALID(reg)
-            _CHECK_ADDR_VALID((uint32_t)addr + 1)
-            this->_registers[reg] = 0;
-            memcpy(&this->_registers[reg], &this->_memory[addr], sizeof(uint16_t));
-            break;
-        }
-        case OP_LOADW_P:
-        {
-            _CHECK_BYTES_AVAIL(2)
-            const uint8_t reg1 = _NEXT_BYTE;
-            const uint8_t reg2 = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(reg1)
-            _CHECK_REGISTER_VALID(reg2)
-            const uint16_t src = this->_registers[reg2];
-            _CHECK_ADDR_VALID((uint32_t)src + 1)
-            this->_registers[reg1] = 0;
-            memcpy(&this->_registers[reg1], &this->_memory[src], sizeof(uint16_t));
-            break;
-        }
-        case OP_LOADB:
-        {
-            _CHECK_BYTES_AVAIL(3)
-            const uint8_t reg = _NEXT_BYTE;
-            const uint16_t addr = _NEXT_SHORT;
-            _CHECK_REGISTER_VALID(reg)
-            _CHECK_ADDR_VALID((uint32_t)addr)
-            this->_registers[reg] = this->_memory[addr];
-            break;
-        }
-        case OP_LOADB_P:
-        {
-            _CHECK_BYTES_AVAIL(2)
-            const uint8_t reg1 = _NEXT_BYTE;
-            const uint8_t reg2 = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(reg1)
-            _CHECK_REGISTER_VALID(reg2)
-            const uint16_t src = this->_registers[reg2];
-            _CHECK_ADDR_VALID((uint32_t)src)
-            this->_registers[reg1] = this->_memory[src];
-            break;
-        }
-        case OP_MEMCPY:
-        {
-            _CHECK_BYTES_AVAIL(6)
-            const uint16_t dest = _NEXT_SHORT;
-            const uint16_t source = _NEXT_SHORT;
-            const uint16_t bytes = _NEXT_SHORT;
-            _CHECK_ADDR_VALID((uint32_t)source + bytes - 1)
-            _CHECK_ADDR_VALID((uint32_t)dest + bytes - 1)
-            memcpy(&this->_memory[dest], &this->_memory[source], bytes);
-            break;
-        }
-        case OP_MEMCPY_P:
-        {
-            _CHECK_BYTES_AVAIL(3)
-            const uint8_t reg1 = _NEXT_BYTE;
-            const uint8_t reg2 = _NEXT_BYTE;
-            const uint8_t reg3 = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(reg1)
-            _CHECK_REGISTER_VALID(reg2)
-            _CHECK_REGISTER_VALID(reg3)
-            const uint16_t dest = this->_registers[reg1];
-            const uint16_t source = this->_registers[reg2];
-            const uint16_t bytes = this->_registers[reg3];
-            _CHECK_ADDR_VALID((uint32_t)source + bytes - 1)
-            _CHECK_ADDR_VALID((uint32_t)dest + bytes - 1)
-            memcpy(&this->_memory[dest], &this->_memory[source], bytes);
-            break;
-        }
-        case OP_INC:
-        {
-            _CHECK_BYTES_AVAIL(1)
-            const uint8_t reg = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(reg)
-            this->_registers[reg]++;
-            break;
-        }
-        case OP_FINC:
-        {
-            _CHECK_BYTES_AVAIL(1)
-            const uint8_t reg = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(reg)
-            (*((float *)&this->_registers[reg]))++;
-            break;
-        }
-        case OP_DEC:
-        {
-            _CHECK_BYTES_AVAIL(1)
-            const uint8_t reg = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(reg)
-            this->_registers[reg]--;
-            break;
-        }
-        case OP_FDEC:
-        {
-            _CHECK_BYTES_AVAIL(1)
-            const uint8_t reg = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(reg)
-            (*((float *)&this->_registers[reg]))--;
-            break;
-        }
-        case OP_ADD:
-        {
-            _CHECK_BYTES_AVAIL(3)
-            const uint8_t rreg = _NEXT_BYTE;
-            const uint8_t reg1 = _NEXT_BYTE;
-            const uint8_t reg2 = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(rreg)
-            _CHECK_REGISTER_VALID(reg1)
-            _CHECK_REGISTER_VALID(reg2)
-            this->_registers[rreg] = this->_registers[reg1] + this->_registers[reg2];
-            break;
-        }
-        case OP_FADD:
-        {
-            _CHECK_BYTES_AVAIL(3)
-            const uint8_t rreg = _NEXT_BYTE;
-            const uint8_t reg1 = _NEXT_BYTE;
-            const uint8_t reg2 = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(rreg)
-            _CHECK_REGISTER_VALID(reg1)
-            _CHECK_REGISTER_VALID(reg2)
-            *((float *)&this->_registers[rreg]) = *((float *)&this->_registers[reg1]) + *((float *)&this->_registers[reg2]);
-            break;
-        }
-        case OP_SUB:
-        {
-            _CHECK_BYTES_AVAIL(3)
-            const uint8_t rreg = _NEXT_BYTE;
-            const uint8_t reg1 = _NEXT_BYTE;
-            const uint8_t reg2 = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(rreg)
-            _CHECK_REGISTER_VALID(reg1)
-            _CHECK_REGISTER_VALID(reg2)
-            this->_registers[rreg] = this->_registers[reg1] - this->_registers[reg2];
-            break;
-        }
-        case OP_FSUB:
-        {
-            _CHECK_BYTES_AVAIL(3)
-            const uint8_t rreg = _NEXT_BYTE;
-            const uint8_t reg1 = _NEXT_BYTE;
-            const uint8_t reg2 = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(rreg)
-            _CHECK_REGISTER_VALID(reg1)
-            _CHECK_REGISTER_VALID(reg2)
-            *((float *)&this->_registers[rreg]) = *((float *)&this->_registers[reg1]) - *((float *)&this->_registers[reg2]);
-            break;
-        }
-        case OP_MUL:
-        {
-            _CHECK_BYTES_AVAIL(3)
-            const uint8_t rreg = _NEXT_BYTE;
-            const uint8_t reg1 = _NEXT_BYTE;
-            const uint8_t reg2 = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(rreg)
-            _CHECK_REGISTER_VALID(reg1)
-            _CHECK_REGISTER_VALID(reg2)
-            this->_registers[rreg] = this->_registers[reg1] * this->_registers[reg2];
-            break;
-        }
-        case OP_IMUL:
-        {
-            _CHECK_BYTES_AVAIL(3)
-            const uint8_t rreg = _NEXT_BYTE;
-            const uint8_t reg1 = _NEXT_BYTE;
-            const uint8_t reg2 = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(rreg)
-            _CHECK_REGISTER_VALID(reg1)
-            _CHECK_REGISTER_VALID(reg2)
-            *((int32_t *)&this->_registers[rreg]) = *((int32_t *)&this->_registers[reg1]) * *((int32_t *)&this->_registers[reg2]);
-            break;
-        }
-        case OP_FMUL:
-        {
-            _CHECK_BYTES_AVAIL(3)
-            const uint8_t rreg = _NEXT_BYTE;
-            const uint8_t reg1 = _NEXT_BYTE;
-            const uint8_t reg2 = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(rreg)
-            _CHECK_REGISTER_VALID(reg1)
-            _CHECK_REGISTER_VALID(reg2)
-            *((float *)&this->_registers[rreg]) = *((float *)&this->_registers[reg1]) * *((float *)&this->_registers[reg2]);
-            break;
-        }
-        case OP_DIV:
-        {
-            _CHECK_BYTES_AVAIL(3)
-            const uint8_t rreg = _NEXT_BYTE;
-            const uint8_t reg1 = _NEXT_BYTE;
-            const uint8_t reg2 = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(rreg)
-            _CHECK_REGISTER_VALID(reg1)
-            _CHECK_REGISTER_VALID(reg2)
-            this->_registers[rreg] = this->_registers[reg1] / this->_registers[reg2];
-            break;
-        }
-        case OP_IDIV:
-        {
-            _CHECK_BYTES_AVAIL(3)
-            const uint8_t rreg = _NEXT_BYTE;
-            const uint8_t reg1 = _NEXT_BYTE;
-            const uint8_t reg2 = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(rreg)
-            _CHECK_REGISTER_VALID(reg1)
-            _CHECK_REGISTER_VALID(reg2)
-            *((int32_t *)&this->_registers[rreg]) = *((int32_t *)&this->_registers[reg1]) / *((int32_t *)&this->_registers[reg2]);
-            break;
-        }
-        case OP_FDIV:
-        {
-            _CHECK_BYTES_AVAIL(3)
-            const uint8_t rreg = _NEXT_BYTE;
-            const uint8_t reg1 = _NEXT_BYTE;
-            const uint8_t reg2 = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(rreg)
-            _CHECK_REGISTER_VALID(reg1)
-            _CHECK_REGISTER_VALID(reg2)
-            *((float *)&this->_registers[rreg]) = *((float *)&this->_registers[reg1]) / *((float *)&this->_registers[reg2]);
-            break;
-        }
-        case OP_SHL:
-        {
-            _CHECK_BYTES_AVAIL(3)
-            const uint8_t rreg = _NEXT_BYTE;
-            const uint8_t reg1 = _NEXT_BYTE;
-            const uint8_t reg2 = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(rreg)
-            _CHECK_REGISTER_VALID(reg1)
-            _CHECK_REGISTER_VALID(reg2)
-            this->_registers[rreg] = this->_registers[reg1] << this->_registers[reg2];
-            break;
-        }
-        case OP_SHR:
-        {
-            _CHECK_BYTES_AVAIL(3)
-            const uint8_t rreg = _NEXT_BYTE;
-            const uint8_t reg1 = _NEXT_BYTE;
-            const uint8_t reg2 = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(rreg)
-            _CHECK_REGISTER_VALID(reg1)
-            _CHECK_REGISTER_VALID(reg2)
-            this->_registers[rreg] = this->_registers[reg1] >> this->_registers[reg2];
-            break;
-        }
-        case OP_ISHR:
-        {
-            _CHECK_BYTES_AVAIL(3)
-            const uint8_t rreg = _NEXT_BYTE;
-            const uint8_t reg1 = _NEXT_BYTE;
-            const uint8_t reg2 = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(rreg)
-            _CHECK_REGISTER_VALID(reg1)
-            _CHECK_REGISTER_VALID(reg2)
-            *((int32_t *)&this->_registers[rreg]) = *((int32_t *)&this->_registers[reg1]) >> *((int32_t *)&this->_registers[reg2]);
-            break;
-        }
-        case OP_MOD:
-        {
-            _CHECK_BYTES_AVAIL(3)
-            const uint8_t rreg = _NEXT_BYTE;
-            const uint8_t reg1 = _NEXT_BYTE;
-            const uint8_t reg2 = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(rreg)
-            _CHECK_REGISTER_VALID(reg1)
-            _CHECK_REGISTER_VALID(reg2)
-            this->_registers[rreg] = this->_registers[reg1] % this->_registers[reg2];
-            break;
-        }
-        case OP_IMOD:
-        {
-            _CHECK_BYTES_AVAIL(3)
-            const uint8_t rreg = _NEXT_BYTE;
-            const uint8_t reg1 = _NEXT_BYTE;
-            const uint8_t reg2 = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(rreg)
-            _CHECK_REGISTER_VALID(reg1)
-            _CHECK_REGISTER_VALID(reg2)
-            *((int32_t *)&this->_registers[rreg]) = *((int32_t *)&this->_registers[reg1]) % *((int32_t *)&this->_registers[reg2]);
-            break;
-        }
-        case OP_AND:
-        {
-            _CHECK_BYTES_AVAIL(3)
-            const uint8_t rreg = _NEXT_BYTE;
-            const uint8_t reg1 = _NEXT_BYTE;
-            const uint8_t reg2 = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(rreg)
-            _CHECK_REGISTER_VALID(reg1)
-            _CHECK_REGISTER_VALID(reg2)
-            this->_registers[rreg] = this->_registers[reg1] & this->_registers[reg2];
-            break;
-        }
-        case OP_OR:
-        {
-            _CHECK_BYTES_AVAIL(3)
-            const uint8_t rreg = _NEXT_BYTE;
-            const uint8_t reg1 = _NEXT_BYTE;
-            const uint8_t reg2 = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(rreg)
-            _CHECK_REGISTER_VALID(reg1)
-            _CHECK_REGISTER_VALID(reg2)
-            this->_registers[rreg] = this->_registers[reg1] | this->_registers[reg2];
-            break;
-        }
-        case OP_XOR:
-        {
-            _CHECK_BYTES_AVAIL(3)
-            const uint8_t rreg = _NEXT_BYTE;
-            const uint8_t reg1 = _NEXT_BYTE;
-            const uint8_t reg2 = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(rreg)
-            _CHECK_REGISTER_VALID(reg1)
-            _CHECK_REGISTER_VALID(reg2)
-            this->_registers[rreg] = this->_registers[reg1] ^ this->_registers[reg2];
-            break;
-        }
-        case OP_NOT:
-        {
-            _CHECK_BYTES_AVAIL(2)
-            const uint8_t rreg = _NEXT_BYTE;
-            const uint8_t reg1 = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(rreg)
-            _CHECK_REGISTER_VALID(reg1)
-            this->_registers[rreg] = ~this->_registers[reg1];
-            break;
-        }
-        case OP_U2I:
-        {
-            _CHECK_BYTES_AVAIL(1)
-            const uint8_t reg = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(reg)
-            *((int32_t *)&this->_registers[reg]) = this->_registers[reg];
-            break;
-        }
-        case OP_I2U:
-        {
-            _CHECK_BYTES_AVAIL(1)
-            const uint8_t reg = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(reg)
-            this->_registers[reg] = *((int32_t *)&this->_registers[reg]);
-            break;
-        }
-        case OP_I2F:
-        {
-            _CHECK_BYTES_AVAIL(2)
-            const uint8_t reg = _NEXT_BYTE;
-            const uint8_t reg1 = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(reg)
-            _CHECK_REGISTER_VALID(reg1)
-            *((float *)&this->_registers[reg]) = (float)*((int32_t *)&this->_registers[reg1]);
-            break;
-        }
-        case OP_F2I:
-        {
-            _CHECK_BYTES_AVAIL(2)
-            const uint8_t reg = _NEXT_BYTE;
-            const uint8_t reg1 = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(reg)
-            _CHECK_REGISTER_VALID(reg1)
-            *((int32_t *)&this->_registers[reg]) = (int32_t) * ((float *)&this->_registers[reg1]);
-            break;
-        }
-        case OP_JMP:
-        {
-            _CHECK_BYTES_AVAIL(2)
-            this->_registers[IP] = _NEXT_SHORT - 1;
-            break;
-        }
-        case OP_JR:
-        {
-            _CHECK_BYTES_AVAIL(1)
-            const uint8_t reg = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(reg)
-            this->_registers[IP] = this->_registers[reg] - 1;
-            break;
-        }
-        case OP_JZ:
-        {
-            _CHECK_BYTES_AVAIL(3)
-            const uint8_t reg = _NEXT_BYTE;
-            const uint16_t addr = _NEXT_SHORT;
-            _CHECK_REGISTER_VALID(reg)
-
-            if (this->_registers[reg] == 0)
-                this->_registers[IP] = addr - 1;
-            break;
-        }
-        case OP_JNZ:
-        {
-            _CHECK_BYTES_AVAIL(3)
-            const uint8_t reg = _NEXT_BYTE;
-            const uint16_t addr = _NEXT_SHORT;
-            _CHECK_REGISTER_VALID(reg)
-
-            if (this->_registers[reg] != 0)
-                this->_registers[IP] = addr - 1;
-            break;
-        }
-        case OP_JE:
-        {
-            _CHECK_BYTES_AVAIL(4)
-            const uint8_t reg1 = _NEXT_BYTE;
-            const uint8_t reg2 = _NEXT_BYTE;
-            const uint16_t addr = _NEXT_SHORT;
-            _CHECK_REGISTER_VALID(reg1)
-            _CHECK_REGISTER_VALID(reg2)
-
-            if (this->_registers[reg1] == this->_registers[reg2])
-                this->_registers[IP] = addr - 1;
-            break;
-        }
-        case OP_JNE:
-        {
-            _CHECK_BYTES_AVAIL(4)
-            const uint8_t reg1 = _NEXT_BYTE;
-            const uint8_t reg2 = _NEXT_BYTE;
-            const uint16_t addr = _NEXT_SHORT;
-            _CHECK_REGISTER_VALID(reg1)
-            _CHECK_REGISTER_VALID(reg2)
-
-            if (this->_registers[reg1] != this->_registers[reg2])
-                this->_registers[IP] = addr - 1;
-            break;
-        }
-        case OP_JA:
-        {
-            _CHECK_BYTES_AVAIL(4)
-            const uint8_t reg1 = _NEXT_BYTE;
-            const uint8_t reg2 = _NEXT_BYTE;
-            const uint16_t addr = _NEXT_SHORT;
-            _CHECK_REGISTER_VALID(reg1)
-            _CHECK_REGISTER_VALID(reg2)
-
-            if (this->_registers[reg1] > this->_registers[reg2])
-                this->_registers[IP] = addr - 1;
-            break;
-        }
-        case OP_JG:
-        {
-            _CHECK_BYTES_AVAIL(4)
-            const uint8_t reg1 = _NEXT_BYTE;
-            const uint8_t reg2 = _NEXT_BYTE;
-            const uint16_t addr = _NEXT_SHORT;
-            _CHECK_REGISTER_VALID(reg1)
-            _CHECK_REGISTER_VALID(reg2)
-
-            if (*((int32_t *)&this->_registers[reg1]) > *((int32_t *)&this->_registers[reg2]))
-                this->_registers[IP] = addr - 1;
-            break;
-        }
-        case OP_JAE:
-        {
-            _CHECK_BYTES_AVAIL(4)
-            const uint8_t reg1 = _NEXT_BYTE;
-            const uint8_t reg2 = _NEXT_BYTE;
-            const uint16_t addr = _NEXT_SHORT;
-            _CHECK_REGISTER_VALID(reg1)
-            _CHECK_REGISTER_VALID(reg2)
-
-            if (this->_registers[reg1] >= this->_registers[reg2])
-                this->_registers[IP] = addr - 1;
-            break;
-        }
-        case OP_JGE:
-        {
-            _CHECK_BYTES_AVAIL(4)
-            const uint8_t reg1 = _NEXT_BYTE;
-            const uint8_t reg2 = _NEXT_BYTE;
-            const uint16_t addr = _NEXT_SHORT;
-            _CHECK_REGISTER_VALID(reg1)
-            _CHECK_REGISTER_VALID(reg2)
-
-            if (*((int32_t *)&this->_registers[reg1]) >= *((int32_t *)&this->_registers[reg2]))
-                this->_registers[IP] = addr - 1;
-            break;
-        }
-        case OP_JB:
-        {
-            _CHECK_BYTES_AVAIL(4)
-            const uint8_t reg1 = _NEXT_BYTE;
-            const uint8_t reg2 = _NEXT_BYTE;
-            const uint16_t addr = _NEXT_SHORT;
-            _CHECK_REGISTER_VALID(reg1)
-            _CHECK_REGISTER_VALID(reg2)
-
-            if (this->_registers[reg1] < this->_registers[reg2])
-                this->_registers[IP] = addr - 1;
-            break;
-        }
-        case OP_JL:
-        {
-            _CHECK_BYTES_AVAIL(4)
-            const uint8_t reg1 = _NEXT_BYTE;
-            const uint8_t reg2 = _NEXT_BYTE;
-            const uint16_t addr = _NEXT_SHORT;
-            _CHECK_REGISTER_VALID(reg1)
-            _CHECK_REGISTER_VALID(reg2)
-
-            if (*((int32_t *)&this->_registers[reg1]) < *((int32_t *)&this->_registers[reg2]))
-                this->_registers[IP] = addr - 1;
-            break;
-        }
-        case OP_JBE:
-        {
-            _CHECK_BYTES_AVAIL(4)
-            const uint8_t reg1 = _NEXT_BYTE;
-            const uint8_t reg2 = _NEXT_BYTE;
-            const uint16_t addr = _NEXT_SHORT;
-            _CHECK_REGISTER_VALID(reg1)
-            _CHECK_REGISTER_VALID(reg2)
-
-            if (this->_registers[reg1] <= this->_registers[reg2])
-                this->_registers[IP] = addr - 1;
-            break;
-        }
-        case OP_JLE:
-        {
-            _CHECK_BYTES_AVAIL(4)
-            const uint8_t reg1 = _NEXT_BYTE;
-            const uint8_t reg2 = _NEXT_BYTE;
-            const uint16_t addr = _NEXT_SHORT;
-            _CHECK_REGISTER_VALID(reg1)
-            _CHECK_REGISTER_VALID(reg2)
-
-            if (*((int32_t *)&this->_registers[reg1]) <= *((int32_t *)&this->_registers[reg2]))
-                this->_registers[IP] = addr - 1;
-            break;
-        }
-        case OP_PRINT:
-        {
-            _CHECK_BYTES_AVAIL(2)
-            const uint8_t reg = _NEXT_BYTE;
-            const uint8_t ln = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(reg)
-
-            printf("%u", this->_registers[reg]);
-            if (ln != 0)
-                putchar('\n');
-            break;
-        }
-        case OP_PRINTI:
-        {
-            _CHECK_BYTES_AVAIL(2)
-            const uint8_t reg = _NEXT_BYTE;
-            const uint8_t ln = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(reg)
-
-            printf("%d", *((int32_t *)&this->_registers[reg]));
-            if (ln != 0)
-                putchar('\n');
-            break;
-        }
-        case OP_PRINTF:
-        {
-            _CHECK_BYTES_AVAIL(2)
-            const uint8_t reg = _NEXT_BYTE;
-            const uint8_t ln = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(reg)
-
-            printf("%f", *((float *)&this->_registers[reg]));
-            if (ln != 0)
-                putchar('\n');
-            break;
-        }
-        case OP_PRINTC:
-        {
-            _CHECK_BYTES_AVAIL(1)
-            const uint8_t reg = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(reg)
-            char *c = (char *)&this->_registers[reg];
-            putchar(*c);
-            break;
-        }
-        case OP_PRINTS:
-        {
-            _CHECK_BYTES_AVAIL(2)
-            const uint16_t addr = _NEXT_SHORT;
-            _CHECK_ADDR_VALID(addr)
-            char *curChar = (char *)&this->_memory[addr];
-
-            while (*curChar != '\0')
-            {
-                putchar(*curChar);
-                curChar++;
-                _CHECK_ADDR_VALID((uint8_t *)curChar - this->_memory)
-            }
-            break;
-        }
-        case OP_PRINTLN:
-        {
-            putchar('\n');
-            break;
-        }
-        case OP_READ:
-        {
-            _CHECK_BYTES_AVAIL(1)
-            const uint8_t reg = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(reg)
-            scanf("%u", &this->_registers[reg]);
-            break;
-        }
-        case OP_READI:
-        {
-            _CHECK_BYTES_AVAIL(1)
-            const uint8_t reg = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(reg)
-            scanf("%d", (int32_t *)&this->_registers[reg]);
-            break;
-        }
-        case OP_READF:
-        {
-            _CHECK_BYTES_AVAIL(1)
-            const uint8_t reg = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(reg)
-            scanf("%f", (float *)&this->_registers[reg]);
-            break;
-        }
-        case OP_READC:
-        {
-            _CHECK_BYTES_AVAIL(1)
-            const uint8_t reg = _NEXT_BYTE;
-            _CHECK_REGISTER_VALID(reg)
-            this->_registers[reg] = getchar();
-            break;
-        }
-        case OP_READS:
-        {
-            _CHECK_BYTES_AVAIL(4)
-            const uint16_t addr = _NEXT_SHORT;
-            size_t maxLen = _NEXT_SHORT;
-            _CHECK_ADDR_VALID((uint32_t)addr + maxLen)
-            char *dest = (char *)&this->_memory[addr];
-            getline(&dest, &maxLen, stdin);
-            break;
-        }
-        }
+    switch (this->_dispatch)
+    {
+    case VM_DISPATCH_JIT:
+    case VM_DISPATCH_STENCIL:
+#ifdef VM_JIT
+        if (this->_jit == nullptr)
+            this->_jit = new JitCompiler(this->_codeLen, this->_progLen, this->_memSize, this->_dispatch == VM_DISPATCH_STENCIL);
+#endif
+        // fall through
+    case VM_DISPATCH_DECODED:
+        return this->_runDecoded(maxInstr);
+#ifdef VM_THREADED_DISPATCH
+    case VM_DISPATCH_THREADED:
+        return checked ? this->_run<VMConfig, true, true>(maxInstr) : this->_run<VMConfig, true, false>(maxInstr);
+#endif
+#ifdef VM_TAILCALL_DISPATCH
+    case VM_DISPATCH_TAILCALL:
+        return this->_runTailCall(maxInstr);
+#endif
+    default:
+        return checked ? this->_run<VMConfig, false, true>(maxInstr) : this->_run<VMConfig, false, false>(maxInstr);
+    }
+}
 
-        this->_registers[IP]++;
+ExecResult VM::_runCompiled(uint32_t maxInstr)
+{
+    uint32_t instrCount = 0;
+    for (;;)
+    {
+        const uint32_t budget = maxInstr == 0 ? UINT32_MAX : maxInstr - instrCount;
+        const uint32_t executed = this->_compiled->run(this->_registers, this->_memory, this->_memSize, budget);
+        instrCount += executed;
+        this->_executed += executed;
+        if (maxInstr != 0 && instrCount >= maxInstr)
+            return ExecResult::VM_PAUSED;
+
+        // whatever stopped the compiled code goes through the decoded engine,
+        // which also notices writes to the program
+        const ExecResult res = this->_runDecoded(1);
+        if (res != ExecResult::VM_PAUSED)
+            return res;
         instrCount++;
+        if (maxInstr != 0 && instrCount >= maxInstr)
+            return ExecResult::VM_PAUSED;
+
+        // the program rewrote compiled code, interpret the rest
+        if (this->_compiled == nullptr)
+            return this->_execute(maxInstr == 0 ? 0 : maxInstr - instrCount);
     }
+}
 
-    return ExecResult::VM_PAUSED;
-}
\ No newline at end of file
+// the decoded engine counts what it steps through itself
+ExecResult VM::_step()
+{
+    const uint32_t executed = this->_executed;
+    const ExecResult res = this->_run<VMConfig, false, true>(1);
+    // apart from interrupts left waiting, which end the run having completed
+    if (res != ExecResult::VM_WAITING)
+        this->_executed = executed;
+    return res;
+}
@@ -5,6 +5,48 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdio.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// computed goto dispatch relies on the labels-as-values extension
+#if defined(__GNUC__) && !defined(VM_DISABLE_THREADED_DISPATCH)
+#define VM_THREADED_DISPATCH
+#endif
+
+// stop GCC from merging the per-handler dispatch jumps back into a single one
+#if defined(VM_THREADED_DISPATCH) && !defined(__clang__)
+#define VM_DISPATCH_ATTR __attribute__((optimize("no-gcse", "no-crossjumping")))
+#else
+#define VM_DISPATCH_ATTR
+#endif
+
+// tail-calling handlers need a guaranteed tail call (musttail), or GCC's
+// sibling call optimization, which is only there when optimizing
+#if defined(__has_attribute)
+#if __has_attribute(musttail)
+#define VM_MUSTTAIL __attribute__((musttail))
+#endif
+#endif
+#if (defined(VM_MUSTTAIL) || (defined(__GNUC__) && defined(__OPTIMIZE__))) && !defined(VM_DISABLE_TAILCALL_DISPATCH)
+#define VM_TAILCALL_DISPATCH
+#endif
+
+// the JIT writes x86-64 code to memory that is flipped between writable and
+// executable, so it has to be asked for with -DVM_ENABLE_JIT
+#if defined(VM_ENABLE_JIT) && defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+#define VM_JIT
+#endif
+
+// the copy-and-patch backend of the JIT is cut out of an ELF object at build
+// time by src/stencils.py, so it also needs -DVM_ENABLE_STENCILS
+#if defined(VM_JIT) && defined(VM_ENABLE_STENCILS) && defined(__linux__)
+#define VM_JIT_STENCILS
+#endif
 
 enum ExecResult : uint8_t
 {
@@ -17,8 +59,73 @@ enum ExecResult : uint8_t
     VM_ERR_STACK_OVERFLOW,      // stack overflow
     VM_ERR_STACK_UNDERFLOW,     // stack underflow
     VM_ERR_INVALID_ADDRESS,     // tried to access an invalid memory address
+    VM_WAITING,                 // an interrupt handler is waiting on the host, run() goes on after the int
+};
+
+// what an interrupt handler wants the VM to do once it returns
+enum InterruptResult : uint8_t
+{
+    VM_INT_FINISH, // stop, run() returns VM_FINISHED
+    VM_INT_RESUME, // go on with the next instruction
+    VM_INT_WAIT,   // stop, run() returns VM_WAITING and the next run() goes on after the int
+};
+
+// size of the buffer print instructions write to, which is only handed to
+// the VM's output once it's full or the VM stops
+#ifndef VM_OUTPUT_BUFFER_SIZE
+#define VM_OUTPUT_BUFFER_SIZE (64 * 1024)
+#endif
+
+// where a VM's output goes, in chunks of up to VM_OUTPUT_BUFFER_SIZE bytes
+typedef void (*OutputFn)(const char *data, uint32_t len, void *context);
+
+// size of the buffer read instructions parse from, which is only refilled
+// once everything in it has been read
+#ifndef VM_INPUT_BUFFER_SIZE
+#define VM_INPUT_BUFFER_SIZE (64 * 1024)
+#endif
+
+// where a VM's input comes from: fills data with up to len bytes and returns
+// how many, or 0 once there is no more. It may return fewer than are left,
+// e.g. a line at a time, so that read instructions only wait for what they need
+typedef uint32_t (*InputFn)(char *data, uint32_t len, void *context);
+
+class VM;
+
+// handles one int code, with the context it was registered with
+typedef InterruptResult (*InterruptHandler)(VM *vm, uint8_t code, void *context);
+// handles one int code by only reading and writing registers (any but IP),
+// and always goes on. The VM doesn't have to sync or recheck anything for it
+typedef void (*RegisterHandler)(uint32_t *registers, void *context);
+
+enum DispatchMode : uint8_t
+{
+    VM_DISPATCH_SWITCH,   // single switch statement, portable
+    VM_DISPATCH_THREADED, // computed goto jump table (falls back to switch if unavailable)
+    VM_DISPATCH_DECODED,  // run from a cache of pre-decoded instructions
+    VM_DISPATCH_JIT,      // decoded, compiling hot blocks to native code (falls back to decoded if unavailable)
+    VM_DISPATCH_TAILCALL, // one function per opcode, tail-calling the next (falls back to switch if unavailable)
+    VM_DISPATCH_STENCIL,  // JIT stitching together precompiled stencils (falls back to the JIT if unavailable)
 };
 
+struct DecodedInstr;
+class JitCompiler;
+
+// a program translated to C++ by risvm-aot
+struct CompiledProgram
+{
+    // runs at most budget instructions starting at IP and returns how many it
+    // ran, leaving IP on the first instruction that needs the interpreter
+    uint32_t (*run)(uint32_t *registers, uint8_t *memory, uint32_t memSize, uint32_t budget);
+    const uint8_t *program; // bytes it was compiled from
+    const uint8_t *codeMap; // one bit per program byte covered by compiled instructions
+    uint32_t progLen;
+};
+
+// near jumps (jmp, call and the conditional ones) have 16-bit targets in the
+// 64 KiB page of the instruction at addr, ljmp and lcall reach anywhere
+#define VM_NEAR_TARGET(addr, target) (((addr) & 0xFFFF0000U) | (target))
+
 enum Instruction : uint8_t
 {
     // system:
@@ -110,6 +217,9 @@ enum Instruction : uint8_t
     OP_READF,   // read a float from stdin to the specified register
     OP_READC,   // read a single character's code from stdin to the specified register
     OP_READS,   // read a line to the specified memory address, to a maximum length
+    // far jumps:
+    OP_LJMP,  // jump to a 32-bit address, e.g.: ljmp 0x0A 0x00 0x01 0x00
+    OP_LCALL, // set register RA to the next instruction and jump to a 32-bit address, e.g.: lcall 0x10 0x00 0x01 0x00
     INSTRUCTION_COUNT
 };
 
@@ -142,32 +252,399 @@ enum Register : uint8_t
     REGISTER_COUNT
 };
 
+// Programs from the assembler come in an image file: this header, then the
+// code and the read-only data. Zeroed data follows them in memory but not in
+// the file. All fields are little-endian
+#define VM_IMAGE_MAGIC "RISV"
+#define VM_IMAGE_VERSION 1
+
+struct ImageHeader
+{
+    char magic[4];
+    uint16_t version;
+    uint16_t headerSize; // where the code starts in the file
+    uint32_t entry;      // initial IP
+    uint32_t stackSize;  // the least the program needs, 0 for the host's choice
+    uint32_t codeSize;
+    uint32_t rodataSize;
+    uint32_t bssSize;
+    uint32_t checksum; // CRC-32 of the whole file, with this field as zero
+};
+
+enum ImageError : uint8_t
+{
+    IMAGE_OK,
+    IMAGE_ERR_TRUNCATED, // shorter than its header says
+    IMAGE_ERR_VERSION,   // made for another version of the VM
+    IMAGE_ERR_SIZE,      // sections (and the stack) don't fit in memory, or the entry point isn't in the code
+    IMAGE_ERR_CHECKSUM,  // corrupted
+    IMAGE_ERR_FILE,      // couldn't be opened or read
+};
+
+const char *imageErrorString(ImageError error);
+
+// A loaded program, shared by every VM running it: the code is kept once (in
+// pages the VMs map copy-on-write where the system allows it), verified once
+// and decoded once. VM::snapshot() makes one that also has a stack and the
+// registers to start with. It is reference counted, whoever creates one
+// releases it when done and the last VM using it frees it.
+class Program
+{
+  public:
+    Program(const uint8_t *code, uint32_t progLen, uint32_t stackSize = 256);
+    static Program *load(const uint8_t *data, uint32_t len, uint32_t stackSize = 256, ImageError *error = nullptr);
+    static Program *map(const char *path, uint32_t stackSize = 256, ImageError *error = nullptr);
+
+    void retain();
+    void release();
+
+    const uint8_t *code();
+    uint32_t progLen();
+    uint32_t codeLen();
+    uint32_t stackSize();
+    uint32_t entry();
+
+  protected:
+    Program(const uint8_t *image, uint32_t imageLen, uint32_t progLen, uint32_t codeLen, uint32_t stackSize,
+            const uint32_t *registers, int fd = -1, uint32_t fileOffset = 0);
+    ~Program();
+
+    uint8_t *_mapMemory(bool &mapped);
+    void _unmapMemory(uint8_t *memory, bool mapped);
+    void _resetMemory(uint8_t *memory, bool mapped, bool keepProgram);
+    DecodedInstr *_decodedInstrs();
+
+    std::atomic<uint32_t> _refs;
+    uint8_t *_code;
+    // memory file holding the first _copiedLen bytes of the image, -1 if it's
+    // just in _code, and the program's own file with the rest of it when
+    // that is mapped from there (the image starting at _fileOffset)
+    int _fd = -1;
+    uint32_t _copiedLen = 0;
+    int _file = -1;
+    uint32_t _fileOffset = 0;
+    // bytes of memory in the image, more than the program for snapshots
+    const uint32_t _imageLen;
+    const uint32_t _progLen;
+    // the code section at its start (all of it for plain program bytes), the
+    // only part that is verified, decoded and compiled. Data after it is just
+    // memory
+    const uint32_t _codeLen;
+    const uint32_t _stackSize;
+    uint32_t _registers[REGISTER_COUNT];
+    // where reset() starts over, which a snapshot keeps from its program
+    uint32_t _entry;
+    // what verify() finds, for VMs that haven't changed the code
+    uint8_t *_verifyMap = nullptr;
+    uint32_t *_blockLen = nullptr;
+    bool _verified = false;
+    // built on first use and never changed after that: the instructions
+    // reachable from the entry point, and which bytes of code they cover
+    DecodedInstr *_decoded = nullptr;
+    uint8_t *_codeMap = nullptr;
+    std::mutex _decodeLock;
+
+    friend class VM;
+};
+
+// the clock profiles are kept with: cycles of the time stamp counter on x86,
+// nanoseconds elsewhere
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define VM_PROFILE_CLOCK() ((uint64_t)__rdtsc())
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define VM_PROFILE_CLOCK() ((uint64_t)__rdtsc())
+#else
+#include <chrono>
+#define VM_PROFILE_CLOCK() \
+    ((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count())
+#endif
+
+// fadd and fmul with the first operand kept first: with two NaNs x86 returns
+// the first one, and the compiler may swap the operands of + and *, which
+// would give engines built from the same C++ different NaNs
+#if defined(__GNUC__) && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE__)))
+static inline float floatAdd(float b, float c)
+{
+    __asm__("addss %1, %0" : "+x"(b) : "x"(c));
+    return b;
+}
+static inline float floatMul(float b, float c)
+{
+    __asm__("mulss %1, %0" : "+x"(b) : "x"(c));
+    return b;
+}
+#else
+static inline float floatAdd(float b, float c) { return b + c; }
+static inline float floatMul(float b, float c) { return b * c; }
+#endif
+
+// buckets of a profile's histograms: the n-th counts executions that took
+// 2^n to 2^(n+1) - 1 cycles, the first also 0 and the last anything longer
+#ifndef VM_PROFILE_BUCKETS
+#define VM_PROFILE_BUCKETS 16
+#endif
+
+// How many times each instruction was executed and the cycles it took, over
+// every run of the VMs given it with setProfile(). An instruction's time is
+// from its fetch to the next one's, less what keeping the profile costs, so
+// it includes the dispatch to it. Only one VM may run into it at a time
+struct Profile
+{
+    struct Entry
+    {
+        uint64_t count;
+        uint64_t cycles;
+        uint64_t histogram[VM_PROFILE_BUCKETS];
+    };
+    Entry entries[INSTRUCTION_COUNT];
+    // cycles between two instructions that did nothing
+    uint64_t overhead;
+
+    Profile();
+    void clear();
+    void report(FILE *file) const;
+
+    void record(uint8_t instr, uint64_t cycles)
+    {
+        cycles = cycles > this->overhead ? cycles - this->overhead : 0;
+        uint32_t bucket = 0;
+        while (bucket < VM_PROFILE_BUCKETS - 1 && cycles >> (bucket + 1) != 0)
+            bucket++;
+        Entry &entry = this->entries[instr];
+        entry.count++;
+        entry.cycles += cycles;
+        entry.histogram[bucket]++;
+    }
+};
+
 class VM
 {
   public:
-    VM(uint8_t *program, uint16_t progLen, uint16_t stackSize = 256);
+    VM(uint8_t *program, uint32_t progLen, uint32_t stackSize = 256);
+    VM(Program *program);
     ~VM();
+    static VM *fromFile(const char *path, uint32_t stackSize = 256, ImageError *error = nullptr);
 
     ExecResult run(uint32_t maxInstr = 0);
+    uint32_t instructionsExecuted();
     void reset();
+    void restore();
+    Program *snapshot();
+    VM *clone();
     void onInterrupt(bool (*callback)(uint8_t));
+    void onInterrupt(InterruptResult (*callback)(uint8_t));
+    void onInterrupt(uint8_t code, InterruptHandler handler, void *context = nullptr);
+    void onInterrupt(uint8_t code, RegisterHandler handler, void *context = nullptr);
+
+    void setOutput(FILE *file);
+    void setOutput(int fd);
+    void setOutput(std::string *buffer);
+    void setOutput(OutputFn write, void *context);
+    void flush();
+
+    void setInput(FILE *file);
+    void setInput(int fd);
+    void setInput(const char *data, uint32_t len);
+    void setInput(InputFn read, void *context);
+    bool mapInput(const char *path);
+
+    void setDispatch(DispatchMode mode);
+    DispatchMode dispatch();
+    bool setCompiled(const CompiledProgram *program);
+    bool verify();
+    void setProfile(Profile *profile);
 
     uint32_t stackCount();
     void stackPush(uint32_t value);
     uint32_t stackPop();
 
-    uint8_t *memory(uint16_t addr = 0);
+    // memory() hands out the memory to change, and if that includes the code the
+    // VM decodes, compiles and verifies it again on the next run; peek() only
+    // reads, so it keeps all of that
+    uint8_t *memory(uint32_t addr = 0);
+    const uint8_t *peek(uint32_t addr = 0) const;
 
     uint32_t getRegister(Register reg);
     void setRegister(Register reg, uint32_t val);
 
   protected:
+    // the byte interpreter, in basicvm.h
+    template <class Config, bool threaded, bool checked>
+    ExecResult _run(uint32_t maxInstr);
+    friend struct VMBufferedIO;
+    friend struct VMInterruptHandlers;
+    ExecResult _step();
+    ExecResult _execute(uint32_t maxInstr);
+
+    ExecResult _runCompiled(uint32_t maxInstr);
+
+    typedef ExecResult (*TailHandler)(VM *vm, uint8_t *mem, uint32_t *regs, uint32_t ip, uint32_t sp, uint32_t left);
+    ExecResult _runTailCall(uint32_t maxInstr);
+    static ExecResult _tailStep(VM *vm, uint8_t *mem, uint32_t *regs, uint32_t ip, uint32_t sp, uint32_t left);
+    template <uint8_t op>
+    static ExecResult _tailOp(VM *vm, uint8_t *mem, uint32_t *regs, uint32_t ip, uint32_t sp, uint32_t left);
+    static const TailHandler _tailHandlers[256];
+
+    ExecResult _runDecoded(uint32_t maxInstr);
+    void _invalidateDecoded(uint32_t addr, uint32_t len);
+    bool _decodedCode(uint32_t addr, uint32_t len);
+    void _decodeAt(uint32_t addr);
+    void _markCode(uint32_t addr, uint32_t len);
+    void _resetDecoded();
+    void _compileJit(uint32_t addr, bool backward);
+    bool _recordTrace(uint32_t head, uint32_t *path, uint8_t &length);
+    bool _verifiedStart(uint32_t addr);
+    bool _writesCode(uint32_t addr, uint32_t len);
+    void _unverify(uint32_t addr, uint32_t len);
+    void _useDecoded();
+    void _ownDecoded();
+
+    Program *const _program;
+    bool _mapped = false;
     uint8_t *_memory;
     uint32_t _registers[REGISTER_COUNT] = {0};
-    const uint16_t _memSize;
-    const uint16_t _stackSize;
-    const uint16_t _progLen;
+    const uint32_t _memSize;
+    const uint32_t _stackSize;
+    const uint32_t _progLen;
+    const uint32_t _codeLen;
+    // one or the other, or neither, for codes without a handler of their own
     bool (*_interruptCallback)(uint8_t) = nullptr;
+    InterruptResult (*_interruptHandler)(uint8_t) = nullptr;
+    // handlers by code, allocated when the first one is registered
+    struct InterruptEntry
+    {
+        InterruptHandler handler;
+        RegisterHandler registers;
+        void *context;
+    };
+    InterruptEntry *_interrupts = nullptr;
+    bool _handlesInterrupt(uint8_t code);
+
+    void _output(const char *data, uint32_t len);
+    void _outputChar(char c);
+    void _outputValue(uint8_t op, uint32_t value, bool newline);
+    OutputFn _outputFn = nullptr;
+    void *_outputContext = nullptr;
+    // allocated on first use
+    char *_outputBuffer = nullptr;
+    uint32_t _outputLen = 0;
+
+    bool _fillInput();
+    int _peekInput();
+    int _skipSpace();
+    uint32_t _readChar();
+    bool _readInteger(uint32_t &value);
+    bool _readFloat(float &value);
+    void _readLine(char *dest, uint32_t maxLen);
+    void _closeInput();
+    void _copyInput(const VM *from);
+    InputFn _inputFn = nullptr;
+    void *_inputContext = nullptr;
+    // what hasn't been read yet, in the buffer or straight from the host's memory
+    const char *_inputPos = nullptr;
+    const char *_inputEnd = nullptr;
+    // allocated on first use
+    char *_inputBuffer = nullptr;
+    // a file given to mapInput()
+    void *_inputMap = nullptr;
+    size_t _inputMapLen = 0;
+    InterruptResult _interrupt(uint8_t code);
+    // the program's decoded instructions until this VM changes its code, and
+    // the bytes of code that were decoded, compiled or verified with them
+    DecodedInstr *_decoded = nullptr;
+    uint8_t *_codeMap = nullptr;
+    bool _ownsDecoded = false;
+    JitCompiler *_jit = nullptr;
+    const CompiledProgram *_compiled = nullptr;
+    bool _compiledStale = false;
+    // instruction starts and code bytes found by verify(), the program's own
+    // until this VM verifies again
+    uint8_t *_verifyMap = nullptr;
+    bool _ownsVerify = false;
+    bool _verified = false;
+    bool _verifyStale = false;
+    // instructions from every verified instruction to the end of its block
+    uint32_t *_blockLen = nullptr;
+    uint32_t _executed = 0;
+    Profile *_profile = nullptr;
+#ifdef VM_THREADED_DISPATCH
+    DispatchMode _dispatch = VM_DISPATCH_THREADED;
+#else
+    DispatchMode _dispatch = VM_DISPATCH_SWITCH;
+#endif
+};
+
+// VMs of one program, created up front and handed out to run one job each.
+// Taking one back restores it, at the cost of the pages the job touched.
+// Interrupt callbacks and dispatch mode are kept between jobs. Every VM must
+// be given back before the pool is destroyed
+class VMPool
+{
+  public:
+    VMPool(Program *program, uint32_t count);
+    ~VMPool();
+
+    VM *acquire();
+    void release(VM *vm);
+    uint32_t available();
+
+  protected:
+    Program *const _program;
+    std::vector<VM *> _free;
+    std::mutex _lock;
+};
+
+// runs VMs on a number of threads, a slice of instructions at a time, so that
+// long programs take turns instead of holding a thread. Each thread works
+// through its own queue and takes jobs from the others' when it runs out
+class Scheduler
+{
+  public:
+    // called on the thread that finished the VM, which then belongs to the
+    // caller again
+    typedef void (*DoneCallback)(VM *vm, ExecResult result, void *context);
+
+    Scheduler(uint32_t threads = 0, uint32_t slice = 100000);
+    ~Scheduler();
+
+    void submit(VM *vm, DoneCallback done = nullptr, void *context = nullptr);
+    void wait();
+    uint32_t threads();
+
+  protected:
+    struct Job
+    {
+        VM *vm;
+        DoneCallback done;
+        void *context;
+    };
+
+    struct Worker
+    {
+        std::deque<Job> jobs;
+        std::mutex lock;
+        std::thread thread;
+    };
+
+    void _push(uint32_t index, const Job &job, bool wake);
+    bool _take(uint32_t index, Job &job);
+    void _work(uint32_t index);
+
+    const uint32_t _slice;
+    std::vector<Worker *> _workers;
+    // jobs in a queue, and submitted ones that haven't finished yet
+    std::atomic<uint32_t> _queued;
+    std::atomic<uint32_t> _pending;
+    // where the next submitted job goes
+    std::atomic<uint32_t> _next;
+    // the rest is guarded by _idleLock
+    std::mutex _idleLock;
+    std::condition_variable _wake;
+    std::condition_variable _done;
+    uint32_t _idle = 0;
+    bool _stopping = false;
 };
 
 #endif // __VM_H__
\ No newline at end of file
@@ -0,0 +1,251 @@
+#include <random>
+#include <string>
+#include "test.h"
+#include "../src/basicvm.h"
+
+struct Fixed64 : VMConfig
+{
+    static const uint32_t memorySize = 64;
+};
+
+struct Unchecked : VMConfig
+{
+    static const bool checks = false;
+};
+
+// everything printed goes to a string, input comes from another
+struct StringIO
+{
+    static std::string out;
+    static std::string in;
+
+    static void print(VM *, uint8_t op, uint32_t value, bool newline)
+    {
+        float f;
+        memcpy(&f, &value, 4);
+        out += op == OP_PRINTI ? std::to_string((int32_t)value) : op == OP_PRINTF ? std::to_string(f) : std::to_string(value);
+        if (newline)
+            out += '\n';
+    }
+    static void printChar(VM *, char c)
+    {
+        out += c;
+    }
+    static void printString(VM *, const char *str, uint32_t len)
+    {
+        out.append(str, len);
+    }
+    static bool readInteger(VM *, uint32_t &value)
+    {
+        if (in.empty())
+            return false;
+        value = in[0] - '0';
+        in.erase(0, 1);
+        return true;
+    }
+    static bool readFloat(VM *, float &value)
+    {
+        uint32_t digit;
+        if (!readInteger(nullptr, digit))
+            return false;
+        value = digit / 2.0f;
+        return true;
+    }
+    static uint32_t readChar(VM *)
+    {
+        uint32_t digit = (uint32_t)EOF;
+        readInteger(nullptr, digit);
+        return digit;
+    }
+    static void readLine(VM *, char *dest, uint32_t maxLen)
+    {
+        const size_t len = in.size() < maxLen ? in.size() : maxLen;
+        memcpy(dest, in.data(), len);
+        dest[len] = '\0';
+        in.erase(0, len);
+    }
+    static void flush(VM *)
+    {
+        out += '.';
+    }
+};
+
+std::string StringIO::out;
+std::string StringIO::in;
+
+struct StringConfig : VMConfig
+{
+    typedef StringIO IO;
+};
+
+// even codes double r0, odd ones below 10 stop the VM
+struct Syscalls
+{
+    static bool handleRegisters(VM *vm, uint8_t code)
+    {
+        if (code % 2 != 0)
+            return false;
+        vm->setRegister(R0, vm->getRegister(R0) * 2);
+        return true;
+    }
+    static bool handles(VM *, uint8_t code)
+    {
+        return code < 10;
+    }
+    // with IP on the int, which goes in r1
+    static InterruptResult handle(VM *vm, uint8_t code)
+    {
+        vm->setRegister(R1, vm->getRegister(IP));
+        return code == 1 ? VM_INT_FINISH : VM_INT_WAIT;
+    }
+};
+
+struct SyscallConfig : VMConfig
+{
+    typedef Syscalls Interrupts;
+};
+
+template <class T>
+static void setUp(T &vm, uint16_t progLen)
+{
+    for (uint8_t i = R0; i <= T9; i++)
+        vm.setRegister((Register)i, 0x01010101 * (i + 1));
+    vm.setRegister(R1, 2);
+    vm.setRegister(R2, 7);
+    vm.setRegister(RA, progLen - 1);
+}
+
+template <class T>
+static void requireSame(VM &vm, T &other)
+{
+    REQUIRE(other.instructionsExecuted() == vm.instructionsExecuted());
+    for (uint8_t i = 0; i < REGISTER_COUNT; i++)
+        REQUIRE(other.getRegister((Register)i) == vm.getRegister((Register)i));
+    REQUIRE(memcmp(other.memory(), vm.memory(), 64) == 0);
+}
+
+TEST_CASE("BasicVM runs programs like VM")
+{
+    // random instructions with operands small enough to be mostly valid,
+    // apart from I/O and division (by zero), and a budget in case they loop
+    std::mt19937 random(7);
+    for (int i = 0; i < 2000; i++)
+    {
+        uint8_t program[24];
+        for (uint8_t &byte : program)
+            byte = random() % 24;
+        for (int j = 0; j < 4; j++)
+        {
+            uint8_t op = random() % INSTRUCTION_COUNT;
+            if ((op >= OP_PRINT && op <= OP_READS) || op == OP_DIV || op == OP_IDIV || op == OP_MOD || op == OP_IMOD)
+                op = OP_NOP;
+            program[random() % 16] = op;
+        }
+        program[sizeof(program) - 1] = OP_HALT;
+        const uint32_t budget = random() % 2 == 0 ? 100000 : 1 + random() % 40;
+        INFO("program " << i);
+
+        VM vm(program, sizeof(program), 64 - sizeof(program));
+        vm.setDispatch(VM_DISPATCH_SWITCH);
+        setUp(vm, sizeof(program));
+        const ExecResult result = vm.run(budget);
+
+        Program *shared = new Program(program, sizeof(program), 64 - sizeof(program));
+        BasicVM<VMConfig> basic(shared);
+        shared->release();
+        setUp(basic, sizeof(program));
+        REQUIRE(basic.run(budget) == result);
+        requireSame(vm, basic);
+
+        BasicVM<Fixed64> fixed(program, sizeof(program));
+        setUp(fixed, sizeof(program));
+        REQUIRE(fixed.run(budget) == result);
+        requireSame(vm, fixed);
+    }
+}
+
+TEST_CASE("Configs")
+{
+    SECTION("Memory of a fixed size")
+    {
+        // pushes and pops r0 through a pointer at the top of memory
+        uint8_t program[] = {
+            OP_PUSH, R0,
+            OP_LCONSB, R1, 60,
+            OP_LOAD_P, R2, R1,
+            OP_LCONSB, R1, 64,
+            OP_LOAD_P, R2, R1,
+            OP_HALT};
+        BasicVM<Fixed64> vm(program, sizeof(program));
+        REQUIRE(vm.getRegister(SP) == 64);
+        vm.setRegister(R0, 1234);
+        REQUIRE(vm.run() == ExecResult::VM_ERR_INVALID_ADDRESS);
+        REQUIRE(vm.getRegister(R2) == 1234);
+
+        // programs of another size can't be run
+        Program *other = new Program(program, sizeof(program), 100);
+        BasicVM<Fixed64> wrong(other);
+        other->release();
+        REQUIRE(wrong.run() == ExecResult::VM_ERR_INVALID_ADDRESS);
+        REQUIRE(wrong.getRegister(IP) == 0);
+    }
+
+    SECTION("Without checks")
+    {
+        uint8_t program[] = {
+            OP_LCONSB, R0, 20,
+            OP_LCONSB, R1, 22,
+            OP_ADD, R2, R0, R1,
+            OP_PUSH, R2,
+            OP_POP, R3,
+            OP_HALT};
+        VM checked(program, sizeof(program));
+        REQUIRE(checked.run() == ExecResult::VM_FINISHED);
+        BasicVM<Unchecked> vm(program, sizeof(program));
+        REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+        REQUIRE(vm.getRegister(R3) == 42);
+        requireSame(checked, vm);
+    }
+
+    SECTION("I/O of its own")
+    {
+        uint8_t program[] = {
+            OP_READ, R0,
+            OP_READF, R1,
+            OP_READC, R2,
+            OP_READS, 40, 0, 3, 0,
+            OP_PRINT, R0, 0,
+            OP_PRINTC, R3,
+            OP_PRINTF, R1, 1,
+            OP_PRINTI, R2, 0,
+            OP_PRINTS, 40, 0,
+            OP_PRINTLN,
+            OP_HALT};
+        BasicVM<StringConfig> vm(program, sizeof(program));
+        StringIO::out.clear();
+        StringIO::in = "7348x";
+        vm.setRegister(R3, ' ');
+        REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+        REQUIRE(StringIO::out == "7 1.500000\n48x\n.");
+    }
+
+    SECTION("Interrupts of its own")
+    {
+        uint8_t program[] = {
+            OP_INT, 4,
+            OP_INT, 3,
+            OP_INT, 1,
+            OP_INT, 11,
+            OP_HALT};
+        BasicVM<SyscallConfig> vm(program, sizeof(program));
+        vm.setRegister(R0, 5);
+        REQUIRE(vm.run() == ExecResult::VM_WAITING);
+        REQUIRE(vm.getRegister(R0) == 10);
+        REQUIRE(vm.getRegister(R1) == 3);
+        REQUIRE(vm.getRegister(IP) == 4);
+        REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+        REQUIRE(vm.getRegister(R1) == 5);
+        vm.setRegister(IP, 6);
+        REQUIRE(vm.run() == ExecResult::VM_ERR_UNHANDLED_INTERRUPT);
+    }
+}
@@ -1,3 +1,4 @@
+#include <vector>
 #include "test.h"
 
 TEST_CASE("OP_JMP")
@@ -16,6 +17,73 @@ TEST_CASE("OP_JMP")
     }
 }
 
+TEST_CASE("OP_LJMP")
+{
+    SECTION("Jump and set 1")
+    {
+        uint8_t program[] = {
+            OP_LJMP, 6, 0, 0, 0,
+            OP_HALT,
+            OP_LCONSB, R0, 1,
+            OP_HALT};
+        VM vm(program, sizeof(program));
+        REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+        REQUIRE(vm.getRegister(R0) == 1);
+    }
+
+    SECTION("Jump past 64 KiB")
+    {
+        std::vector<uint8_t> program(0x10004, OP_HALT);
+        const uint8_t code[] = {OP_LJMP, 0x00, 0x00, 0x01, 0x00};
+        const uint8_t far[] = {OP_LCONSB, R0, 1};
+        memcpy(&program[0], code, sizeof(code));
+        memcpy(&program[0x10000], far, sizeof(far));
+        VM vm(program.data(), program.size());
+        REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+        REQUIRE(vm.getRegister(R0) == 1);
+        REQUIRE(vm.getRegister(IP) == 0x10003);
+    }
+
+    SECTION("Near jumps stay in their 64 KiB page")
+    {
+        std::vector<uint8_t> program(0x10010, OP_HALT);
+        const uint8_t code[] = {OP_LJMP, 0x00, 0x00, 0x01, 0x00};
+        const uint8_t far[] = {
+            OP_JMP, 0x08, 0x00, // to 0x10008
+            OP_HALT, OP_HALT, OP_HALT, OP_HALT, OP_HALT,
+            OP_LCONSB, R0, 1};
+        memcpy(&program[0], code, sizeof(code));
+        program[8] = OP_LCONSB; // not reached
+        memcpy(&program[0x10000], far, sizeof(far));
+        VM vm(program.data(), program.size());
+        REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+        REQUIRE(vm.getRegister(R0) == 1);
+        REQUIRE(vm.getRegister(IP) == 0x1000B);
+    }
+
+    SECTION("Jump past the end of memory")
+    {
+        uint8_t program[] = {
+            OP_LJMP, 0x00, 0x00, 0x00, 0x01};
+        VM vm(program, sizeof(program));
+        REQUIRE(vm.run() == ExecResult::VM_ERR_INVALID_ADDRESS);
+    }
+}
+
+TEST_CASE("OP_LCALL")
+{
+    uint8_t program[] = {
+        OP_LCALL, 7, 0, 0, 0,
+        OP_HALT, OP_HALT,
+        OP_LCONSB, R0, 1,
+        OP_RET};
+    VM vm(program, sizeof(program));
+    REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+    REQUIRE(vm.getRegister(R0) == 1);
+    REQUIRE(vm.getRegister(RA) == 5);
+    REQUIRE(vm.getRegister(IP) == 5);
+}
+
 TEST_CASE("OP_JR")
 {
     SECTION("Jump and set 1")
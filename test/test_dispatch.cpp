@@ -0,0 +1,902 @@
+#include <vector>
+#include "test.h"
+#include "../src/decode.h"
+
+struct DispatchResult
+{
+    ExecResult result;
+    uint32_t executed;
+    uint32_t registers[REGISTER_COUNT];
+    uint8_t memory[64];
+};
+
+static DispatchResult runWithDispatch(uint8_t *program, uint16_t progLen, DispatchMode mode, uint32_t maxInstr = 0)
+{
+    DispatchResult res;
+    VM vm(program, progLen, 64 - progLen);
+    vm.setDispatch(mode);
+    for (uint8_t i = R0; i <= T9; i++)
+        vm.setRegister((Register)i, 0x01010101 * (i + 1));
+    vm.setRegister(R1, 2);
+    vm.setRegister(R2, 7);
+    vm.setRegister(RA, progLen - 1);
+
+    res.result = vm.run(maxInstr);
+    res.executed = vm.instructionsExecuted();
+    for (uint8_t i = 0; i < REGISTER_COUNT; i++)
+        res.registers[i] = vm.getRegister((Register)i);
+    memcpy(res.memory, vm.peek(), sizeof(res.memory));
+    return res;
+}
+
+static void requireSameResult(uint8_t *program, uint16_t progLen, uint32_t maxInstr = 0)
+{
+    const DispatchMode modes[] = {VM_DISPATCH_THREADED, VM_DISPATCH_DECODED, VM_DISPATCH_JIT, VM_DISPATCH_TAILCALL, VM_DISPATCH_STENCIL};
+    DispatchResult sw = runWithDispatch(program, progLen, VM_DISPATCH_SWITCH, maxInstr);
+
+    for (DispatchMode mode : modes)
+    {
+        INFO("dispatch mode " << (int)mode);
+        DispatchResult other = runWithDispatch(program, progLen, mode, maxInstr);
+
+        REQUIRE(sw.result == other.result);
+        REQUIRE(sw.executed == other.executed);
+        for (uint8_t i = 0; i < REGISTER_COUNT; i++)
+            REQUIRE(sw.registers[i] == other.registers[i]);
+        REQUIRE(memcmp(sw.memory, other.memory, sizeof(sw.memory)) == 0);
+    }
+}
+
+TEST_CASE("Dispatch engines agree on every opcode")
+{
+    for (uint8_t op = 0; op < INSTRUCTION_COUNT; op++)
+    {
+        // skip anything that would touch stdin/stdout
+        if (op >= OP_PRINT && op <= OP_READS)
+            continue;
+
+        // operands are small enough to be valid registers, addresses and jump targets
+        uint8_t program[] = {
+            op, R1, R2, R0, 1, 2,
+            OP_HALT, OP_HALT, OP_HALT, OP_HALT};
+        INFO("opcode " << (int)op);
+        requireSameResult(program, sizeof(program));
+    }
+}
+
+TEST_CASE("Dispatch engines agree on errors and pauses")
+{
+    SECTION("Unknown opcode")
+    {
+        uint8_t program[] = {
+            OP_NOP,
+            INSTRUCTION_COUNT};
+        requireSameResult(program, sizeof(program));
+    }
+
+    SECTION("Invalid register")
+    {
+        uint8_t program[] = {
+            OP_MOV, R0, REGISTER_COUNT,
+            OP_HALT};
+        requireSameResult(program, sizeof(program));
+    }
+
+    SECTION("Running past the end")
+    {
+        uint8_t program[] = {
+            OP_JMP, 63, 0};
+        requireSameResult(program, sizeof(program));
+    }
+
+    SECTION("Operands past the end of the program")
+    {
+        uint8_t program[] = {
+            OP_NOP,
+            OP_LCONS, R0, 1, 2};
+        requireSameResult(program, sizeof(program));
+    }
+
+    SECTION("Executing the stack")
+    {
+        uint8_t program[] = {
+            OP_LCONSB, R0, OP_HALT,
+            OP_PUSH, R0,
+            OP_JR, SP};
+        requireSameResult(program, sizeof(program));
+    }
+
+    SECTION("Stack overflow")
+    {
+        uint8_t program[] = {
+            OP_PUSH, R0,
+            OP_JMP, 0, 0};
+        requireSameResult(program, sizeof(program));
+    }
+
+    SECTION("Paused loop")
+    {
+        uint8_t program[] = {
+            OP_INC, R0,
+            OP_JMP, 0, 0};
+        requireSameResult(program, sizeof(program), 1);
+        requireSameResult(program, sizeof(program), 1001);
+    }
+}
+
+TEST_CASE("Dispatch engines agree on special registers as operands")
+{
+    uint8_t program[] = {
+        OP_MOV, R0, SP,
+        OP_LCONSB, R1, 8,
+        OP_SUB, SP, SP, R1,
+        OP_PUSH, R0,
+        OP_POP, R3,
+        OP_ADD, SP, SP, R1,
+        OP_MOV, R4, IP,
+        OP_LCONSB, IP, 24,
+        OP_HALT,
+        OP_INC, R2,
+        OP_HALT};
+    requireSameResult(program, sizeof(program));
+    for (uint32_t maxInstr = 1; maxInstr < 10; maxInstr++)
+        requireSameResult(program, sizeof(program), maxInstr);
+}
+
+TEST_CASE("Superinstructions match the byte interpreter")
+{
+    SECTION("Local variable access")
+    {
+        uint8_t program[] = {
+            OP_LCONSW, R5, 4, 0,
+            OP_SUB, R5, R2, R5,
+            OP_LOAD_P, R0, R5,
+            OP_PUSH, R0,
+            OP_LCONSW, R5, 3, 0,
+            OP_SUB, R5, R2, R5,
+            OP_LOAD_P, R0, R5,
+            OP_POP, R1,
+            OP_HALT};
+        for (uint32_t maxInstr = 0; maxInstr < 9; maxInstr++)
+            requireSameResult(program, sizeof(program), maxInstr);
+    }
+
+    SECTION("Loops")
+    {
+        uint8_t program[] = {
+            OP_LCONSB, R3, 3,
+            OP_INC, R0,
+            OP_MOD, R4, R0, R3,
+            OP_JNZ, R4, 3, 0,
+            OP_INC, R0,
+            OP_JB, R0, R3, 3, 0,
+            OP_MOD, R4, R0, R1,
+            OP_JZ, R4, 30, 0,
+            OP_INC, R1,
+            OP_HALT};
+        for (uint32_t maxInstr = 0; maxInstr < 12; maxInstr++)
+            requireSameResult(program, sizeof(program), maxInstr);
+    }
+
+    SECTION("Error in the middle")
+    {
+        uint8_t program[] = {
+            OP_LCONSW, R5, 0xFF, 0xFF,
+            OP_SUB, R5, R5, R1,
+            OP_LOAD_P, R0, R5,
+            OP_HALT};
+        requireSameResult(program, sizeof(program));
+
+        uint8_t pushProgram[] = {
+            OP_LOAD_P, R0, R1,
+            OP_PUSH, R0,
+            OP_JMP, 0, 0};
+        requireSameResult(pushProgram, sizeof(pushProgram));
+    }
+
+    SECTION("Patching the second instruction")
+    {
+        // turn the inc into a dec once the loop has run once
+        uint8_t program[] = {
+            OP_LCONSB, R3, OP_DEC,
+            OP_LCONSB, R4, 14,
+            OP_INC, R0,
+            OP_JMP, 14, 0,
+            OP_HALT,
+            OP_HALT,
+            OP_HALT,
+            OP_JNZ, R5, 11, 0,
+            OP_INC, R5,
+            OP_STORB, 6, 0, R3,
+            OP_JMP, 6, 0};
+        requireSameResult(program, sizeof(program));
+    }
+}
+
+// a VM that shows what its decoded engine made of the code
+struct DecodedVM : VM
+{
+    DecodedVM(uint8_t *program, uint32_t progLen) : VM(program, progLen) {}
+
+    uint8_t decodedOp(uint32_t addr)
+    {
+        return this->_decoded[addr].op;
+    }
+};
+
+TEST_CASE("Decoded dispatch sees code changes")
+{
+    SECTION("Self-modifying code")
+    {
+        // overwrite the increment with a decrement after its first execution
+        uint8_t program[] = {
+            OP_INC, R0,
+            OP_LCONSB, R1, OP_DEC,
+            OP_STORB, 0, 0, R1,
+            OP_JNZ, R0, 0, 0,
+            OP_HALT};
+        requireSameResult(program, sizeof(program));
+
+        VM vm(program, sizeof(program));
+        vm.setDispatch(VM_DISPATCH_DECODED);
+        REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+        REQUIRE(vm.getRegister(R0) == 0);
+    }
+
+    SECTION("Writes by instructions the interpreter steps through")
+    {
+        // stores through ip aren't decoded, this one overwrites the dec and
+        // the jnz after it
+        uint8_t program[] = {
+            OP_DEC, R4,
+            OP_STOR_P, IP, R0,
+            OP_DEC, R5,
+            OP_JNZ, R5, 0, 0,
+            OP_HALT};
+        requireSameResult(program, sizeof(program));
+        for (uint32_t maxInstr = 1; maxInstr < 8; maxInstr++)
+            requireSameResult(program, sizeof(program), maxInstr);
+    }
+
+    SECTION("Writes next to a superinstruction")
+    {
+        // after the inc + jb loop, a store to the data after the halt and one
+        // to the constant of the lconsb right after it
+        uint8_t program[] = {
+            OP_LCONSB, R1, 3,
+            OP_INC, R0,
+            OP_JB, R0, R1, 3, 0,
+            OP_STORB, 22, 0, R0,
+            OP_STORB, 20, 0, R0,
+            OP_LCONSB, R2, 1,
+            OP_HALT,
+            0};
+        requireSameResult(program, sizeof(program));
+
+        DecodedVM vm(program, sizeof(program));
+        vm.setDispatch(VM_DISPATCH_DECODED);
+        REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+        REQUIRE(vm.getRegister(R2) == 3);
+        REQUIRE(vm.peek(22)[0] == 3);
+        REQUIRE(vm.decodedOp(3) == DOP_INC_JB);
+        REQUIRE(vm.decodedOp(10) == OP_STORB);
+        REQUIRE(vm.decodedOp(18) == OP_LCONSB);
+    }
+
+    SECTION("Writes through memory()")
+    {
+        uint8_t program[] = {
+            OP_LCONSB, R0, 1,
+            OP_HALT};
+        VM vm(program, sizeof(program));
+        vm.setDispatch(VM_DISPATCH_DECODED);
+        REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+        REQUIRE(vm.getRegister(R0) == 1);
+
+        vm.reset();
+        vm.memory()[2] = 2;
+        REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+        REQUIRE(vm.getRegister(R0) == 2);
+    }
+}
+
+TEST_CASE("Hot blocks match the byte interpreter")
+{
+    // loops run well past the JIT threshold so their blocks get compiled
+    SECTION("Arithmetic and branches")
+    {
+        uint8_t program[] = {
+            OP_LCONSB, R0, 0,
+            OP_LCONSW, R3, 0x88, 0x13,
+            OP_LCONSB, R4, 3,
+            OP_ADD, R5, R5, R0,
+            OP_MUL, T0, R5, R4,
+            OP_XOR, T1, T0, R0,
+            OP_SHL, T2, R0, R4,
+            OP_ISHR, T3, T0, R4,
+            OP_MOD, T4, R0, R4,
+            OP_IDIV, T5, T0, R4,
+            OP_I2F, T6, R0,
+            OP_FMUL, T6, T6, T6,
+            OP_FINC, T6,
+            OP_F2I, T7, T6,
+            OP_JZ, T4, 56, 0,
+            OP_DEC, T8,
+            OP_INC, R0,
+            OP_JB, R0, R3, 10, 0,
+            OP_HALT};
+        requireSameResult(program, sizeof(program));
+        for (uint32_t maxInstr = 1000; maxInstr < 100000; maxInstr = maxInstr * 3 + 7)
+            requireSameResult(program, sizeof(program), maxInstr);
+    }
+
+    SECTION("NaN operands")
+    {
+        // with two NaNs the result is one of them, which has to be the same
+        // one whichever engine runs the float op
+        uint8_t program[] = {
+            OP_LCONSB, R0, 0,
+            OP_LCONS, R1, 0x01, 0x00, 0xc0, 0x7f,
+            OP_LCONS, R2, 0x02, 0x00, 0xc0, 0x7f,
+            OP_LCONSW, R3, 0xb8, 0x0b,
+            OP_FADD, T0, R1, R2,
+            OP_FSUB, T1, R1, R2,
+            OP_FMUL, T2, R1, R2,
+            OP_FDIV, T3, R1, R2,
+            OP_FADD, T4, R2, R1,
+            OP_FMUL, T5, R2, R1,
+            OP_INC, R0,
+            OP_JB, R0, R3, 19, 0,
+            OP_HALT};
+        requireSameResult(program, sizeof(program));
+        REQUIRE(runWithDispatch(program, sizeof(program), VM_DISPATCH_SWITCH).registers[T0] == 0x7fc00001);
+    }
+
+    SECTION("Calls, memory and the stack")
+    {
+        uint8_t program[] = {
+            OP_JMP, 25, 0,
+            // sub: push r0, store it at 60 and load it back into r1
+            OP_PUSH, R0,
+            OP_LCONSB, R5, 60,
+            OP_STOR_P, R5, R0,
+            OP_LOADB_P, R1, R5,
+            OP_STORW, 56, 0, R1,
+            OP_LOAD, R2, 56, 0,
+            OP_POP, T0,
+            OP_RET,
+            // entry
+            OP_LCONSB, R0, 0,
+            OP_LCONSW, R3, 0xD0, 0x07,
+            OP_CALL, 3, 0,
+            OP_INC, R0,
+            OP_JNE, R0, R3, 32, 0,
+            OP_HALT};
+        requireSameResult(program, sizeof(program));
+        requireSameResult(program, sizeof(program), 12345);
+    }
+
+    SECTION("Errors inside a hot block")
+    {
+        // the load walks r0 up until it runs off the end of memory
+        uint8_t program[] = {
+            OP_LCONSB, R0, 0,
+            OP_LOAD_P, R1, R0,
+            OP_DEC, R2,
+            OP_JNZ, R2, 3, 0,
+            OP_INC, R0,
+            OP_LCONSW, R2, 0xE8, 0x03,
+            OP_JMP, 3, 0};
+        requireSameResult(program, sizeof(program));
+
+        // balanced pushes and pops until r1 reaches zero, then only pushes
+        uint8_t pushProgram[] = {
+            OP_LCONSW, R1, 0xD0, 0x07,
+            OP_PUSH, R0,
+            OP_DEC, R1,
+            OP_JZ, R1, 17, 0,
+            OP_POP, R2,
+            OP_JMP, 4, 0,
+            OP_LCONSB, R1, 1,
+            OP_JMP, 4, 0};
+        requireSameResult(pushProgram, sizeof(pushProgram));
+    }
+
+    SECTION("Writes to a compiled block")
+    {
+        // once the loop at 10 is hot its inc is patched into a dec
+        uint8_t program[] = {
+            OP_LCONSB, T0, 0,
+            OP_LCONSB, R0, 0,
+            OP_LCONSW, R3, 0xD0, 0x07,
+            OP_INC, R0,
+            OP_JNE, R0, R3, 10, 0,
+            OP_JNZ, T0, 39, 0,
+            OP_LCONSB, R5, 10,
+            OP_LCONSB, R4, OP_DEC,
+            OP_STORB_P, R5, R4,
+            OP_LCONSW, R3, 0xE8, 0x03,
+            OP_INC, T0,
+            OP_JMP, 10, 0,
+            OP_HALT};
+        requireSameResult(program, sizeof(program));
+
+        VM vm(program, sizeof(program));
+        vm.setDispatch(VM_DISPATCH_JIT);
+        REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+        REQUIRE(vm.getRegister(R0) == 1000);
+    }
+
+    SECTION("Stores to data next to the code")
+    {
+        // the loop keeps writing the bytes after the halt, which are never run
+        uint8_t program[] = {
+            OP_LCONSB, R0, 0,
+            OP_LCONSW, R3, 0xB8, 0x0B,
+            OP_LCONSB, R4, 38,
+            OP_STOR, 33, 0, R0,
+            OP_STORB, 37, 0, R0,
+            OP_STORW_P, R4, R0,
+            OP_INC, R0,
+            OP_JB, R0, R3, 10, 0,
+            OP_HALT,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+        requireSameResult(program, sizeof(program));
+
+        VM vm(program, sizeof(program));
+        vm.setDispatch(VM_DISPATCH_JIT);
+        REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+        REQUIRE(vm.getRegister(R0) == 3000);
+        REQUIRE(vm.peek()[33] == (3000 - 1) % 256);
+    }
+
+    SECTION("Pointer stores that start hitting code")
+    {
+        // after 2000 rounds the store moves from the data at 50 onto the
+        // immediate of the lconsb at 20, so r5 goes from 1 to 2
+        uint8_t program[] = {
+            OP_LCONSB, R0, 0,
+            OP_LCONSW, R3, 0xB8, 0x0B,
+            OP_LCONSW, T3, 0xD0, 0x07,
+            OP_LCONSB, R4, 50,
+            OP_LCONSB, T1, 0,
+            OP_LCONSB, T2, 2,
+            OP_LCONSB, R5, 1,
+            OP_ADD, T1, T1, R5,
+            OP_STORB_P, R4, T2,
+            OP_JNE, R0, T3, 38, 0,
+            OP_LCONSB, R4, 22,
+            OP_INC, R0,
+            OP_JB, R0, R3, 20, 0,
+            OP_HALT,
+            0, 0, 0, 0, 0, 0};
+        requireSameResult(program, sizeof(program));
+
+        VM vm(program, sizeof(program));
+        vm.setDispatch(VM_DISPATCH_JIT);
+        REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+        REQUIRE(vm.getRegister(T1) == 3998);
+    }
+
+    SECTION("Constant stores to code found later")
+    {
+        // the loop at 16 is compiled while 46 is still unknown, so its store
+        // into the lconsb there is emitted natively; jumping to 46 later
+        // makes it code and the loop has to be compiled again
+        uint8_t program[] = {
+            OP_LCONSB, R5, 0,
+            OP_LCONSB, T1, 3,
+            OP_LCONSB, R4, 0,
+            OP_LCONSW, R3, 0xDC, 0x05,
+            OP_LCONSB, R0, 0,
+            OP_STORB, 48, 0, R5,
+            OP_INC, R0,
+            OP_JB, R0, R3, 16, 0,
+            OP_LCONSB, T2, 46,
+            OP_JR, T2,
+            OP_HALT,
+            OP_NOP, OP_NOP, OP_NOP, OP_NOP, OP_NOP, OP_NOP, OP_NOP,
+            OP_NOP, OP_NOP, OP_NOP, OP_NOP, OP_NOP, OP_NOP,
+            OP_LCONSB, R2, 0,
+            OP_ADD, R4, R4, R2,
+            OP_INC, R5,
+            OP_JB, R5, T1, 13, 0,
+            OP_JMP, 32, 0};
+        requireSameResult(program, sizeof(program));
+
+        VM vm(program, sizeof(program));
+        vm.setDispatch(VM_DISPATCH_JIT);
+        REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+        REQUIRE(vm.getRegister(R4) == 3);
+    }
+}
+
+TEST_CASE("Hot loops are traced like the byte interpreter runs them")
+{
+    // every third iteration calls the subroutine at 33 instead of adding, so
+    // whichever way the trace was recorded, the other one leaves it
+    uint8_t program[] = {
+        OP_LCONSW, R3, 0xB8, 0x0B,
+        OP_LCONSB, R4, 3,
+        OP_INC, R0,
+        OP_MOD, T0, R0, R4,
+        OP_JZ, T0, 24, 0,
+        OP_ADD, R5, R5, R0,
+        OP_JMP, 27, 0,
+        OP_CALL, 33, 0,
+        OP_JB, R0, R3, 7, 0,
+        OP_HALT,
+        OP_SUB, R5, R5, R1,
+        OP_RET};
+
+    SECTION("Recorded through the add")
+    {
+        requireSameResult(program, sizeof(program));
+        for (uint32_t maxInstr = 1000; maxInstr < 30000; maxInstr = maxInstr * 2 + 11)
+            requireSameResult(program, sizeof(program), maxInstr);
+    }
+
+    SECTION("Recorded through the call")
+    {
+        program[13] = OP_JNZ;
+        requireSameResult(program, sizeof(program));
+        for (uint32_t maxInstr = 1000; maxInstr < 30000; maxInstr = maxInstr * 2 + 11)
+            requireSameResult(program, sizeof(program), maxInstr);
+    }
+
+    SECTION("Returning somewhere else")
+    {
+        // the subroutine returns past the jb once r0 reaches 2000
+        uint8_t retProgram[] = {
+            OP_LCONSW, R3, 0xB8, 0x0B,
+            OP_LCONSW, R4, 0xD0, 0x07,
+            OP_INC, R0,
+            OP_CALL, 21, 0,
+            OP_JB, R0, R3, 8, 0,
+            OP_HALT,
+            OP_HALT,
+            OP_HALT,
+            OP_JNE, R0, R4, 30, 0,
+            OP_LCONSB, RA, 19,
+            OP_RET};
+        requireSameResult(retProgram, sizeof(retProgram));
+        requireSameResult(retProgram, sizeof(retProgram), 7777);
+    }
+}
+
+static bool verifies(uint8_t *program, uint16_t progLen)
+{
+    VM vm(program, progLen);
+    return vm.verify();
+}
+
+TEST_CASE("Verified programs skip static checks")
+{
+    SECTION("Verification")
+    {
+        uint8_t valid[] = {
+            OP_LCONSB, R0, 5,
+            OP_STOR, 20, 0, R0,
+            OP_CALL, 12, 0,
+            OP_HALT,
+            OP_HALT,
+            OP_LOAD, R1, 20, 0,
+            OP_RET};
+        REQUIRE(verifies(valid, sizeof(valid)));
+
+        uint8_t badRegister[] = {
+            OP_MOV, R0, REGISTER_COUNT,
+            OP_HALT};
+        REQUIRE_FALSE(verifies(badRegister, sizeof(badRegister)));
+
+        uint8_t writesIP[] = {
+            OP_LCONSB, IP, 0,
+            OP_HALT};
+        REQUIRE_FALSE(verifies(writesIP, sizeof(writesIP)));
+
+        uint8_t pastEnd[] = {
+            OP_NOP,
+            OP_LCONS, R0, 1, 2};
+        REQUIRE_FALSE(verifies(pastEnd, sizeof(pastEnd)));
+
+        uint8_t jumpPastEnd[] = {
+            OP_JZ, R0, 0xFF, 0,
+            OP_HALT};
+        REQUIRE_FALSE(verifies(jumpPastEnd, sizeof(jumpPastEnd)));
+
+        uint8_t loadPastMemory[] = {
+            OP_LOAD, R0, 0xFF, 0xFF,
+            OP_HALT};
+        REQUIRE_FALSE(verifies(loadPastMemory, sizeof(loadPastMemory)));
+
+        uint8_t storeToCode[] = {
+            OP_STORB, 5, 0, R0,
+            OP_NOP,
+            OP_HALT};
+        REQUIRE_FALSE(verifies(storeToCode, sizeof(storeToCode)));
+
+        // bytes after an unconditional jump are never looked at
+        uint8_t skipsData[] = {
+            OP_JMP, 5, 0,
+            INSTRUCTION_COUNT, REGISTER_COUNT,
+            OP_HALT};
+        REQUIRE(verifies(skipsData, sizeof(skipsData)));
+    }
+
+    SECTION("Indirect jumps are still checked")
+    {
+        uint8_t program[] = {
+            OP_LCONSB, R0, 6,
+            OP_JR, R0,
+            OP_HALT,
+            INSTRUCTION_COUNT};
+        REQUIRE(verifies(program, sizeof(program)));
+        requireSameResult(program, sizeof(program));
+
+        VM vm(program, sizeof(program));
+        vm.setDispatch(VM_DISPATCH_SWITCH);
+        REQUIRE(vm.run() == ExecResult::VM_ERR_UNKNOWN_OPCODE);
+    }
+
+    SECTION("Pointer writes into code")
+    {
+        // patch the inc into a dec through a pointer after the first pass
+        uint8_t program[] = {
+            OP_INC, R0,
+            OP_LCONSB, R1, OP_DEC,
+            OP_LCONSB, R2, 0,
+            OP_STORB_P, R2, R1,
+            OP_JNZ, R0, 0, 0,
+            OP_HALT};
+        REQUIRE(verifies(program, sizeof(program)));
+        requireSameResult(program, sizeof(program));
+
+        VM vm(program, sizeof(program));
+        vm.setDispatch(VM_DISPATCH_SWITCH);
+        REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+        REQUIRE(vm.getRegister(R0) == 0);
+    }
+
+    SECTION("Writes into code in budget slices")
+    {
+        // the halt is patched into an lconsb to an invalid register, by
+        // whichever engine runs the store when the budget ends mid-block
+        uint8_t program[] = {
+            OP_LCONSW, R0, 16, 0,
+            OP_LCONS, R1, OP_LCONSB, 200, 0x41, OP_HALT,
+            OP_STOR_P, R0, R1,
+            OP_JMP, 16, 0,
+            OP_HALT, 0, 0, 0};
+        REQUIRE(verifies(program, sizeof(program)));
+
+        const DispatchMode modes[] = {VM_DISPATCH_SWITCH, VM_DISPATCH_THREADED, VM_DISPATCH_DECODED, VM_DISPATCH_JIT, VM_DISPATCH_TAILCALL, VM_DISPATCH_STENCIL};
+        for (DispatchMode mode : modes)
+        {
+            for (uint32_t slice = 1; slice <= 5; slice++)
+            {
+                INFO("dispatch mode " << (int)mode << ", slice " << slice);
+                VM vm(program, sizeof(program));
+                vm.setDispatch(mode);
+                ExecResult res;
+                while ((res = vm.run(slice)) == ExecResult::VM_PAUSED)
+                    ;
+                REQUIRE(res == ExecResult::VM_ERR_INVALID_REGISTER);
+            }
+        }
+
+        VM vm(program, sizeof(program));
+        vm.setDispatch(VM_DISPATCH_SWITCH);
+        REQUIRE(vm.run(3) == ExecResult::VM_PAUSED);
+        REQUIRE(vm.run() == ExecResult::VM_ERR_INVALID_REGISTER);
+        REQUIRE(vm.instructionsExecuted() == 1);
+    }
+
+    SECTION("Host writes into code")
+    {
+        uint8_t program[] = {
+            OP_INC, R0,
+            OP_HALT};
+        VM vm(program, sizeof(program));
+        vm.setDispatch(VM_DISPATCH_SWITCH);
+        REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+
+        vm.reset();
+        vm.memory()[1] = REGISTER_COUNT;
+        REQUIRE(vm.run() == ExecResult::VM_ERR_INVALID_REGISTER);
+    }
+}
+
+TEST_CASE("Instruction counts are exact")
+{
+    // nested loops with a call, so blocks of different lengths
+    uint8_t program[] = {
+        OP_LCONSB, R0, 0,
+        OP_LCONSB, R3, 50,
+        OP_LCONSB, R1, 0,
+        OP_CALL, 28, 0,
+        OP_INC, R1,
+        OP_JB, R1, R3, 9, 0,
+        OP_INC, R0,
+        OP_JB, R0, R3, 6, 0,
+        OP_HALT,
+        OP_HALT,
+        OP_ADD, R2, R2, R1,
+        OP_XOR, R4, R2, R0,
+        OP_RET};
+    REQUIRE(verifies(program, sizeof(program)));
+
+    VM whole(program, sizeof(program));
+    REQUIRE(whole.run() == ExecResult::VM_FINISHED);
+    const uint32_t total = whole.instructionsExecuted();
+    REQUIRE(total == 2 + 50 * (1 + 50 * 6 + 2));
+
+    const DispatchMode modes[] = {VM_DISPATCH_SWITCH, VM_DISPATCH_THREADED, VM_DISPATCH_DECODED, VM_DISPATCH_JIT, VM_DISPATCH_TAILCALL, VM_DISPATCH_STENCIL};
+    for (DispatchMode mode : modes)
+    {
+        for (uint32_t slice = 1; slice < 2000; slice = slice * 2 + 3)
+        {
+            INFO("dispatch mode " << (int)mode << ", slice " << slice);
+            VM vm(program, sizeof(program));
+            vm.setDispatch(mode);
+            uint32_t executed = 0;
+            ExecResult res;
+            while ((res = vm.run(slice)) == ExecResult::VM_PAUSED)
+            {
+                REQUIRE(vm.instructionsExecuted() == slice);
+                executed += slice;
+            }
+            REQUIRE(res == ExecResult::VM_FINISHED);
+            executed += vm.instructionsExecuted();
+            REQUIRE(executed == total);
+            REQUIRE(vm.getRegister(R2) == whole.getRegister(R2));
+        }
+    }
+}
+
+// hand-written equivalent of what risvm-aot emits for the loop at 3 below
+static uint32_t compiledLoop(uint32_t *r, uint8_t *m, uint32_t memSize, uint32_t budget)
+{
+    uint32_t executed = 0;
+    if (r[IP] != 3)
+        return executed;
+    while (budget - executed >= 2)
+    {
+        executed += 2;
+        r[R0]++;
+        if (r[R0] >= r[R3])
+        {
+            r[IP] = 10;
+            return executed;
+        }
+    }
+    return executed;
+}
+
+TEST_CASE("Compiled programs match the byte interpreter")
+{
+    uint8_t program[] = {
+        OP_LCONSB, R3, 100,
+        OP_INC, R0,
+        OP_JB, R0, R3, 3, 0,
+        OP_HALT};
+    const uint8_t codeMap[] = {0xF8, 0x03};
+    const CompiledProgram compiled = {compiledLoop, program, codeMap, sizeof(program)};
+
+    SECTION("Runs and pauses like the interpreter")
+    {
+        for (uint32_t maxInstr = 0; maxInstr < 210; maxInstr += 7)
+        {
+            VM sw(program, sizeof(program));
+            sw.setDispatch(VM_DISPATCH_SWITCH);
+            VM vm(program, sizeof(program));
+            REQUIRE(vm.setCompiled(&compiled));
+
+            INFO("maxInstr " << maxInstr);
+            REQUIRE(vm.run(maxInstr) == sw.run(maxInstr));
+            for (uint8_t i = 0; i < REGISTER_COUNT; i++)
+                REQUIRE(vm.getRegister((Register)i) == sw.getRegister((Register)i));
+        }
+    }
+
+    SECTION("Only accepted for the program it was compiled from")
+    {
+        uint8_t other[sizeof(program)];
+        memcpy(other, program, sizeof(program));
+        other[2] = 50;
+        VM vm(other, sizeof(other));
+        REQUIRE_FALSE(vm.setCompiled(&compiled));
+        REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+        REQUIRE(vm.getRegister(R0) == 50);
+    }
+
+    SECTION("Dropped when the code changes")
+    {
+        VM vm(program, sizeof(program));
+        REQUIRE(vm.setCompiled(&compiled));
+        vm.memory()[3] = OP_DEC;
+        vm.setRegister(R0, 5);
+        REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+        REQUIRE(vm.getRegister(R0) == 0xFFFFFFFF);
+    }
+}
+
+TEST_CASE("Dispatch engines agree past 64 KiB")
+{
+    // a hot loop in the second 64 KiB page of code, storing through pointers in the third
+    std::vector<uint8_t> program(0x10020, OP_HALT);
+    const uint8_t entry[] = {
+        OP_LCONS, R1, 0x00, 0x00, 0x02, 0x00, // r1 = 0x20000
+        OP_LCALL, 0x00, 0x00, 0x01, 0x00,
+        OP_HALT};
+    const uint8_t loop[] = {
+        OP_STOR_P, R1, R0,         // 0x10000
+        OP_LOADB_P, R2, R1,        // 0x10003
+        OP_ADD, R3, R3, R2,        // 0x10006
+        OP_INC, R1,                // 0x1000A
+        OP_INC, R0,                // 0x1000C
+        OP_JB, R0, R4, 0x00, 0x00, // 0x1000E, back to 0x10000
+        OP_RET};
+    memcpy(&program[0], entry, sizeof(entry));
+    memcpy(&program[0x10000], loop, sizeof(loop));
+
+    const DispatchMode modes[] = {VM_DISPATCH_SWITCH, VM_DISPATCH_THREADED, VM_DISPATCH_DECODED, VM_DISPATCH_JIT, VM_DISPATCH_TAILCALL, VM_DISPATCH_STENCIL};
+    for (uint32_t maxInstr : {0u, 1001u})
+    {
+        for (DispatchMode mode : modes)
+        {
+            INFO("dispatch mode " << (int)mode << ", budget " << maxInstr);
+            VM vm(program.data(), program.size(), 0x12000);
+            vm.setDispatch(mode);
+            vm.setRegister(R4, 5000);
+
+            REQUIRE(vm.run(maxInstr) == (maxInstr == 0 ? ExecResult::VM_FINISHED : ExecResult::VM_PAUSED));
+            REQUIRE(vm.instructionsExecuted() == (maxInstr == 0 ? 6 * 5000 + 3 : maxInstr));
+            // a paused run stops right after the add of iteration 166
+            REQUIRE(vm.getRegister(R0) == (maxInstr == 0 ? 5000 : 166));
+            const uint32_t stores = maxInstr == 0 ? 5000 : 167;
+            REQUIRE(vm.getRegister(R1) == 0x20000 + stores - (maxInstr == 0 ? 0 : 1));
+            // each store overwrites all but the low byte of the previous one
+            uint32_t sum = 0;
+            for (uint32_t i = 0; i < stores; i++)
+            {
+                sum += i & 0xFF;
+                REQUIRE(*vm.memory(0x20000 + i) == (i & 0xFF));
+            }
+            REQUIRE(vm.getRegister(R3) == sum);
+        }
+    }
+}
+
+TEST_CASE("Dispatch mode can be switched")
+{
+    uint8_t program[] = {
+        OP_INC, R0,
+        OP_JMP, 0, 0};
+    VM vm(program, sizeof(program));
+
+    vm.setDispatch(VM_DISPATCH_SWITCH);
+    REQUIRE(vm.dispatch() == VM_DISPATCH_SWITCH);
+    REQUIRE(vm.run(100) == ExecResult::VM_PAUSED);
+    REQUIRE(vm.getRegister(R0) == 50);
+
+    vm.setDispatch(VM_DISPATCH_THREADED);
+    REQUIRE(vm.dispatch() == VM_DISPATCH_THREADED);
+    REQUIRE(vm.run(100) == ExecResult::VM_PAUSED);
+    REQUIRE(vm.getRegister(R0) == 100);
+
+    vm.setDispatch(VM_DISPATCH_TAILCALL);
+    REQUIRE(vm.dispatch() == VM_DISPATCH_TAILCALL);
+    REQUIRE(vm.run(100) == ExecResult::VM_PAUSED);
+    REQUIRE(vm.getRegister(R0) == 150);
+
+    // long enough for the loop to get compiled, by one backend and then the other
+    vm.setDispatch(VM_DISPATCH_JIT);
+    REQUIRE(vm.run(5000) == ExecResult::VM_PAUSED);
+    REQUIRE(vm.getRegister(R0) == 2650);
+
+    vm.setDispatch(VM_DISPATCH_STENCIL);
+    REQUIRE(vm.dispatch() == VM_DISPATCH_STENCIL);
+    REQUIRE(vm.run(5000) == ExecResult::VM_PAUSED);
+    REQUIRE(vm.instructionsExecuted() == 5000);
+    REQUIRE(vm.getRegister(R0) == 5150);
+}
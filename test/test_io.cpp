@@ -0,0 +1,405 @@
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "test.h"
+
+static const DispatchMode modes[] = {VM_DISPATCH_SWITCH, VM_DISPATCH_THREADED, VM_DISPATCH_DECODED,
+                                     VM_DISPATCH_JIT, VM_DISPATCH_TAILCALL, VM_DISPATCH_STENCIL};
+
+struct Chunks
+{
+    std::string data;
+    uint32_t count;
+};
+
+static void collect(const char *data, uint32_t len, void *context)
+{
+    Chunks *chunks = (Chunks *)context;
+    chunks->data.append(data, len);
+    chunks->count++;
+}
+
+TEST_CASE("Printing")
+{
+    float half = -0.5f;
+    uint32_t halfBits;
+    memcpy(&halfBits, &half, 4);
+
+    SECTION("Every print instruction")
+    {
+        uint8_t program[] = {
+            OP_PRINT, R0, 1,
+            OP_PRINTI, R0, 0,
+            OP_PRINTC, R2,
+            OP_PRINTF, R1, 1,
+            OP_PRINTS, 20, 0,
+            OP_PRINTLN,
+            OP_HALT,
+            0, 0, 0, 0,
+            'h', 'i', '!', 0};
+        for (DispatchMode mode : modes)
+        {
+            std::string out;
+            VM vm(program, sizeof(program));
+            vm.setDispatch(mode);
+            vm.setOutput(&out);
+            vm.setRegister(R0, (uint32_t)-42);
+            vm.setRegister(R1, halfBits);
+            vm.setRegister(R2, ' ');
+            REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+            REQUIRE(out == "4294967254\n-42 -0.500000\nhi!\n");
+        }
+    }
+
+    SECTION("Strings running off the end of memory")
+    {
+        uint8_t program[] = {
+            OP_PRINTS, 4, 0,
+            OP_HALT,
+            'a', 'b', 'c'};
+        for (DispatchMode mode : {VM_DISPATCH_SWITCH, VM_DISPATCH_DECODED})
+        {
+            std::string out;
+            VM vm(program, sizeof(program), 0);
+            vm.setDispatch(mode);
+            vm.setOutput(&out);
+            REQUIRE(vm.run() == ExecResult::VM_ERR_INVALID_ADDRESS);
+            REQUIRE(out == "abc");
+        }
+    }
+
+    SECTION("Written out in large chunks")
+    {
+        // prints r0 up to r1
+        uint8_t program[] = {
+            OP_PRINT, R0, 1,
+            OP_INC, R0,
+            OP_JB, R0, R1, 0, 0,
+            OP_HALT};
+        std::string expected;
+        for (uint32_t i = 0; i < 20000; i++)
+            expected += std::to_string(i) + "\n";
+
+        for (DispatchMode mode : modes)
+        {
+            Chunks chunks = {"", 0};
+            VM vm(program, sizeof(program));
+            vm.setDispatch(mode);
+            vm.setOutput(collect, &chunks);
+            vm.setRegister(R1, 20000);
+            REQUIRE(vm.run(1000) == ExecResult::VM_PAUSED);
+            // whatever was printed is written out when run() returns
+            REQUIRE(chunks.count == 1);
+            REQUIRE(chunks.data == expected.substr(0, chunks.data.size()));
+            REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+            REQUIRE(chunks.data == expected);
+            REQUIRE(chunks.count == 1 + (expected.size() - 1) / VM_OUTPUT_BUFFER_SIZE + 1);
+        }
+    }
+
+    SECTION("File descriptors and clones")
+    {
+        uint8_t program[] = {
+            OP_PRINT, R0, 1,
+            OP_HALT};
+        int fds[2];
+        REQUIRE(pipe(fds) == 0);
+        VM vm(program, sizeof(program));
+        vm.setOutput(fds[1]);
+        vm.setRegister(R0, 7);
+        REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+        VM *clone = vm.clone();
+        clone->setRegister(IP, 0);
+        clone->setRegister(R0, 8);
+        REQUIRE(clone->run() == ExecResult::VM_FINISHED);
+        delete clone;
+        close(fds[1]);
+
+        char read[16] = {0};
+        REQUIRE(::read(fds[0], read, sizeof(read)) == 4);
+        close(fds[0]);
+        REQUIRE(std::string(read) == "7\n8\n");
+    }
+}
+
+TEST_CASE("Numbers are printed the way printf does")
+{
+    uint8_t program[] = {
+        OP_PRINT, R0, 1,
+        OP_PRINTI, R0, 1,
+        OP_PRINTF, R0, 1,
+        OP_HALT};
+    // extremes, values that round up into the next whole number, ties that
+    // round to even (1/128 and 3/128), NaNs and infinities
+    std::vector<uint32_t> values = {0, 1, 9, 10, 99, 100, 12345, INT32_MAX, 0x80000000, UINT32_MAX,
+                                    0x3F7FFFFF, 0x3C000000, 0x3CC00000, 0x00000001, 0x007FFFFF,
+                                    0x7F7FFFFF, 0x7F800000, 0xFF800000, 0x7FC00000, 0xFFC00000};
+    std::mt19937 random(42);
+    for (int i = 0; i < 20000; i++)
+        values.push_back(random());
+
+    for (DispatchMode mode : {VM_DISPATCH_SWITCH, VM_DISPATCH_DECODED})
+    {
+        std::string out, expected;
+        VM vm(program, sizeof(program));
+        vm.setDispatch(mode);
+        vm.setOutput(&out);
+        for (uint32_t value : values)
+        {
+            char text[160];
+            float f;
+            memcpy(&f, &value, 4);
+            snprintf(text, sizeof(text), "%u\n%d\n%f\n", value, (int32_t)value, f);
+            expected += text;
+            vm.setRegister(IP, 0);
+            vm.setRegister(R0, value);
+            REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+        }
+        REQUIRE(out == expected);
+    }
+}
+
+// hands out the input a few bytes at a time, so that numbers span refills
+struct Trickle
+{
+    std::string data;
+    size_t pos;
+    std::string *out;
+    size_t printed;
+};
+
+static uint32_t trickle(char *data, uint32_t len, void *context)
+{
+    Trickle *input = (Trickle *)context;
+    if (input->out != nullptr)
+        input->printed = input->out->size();
+    uint32_t count = input->data.size() - input->pos;
+    count = count < 3 ? count : 3;
+    count = count < len ? count : len;
+    memcpy(data, &input->data[input->pos], count);
+    input->pos += count;
+    return count;
+}
+
+TEST_CASE("Reading")
+{
+    SECTION("Every read instruction")
+    {
+        uint8_t program[] = {
+            OP_READ, R0,
+            OP_READI, R1,
+            OP_READF, R2,
+            OP_READC, R3,
+            OP_READS, 20, 0, 8, 0,
+            OP_READC, R4,
+            OP_HALT,
+            0, 0};
+        const char input[] = "  42\n-7 3.25 \tx hello world\n";
+        for (DispatchMode mode : modes)
+        {
+            uint8_t memory[32];
+            VM vm(program, sizeof(program), 32);
+            vm.setDispatch(mode);
+            vm.setInput(input, sizeof(input) - 1);
+            memset(vm.memory(20), 0xAA, 12);
+            REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+            REQUIRE(vm.getRegister(R0) == 42);
+            REQUIRE(vm.getRegister(R1) == (uint32_t)-7);
+            REQUIRE(vm.getRegister(R2) == 0x40500000);
+            REQUIRE(vm.getRegister(R3) == ' ');
+            // the line is longer than 8 characters, so the rest is left over
+            memcpy(memory, vm.memory(20), 12);
+            REQUIRE(std::string((char *)memory) == "\tx hello");
+            REQUIRE(memory[9] == 0xAA);
+            REQUIRE(vm.getRegister(R4) == ' ');
+        }
+    }
+
+    SECTION("Lines never go past their space")
+    {
+        // reads lines of up to 4 characters until one comes back empty
+        uint8_t program[] = {
+            OP_READS, 32, 0, 4, 0,
+            OP_PRINTS, 32, 0,
+            OP_PRINTC, R1,
+            OP_LOADB, R0, 32, 0,
+            OP_JNZ, R0, 0, 0,
+            OP_HALT};
+        const char input[] = "ab\nabcdefgh\n\nxyz";
+        for (DispatchMode mode : {VM_DISPATCH_SWITCH, VM_DISPATCH_DECODED})
+        {
+            Trickle trickled = {input, 0, nullptr, 0};
+            std::string out;
+            VM vm(program, sizeof(program), 64);
+            vm.setDispatch(mode);
+            vm.setInput(trickle, &trickled);
+            vm.setOutput(&out);
+            vm.setRegister(R1, '|');
+            memset(vm.memory(32), 0xAA, 16);
+            REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+            REQUIRE(out == "ab\n|abcd|efgh|\n|\n|xyz||");
+            REQUIRE(*vm.memory(37) == 0xAA);
+        }
+    }
+
+    SECTION("The end of the input")
+    {
+        uint8_t program[] = {
+            OP_READ, R0,
+            OP_READF, R1,
+            OP_READC, R2,
+            OP_HALT};
+        VM vm(program, sizeof(program));
+        vm.setInput("  ", 2);
+        vm.setRegister(R0, 5);
+        vm.setRegister(R1, 6);
+        REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+        REQUIRE(vm.getRegister(R0) == 5);
+        REQUIRE(vm.getRegister(R1) == 6);
+        REQUIRE(vm.getRegister(R2) == (uint32_t)EOF);
+    }
+
+    SECTION("Output is written out before waiting for input")
+    {
+        uint8_t program[] = {
+            OP_PRINT, R0, 1,
+            OP_READ, R0,
+            OP_PRINT, R0, 1,
+            OP_READ, R0,
+            OP_HALT};
+        std::string out;
+        Trickle trickled = {"12 34", 0, &out, 0};
+        VM vm(program, sizeof(program));
+        vm.setOutput(&out);
+        vm.setInput(trickle, &trickled);
+        vm.setRegister(R0, 7);
+        REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+        REQUIRE(vm.getRegister(R0) == 34);
+        REQUIRE(out == "7\n12\n");
+        // "12 " came in one piece, "34" had to be waited for after printing 12
+        REQUIRE(trickled.printed == 5);
+    }
+
+    SECTION("Files, descriptors and clones")
+    {
+        uint8_t program[] = {
+            OP_READ, R0,
+            OP_HALT};
+        char path[] = "/tmp/vm_input_XXXXXX";
+        const int fd = mkstemp(path);
+        REQUIRE(fd >= 0);
+        REQUIRE(write(fd, "1 2 3 4", 7) == 7);
+
+        VM vm(program, sizeof(program));
+        REQUIRE(vm.mapInput(path));
+        REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+        REQUIRE(vm.getRegister(R0) == 1);
+
+        // a clone of a VM reading from memory goes on from the same place
+        vm.setInput("5 6", 3);
+        vm.setRegister(IP, 0);
+        REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+        VM *clone = vm.clone();
+        clone->setRegister(IP, 0);
+        REQUIRE(clone->run() == ExecResult::VM_FINISHED);
+        REQUIRE(clone->getRegister(R0) == 6);
+        delete clone;
+
+        lseek(fd, 2, SEEK_SET);
+        vm.setInput(fd);
+        vm.setRegister(IP, 0);
+        REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+        REQUIRE(vm.getRegister(R0) == 2);
+
+        FILE *file = fopen(path, "r");
+        vm.setInput(file);
+        vm.setRegister(IP, 0);
+        REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+        REQUIRE(vm.getRegister(R0) == 1);
+        fclose(file);
+
+        close(fd);
+        unlink(path);
+        REQUIRE_FALSE(vm.mapInput(path));
+    }
+}
+
+TEST_CASE("Numbers are read the way scanf does")
+{
+    // reads and prints values until the input runs out
+    uint8_t program[] = {
+        OP_READF, R0,
+        OP_PRINT, R0, 1,
+        OP_INC, R1,
+        OP_JB, R1, R2, 0, 0,
+        OP_HALT};
+
+    std::mt19937 random(42);
+    std::vector<std::string> words = {"0", "-0", "+0.0", "1", "1.5", ".5", "5.", "1e3", "1E-3", "2.5e+2",
+                                      "3.4028235e38", "3.4028236e38", "1e39", "1.4e-45", "7e-46", "1e-50",
+                                      "0.000000000000000000000000000000000000000000001401298464324817",
+                                      "16777217", "16777216.5", "1234567.5", "0.1", "9999999", "99999999",
+                                      "inf", "-Infinity", "NaN", "-nan", "000123.4500"};
+    for (int i = 0; i < 20000; i++)
+    {
+        char text[64];
+        const uint32_t bits = random();
+        float f;
+        memcpy(&f, &bits, 4);
+        if (f != f)
+            continue;
+        // shortest round trips, halfway points, and long runs of digits
+        switch (i % 4)
+        {
+        case 0:
+            snprintf(text, sizeof(text), "%.9g", f);
+            break;
+        case 1:
+            snprintf(text, sizeof(text), "%.17g", (double)f + (double)f / 16777216);
+            break;
+        case 2:
+            snprintf(text, sizeof(text), "%.3f", (double)(random() % 2000000) / 7);
+            break;
+        default:
+            snprintf(text, sizeof(text), "%u.%u%ue%d", random(), random(), random(), (int)(random() % 90) - 60);
+        }
+        words.push_back(text);
+    }
+
+    std::string input, expected;
+    for (size_t i = 0; i < words.size(); i++)
+    {
+        float f;
+        REQUIRE(sscanf(words[i].c_str(), "%f", &f) == 1);
+        uint32_t bits;
+        memcpy(&bits, &f, 4);
+        input += words[i] + (i % 3 == 0 ? "\n" : " \t");
+        expected += std::to_string(bits) + "\n";
+    }
+
+    for (DispatchMode mode : {VM_DISPATCH_SWITCH, VM_DISPATCH_DECODED})
+    {
+        std::string out;
+        Trickle trickled = {input, 0, nullptr, 0};
+        VM vm(program, sizeof(program));
+        vm.setDispatch(mode);
+        vm.setInput(trickle, &trickled);
+        vm.setOutput(&out);
+        vm.setRegister(R2, words.size());
+        REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+        REQUIRE(out == expected);
+    }
+
+    // integers wrap around like they do with %u and %d
+    program[0] = OP_READ;
+    input = "0 -1 +17 4294967295 4294967296 -2147483648 99999999999 007";
+    expected = "0\n4294967295\n17\n4294967295\n0\n2147483648\n1215752191\n7\n";
+    std::string out;
+    VM vm(program, sizeof(program));
+    vm.setInput(input.data(), input.size());
+    vm.setOutput(&out);
+    vm.setRegister(R2, 8);
+    REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+    REQUIRE(out == expected);
+}
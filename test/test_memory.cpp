@@ -33,6 +33,21 @@ TEST_CASE("OP_STOR")
         REQUIRE(actual == 0);
         REQUIRE(memory[9] == 0xFF);
     }
+
+    SECTION("Read through peek()")
+    {
+        vm.setRegister(R0, _U32_GARBAGE);
+        REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+        memcpy(&actual, vm.peek(5), 4);
+        REQUIRE(*vm.peek() == OP_STOR);
+        REQUIRE(actual == _U32_GARBAGE);
+
+        vm.reset();
+        vm.setRegister(R0, 0);
+        REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+        memcpy(&actual, vm.peek(5), 4);
+        REQUIRE(actual == 0);
+    }
 }
 
 TEST_CASE("OP_STOR_P")
@@ -509,3 +524,46 @@ TEST_CASE("OP_MEMCPY_P")
         REQUIRE(memory[13] == 0xFF);
     }
 }
+
+TEST_CASE("Pointers past 64 KiB")
+{
+    uint8_t program[] = {
+        OP_STOR_P, R1, R0,
+        OP_LOADB_P, R2, R1,
+        OP_MEMCPY_P, R3, R1, R4,
+        OP_HALT};
+    VM vm(program, sizeof(program), 0x20000);
+
+    SECTION("Store, load and copy")
+    {
+        vm.setRegister(R0, _U32_GARBAGE);
+        vm.setRegister(R1, 0x18000);
+        vm.setRegister(R3, 0x1FFF0);
+        vm.setRegister(R4, 4);
+        REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+
+        uint32_t actual = 0;
+        memcpy(&actual, vm.memory(0x18000), 4);
+        REQUIRE(actual == _U32_GARBAGE);
+        memcpy(&actual, vm.memory(0x1FFF0), 4);
+        REQUIRE(actual == _U32_GARBAGE);
+        REQUIRE(vm.getRegister(R2) == (_NTH_BYTE(_U32_GARBAGE, 0)));
+        // where a 16-bit pointer would have wrapped to
+        REQUIRE(*vm.memory(0x8000) == 0);
+    }
+
+    SECTION("Pointers don't wrap around")
+    {
+        vm.reset();
+        vm.setRegister(R1, 0x1008000);
+        REQUIRE(vm.run() == ExecResult::VM_ERR_INVALID_ADDRESS);
+        REQUIRE(*vm.memory(0x8000) == 0);
+    }
+
+    SECTION("Overflowing the address space")
+    {
+        vm.reset();
+        vm.setRegister(R1, 0xFFFFFFFE);
+        REQUIRE(vm.run() == ExecResult::VM_ERR_INVALID_ADDRESS);
+    }
+}
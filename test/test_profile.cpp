@@ -0,0 +1,169 @@
+#include <string>
+#include "test.h"
+#include "../src/basicvm.h"
+
+// counts R0 up to 100
+static uint8_t loop[] = {
+    OP_LCONSB, R1, 100,
+    OP_INC, R0,
+    OP_JNE, R0, R1, 3, 0,
+    OP_HALT};
+
+struct Profiled : VMConfig
+{
+    static const bool profile = true;
+};
+
+static uint64_t totalCount(const Profile &profile)
+{
+    uint64_t count = 0;
+    for (uint32_t instr = 0; instr < INSTRUCTION_COUNT; instr++)
+        count += profile.entries[instr].count;
+    return count;
+}
+
+static void requireLoopCounts(const Profile &profile, uint64_t times = 1)
+{
+    REQUIRE(profile.entries[OP_LCONSB].count == times);
+    REQUIRE(profile.entries[OP_INC].count == 100 * times);
+    REQUIRE(profile.entries[OP_JNE].count == 100 * times);
+    REQUIRE(profile.entries[OP_HALT].count == times);
+    REQUIRE(totalCount(profile) == 202 * times);
+}
+
+TEST_CASE("Profiling")
+{
+    Profile profile;
+
+    SECTION("Every instruction is counted, whatever the dispatch mode")
+    {
+        const DispatchMode modes[] = {VM_DISPATCH_SWITCH, VM_DISPATCH_THREADED, VM_DISPATCH_DECODED, VM_DISPATCH_JIT, VM_DISPATCH_TAILCALL, VM_DISPATCH_STENCIL};
+        for (DispatchMode mode : modes)
+        {
+            INFO("dispatch mode " << (int)mode);
+            profile.clear();
+            VM vm(loop, sizeof(loop));
+            vm.setDispatch(mode);
+            vm.setProfile(&profile);
+            REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+            REQUIRE(vm.getRegister(R0) == 100);
+            requireLoopCounts(profile);
+        }
+    }
+
+    SECTION("Histograms add up to the counts")
+    {
+        VM vm(loop, sizeof(loop));
+        vm.setProfile(&profile);
+        vm.run();
+        for (uint32_t instr = 0; instr < INSTRUCTION_COUNT; instr++)
+        {
+            uint64_t count = 0;
+            for (uint32_t bucket = 0; bucket < VM_PROFILE_BUCKETS; bucket++)
+                count += profile.entries[instr].histogram[bucket];
+            REQUIRE(count == profile.entries[instr].count);
+        }
+    }
+
+    SECTION("Pauses and runs without a profile")
+    {
+        VM vm(loop, sizeof(loop));
+        vm.setProfile(&profile);
+        uint32_t executed = 0;
+        ExecResult res;
+        while ((res = vm.run(7)) == ExecResult::VM_PAUSED)
+        {
+            executed += vm.instructionsExecuted();
+            REQUIRE(totalCount(profile) == executed);
+        }
+        REQUIRE(res == ExecResult::VM_FINISHED);
+        requireLoopCounts(profile);
+
+        vm.reset();
+        vm.setProfile(nullptr);
+        REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+        requireLoopCounts(profile);
+    }
+
+    SECTION("Code that writes to itself")
+    {
+        // the inc is patched into a dec, after which the checked interpreter
+        // takes over
+        uint8_t program[] = {
+            OP_INC, R0,
+            OP_LCONSB, R1, OP_DEC,
+            OP_LCONSB, R2, 0,
+            OP_STORB_P, R2, R1,
+            OP_JNZ, R0, 0, 0,
+            OP_HALT};
+        VM vm(program, sizeof(program));
+        vm.setProfile(&profile);
+        REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+        REQUIRE(profile.entries[OP_INC].count == 1);
+        REQUIRE(profile.entries[OP_DEC].count == 1);
+        REQUIRE(profile.entries[OP_LCONSB].count == 4);
+        REQUIRE(profile.entries[OP_STORB_P].count == 2);
+        REQUIRE(profile.entries[OP_JNZ].count == 2);
+        REQUIRE(profile.entries[OP_HALT].count == 1);
+        // a halt isn't counted as executed
+        REQUIRE(totalCount(profile) == vm.instructionsExecuted() + 1);
+    }
+
+    SECTION("Interrupts that wait")
+    {
+        uint8_t program[] = {
+            OP_INT, 1,
+            OP_INT, 1,
+            OP_HALT};
+        VM vm(program, sizeof(program));
+        vm.onInterrupt(1, [](VM *, uint8_t, void *) { return VM_INT_WAIT; });
+        vm.setProfile(&profile);
+        REQUIRE(vm.run() == ExecResult::VM_WAITING);
+        REQUIRE(profile.entries[OP_INT].count == 1);
+        REQUIRE(vm.run() == ExecResult::VM_WAITING);
+        REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+        REQUIRE(profile.entries[OP_INT].count == 2);
+        REQUIRE(profile.entries[OP_HALT].count == 1);
+    }
+
+    SECTION("BasicVM")
+    {
+        BasicVM<Profiled> vm(loop, sizeof(loop));
+        REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+        REQUIRE(totalCount(profile) == 0);
+
+        vm.reset();
+        vm.setProfile(&profile);
+        REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+        requireLoopCounts(profile);
+    }
+
+    SECTION("Report")
+    {
+        VM vm(loop, sizeof(loop));
+        vm.setProfile(&profile);
+        vm.run();
+
+        FILE *file = tmpfile();
+        profile.report(file);
+        rewind(file);
+        std::string report;
+        char line[256];
+        uint32_t lines = 0;
+        while (fgets(line, sizeof(line), file) != nullptr)
+        {
+            report += line;
+            lines++;
+        }
+        fclose(file);
+
+        // a blank line and two of headings, then a line per instruction
+        REQUIRE(lines == 3 + 4);
+        REQUIRE(report.find("202 instructions") != std::string::npos);
+        REQUIRE(report.find("\nlconsb ") != std::string::npos);
+        REQUIRE(report.find("\ninc ") != std::string::npos);
+        REQUIRE(report.find("\njne ") != std::string::npos);
+        REQUIRE(report.find("\nhalt ") != std::string::npos);
+        REQUIRE(report.find("\nnop ") == std::string::npos);
+    }
+}
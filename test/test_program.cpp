@@ -0,0 +1,655 @@
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <unistd.h>
+#include "test.h"
+
+static const DispatchMode modes[] = {VM_DISPATCH_SWITCH, VM_DISPATCH_THREADED, VM_DISPATCH_DECODED,
+                                     VM_DISPATCH_JIT, VM_DISPATCH_TAILCALL, VM_DISPATCH_STENCIL};
+
+TEST_CASE("VMs sharing a program")
+{
+    // counts its runs in the word at 12
+    uint8_t code[] = {
+        OP_LOAD, R0, 12, 0,
+        OP_INC, R0,
+        OP_STOR, 12, 0, R0,
+        OP_HALT,
+        OP_NOP,
+        0, 0, 0, 0};
+    Program *program = new Program(code, sizeof(code));
+
+    SECTION("Each VM has its own data")
+    {
+        for (DispatchMode mode : modes)
+        {
+            VM first(program);
+            VM second(program);
+            first.setDispatch(mode);
+            second.setDispatch(mode);
+
+            REQUIRE(first.run() == ExecResult::VM_FINISHED);
+            first.reset();
+            REQUIRE(first.run() == ExecResult::VM_FINISHED);
+            REQUIRE(second.run() == ExecResult::VM_FINISHED);
+            REQUIRE(first.getRegister(R0) == 2);
+            REQUIRE(second.getRegister(R0) == 1);
+            REQUIRE(first.memory(12)[0] == 2);
+            REQUIRE(second.memory(12)[0] == 1);
+        }
+        REQUIRE(program->code()[12] == 0);
+    }
+
+    SECTION("Stack and registers")
+    {
+        VM first(program);
+        VM second(program);
+        first.stackPush(0xABCD);
+        first.setRegister(R3, 5);
+
+        REQUIRE(first.stackCount() == 4);
+        REQUIRE(second.stackCount() == 0);
+        REQUIRE(second.getRegister(R3) == 0);
+        REQUIRE(first.stackPop() == 0xABCD);
+    }
+
+    SECTION("Outlives its creator's reference")
+    {
+        VM *vm = new VM(program);
+        program->release();
+        program = nullptr;
+        REQUIRE(vm->verify());
+        REQUIRE(vm->run() == ExecResult::VM_FINISHED);
+        REQUIRE(vm->getRegister(R0) == 1);
+        delete vm;
+    }
+
+    if (program != nullptr)
+        program->release();
+}
+
+TEST_CASE("Code changes stay in their VM")
+{
+    uint8_t code[] = {
+        OP_LCONSB, R1, 9,
+        OP_STORB, 10, 0, R1,
+        OP_NOP,
+        OP_LCONSB, R0, 1,
+        OP_HALT};
+    Program *program = new Program(code, sizeof(code));
+
+    SECTION("Self-modifying code")
+    {
+        for (DispatchMode mode : modes)
+        {
+            VM first(program);
+            VM second(program);
+            first.setDispatch(mode);
+            second.setDispatch(mode);
+
+            REQUIRE(first.run() == ExecResult::VM_FINISHED);
+            REQUIRE(first.getRegister(R0) == 9);
+            REQUIRE(second.memory(10)[0] == 1);
+            REQUIRE(second.run() == ExecResult::VM_FINISHED);
+            REQUIRE(second.getRegister(R0) == 9);
+        }
+    }
+
+    SECTION("Writes through memory()")
+    {
+        for (DispatchMode mode : modes)
+        {
+            VM first(program);
+            VM second(program);
+            first.setDispatch(mode);
+            second.setDispatch(mode);
+
+            REQUIRE(second.run() == ExecResult::VM_FINISHED);
+            first.memory(2)[0] = 4;
+            REQUIRE(first.run() == ExecResult::VM_FINISHED);
+            REQUIRE(first.getRegister(R0) == 4);
+            second.reset();
+            REQUIRE(second.run() == ExecResult::VM_FINISHED);
+            REQUIRE(second.getRegister(R0) == 9);
+        }
+    }
+
+    REQUIRE(program->code()[2] == 9);
+    REQUIRE(program->code()[10] == 1);
+    program->release();
+}
+
+TEST_CASE("Code only reached through indirect jumps")
+{
+    // the loop at 9 patches its own first instruction, and is only ever
+    // jumped to through a register
+    uint8_t code[] = {
+        OP_LCONSB, R4, 2,
+        OP_LCONSB, R2, 9,
+        OP_JR, R2,
+        OP_HALT,
+        OP_LCONSB, R0, 1,
+        OP_LCONSB, R1, 5,
+        OP_STORB, 11, 0, R1,
+        OP_INC, R3,
+        OP_JB, R3, R4, 9, 0,
+        OP_JMP, 8, 0};
+    Program *program = new Program(code, sizeof(code));
+
+    for (DispatchMode mode : modes)
+    {
+        VM first(program);
+        VM second(program);
+        first.setDispatch(mode);
+        second.setDispatch(mode);
+
+        REQUIRE(first.run() == ExecResult::VM_FINISHED);
+        REQUIRE(first.getRegister(R0) == 5);
+        REQUIRE(first.getRegister(R3) == 2);
+        REQUIRE(second.peek(11)[0] == 1);
+        REQUIRE(second.run() == ExecResult::VM_FINISHED);
+        REQUIRE(second.getRegister(R0) == 5);
+        first.restore();
+        REQUIRE(first.run() == ExecResult::VM_FINISHED);
+        REQUIRE(first.getRegister(R0) == 5);
+    }
+
+    REQUIRE(program->code()[11] == 1);
+    program->release();
+}
+
+TEST_CASE("Programs larger than a page")
+{
+    // runs through 9000 bytes of nops and then overwrites one it went past
+    std::vector<uint8_t> code(9008, OP_NOP);
+    code[0] = OP_LCONSB;
+    code[1] = R0;
+    code[2] = 7;
+    code[9000] = OP_STORB;
+    code[9001] = 100;
+    code[9002] = 0;
+    code[9003] = R0;
+    code[9004] = OP_HALT;
+    Program *program = new Program(code.data(), code.size(), 64);
+    REQUIRE(program->progLen() == 9008);
+    REQUIRE(program->stackSize() == 64);
+
+    for (DispatchMode mode : modes)
+    {
+        VM first(program);
+        VM second(program);
+        first.setDispatch(mode);
+        second.setDispatch(mode);
+
+        REQUIRE(first.run() == ExecResult::VM_FINISHED);
+        REQUIRE(first.instructionsExecuted() == 8999);
+        REQUIRE(first.memory(100)[0] == 7);
+        REQUIRE(second.memory(100)[0] == OP_NOP);
+        REQUIRE(second.memory(9004)[0] == OP_HALT);
+
+        second.stackPush(0x12345678);
+        REQUIRE(second.memory(9008 + 60)[0] == 0x78);
+        REQUIRE(first.memory(9008 + 60)[0] == 0);
+        REQUIRE(second.run() == ExecResult::VM_FINISHED);
+        REQUIRE(second.memory(100)[0] == 7);
+    }
+    REQUIRE(program->code()[100] == OP_NOP);
+    program->release();
+}
+
+TEST_CASE("Restoring a VM")
+{
+    // patches its own lconsb, stores past a page and pushes onto a big stack
+    std::vector<uint8_t> code(5000, OP_NOP);
+    const uint8_t start[] = {
+        OP_LCONSB, R1, 9,
+        OP_STORB, 10, 0, R1,
+        OP_NOP,
+        OP_LCONSB, R0, 1,
+        OP_STORB, 0x80, 0x13, R0, // 5000 - 8
+        OP_PUSH, R0,
+        OP_HALT};
+    memcpy(code.data(), start, sizeof(start));
+    Program *program = new Program(code.data(), code.size(), 3 * 4096);
+
+    for (DispatchMode mode : modes)
+    {
+        VM vm(program);
+        vm.setDispatch(mode);
+        for (int i = 0; i < 3; i++)
+        {
+            REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+            REQUIRE(vm.getRegister(R0) == 9);
+            REQUIRE(vm.memory(4992)[0] == 9);
+            REQUIRE(vm.stackCount() == 4);
+
+            vm.reset();
+            REQUIRE(vm.stackCount() == 0);
+            REQUIRE(vm.memory(5000 + 3 * 4096 - 4)[0] == 0);
+            REQUIRE(vm.memory(10)[0] == 9);
+
+            vm.restore();
+            REQUIRE(vm.getRegister(R0) == 0);
+            REQUIRE(vm.stackCount() == 0);
+            REQUIRE(memcmp(vm.memory(), code.data(), code.size()) == 0);
+            REQUIRE(vm.instructionsExecuted() == 0);
+        }
+    }
+    program->release();
+}
+
+TEST_CASE("VM pools")
+{
+    uint8_t code[] = {
+        OP_LOAD, R0, 12, 0,
+        OP_INC, R0,
+        OP_STOR, 12, 0, R0,
+        OP_HALT,
+        OP_NOP,
+        0, 0, 0, 0};
+    Program *program = new Program(code, sizeof(code));
+    VMPool pool(program, 2);
+    program->release();
+    REQUIRE(pool.available() == 2);
+
+    SECTION("Jobs start from the loaded program")
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            VM *vm = pool.acquire();
+            REQUIRE(pool.available() == 1);
+            vm->stackPush(5);
+            vm->setRegister(R0, 100);
+            vm->stackPop();
+            REQUIRE(vm->run() == ExecResult::VM_FINISHED);
+            REQUIRE(vm->getRegister(R0) == 1);
+            REQUIRE(vm->memory(12)[0] == 1);
+            vm->stackPush(7);
+            pool.release(vm);
+        }
+    }
+
+    SECTION("Grows when all are in use")
+    {
+        VM *vms[3];
+        for (VM *&vm : vms)
+            vm = pool.acquire();
+        REQUIRE(pool.available() == 0);
+        for (VM *vm : vms)
+        {
+            REQUIRE(vm->stackCount() == 0);
+            REQUIRE(vm->run() == ExecResult::VM_FINISHED);
+            pool.release(vm);
+        }
+        REQUIRE(pool.available() == 3);
+    }
+}
+
+TEST_CASE("Snapshots")
+{
+    // three instructions of setup, then the part that uses it
+    uint8_t code[] = {
+        OP_LCONSB, R0, 42,
+        OP_STORB, 20, 0, R0,
+        OP_PUSH, R0,
+        OP_POP, R1,
+        OP_LOADB, R2, 20, 0,
+        OP_HALT,
+        OP_NOP, OP_NOP, OP_NOP, OP_NOP,
+        0};
+
+    // small memory is copied, a stack over a page is mapped from the snapshot
+    const uint32_t stackSizes[] = {64, 3 * 4096};
+    for (uint32_t stackSize : stackSizes)
+    {
+        VM vm(code, sizeof(code), stackSize);
+        REQUIRE(vm.run(3) == ExecResult::VM_PAUSED);
+        Program *snapshot = vm.snapshot();
+        REQUIRE(snapshot->progLen() == sizeof(code));
+        REQUIRE(snapshot->stackSize() == stackSize);
+
+        SECTION("VMs start where it was taken")
+        {
+            for (DispatchMode mode : modes)
+            {
+                VM resumed(snapshot);
+                resumed.setDispatch(mode);
+                REQUIRE(resumed.getRegister(IP) == 9);
+                REQUIRE(resumed.stackCount() == 4);
+                REQUIRE(resumed.run() == ExecResult::VM_FINISHED);
+                REQUIRE(resumed.instructionsExecuted() == 2);
+                REQUIRE(resumed.getRegister(R1) == 42);
+                REQUIRE(resumed.getRegister(R2) == 42);
+                REQUIRE(resumed.stackCount() == 0);
+
+                resumed.memory(20)[0] = 7;
+                resumed.restore();
+                REQUIRE(resumed.getRegister(IP) == 9);
+                REQUIRE(resumed.stackCount() == 4);
+                REQUIRE(resumed.memory(20)[0] == 42);
+
+                resumed.reset();
+                REQUIRE(resumed.getRegister(IP) == 0);
+                REQUIRE(resumed.stackCount() == 0);
+                REQUIRE(resumed.memory(sizeof(code) + stackSize - 4)[0] == 0);
+                REQUIRE(resumed.memory(20)[0] == 42);
+            }
+            REQUIRE(vm.getRegister(IP) == 9);
+        }
+
+        SECTION("Clones")
+        {
+            vm.setDispatch(VM_DISPATCH_DECODED);
+            VM *clone = vm.clone();
+            REQUIRE(clone->dispatch() == VM_DISPATCH_DECODED);
+            REQUIRE(clone->run() == ExecResult::VM_FINISHED);
+            REQUIRE(clone->getRegister(R2) == 42);
+            REQUIRE(vm.stackCount() == 4);
+            REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+            REQUIRE(vm.getRegister(R1) == 42);
+            delete clone;
+        }
+
+        SECTION("Pools of them")
+        {
+            VMPool pool(snapshot, 1);
+            for (int i = 0; i < 3; i++)
+            {
+                VM *pooled = pool.acquire();
+                REQUIRE(pooled->run() == ExecResult::VM_FINISHED);
+                REQUIRE(pooled->getRegister(R1) == 42);
+                pool.release(pooled);
+            }
+        }
+
+        snapshot->release();
+    }
+}
+
+static uint32_t testCrc32(const uint8_t *data, size_t len)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < len; i++)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+            crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+    }
+    return ~crc;
+}
+
+static std::vector<uint8_t> makeImage(const std::vector<uint8_t> &code, const std::vector<uint8_t> &rodata,
+                                      uint32_t bssSize, uint32_t entry, uint32_t stackSize,
+                                      uint32_t headerSize = sizeof(ImageHeader))
+{
+    ImageHeader header;
+    memcpy(header.magic, VM_IMAGE_MAGIC, 4);
+    header.version = VM_IMAGE_VERSION;
+    header.headerSize = headerSize;
+    header.entry = entry;
+    header.stackSize = stackSize;
+    header.codeSize = code.size();
+    header.rodataSize = rodata.size();
+    header.bssSize = bssSize;
+    header.checksum = 0;
+
+    std::vector<uint8_t> image((uint8_t *)&header, (uint8_t *)&header + sizeof(header));
+    image.resize(headerSize);
+    image.insert(image.end(), code.begin(), code.end());
+    image.insert(image.end(), rodata.begin(), rodata.end());
+    const uint32_t checksum = testCrc32(image.data(), image.size());
+    memcpy(&image[offsetof(ImageHeader, checksum)], &checksum, 4);
+    return image;
+}
+
+TEST_CASE("Loading images")
+{
+    // adds the word in rodata to the one in bss, starting after a halt
+    const std::vector<uint8_t> code = {
+        OP_HALT,
+        OP_LOAD, R0, 18, 0,
+        OP_LOAD, R1, 28, 0,
+        OP_ADD, R1, R1, R0,
+        OP_STOR, 28, 0, R1,
+        OP_HALT};
+    const std::vector<uint8_t> rodata = {5, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    ImageError error;
+
+    SECTION("Sections and entry point")
+    {
+        std::vector<uint8_t> image = makeImage(code, rodata, 4096, 1, 1024);
+        Program *program = Program::load(image.data(), image.size(), 64, &error);
+        REQUIRE(program != nullptr);
+        REQUIRE(error == IMAGE_OK);
+        REQUIRE(program->progLen() == code.size() + rodata.size() + 4096);
+        REQUIRE(program->codeLen() == code.size());
+        REQUIRE(program->stackSize() == 1024);
+        REQUIRE(program->entry() == 1);
+
+        for (DispatchMode mode : modes)
+        {
+            VM vm(program);
+            vm.setDispatch(mode);
+            REQUIRE(vm.verify());
+            REQUIRE(vm.getRegister(IP) == 1);
+            REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+            REQUIRE(vm.getRegister(R1) == 5);
+            vm.setRegister(IP, 1);
+            REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+            REQUIRE(vm.memory(28)[0] == 10);
+            REQUIRE(vm.memory(code.size() + rodata.size() + 4095)[0] == 0);
+            vm.restore();
+            REQUIRE(vm.getRegister(IP) == 1);
+            REQUIRE(vm.memory(28)[0] == 0);
+
+            // reset() keeps memory but also starts from the entry point
+            REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+            vm.reset();
+            REQUIRE(vm.getRegister(IP) == 1);
+            REQUIRE(vm.getRegister(R1) == 0);
+            REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+            REQUIRE(vm.getRegister(R1) == 10);
+        }
+        program->release();
+
+        // the host may give it a bigger stack
+        program = Program::load(image.data(), image.size(), 2048, &error);
+        REQUIRE(program->stackSize() == 2048);
+        program->release();
+    }
+
+    SECTION("Data sections are only memory")
+    {
+        // a hot loop storing into a large bss, which nothing decodes or compiles
+        const std::vector<uint8_t> loop = {
+            OP_LCONS, R1, 0xb8, 0x0b, 0x00, 0x00,
+            OP_STOR, 18, 0, R0,
+            OP_INC, R0,
+            OP_JB, R0, R1, 6, 0,
+            OP_HALT};
+        std::vector<uint8_t> image = makeImage(loop, {}, 64 << 20, 0, 0);
+        Program *program = Program::load(image.data(), image.size(), 64, &error);
+        REQUIRE(program != nullptr);
+        REQUIRE(program->progLen() == loop.size() + (64 << 20));
+        REQUIRE(program->codeLen() == loop.size());
+
+        for (DispatchMode mode : modes)
+        {
+            VM vm(program);
+            vm.setDispatch(mode);
+            REQUIRE(vm.verify());
+            REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+            REQUIRE(vm.getRegister(R0) == 3000);
+            uint32_t count;
+            memcpy(&count, vm.peek(18), sizeof(count));
+            REQUIRE(count == 2999);
+        }
+        program->release();
+    }
+
+    SECTION("Plain program bytes")
+    {
+        Program *program = Program::load(code.data(), code.size(), 64, &error);
+        REQUIRE(program != nullptr);
+        REQUIRE(program->progLen() == code.size());
+        REQUIRE(program->codeLen() == code.size());
+        REQUIRE(program->entry() == 0);
+        REQUIRE(memcmp(program->code(), code.data(), code.size()) == 0);
+        program->release();
+    }
+
+    SECTION("Invalid images")
+    {
+        std::vector<uint8_t> image = makeImage(code, rodata, 0, 1, 0);
+        std::vector<uint8_t> corrupted = image;
+        corrupted.back() ^= 1;
+        REQUIRE(Program::load(corrupted.data(), corrupted.size(), 64, &error) == nullptr);
+        REQUIRE(error == IMAGE_ERR_CHECKSUM);
+
+        REQUIRE(Program::load(image.data(), image.size() - 1, 64, &error) == nullptr);
+        REQUIRE(error == IMAGE_ERR_TRUNCATED);
+        REQUIRE(Program::load(image.data(), 10, 64, &error) == nullptr);
+        REQUIRE(error == IMAGE_ERR_TRUNCATED);
+
+        image.push_back(0);
+        REQUIRE(Program::load(image.data(), image.size(), 64, &error) == nullptr);
+        REQUIRE(error == IMAGE_ERR_SIZE);
+
+        image = makeImage(code, rodata, 0, code.size(), 0);
+        REQUIRE(Program::load(image.data(), image.size(), 64, &error) == nullptr);
+        REQUIRE(error == IMAGE_ERR_SIZE);
+
+        image = makeImage(code, rodata, UINT32_MAX - 20, 0, 0);
+        REQUIRE(Program::load(image.data(), image.size(), 64, &error) == nullptr);
+        REQUIRE(error == IMAGE_ERR_SIZE);
+
+        image = makeImage(code, rodata, 0, 0, 0);
+        image[4] = VM_IMAGE_VERSION + 1;
+        REQUIRE(Program::load(image.data(), image.size(), 64, &error) == nullptr);
+        REQUIRE(error == IMAGE_ERR_VERSION);
+    }
+}
+
+static void writeFile(const std::string &path, const std::vector<uint8_t> &data)
+{
+    FILE *f = fopen(path.c_str(), "wb");
+    REQUIRE(f != nullptr);
+    REQUIRE(fwrite(data.data(), data.size(), 1, f) == 1);
+    fclose(f);
+}
+
+TEST_CASE("Mapping image files")
+{
+    // the same program as above, with its data a page in
+    std::vector<uint8_t> code = {
+        OP_HALT,
+        OP_LOAD, R0, 0x12, 0x20,
+        OP_LOAD, R1, 0x1C, 0x20,
+        OP_ADD, R1, R1, R0,
+        OP_STOR, 0x1C, 0x20, R1,
+        OP_HALT};
+    code.resize(0x2012, OP_HALT);
+    const std::vector<uint8_t> rodata = {5, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    const std::string path = "/tmp/risvm-test-" + std::to_string(getpid()) + ".bin";
+    ImageError error;
+
+    // at a page boundary of the file and not, with the stack and with
+    // zeroed data after the image
+    for (uint32_t headerSize : {4096u, (uint32_t)sizeof(ImageHeader)})
+    {
+        std::vector<uint8_t> image = makeImage(code, rodata, 8192, 1, 64, headerSize);
+        writeFile(path, image);
+        Program *program = Program::map(path.c_str(), 64, &error);
+        REQUIRE(program != nullptr);
+        REQUIRE(error == IMAGE_OK);
+        REQUIRE(program->entry() == 1);
+        REQUIRE(program->progLen() == code.size() + rodata.size() + 8192);
+        REQUIRE(memcmp(program->code(), code.data(), code.size()) == 0);
+        REQUIRE(program->code()[program->progLen() - 1] == 0);
+
+        for (DispatchMode mode : modes)
+        {
+            VM vm(program);
+            vm.setDispatch(mode);
+            REQUIRE(vm.verify());
+            REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+            vm.setRegister(IP, 1);
+            REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+            REQUIRE(vm.memory(0x201C)[0] == 10);
+            vm.memory(0)[0] = OP_NOP;
+            vm.restore();
+            REQUIRE(vm.memory(0)[0] == OP_HALT);
+            REQUIRE(vm.memory(0x201C)[0] == 0);
+        }
+        program->release();
+
+        // what VMs write never reaches the file
+        std::vector<uint8_t> read(image.size());
+        FILE *f = fopen(path.c_str(), "rb");
+        REQUIRE(fread(read.data(), read.size(), 1, f) == 1);
+        fclose(f);
+        REQUIRE(read == image);
+    }
+
+    SECTION("VMs straight from a file")
+    {
+        writeFile(path, code);
+        VM *vm = VM::fromFile(path.c_str(), 64, &error);
+        REQUIRE(vm != nullptr);
+        REQUIRE(vm->getRegister(IP) == 0);
+        REQUIRE(vm->run() == ExecResult::VM_FINISHED);
+        delete vm;
+
+        std::vector<uint8_t> corrupted = makeImage(code, rodata, 0, 1, 0, 4096);
+        corrupted.back() ^= 1;
+        writeFile(path, corrupted);
+        REQUIRE(VM::fromFile(path.c_str(), 64, &error) == nullptr);
+        REQUIRE(error == IMAGE_ERR_CHECKSUM);
+    }
+
+    SECTION("Writing over the file")
+    {
+        // the code and its first page are copied, the data pages after them
+        // are mapped from the file
+        const std::vector<uint8_t> loads = {
+            OP_LOAD, R0, 10, 0,
+            OP_LOAD, R1, 0x00, 0x20,
+            OP_HALT,
+            0};
+        std::vector<uint8_t> data(3 * 4096, 0);
+        data[0] = 7;
+        data[0x2000 - loads.size()] = 9;
+        std::vector<uint8_t> image = makeImage(loads, data, 0, 0, 64, 4096);
+        writeFile(path, image);
+        Program *program = Program::map(path.c_str(), 64, &error);
+        REQUIRE(program != nullptr);
+        REQUIRE(program->codeLen() == loads.size());
+
+        std::vector<uint8_t> changed = image;
+        changed[4096] = OP_HALT;
+        writeFile(path, changed);
+        for (DispatchMode mode : modes)
+        {
+            VM vm(program);
+            vm.setDispatch(mode);
+            REQUIRE(vm.verify());
+            REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+            REQUIRE(vm.getRegister(R0) == 7);
+            REQUIRE(vm.getRegister(R1) == 9);
+        }
+        REQUIRE(program->code()[0] == OP_LOAD);
+        program->release();
+    }
+
+    SECTION("Missing and empty files")
+    {
+        writeFile(path, {0});
+        REQUIRE(truncate(path.c_str(), 0) == 0);
+        REQUIRE(Program::map(path.c_str(), 64, &error) == nullptr);
+        REQUIRE(error == IMAGE_ERR_FILE);
+        remove(path.c_str());
+        REQUIRE(Program::map(path.c_str(), 64, &error) == nullptr);
+        REQUIRE(error == IMAGE_ERR_FILE);
+    }
+    remove(path.c_str());
+}
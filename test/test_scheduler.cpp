@@ -0,0 +1,128 @@
+#include <vector>
+#include "test.h"
+
+// counts r0 up to r1
+static uint8_t countingCode[] = {
+    OP_INC, R0,
+    OP_JB, R0, R1, 0, 0,
+    OP_HALT};
+
+struct Finished
+{
+    std::atomic<uint32_t> calls;
+    ExecResult result;
+};
+
+static void onDone(VM *vm, ExecResult result, void *context)
+{
+    Finished *finished = (Finished *)context;
+    finished->result = result;
+    finished->calls++;
+}
+
+TEST_CASE("Scheduling VMs")
+{
+    Program *program = new Program(countingCode, sizeof(countingCode));
+    const uint32_t count = 64;
+    std::vector<VM *> vms;
+    std::vector<Finished> finished(count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        vms.push_back(new VM(program));
+        vms[i]->setRegister(R1, 1000 + i * 997);
+        finished[i].calls = 0;
+    }
+    program->release();
+
+    SECTION("Every VM runs to the end, taking turns")
+    {
+        Scheduler scheduler(4, 1000);
+        REQUIRE(scheduler.threads() == 4);
+        for (uint32_t i = 0; i < count; i++)
+            scheduler.submit(vms[i], onDone, &finished[i]);
+        scheduler.wait();
+        for (uint32_t i = 0; i < count; i++)
+        {
+            REQUIRE(finished[i].calls == 1);
+            REQUIRE(finished[i].result == ExecResult::VM_FINISHED);
+            REQUIRE(vms[i]->getRegister(R0) == 1000 + i * 997);
+        }
+
+        // and can be given more work after waiting
+        vms[0]->setRegister(IP, 0);
+        vms[0]->setRegister(R1, 5000);
+        scheduler.submit(vms[0], onDone, &finished[0]);
+        scheduler.wait();
+        REQUIRE(finished[0].calls == 2);
+        REQUIRE(vms[0]->getRegister(R0) == 5000);
+    }
+
+    SECTION("Errors are reported")
+    {
+        uint8_t bad[] = {OP_INC, R0, 0xFF};
+        VM vm(bad, sizeof(bad));
+        Scheduler scheduler(2, 1);
+        scheduler.submit(&vm, onDone, &finished[0]);
+        scheduler.submit(vms[1]);
+        scheduler.wait();
+        REQUIRE(finished[0].calls == 1);
+        REQUIRE(finished[0].result == ExecResult::VM_ERR_UNKNOWN_OPCODE);
+        REQUIRE(vms[1]->getRegister(R0) == 1000 + 997);
+    }
+
+    SECTION("Finishing runs everything submitted")
+    {
+        {
+            Scheduler scheduler(3, 500);
+            for (uint32_t i = 0; i < count; i++)
+                scheduler.submit(vms[i], onDone, &finished[i]);
+        }
+        for (uint32_t i = 0; i < count; i++)
+            REQUIRE(finished[i].calls == 1);
+    }
+
+    for (VM *vm : vms)
+        delete vm;
+}
+
+struct Chain
+{
+    Scheduler *scheduler;
+    std::vector<VM *> *vms;
+    std::atomic<uint32_t> next;
+};
+
+// starts the next VM from the thread that finished the last one
+static void onChainDone(VM *vm, ExecResult result, void *context)
+{
+    Chain *chain = (Chain *)context;
+    const uint32_t next = chain->next++;
+    if (next < chain->vms->size())
+        chain->scheduler->submit((*chain->vms)[next], onChainDone, chain);
+}
+
+TEST_CASE("Submitting from a finished VM")
+{
+    Program *program = new Program(countingCode, sizeof(countingCode));
+    std::vector<VM *> vms;
+    for (uint32_t i = 0; i < 16; i++)
+    {
+        vms.push_back(new VM(program));
+        vms[i]->setRegister(R1, 3000);
+    }
+    program->release();
+
+    Scheduler scheduler(4, 100);
+    Chain chain;
+    chain.scheduler = &scheduler;
+    chain.vms = &vms;
+    chain.next = 1;
+    scheduler.submit(vms[0], onChainDone, &chain);
+    scheduler.wait();
+    REQUIRE(chain.next == 17);
+    for (VM *vm : vms)
+    {
+        REQUIRE(vm->getRegister(R0) == 3000);
+        delete vm;
+    }
+}
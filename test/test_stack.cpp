@@ -143,4 +143,15 @@ TEST_CASE("OP_DUP")
         REQUIRE(vm.stackPop() == UINT32_MAX);
         REQUIRE(vm.stackPop() == UINT32_MAX);
     }
+
+    SECTION("Empty stack")
+    {
+        for (DispatchMode mode : {VM_DISPATCH_SWITCH, VM_DISPATCH_DECODED, VM_DISPATCH_TAILCALL})
+        {
+            vm.reset();
+            vm.setDispatch(mode);
+            REQUIRE(vm.run() == ExecResult::VM_ERR_STACK_UNDERFLOW);
+            REQUIRE(vm.stackCount() == 0);
+        }
+    }
 }
@@ -9,6 +9,14 @@ bool handleInterrupt(uint8_t code)
     return intContinue;
 }
 
+InterruptResult intResult;
+
+InterruptResult handleWaitingInterrupt(uint8_t code)
+{
+    intCode = code;
+    return intResult;
+}
+
 TEST_CASE("OP_INT")
 {
     SECTION("Code is correct")
@@ -58,6 +66,61 @@ TEST_CASE("OP_INT")
         REQUIRE(vm.getRegister(IP) == 1);
     }
 
+    SECTION("Can wait for the host")
+    {
+        // adds up what the host hands it for each int
+        uint8_t program[] = {
+            OP_INT, 7,
+            OP_ADD, R1, R1, R0,
+            OP_INC, R2,
+            OP_JB, R2, R3, 0, 0,
+            OP_HALT};
+        const DispatchMode modes[] = {VM_DISPATCH_SWITCH, VM_DISPATCH_THREADED, VM_DISPATCH_DECODED,
+                                      VM_DISPATCH_JIT, VM_DISPATCH_TAILCALL, VM_DISPATCH_STENCIL};
+        for (DispatchMode mode : modes)
+        {
+            VM vm(program, sizeof(program));
+            vm.setDispatch(mode);
+            vm.onInterrupt(handleWaitingInterrupt);
+            vm.setRegister(R3, 3000);
+            intResult = VM_INT_WAIT;
+            intCode = 0;
+
+            REQUIRE(vm.run() == ExecResult::VM_WAITING);
+            REQUIRE(intCode == 7);
+            REQUIRE(vm.getRegister(IP) == 2);
+            REQUIRE(vm.instructionsExecuted() == 1);
+
+            uint32_t waits = 1;
+            ExecResult res;
+            for (;;)
+            {
+                // pausing on the way doesn't change anything
+                vm.setRegister(R0, waits);
+                res = vm.run(waits % 7 == 0 ? 3 : 0);
+                if (res != ExecResult::VM_WAITING && res != ExecResult::VM_PAUSED)
+                    break;
+                if (res == ExecResult::VM_WAITING)
+                    waits++;
+            }
+            REQUIRE(res == ExecResult::VM_FINISHED);
+            REQUIRE(waits == 3000);
+            REQUIRE(vm.getRegister(R1) == 3000 * 3001 / 2);
+
+            // and can still finish or go on right away
+            vm.reset();
+            intResult = VM_INT_FINISH;
+            REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+            REQUIRE(vm.getRegister(IP) == 1);
+            intResult = VM_INT_RESUME;
+            vm.setRegister(IP, 0);
+            vm.setRegister(R3, 1);
+            vm.setRegister(R0, 5);
+            REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+            REQUIRE(vm.getRegister(R1) == 5);
+        }
+    }
+
     SECTION("Unhandled interrupt causes error")
     {
         uint8_t program[] = {
@@ -70,6 +133,87 @@ TEST_CASE("OP_INT")
     }
 }
 
+struct Counter
+{
+    uint32_t calls;
+    uint32_t value;
+};
+
+// r0 = the next value of a counter
+static void nextValue(uint32_t *registers, void *context)
+{
+    Counter *counter = (Counter *)context;
+    counter->calls++;
+    registers[R0] = ++counter->value;
+}
+
+// stores r0 at the address in r1, and stops once it's been called enough
+static InterruptResult storeValue(VM *vm, uint8_t code, void *context)
+{
+    Counter *counter = (Counter *)context;
+    counter->calls++;
+    memcpy(vm->memory(vm->getRegister(R1)), &counter->value, 4);
+    return counter->calls < counter->value ? VM_INT_RESUME : VM_INT_FINISH;
+}
+
+TEST_CASE("Interrupt handlers by code")
+{
+    // sums up what int 1 hands it and has int 2 store it
+    uint8_t program[] = {
+        OP_INT, 1,
+        OP_ADD, R2, R2, R0,
+        OP_INC, R3,
+        OP_JB, R3, R4, 0, 0,
+        OP_INT, 2,
+        OP_HALT,
+        0, 0, 0, 0};
+    const DispatchMode modes[] = {VM_DISPATCH_SWITCH, VM_DISPATCH_THREADED, VM_DISPATCH_DECODED,
+                                  VM_DISPATCH_JIT, VM_DISPATCH_TAILCALL, VM_DISPATCH_STENCIL};
+
+    for (DispatchMode mode : modes)
+    {
+        VM vm(program, sizeof(program));
+        vm.setDispatch(mode);
+        Counter counter = {0, 0};
+        Counter stored = {0, 1};
+        vm.onInterrupt(1, nextValue, &counter);
+        vm.onInterrupt(2, storeValue, &stored);
+        // only for codes without a handler
+        vm.onInterrupt(handleInterrupt);
+        intCode = 0;
+        vm.setRegister(R1, 16);
+        vm.setRegister(R4, 3000);
+
+        REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+        REQUIRE(counter.calls == 3000);
+        REQUIRE(vm.getRegister(R2) == 3000 * 3001 / 2);
+        REQUIRE(stored.calls == 1);
+        REQUIRE(memcmp(vm.memory(16), &stored.value, 4) == 0);
+        REQUIRE(vm.getRegister(IP) == 14);
+        REQUIRE(intCode == 0);
+
+        // clones get the same handlers
+        VM *clone = vm.clone();
+        clone->setRegister(IP, 0);
+        clone->setRegister(R3, 2999);
+        REQUIRE(clone->run() == ExecResult::VM_FINISHED);
+        REQUIRE(counter.calls == 3001);
+        REQUIRE(stored.calls == 2);
+        delete clone;
+
+        // removing one falls back to the callback
+        vm.onInterrupt(1, (RegisterHandler)nullptr);
+        intContinue = true;
+        vm.setRegister(IP, 0);
+        vm.setRegister(R3, 2999);
+        stored.value = 5;
+        REQUIRE(vm.run() == ExecResult::VM_FINISHED);
+        REQUIRE(intCode == 1);
+        REQUIRE(vm.getRegister(IP) == 15);
+        REQUIRE(vm.memory(16)[0] == 5);
+    }
+}
+
 TEST_CASE("OP_HALT")
 {
     uint8_t program[] = {